@@ -0,0 +1,629 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbus-capture.h"
+#include "mbus-stats-internal.h"
+
+static const unsigned char mbus_capture_magic[8] = "MBUSCAP";
+
+//
+// The ring holds the file records, each preceded by a 32 bit word with the
+// size of the slot (8 byte aligned). Writers reserve a slot by advancing the
+// head and publish it by storing the size word last, a zero word marks a
+// slot that is still being written. Slots that would wrap around the end of
+// the ring are preceded by a padding slot.
+//
+#define MBUS_CAPTURE_SLOT_PAD   0x80000000U
+#define MBUS_CAPTURE_SLOT_HDR   8
+#define MBUS_CAPTURE_ALIGN(n)   (((n) + 7) & ~((size_t) 7))
+
+static void
+mbus_capture_put16(unsigned char *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void
+mbus_capture_put32(unsigned char *p, uint32_t v)
+{
+    mbus_capture_put16(p, v & 0xFFFF);
+    mbus_capture_put16(p + 2, v >> 16);
+}
+
+static void
+mbus_capture_put64(unsigned char *p, uint64_t v)
+{
+    mbus_capture_put32(p, v & 0xFFFFFFFF);
+    mbus_capture_put32(p + 4, v >> 32);
+}
+
+static uint16_t
+mbus_capture_get16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t
+mbus_capture_get32(const unsigned char *p)
+{
+    return mbus_capture_get16(p) | ((uint32_t) mbus_capture_get16(p + 2) << 16);
+}
+
+static uint64_t
+mbus_capture_get64(const unsigned char *p)
+{
+    return mbus_capture_get32(p) | ((uint64_t) mbus_capture_get32(p + 4) << 32);
+}
+
+//------------------------------------------------------------------------------
+/// Create a capture file
+//------------------------------------------------------------------------------
+mbus_capture *
+mbus_capture_open(const char *path, size_t buff_size)
+{
+    mbus_capture *capture;
+    unsigned char header[MBUS_CAPTURE_HEADER_SIZE];
+    struct timespec ts;
+    size_t size = 1024;
+
+    if (path == NULL)
+    {
+        mbus_error_str_set("Invalid capture file.");
+        return NULL;
+    }
+
+    if (buff_size == 0)
+        buff_size = MBUS_CAPTURE_BUFF_SIZE;
+
+    // at least one record of the maximum size has to fit
+    while (size < buff_size || size < 2 * (MBUS_CAPTURE_SLOT_HDR + MBUS_CAPTURE_RECORD_SIZE + MBUS_CAPTURE_DATA_MAX))
+        size <<= 1;
+
+    if ((capture = (mbus_capture *) calloc(1, sizeof(mbus_capture))) == NULL ||
+        (capture->ring = (unsigned char *) calloc(1, size)) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate capture.");
+        free(capture);
+        return NULL;
+    }
+
+    capture->size = size;
+
+    if ((capture->fp = fopen(path, "wb")) == NULL)
+    {
+        mbus_error_str_set("Failed to create capture file.");
+        free(capture->ring);
+        free(capture);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, mbus_capture_magic, sizeof(mbus_capture_magic));
+    mbus_capture_put16(&header[8], MBUS_CAPTURE_VERSION);
+    mbus_capture_put64(&header[16], (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+    mbus_capture_put64(&header[24], mbus_stats_now());
+
+    if (fwrite(header, 1, sizeof(header), capture->fp) != sizeof(header))
+    {
+        mbus_error_str_set("Failed to write capture file.");
+        fclose(capture->fp);
+        free(capture->ring);
+        free(capture);
+        return NULL;
+    }
+
+    return capture;
+}
+
+//------------------------------------------------------------------------------
+/// Write the published records to the file. Only one thread drains the ring
+/// at a time, returns 1 if another one is busy with it.
+//------------------------------------------------------------------------------
+static int
+mbus_capture_drain(mbus_capture *capture)
+{
+    uint64_t head, tail;
+    uint32_t word, *slot;
+    unsigned char *record;
+    size_t n, len;
+    int ret = 0;
+
+    if (__atomic_exchange_n(&capture->flushing, 1, __ATOMIC_ACQUIRE))
+        return 1;
+
+    tail = capture->tail;
+    head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+
+    while (tail < head)
+    {
+        slot = (uint32_t *) &capture->ring[tail & (capture->size - 1)];
+
+        // not published yet
+        if ((word = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) == 0)
+            break;
+
+        n = word & ~MBUS_CAPTURE_SLOT_PAD;
+
+        if ((word & MBUS_CAPTURE_SLOT_PAD) == 0)
+        {
+            record = (unsigned char *) slot + MBUS_CAPTURE_SLOT_HDR;
+            len = MBUS_CAPTURE_RECORD_SIZE + mbus_capture_get16(&record[2]);
+
+            if (fwrite(record, 1, len, capture->fp) != len)
+                ret = -1;
+
+            capture->records++;
+        }
+
+        // writers expect zeroed slots
+        memset(slot, 0, n);
+
+        tail += n;
+        __atomic_store_n(&capture->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&capture->flushing, 0, __ATOMIC_RELEASE);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/// Append a record to the ring
+//------------------------------------------------------------------------------
+int
+mbus_capture_write(mbus_capture *capture, uint32_t id, unsigned char direction,
+                   unsigned char type, const unsigned char *data, size_t len)
+{
+    uint64_t head, tail;
+    size_t off, pad, need;
+    unsigned char *record;
+
+    if (capture == NULL || (data == NULL && len > 0) || len > MBUS_CAPTURE_DATA_MAX)
+    {
+        return -1;
+    }
+
+    need = MBUS_CAPTURE_ALIGN(MBUS_CAPTURE_SLOT_HDR + MBUS_CAPTURE_RECORD_SIZE + len);
+
+    head = __atomic_load_n(&capture->head, __ATOMIC_RELAXED);
+
+    do
+    {
+        off = head & (capture->size - 1);
+        pad = (off + need > capture->size) ? capture->size - off : 0;
+        tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+
+        if (head + pad + need - tail > capture->size)
+        {
+            __atomic_fetch_add(&capture->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&capture->head, &head, head + pad + need, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (pad)
+    {
+        __atomic_store_n((uint32_t *) &capture->ring[off], pad | MBUS_CAPTURE_SLOT_PAD, __ATOMIC_RELEASE);
+        off = 0;
+    }
+
+    record = &capture->ring[off + MBUS_CAPTURE_SLOT_HDR];
+    record[0] = direction;
+    record[1] = type;
+    mbus_capture_put16(&record[2], len);
+    mbus_capture_put32(&record[4], id);
+    mbus_capture_put64(&record[8], mbus_stats_now());
+    if (len > 0)
+        memcpy(&record[MBUS_CAPTURE_RECORD_SIZE], data, len);
+
+    __atomic_store_n((uint32_t *) &capture->ring[off], need, __ATOMIC_RELEASE);
+
+    // write out in batches, unless another thread is at it already
+    if (head + pad + need - tail > capture->size / 2)
+        mbus_capture_drain(capture);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Write the buffered records to the file
+//------------------------------------------------------------------------------
+int
+mbus_capture_flush(mbus_capture *capture)
+{
+    int ret;
+
+    if (capture == NULL)
+        return -1;
+
+    while ((ret = mbus_capture_drain(capture)) == 1)
+        sched_yield();
+
+    if (fflush(capture->fp) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/// Flush, close and free a capture
+//------------------------------------------------------------------------------
+int
+mbus_capture_close(mbus_capture *capture)
+{
+    int ret;
+
+    if (capture == NULL)
+        return -1;
+
+    ret = mbus_capture_flush(capture);
+
+    if (fclose(capture->fp) != 0)
+        ret = -1;
+
+    free(capture->ring);
+    free(capture);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+/// Record the traffic of a handle
+//------------------------------------------------------------------------------
+int
+mbus_capture_attach(mbus_handle *handle, mbus_capture *capture, uint32_t id)
+{
+    if (handle == NULL)
+    {
+        mbus_error_str_set("Invalid M-Bus handle.");
+        return -1;
+    }
+
+    handle->capture = capture;
+    handle->capture_id = id;
+
+    return 0;
+}
+
+void
+mbus_capture_event(mbus_handle *handle, unsigned char direction, const char *data, size_t len)
+{
+    if (handle && handle->capture)
+    {
+        mbus_capture_write(handle->capture, handle->capture_id, direction,
+                           handle->transport ? handle->transport->type : 0,
+                           (const unsigned char *) data, len);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Read the header of a capture file
+//------------------------------------------------------------------------------
+int
+mbus_capture_read_header(FILE *fp, mbus_capture_header *header)
+{
+    unsigned char buff[MBUS_CAPTURE_HEADER_SIZE];
+
+    if (fp == NULL || header == NULL ||
+        fread(buff, 1, sizeof(buff), fp) != sizeof(buff) ||
+        memcmp(buff, mbus_capture_magic, sizeof(mbus_capture_magic)) != 0)
+    {
+        mbus_error_str_set("Not a capture file.");
+        return -1;
+    }
+
+    header->version = mbus_capture_get16(&buff[8]);
+    header->realtime_ns = mbus_capture_get64(&buff[16]);
+    header->monotonic_ns = mbus_capture_get64(&buff[24]);
+
+    if (header->version != MBUS_CAPTURE_VERSION)
+    {
+        mbus_error_str_set("Unsupported capture file version.");
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Read the next record of a capture file
+//------------------------------------------------------------------------------
+int
+mbus_capture_read(FILE *fp, mbus_capture_record *record)
+{
+    unsigned char buff[MBUS_CAPTURE_RECORD_SIZE];
+    size_t n;
+
+    if (fp == NULL || record == NULL)
+        return -1;
+
+    if ((n = fread(buff, 1, sizeof(buff), fp)) == 0)
+        return 1;
+
+    if (n != sizeof(buff))
+    {
+        mbus_error_str_set("Truncated capture record.");
+        return -1;
+    }
+
+    record->direction = buff[0];
+    record->type = buff[1];
+    record->len = mbus_capture_get16(&buff[2]);
+    record->id = mbus_capture_get32(&buff[4]);
+    record->timestamp_ns = mbus_capture_get64(&buff[8]);
+
+    if (record->len > MBUS_CAPTURE_DATA_MAX ||
+        fread(record->data, 1, record->len, fp) != record->len)
+    {
+        mbus_error_str_set("Truncated capture record.");
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Replay transport
+//------------------------------------------------------------------------------
+
+//
+// look at the next record of the replayed handle id, -1 at the end
+//
+static int
+mbus_replay_peek(mbus_replay_data *replay_data)
+{
+    while (replay_data->have_next == 0)
+    {
+        if (mbus_capture_read(replay_data->fp, &replay_data->next) != 0)
+        {
+            replay_data->have_next = -1;
+        }
+        else if (replay_data->id < 0 || replay_data->next.id == (uint32_t) replay_data->id)
+        {
+            replay_data->have_next = 1;
+        }
+    }
+
+    return replay_data->have_next;
+}
+
+//
+// wait until the (scaled) time of the record has come
+//
+static void
+mbus_replay_wait(mbus_replay_data *replay_data, uint64_t timestamp_ns)
+{
+    uint64_t due, now;
+    struct timespec ts;
+
+    if (replay_data->speed <= 0 || timestamp_ns <= replay_data->first_ns)
+        return;
+
+    due = replay_data->start_ns + (uint64_t) ((timestamp_ns - replay_data->first_ns) / replay_data->speed);
+
+    if ((now = mbus_stats_now()) < due)
+    {
+        ts.tv_sec = (due - now) / 1000000000ULL;
+        ts.tv_nsec = (due - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Open the capture file and start the replay clock
+//------------------------------------------------------------------------------
+int
+mbus_replay_connect(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle == NULL || handle->auxdata == NULL)
+        return -1;
+
+    replay_data = (mbus_replay_data *) handle->auxdata;
+
+    if (replay_data->fp)
+        fclose(replay_data->fp);
+
+    if ((replay_data->fp = fopen(replay_data->path, "rb")) == NULL)
+    {
+        mbus_error_str_set("Failed to open capture file.");
+        return -1;
+    }
+
+    if (mbus_capture_read_header(replay_data->fp, &replay_data->header) != 0)
+    {
+        fclose(replay_data->fp);
+        replay_data->fp = NULL;
+        return -1;
+    }
+
+    replay_data->have_next = 0;
+    replay_data->first_ns = (mbus_replay_peek(replay_data) == 1) ?
+                            replay_data->next.timestamp_ns : 0;
+    replay_data->start_ns = mbus_stats_now();
+
+    return 0;
+}
+
+int
+mbus_replay_disconnect(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle == NULL || handle->auxdata == NULL)
+        return -1;
+
+    replay_data = (mbus_replay_data *) handle->auxdata;
+
+    if (replay_data->fp)
+    {
+        fclose(replay_data->fp);
+        replay_data->fp = NULL;
+    }
+
+    return 0;
+}
+
+void
+mbus_replay_data_free(mbus_handle *handle)
+{
+    mbus_replay_data *replay_data;
+
+    if (handle && (replay_data = (mbus_replay_data *) handle->auxdata) != NULL)
+    {
+        if (replay_data->fp)
+            fclose(replay_data->fp);
+
+        free(replay_data->path);
+        free(replay_data);
+        handle->auxdata = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Every sent frame skips the capture past the next recorded send, replies
+/// the master didn't read are dropped
+//------------------------------------------------------------------------------
+int
+mbus_replay_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt)
+{
+    mbus_replay_data *replay_data;
+    int i;
+
+    if (handle == NULL || handle->auxdata == NULL || iov == NULL || iovcnt <= 0)
+        return -1;
+
+    replay_data = (mbus_replay_data *) handle->auxdata;
+
+    if (replay_data->fp == NULL)
+    {
+        mbus_error_str_set("Replay transport is not connected.");
+        return -1;
+    }
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        mbus_capture_event(handle, MBUS_CAPTURE_SEND, iov[i].iov_base, iov[i].iov_len);
+
+        while (mbus_replay_peek(replay_data) == 1)
+        {
+            replay_data->have_next = 0;
+
+            if (replay_data->next.direction == MBUS_CAPTURE_SEND)
+                break;
+        }
+
+        replay_data->sent++;
+    }
+
+    return 0;
+}
+
+int
+mbus_replay_send_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[MBUS_FRAME_PACKED_MAX_SIZE];
+    struct iovec iov;
+    int len;
+    char error_str[128];
+
+    if (handle == NULL || frame == NULL)
+    {
+        return -1;
+    }
+
+    if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
+    {
+        snprintf(error_str, sizeof(error_str), "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        mbus_error_str_set(error_str);
+        return -1;
+    }
+
+    iov.iov_base = buff;
+    iov.iov_len = len;
+
+    if (mbus_replay_send_raw(handle, &iov, 1) != 0)
+    {
+        return -1;
+    }
+
+    //
+    // call the send event function, if the callback function is registered
+    //
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_REPLAY, (const char *) buff, len);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Receive the next recorded bytes, a timeout at the next recorded send or
+/// the end of the capture
+//------------------------------------------------------------------------------
+int
+mbus_replay_recv_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    mbus_replay_data *replay_data;
+    mbus_capture_record *record;
+    int remaining;
+
+    if (handle == NULL || handle->auxdata == NULL || frame == NULL)
+    {
+        fprintf(stderr, "%s: Invalid parameter.\n", __PRETTY_FUNCTION__);
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    replay_data = (mbus_replay_data *) handle->auxdata;
+
+    if (replay_data->fp == NULL)
+    {
+        mbus_error_str_set("Replay transport is not connected.");
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    if (mbus_replay_peek(replay_data) != 1 || replay_data->next.direction != MBUS_CAPTURE_RECV)
+    {
+        mbus_error_str_set("M-Bus replay transport layer response timeout has been reached.");
+        return MBUS_RECV_RESULT_TIMEOUT;
+    }
+
+    record = &replay_data->next;
+    replay_data->have_next = 0;
+    replay_data->received++;
+
+    mbus_replay_wait(replay_data, record->timestamp_ns);
+    mbus_recv_first_byte(handle, frame);
+
+    remaining = mbus_parse(frame, record->data, record->len);
+
+    //
+    // call the receive event function, if the callback function is registered
+    //
+    if (handle->recv_event)
+        handle->recv_event(MBUS_HANDLE_TYPE_REPLAY, (const char *) record->data, record->len);
+
+    mbus_capture_event(handle, MBUS_CAPTURE_RECV, (const char *) record->data, record->len);
+
+    if (remaining != 0)
+    {
+        mbus_error_str_set("M-Bus layer failed to parse data.");
+        return MBUS_RECV_RESULT_INVALID;
+    }
+
+    return MBUS_RECV_RESULT_OK;
+}
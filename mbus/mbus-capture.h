@@ -0,0 +1,216 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-capture.h
+ *
+ * @brief  Binary capture of the bus traffic and replay transport.
+ *
+ * A capture records the raw bytes every attached handle sends and receives
+ * with a monotonic timestamp and the id of the handle. Several handles (also
+ * in different threads) can write to the same capture, records are appended
+ * to a lock-free ring buffer and written to the file in batches:
+ *
+ * \verbatim
+ * capture = mbus_capture_open("bus.mcap", 0);
+ * mbus_capture_attach(handle, capture, 1);
+ * ...
+ * mbus_capture_close(capture);
+ * \endverbatim
+ *
+ * The replay transport feeds the received bytes of a capture back through
+ * mbus_recv_frame, with the original, an accelerated or no timing at all:
+ *
+ * \verbatim
+ * handle = mbus_context_replay("bus.mcap", 1.0, -1);
+ * mbus_connect(handle);
+ * mbus_sendrecv_request(handle, 5, &reply, 16);
+ * \endverbatim
+ *
+ * File format, all integers little endian:
+ *
+ * \verbatim
+ * header   "MBUSCAP\0", u16 version, u16 reserved, u32 reserved,
+ *          u64 realtime ns, u64 monotonic ns (at the start of the capture)
+ * record   u8 direction, u8 transport type, u16 length, u32 handle id,
+ *          u64 monotonic ns, length bytes
+ * \endverbatim
+ */
+
+#ifndef MBUS_CAPTURE_H
+#define MBUS_CAPTURE_H
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_CAPTURE_VERSION      1
+#define MBUS_CAPTURE_HEADER_SIZE  32
+#define MBUS_CAPTURE_RECORD_SIZE  16     /**< record without the bytes */
+#define MBUS_CAPTURE_DATA_MAX     4096   /**< longest byte sequence recorded */
+#define MBUS_CAPTURE_BUFF_SIZE    65536  /**< default size of the ring buffer */
+
+#define MBUS_CAPTURE_SEND         0      /**< bytes sent by the master */
+#define MBUS_CAPTURE_RECV         1      /**< bytes received by the master */
+
+typedef struct _mbus_capture
+{
+    FILE *fp;
+
+    unsigned char *ring;
+    size_t size;                /**< size of the ring, power of two */
+    uint64_t head;              /**< bytes reserved by writers */
+    uint64_t tail;              /**< bytes written to the file */
+    int flushing;               /**< ring is being written to the file */
+
+    unsigned long records;      /**< records written to the file */
+    unsigned long dropped;      /**< records lost because the ring was full */
+} mbus_capture;
+
+typedef struct _mbus_capture_header
+{
+    uint16_t version;
+    uint64_t realtime_ns;
+    uint64_t monotonic_ns;
+} mbus_capture_header;
+
+typedef struct _mbus_capture_record
+{
+    unsigned char direction;    /**< MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV */
+    unsigned char type;         /**< transport type (MBUS_HANDLE_TYPE_...) */
+    uint32_t id;                /**< handle id given to mbus_capture_attach */
+    uint64_t timestamp_ns;      /**< monotonic time */
+    size_t len;
+    unsigned char data[MBUS_CAPTURE_DATA_MAX];
+} mbus_capture_record;
+
+typedef struct _mbus_replay_data
+{
+    char *path;
+    FILE *fp;
+    double speed;               /**< 1 = original timing, 0 = no delays */
+    long id;                    /**< replay records of this handle id, -1 for all */
+
+    mbus_capture_header header;
+    mbus_capture_record next;   /**< next record of the capture */
+    int have_next;              /**< 1 = next is valid, 0 = not read, -1 = end of file */
+
+    uint64_t first_ns;          /**< timestamp of the first record */
+    uint64_t start_ns;          /**< start of the replay */
+
+    unsigned long sent;         /**< frames sent by the master */
+    unsigned long received;     /**< recorded frames received by the master */
+} mbus_replay_data;
+
+/**
+ * Create a capture file.
+ *
+ * @param path       file name
+ * @param buff_size  size of the ring buffer (rounded up to a power of two),
+ *                   0 for MBUS_CAPTURE_BUFF_SIZE
+ *
+ * @return capture, NULL on error. Use #mbus_capture_close.
+ */
+mbus_capture *mbus_capture_open(const char *path, size_t buff_size);
+
+/**
+ * Write all buffered records to the file and free the capture. Handles must
+ * be detached (or freed) before.
+ *
+ * @return Zero when successful.
+ */
+int mbus_capture_close(mbus_capture *capture);
+
+/**
+ * Write the buffered records to the file.
+ *
+ * @return Zero when successful.
+ */
+int mbus_capture_flush(mbus_capture *capture);
+
+/**
+ * Record the traffic of a handle.
+ *
+ * @param handle   initialized handle
+ * @param capture  capture, NULL to stop recording
+ * @param id       id of the handle in the records
+ *
+ * @return Zero when successful.
+ */
+int mbus_capture_attach(mbus_handle *handle, mbus_capture *capture, uint32_t id);
+
+/**
+ * Append a record, lock-free and safe to call from several threads. The
+ * record is dropped when the ring buffer is full.
+ *
+ * @param capture    capture
+ * @param id         handle id
+ * @param direction  MBUS_CAPTURE_SEND or MBUS_CAPTURE_RECV
+ * @param type       transport type (MBUS_HANDLE_TYPE_...)
+ * @param data       raw bytes
+ * @param len        number of bytes (up to MBUS_CAPTURE_DATA_MAX)
+ *
+ * @return Zero when successful, -1 when the record was dropped.
+ */
+int mbus_capture_write(mbus_capture *capture, uint32_t id, unsigned char direction,
+                       unsigned char type, const unsigned char *data, size_t len);
+
+/**
+ * Record bytes of a handle, used by the transports. Does nothing unless a
+ * capture is attached.
+ */
+void mbus_capture_event(mbus_handle *handle, unsigned char direction, const char *data, size_t len);
+
+/**
+ * Read the header of a capture file.
+ *
+ * @return Zero when successful, -1 if the file is no capture.
+ */
+int mbus_capture_read_header(FILE *fp, mbus_capture_header *header);
+
+/**
+ * Read the next record of a capture file.
+ *
+ * @return Zero when successful, 1 at the end of the file, -1 on error.
+ */
+int mbus_capture_read(FILE *fp, mbus_capture_record *record);
+
+/**
+ * Allocate and initialize a M-Bus context replaying a capture.
+ *
+ * Every frame the master sends skips the capture to the next recorded send,
+ * mbus_recv_frame returns the bytes received after it in the capture and
+ * times out at the next recorded send.
+ *
+ * @param path   capture file
+ * @param speed  1.0 for the original timing, 10.0 for ten times faster,
+ *               0 for no delays at all
+ * @param id     replay only the records of this handle id, -1 for all
+ *
+ * @return Initialized "unified" handler when successful, NULL otherwise;
+ */
+mbus_handle * mbus_context_replay(const char *path, double speed, long id);
+
+int  mbus_replay_connect(mbus_handle *handle);
+int  mbus_replay_disconnect(mbus_handle *handle);
+int  mbus_replay_send_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_replay_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt);
+int  mbus_replay_recv_frame(mbus_handle *handle, mbus_frame *frame);
+void mbus_replay_data_free(mbus_handle *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_CAPTURE_H */
@@ -0,0 +1,958 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+
+#include "mbus-cbor.h"
+
+#define MBUS_CBOR_UINT        0
+#define MBUS_CBOR_NINT        1
+#define MBUS_CBOR_BYTES       2
+#define MBUS_CBOR_TEXT        3
+#define MBUS_CBOR_ARRAY       4
+#define MBUS_CBOR_MAP         5
+#define MBUS_CBOR_TAG         6
+#define MBUS_CBOR_SIMPLE      7
+
+#define MBUS_CBOR_MAX_DEPTH   16
+
+//------------------------------------------------------------------------------
+/// Encoder output, len counts the complete encoding even past size.
+//------------------------------------------------------------------------------
+typedef struct _mbus_cbor_encoder
+{
+    unsigned char *buff;
+    size_t size;
+    size_t len;
+} mbus_cbor_encoder;
+
+static void
+mbus_cbor_put(mbus_cbor_encoder *e, const unsigned char *data, size_t len)
+{
+    if (e->len + len <= e->size)
+    {
+        memcpy(&e->buff[e->len], data, len);
+    }
+
+    e->len += len;
+}
+
+//------------------------------------------------------------------------------
+/// Write the initial byte and argument of a data item (shortest form).
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_head(mbus_cbor_encoder *e, int major, uint64_t val)
+{
+    unsigned char head[9];
+    size_t n, i;
+
+    if (val < 24)
+    {
+        head[0] = (major << 5) | val;
+        n = 0;
+    }
+    else if (val <= 0xFF)
+    {
+        head[0] = (major << 5) | 24;
+        n = 1;
+    }
+    else if (val <= 0xFFFF)
+    {
+        head[0] = (major << 5) | 25;
+        n = 2;
+    }
+    else if (val <= 0xFFFFFFFFULL)
+    {
+        head[0] = (major << 5) | 26;
+        n = 4;
+    }
+    else
+    {
+        head[0] = (major << 5) | 27;
+        n = 8;
+    }
+
+    // network byte order
+    for (i = n; i > 0; i--)
+    {
+        head[i] = val & 0xFF;
+        val >>= 8;
+    }
+
+    mbus_cbor_put(e, head, n + 1);
+}
+
+static void
+mbus_cbor_int(mbus_cbor_encoder *e, int64_t val)
+{
+    if (val >= 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, (uint64_t) val);
+    }
+    else
+    {
+        mbus_cbor_head(e, MBUS_CBOR_NINT, (uint64_t) (-1 - val));
+    }
+}
+
+static void
+mbus_cbor_bytes(mbus_cbor_encoder *e, int major, const unsigned char *data, size_t len)
+{
+    mbus_cbor_head(e, major, len);
+    mbus_cbor_put(e, data, len);
+}
+
+//------------------------------------------------------------------------------
+/// Write a float, single precision when that is exact (always the case for
+/// values from 4 byte real records).
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_float(mbus_cbor_encoder *e, double val)
+{
+    unsigned char data[9];
+    uint64_t bits;
+    uint32_t bits32;
+    float f = (float) val;
+    int i;
+
+    if ((double) f == val || isnan(val))
+    {
+        memcpy(&bits32, &f, sizeof(bits32));
+        data[0] = 0xFA;
+        for (i = 4; i > 0; i--, bits32 >>= 8)
+        {
+            data[i] = bits32 & 0xFF;
+        }
+        mbus_cbor_put(e, data, 5);
+        return;
+    }
+
+    memcpy(&bits, &val, sizeof(bits));
+    data[0] = 0xFB;
+    for (i = 8; i > 0; i--, bits >>= 8)
+    {
+        data[i] = bits & 0xFF;
+    }
+    mbus_cbor_put(e, data, 9);
+}
+
+//------------------------------------------------------------------------------
+/// Encode a single variable-length data record (see mbus-cbor.h for keys).
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_record(mbus_cbor_encoder *e, mbus_data_record *record)
+{
+    mbus_record_value value;
+    unsigned char str[256];
+    size_t i, n = 0;
+    int has_value;
+
+    has_value = (mbus_data_record_decode_typed(record, &value) == 0 &&
+                 value.type != MBUS_VALUE_TYPE_NONE);
+
+    n += has_value;
+    n += 2; // unit and VIF code
+    n += (value.exponent != 0);
+    n += (value.function != 0);
+    n += (value.storage_number != 0);
+    n += (value.tariff >= 0);
+    n += (value.device >= 0);
+    n += (value.timestamp > 0);
+    n += (has_value && (value.type == MBUS_VALUE_TYPE_DATE ||
+                        value.type == MBUS_VALUE_TYPE_DATETIME ||
+                        value.type == MBUS_VALUE_TYPE_STRING));
+    n += (value.first_byte.realtime_ns > 0) + (value.last_byte.realtime_ns > 0);
+    n += (value.first_byte.monotonic_ns > 0) + (value.last_byte.monotonic_ns > 0);
+
+    mbus_cbor_head(e, MBUS_CBOR_MAP, n);
+
+    if (has_value)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_VALUE);
+
+        switch (value.type)
+        {
+            case MBUS_VALUE_TYPE_INTEGER:
+                mbus_cbor_int(e, value.value.integer);
+                break;
+
+            case MBUS_VALUE_TYPE_REAL:
+                mbus_cbor_float(e, value.value.real);
+                break;
+
+            case MBUS_VALUE_TYPE_STRING:
+                // reading order, see mbus_data_str_decode. M-Bus strings are
+                // Latin-1, not the UTF-8 a CBOR text string requires, so they
+                // are stored as bytes and tagged with the value type (key 9)
+                n = (value.data_len < sizeof(str)) ? value.data_len : sizeof(str);
+                for (i = 0; i < n; i++)
+                {
+                    str[i] = value.data[value.data_len - 1 - i];
+                }
+                mbus_cbor_bytes(e, MBUS_CBOR_BYTES, str, n);
+                break;
+
+            default: // binary, date and date/time
+                mbus_cbor_bytes(e, MBUS_CBOR_BYTES, value.data, value.data_len);
+                break;
+        }
+    }
+
+    mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_UNIT);
+    mbus_cbor_head(e, MBUS_CBOR_UINT, value.unit);
+
+    if (value.exponent != 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_EXPONENT);
+        mbus_cbor_int(e, value.exponent);
+    }
+
+    mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_VIF_CODE);
+    mbus_cbor_head(e, MBUS_CBOR_UINT, value.vif_code);
+
+    if (value.function != 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_FUNCTION);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.function);
+    }
+
+    if (value.storage_number != 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_STORAGE_NUMBER);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.storage_number);
+    }
+
+    if (value.tariff >= 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_TARIFF);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.tariff);
+    }
+
+    if (value.device >= 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_DEVICE);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.device);
+    }
+
+    if (value.timestamp > 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_TIMESTAMP);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.timestamp);
+    }
+
+    if (has_value && (value.type == MBUS_VALUE_TYPE_DATE ||
+                      value.type == MBUS_VALUE_TYPE_DATETIME ||
+                      value.type == MBUS_VALUE_TYPE_STRING))
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_VALUE_TYPE);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.type);
+    }
+
+    if (value.first_byte.realtime_ns > 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_FIRST_BYTE);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.first_byte.realtime_ns);
+    }
+
+    if (value.last_byte.realtime_ns > 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_LAST_BYTE);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.last_byte.realtime_ns);
+    }
+
+    if (value.first_byte.monotonic_ns > 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_FIRST_BYTE_MONO);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.first_byte.monotonic_ns);
+    }
+
+    if (value.last_byte.monotonic_ns > 0)
+    {
+        mbus_cbor_head(e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_LAST_BYTE_MONO);
+        mbus_cbor_head(e, MBUS_CBOR_UINT, value.last_byte.monotonic_ns);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Encode parsed frame data as CBOR (see mbus-cbor.h for the schema).
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_cbor(mbus_frame_data *data, unsigned char *buff, size_t size)
+{
+    mbus_cbor_encoder e;
+    mbus_data_record *record;
+    mbus_data_variable_header *header;
+    mbus_data_fixed *fixed;
+    size_t n;
+    int val;
+
+    if (data == NULL || (buff == NULL && size > 0))
+    {
+        return -1;
+    }
+
+    e.buff = buff;
+    e.size = size;
+    e.len  = 0;
+
+    switch (data->type)
+    {
+        case MBUS_DATA_TYPE_ERROR:
+            mbus_cbor_head(&e, MBUS_CBOR_MAP, 2);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_TYPE);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, data->type);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_ERROR);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, data->error);
+            break;
+
+        case MBUS_DATA_TYPE_FIXED:
+            fixed = &(data->data_fix);
+
+            mbus_cbor_head(&e, MBUS_CBOR_MAP, 2);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_TYPE);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, data->type);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_HEADER);
+            mbus_cbor_head(&e, MBUS_CBOR_ARRAY, 7);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, mbus_data_bcd_decode_hex(fixed->id_bcd, 4));
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, fixed->tx_cnt);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, fixed->status);
+
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, fixed->cnt1_type);
+            if ((fixed->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+            {
+                mbus_cbor_int(&e, mbus_data_bcd_decode(fixed->cnt1_val, 4));
+            }
+            else
+            {
+                mbus_data_int_decode(fixed->cnt1_val, 4, &val);
+                mbus_cbor_int(&e, val);
+            }
+
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, fixed->cnt2_type);
+            if ((fixed->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+            {
+                mbus_cbor_int(&e, mbus_data_bcd_decode(fixed->cnt2_val, 4));
+            }
+            else
+            {
+                mbus_data_int_decode(fixed->cnt2_val, 4, &val);
+                mbus_cbor_int(&e, val);
+            }
+            break;
+
+        case MBUS_DATA_TYPE_VARIABLE:
+            header = &(data->data_var.header);
+
+            mbus_cbor_head(&e, MBUS_CBOR_MAP, 3);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_TYPE);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, data->type);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_HEADER);
+            mbus_cbor_head(&e, MBUS_CBOR_ARRAY, 7);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, mbus_data_bcd_decode_hex(header->id_bcd, 4));
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, (header->manufacturer[1] << 8) | header->manufacturer[0]);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, header->version);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, header->medium);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, header->access_no);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, header->status);
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, (header->signature[1] << 8) | header->signature[0]);
+
+            for (record = data->data_var.record, n = 0; record; record = record->next)
+            {
+                n++;
+            }
+
+            mbus_cbor_head(&e, MBUS_CBOR_UINT, MBUS_CBOR_KEY_RECORDS);
+            mbus_cbor_head(&e, MBUS_CBOR_ARRAY, n);
+
+            for (record = data->data_var.record; record; record = record->next)
+            {
+                mbus_cbor_record(&e, record);
+            }
+            break;
+
+        default:
+            return -1;
+    }
+
+    return (int) e.len;
+}
+
+//------------------------------------------------------------------------------
+/// Decoder input.
+//------------------------------------------------------------------------------
+typedef struct _mbus_cbor_decoder
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    int error;
+} mbus_cbor_decoder;
+
+//------------------------------------------------------------------------------
+/// Read the head of a data item. Indefinite lengths are not supported.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_read_head(mbus_cbor_decoder *d, int *major, uint64_t *val)
+{
+    unsigned char ai;
+    size_t n;
+
+    if (d->error || d->p >= d->end)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    *major = *d->p >> 5;
+    ai     = *d->p & 0x1F;
+    d->p++;
+
+    if (ai < 24)
+    {
+        *val = ai;
+        return 0;
+    }
+
+    if (ai > 27)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    n = (size_t) 1 << (ai - 24);
+
+    if ((size_t) (d->end - d->p) < n)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    for (*val = 0; n > 0; n--)
+    {
+        *val = (*val << 8) | *d->p++;
+    }
+
+    return 0;
+}
+
+static int
+mbus_cbor_read_uint(mbus_cbor_decoder *d, uint64_t *val)
+{
+    int major;
+
+    if (mbus_cbor_read_head(d, &major, val) != 0 || major != MBUS_CBOR_UINT)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+mbus_cbor_read_int(mbus_cbor_decoder *d, int64_t *val)
+{
+    uint64_t arg;
+    int major;
+
+    if (mbus_cbor_read_head(d, &major, &arg) != 0 ||
+        (major != MBUS_CBOR_UINT && major != MBUS_CBOR_NINT) ||
+        arg > INT64_MAX)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    *val = (major == MBUS_CBOR_UINT) ? (int64_t) arg : -1 - (int64_t) arg;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Skip a complete data item.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_skip(mbus_cbor_decoder *d, int depth)
+{
+    uint64_t val, i;
+    int major;
+
+    if (depth > MBUS_CBOR_MAX_DEPTH || mbus_cbor_read_head(d, &major, &val) != 0)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    switch (major)
+    {
+        case MBUS_CBOR_BYTES:
+        case MBUS_CBOR_TEXT:
+            if ((uint64_t) (d->end - d->p) < val)
+            {
+                d->error = 1;
+                return -1;
+            }
+            d->p += val;
+            break;
+
+        case MBUS_CBOR_MAP:
+            if (val > (uint64_t) (d->end - d->p))
+            {
+                d->error = 1;
+                return -1;
+            }
+            val *= 2;
+            // fall through
+
+        case MBUS_CBOR_ARRAY:
+            for (i = 0; i < val && d->error == 0; i++)
+            {
+                mbus_cbor_skip(d, depth + 1);
+            }
+            break;
+
+        case MBUS_CBOR_TAG:
+            mbus_cbor_skip(d, depth + 1);
+            break;
+    }
+
+    return d->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Decode the value of a record.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_read_value(mbus_cbor_decoder *d, mbus_record_value *value)
+{
+    uint64_t val;
+    uint32_t bits32;
+    uint64_t bits;
+    float f;
+    int major, ai, exp, mant;
+
+    if (d->p >= d->end)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    ai = *d->p & 0x1F;
+
+    if (mbus_cbor_read_head(d, &major, &val) != 0)
+    {
+        return -1;
+    }
+
+    switch (major)
+    {
+        case MBUS_CBOR_UINT:
+        case MBUS_CBOR_NINT:
+            if (val > INT64_MAX)
+            {
+                d->error = 1;
+                return -1;
+            }
+            value->type = MBUS_VALUE_TYPE_INTEGER;
+            value->value.integer = (major == MBUS_CBOR_UINT) ? (int64_t) val : -1 - (int64_t) val;
+            break;
+
+        case MBUS_CBOR_BYTES:
+        case MBUS_CBOR_TEXT:
+            if ((uint64_t) (d->end - d->p) < val)
+            {
+                d->error = 1;
+                return -1;
+            }
+            value->type = (major == MBUS_CBOR_TEXT) ? MBUS_VALUE_TYPE_STRING : MBUS_VALUE_TYPE_BINARY;
+            value->data = d->p;
+            value->data_len = val;
+            d->p += val;
+            break;
+
+        case MBUS_CBOR_SIMPLE:
+            value->type = MBUS_VALUE_TYPE_REAL;
+
+            if (ai == 25)                 // half precision
+            {
+                exp  = (val >> 10) & 0x1F;
+                mant = val & 0x3FF;
+
+                if (exp == 0)
+                    value->value.real = ldexp(mant, -24);
+                else if (exp == 0x1F)
+                    value->value.real = mant ? NAN : INFINITY;
+                else
+                    value->value.real = ldexp(mant + 1024, exp - 25);
+
+                if (val & 0x8000)
+                {
+                    value->value.real = -value->value.real;
+                }
+            }
+            else if (ai == 26)
+            {
+                bits32 = (uint32_t) val;
+                memcpy(&f, &bits32, sizeof(f));
+                value->value.real = f;
+            }
+            else if (ai == 27)
+            {
+                bits = val;
+                memcpy(&value->value.real, &bits, sizeof(bits));
+            }
+            else
+            {
+                value->type = MBUS_VALUE_TYPE_NONE; // null, undefined, ...
+            }
+            break;
+
+        default:
+            d->error = 1;
+            return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Decode a record map.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_read_record(mbus_cbor_decoder *d, mbus_record_value *value)
+{
+    uint64_t n, key, val, raw;
+    int64_t ival;
+    int major, value_type = -1;
+    size_t i;
+
+    memset(value, 0, sizeof(mbus_record_value));
+    value->type   = MBUS_VALUE_TYPE_NONE;
+    value->unit   = MBUS_UNIT_NONE;
+    value->tariff = -1;
+    value->device = -1;
+
+    if (mbus_cbor_read_head(d, &major, &n) != 0 || major != MBUS_CBOR_MAP)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    while (n-- > 0 && d->error == 0)
+    {
+        if (mbus_cbor_read_uint(d, &key) != 0)
+        {
+            return -1;
+        }
+
+        switch (key)
+        {
+            case MBUS_CBOR_KEY_VALUE:
+                mbus_cbor_read_value(d, value);
+                break;
+
+            case MBUS_CBOR_KEY_UNIT:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->unit = (mbus_unit) val;
+                break;
+
+            case MBUS_CBOR_KEY_EXPONENT:
+                if (mbus_cbor_read_int(d, &ival) == 0)
+                    value->exponent = (int) ival;
+                break;
+
+            case MBUS_CBOR_KEY_VIF_CODE:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->vif_code = (int) val;
+                break;
+
+            case MBUS_CBOR_KEY_FUNCTION:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->function = (int) val;
+                break;
+
+            case MBUS_CBOR_KEY_STORAGE_NUMBER:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->storage_number = (long) val;
+                break;
+
+            case MBUS_CBOR_KEY_TARIFF:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->tariff = (long) val;
+                break;
+
+            case MBUS_CBOR_KEY_DEVICE:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->device = (int) val;
+                break;
+
+            case MBUS_CBOR_KEY_TIMESTAMP:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value->timestamp = (time_t) val;
+                break;
+
+            case MBUS_CBOR_KEY_VALUE_TYPE:
+                if (mbus_cbor_read_uint(d, &val) == 0)
+                    value_type = (int) val;
+                break;
+
+            case MBUS_CBOR_KEY_FIRST_BYTE:
+                mbus_cbor_read_uint(d, &(value->first_byte.realtime_ns));
+                break;
+
+            case MBUS_CBOR_KEY_LAST_BYTE:
+                mbus_cbor_read_uint(d, &(value->last_byte.realtime_ns));
+                break;
+
+            case MBUS_CBOR_KEY_FIRST_BYTE_MONO:
+                mbus_cbor_read_uint(d, &(value->first_byte.monotonic_ns));
+                break;
+
+            case MBUS_CBOR_KEY_LAST_BYTE_MONO:
+                mbus_cbor_read_uint(d, &(value->last_byte.monotonic_ns));
+                break;
+
+            default:
+                mbus_cbor_skip(d, 1);
+                break;
+        }
+    }
+
+    if (d->error)
+    {
+        return -1;
+    }
+
+    // strings (Latin-1) are stored as bytes, type from key 9
+    if (value->type == MBUS_VALUE_TYPE_BINARY && value_type == MBUS_VALUE_TYPE_STRING)
+    {
+        value->type = MBUS_VALUE_TYPE_STRING;
+    }
+
+    // date and date/time: raw bytes in value, type from key 9
+    if (value->type == MBUS_VALUE_TYPE_BINARY &&
+        (value_type == MBUS_VALUE_TYPE_DATE || value_type == MBUS_VALUE_TYPE_DATETIME))
+    {
+        // the raw encoding has to fit value.integer (at most 8 bytes)
+        if (value->data_len > 8)
+        {
+            d->error = 1;
+            return -1;
+        }
+
+        raw = 0;
+
+        for (i = value->data_len; i > 0; i--)
+        {
+            raw = (raw << 8) | value->data[i-1];
+        }
+
+        value->type = value_type;
+        value->value.integer = (int64_t) raw;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// BCD encode in telegram byte order (least significant byte first), the
+/// inverse of mbus_data_bcd_decode.
+//------------------------------------------------------------------------------
+static void
+mbus_cbor_bcd_encode(unsigned char *bcd_data, size_t bcd_data_size, int64_t value)
+{
+    uint64_t v = (value < 0) ? 0 - (uint64_t) value : (uint64_t) value;
+    size_t i;
+
+    for (i = 0; i < bcd_data_size; i++, v /= 100)
+    {
+        bcd_data[i] = ((v / 10 % 10) << 4) | (v % 10);
+    }
+
+    if (value < 0)
+    {
+        bcd_data[bcd_data_size-1] |= 0xF0;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Decode the header array of fixed or variable data.
+//------------------------------------------------------------------------------
+static int
+mbus_cbor_read_header(mbus_cbor_decoder *d, mbus_cbor_readout *readout)
+{
+    uint64_t n, val[7];
+    int64_t cnt[2];
+    int major, i;
+
+    if (mbus_cbor_read_head(d, &major, &n) != 0 || major != MBUS_CBOR_ARRAY || n < 7)
+    {
+        d->error = 1;
+        return -1;
+    }
+
+    for (i = 0; i < 7; i++)
+    {
+        if (readout->type == MBUS_DATA_TYPE_FIXED && (i == 4 || i == 6))
+        {
+            mbus_cbor_read_int(d, &cnt[i / 6]);
+            val[i] = 0;
+        }
+        else
+        {
+            mbus_cbor_read_uint(d, &val[i]);
+        }
+    }
+
+    // skip additional fields of later versions
+    for (n -= 7; n > 0 && d->error == 0; n--)
+    {
+        mbus_cbor_skip(d, 1);
+    }
+
+    if (d->error)
+    {
+        return -1;
+    }
+
+    if (readout->type == MBUS_DATA_TYPE_FIXED)
+    {
+        mbus_data_fixed *fixed = &(readout->fixed);
+
+        for (i = 0; i < 4; i++)
+        {
+            fixed->id_bcd[i] = (val[0] >> (8 * i)) & 0xFF;
+        }
+
+        fixed->tx_cnt    = val[1];
+        fixed->status    = val[2];
+        fixed->cnt1_type = val[3];
+        fixed->cnt2_type = val[5];
+
+        if ((fixed->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+        {
+            mbus_cbor_bcd_encode(fixed->cnt1_val, 4, cnt[0]);
+            mbus_cbor_bcd_encode(fixed->cnt2_val, 4, cnt[1]);
+        }
+        else
+        {
+            mbus_data_int_encode(fixed->cnt1_val, 4, (int) cnt[0]);
+            mbus_data_int_encode(fixed->cnt2_val, 4, (int) cnt[1]);
+        }
+    }
+    else
+    {
+        mbus_data_variable_header *header = &(readout->header);
+
+        for (i = 0; i < 4; i++)
+        {
+            header->id_bcd[i] = (val[0] >> (8 * i)) & 0xFF;
+        }
+
+        header->manufacturer[0] = val[1] & 0xFF;
+        header->manufacturer[1] = (val[1] >> 8) & 0xFF;
+        header->version         = val[2];
+        header->medium          = val[3];
+        header->access_no       = val[4];
+        header->status          = val[5];
+        header->signature[0]    = val[6] & 0xFF;
+        header->signature[1]    = (val[6] >> 8) & 0xFF;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Decode a CBOR readout (see mbus-cbor.h for the schema).
+//------------------------------------------------------------------------------
+int
+mbus_cbor_decode(const unsigned char *buff, size_t len, mbus_cbor_readout *readout)
+{
+    mbus_cbor_decoder d;
+    mbus_record_value dummy;
+    uint64_t n, key, val, i;
+    int major;
+
+    if (buff == NULL || readout == NULL || (readout->records == NULL && readout->max_records > 0))
+    {
+        return -1;
+    }
+
+    d.p     = buff;
+    d.end   = buff + len;
+    d.error = 0;
+
+    readout->type = 0;
+    readout->error = 0;
+    readout->record_count = 0;
+    memset(&(readout->fixed), 0, sizeof(mbus_data_fixed));
+    memset(&(readout->header), 0, sizeof(mbus_data_variable_header));
+
+    if (mbus_cbor_read_head(&d, &major, &n) != 0 || major != MBUS_CBOR_MAP)
+    {
+        return -1;
+    }
+
+    while (n-- > 0 && d.error == 0)
+    {
+        if (mbus_cbor_read_uint(&d, &key) != 0)
+        {
+            return -1;
+        }
+
+        switch (key)
+        {
+            case MBUS_CBOR_KEY_TYPE:
+                if (mbus_cbor_read_uint(&d, &val) == 0)
+                    readout->type = (int) val;
+                break;
+
+            case MBUS_CBOR_KEY_HEADER:
+                // keys are in ascending order, the type is known here
+                if (readout->type != MBUS_DATA_TYPE_FIXED && readout->type != MBUS_DATA_TYPE_VARIABLE)
+                {
+                    return -1;
+                }
+                mbus_cbor_read_header(&d, readout);
+                break;
+
+            case MBUS_CBOR_KEY_RECORDS:
+                if (mbus_cbor_read_head(&d, &major, &val) != 0 || major != MBUS_CBOR_ARRAY)
+                {
+                    return -1;
+                }
+
+                for (i = 0; i < val && d.error == 0; i++)
+                {
+                    if (readout->record_count < readout->max_records)
+                        mbus_cbor_read_record(&d, &(readout->records[readout->record_count]));
+                    else
+                        mbus_cbor_read_record(&d, &dummy);
+
+                    readout->record_count++;
+                }
+                break;
+
+            case MBUS_CBOR_KEY_ERROR:
+                if (mbus_cbor_read_uint(&d, &val) == 0)
+                    readout->error = (int) val;
+                break;
+
+            default:
+                mbus_cbor_skip(&d, 1);
+                break;
+        }
+    }
+
+    if (d.error)
+    {
+        return -1;
+    }
+
+    return (int) (d.p - buff);
+}
@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-cbor.h
+ *
+ * @brief  Compact binary (CBOR, RFC 7049) encoding of parsed M-Bus frames.
+ *
+ * Records are encoded from the typed record decode, no strings are
+ * formatted. All maps use small unsigned integer keys in ascending order,
+ * optional keys are left out.
+ *
+ * Readout (map):
+ * \verbatim
+ *   0: data type         uint, MBUS_DATA_TYPE_FIXED/VARIABLE/ERROR
+ *   1: header            array, see below (fixed and variable data)
+ *   2: records           array of record maps (variable data)
+ *   3: error             uint, general application error (error data)
+ * \endverbatim
+ *
+ * Variable data header (array of 7):
+ * \verbatim
+ *   [ id, manufacturer, version, medium, access number, status, signature ]
+ * \endverbatim
+ *
+ * Fixed data header (array of 7):
+ * \verbatim
+ *   [ id, access number, status, counter 1 type, counter 1 value,
+ *     counter 2 type, counter 2 value ]
+ * \endverbatim
+ *
+ * The id keeps the BCD digits as hex digits (print with %X, as in the XML
+ * output), manufacturer and signature are the raw 16 bit values. Counter
+ * values of fixed data are decoded (BCD or binary, see status).
+ *
+ * Record (map):
+ * \verbatim
+ *   0: value             int, float or bytes (string, binary, date)
+ *   1: unit              uint, mbus_unit
+ *   2: exponent          int, decimal exponent of the value (omitted if 0)
+ *   3: VIF code          uint, as in mbus_record_value
+ *   4: function          uint, MBUS_RECORD_FUNCTION_* (omitted if 0)
+ *   5: storage number    uint (omitted if 0)
+ *   6: tariff            uint (omitted if not present)
+ *   7: device            uint (omitted if not present)
+ *   8: timestamp         uint, seconds since epoch (omitted if unknown)
+ *   9: value type        uint, MBUS_VALUE_TYPE_* (only for strings, date and
+ *                        date/time, value holds the Latin-1 string or the raw
+ *                        CP16/CP32/CP48 bytes)
+ *  10: first byte        uint, realtime ns since epoch (omitted if unknown)
+ *  11: last byte         uint, realtime ns since epoch (omitted if unknown)
+ *  12: first byte mono   uint, monotonic ns (omitted if unknown)
+ *  13: last byte mono    uint, monotonic ns (omitted if unknown)
+ * \endverbatim
+ *
+ * Strings are stored in reading order, i.e. reversed compared to the
+ * telegram, as byte strings: M-Bus strings are Latin-1 while CBOR text
+ * strings must be UTF-8. The decoder also accepts text strings. Unknown keys
+ * are skipped by the decoder.
+ */
+
+#ifndef MBUS_CBOR_H
+#define MBUS_CBOR_H
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Map keys of the readout
+//
+#define MBUS_CBOR_KEY_TYPE             0
+#define MBUS_CBOR_KEY_HEADER           1
+#define MBUS_CBOR_KEY_RECORDS          2
+#define MBUS_CBOR_KEY_ERROR            3
+
+//
+// Map keys of a record
+//
+#define MBUS_CBOR_KEY_VALUE            0
+#define MBUS_CBOR_KEY_UNIT             1
+#define MBUS_CBOR_KEY_EXPONENT         2
+#define MBUS_CBOR_KEY_VIF_CODE         3
+#define MBUS_CBOR_KEY_FUNCTION         4
+#define MBUS_CBOR_KEY_STORAGE_NUMBER   5
+#define MBUS_CBOR_KEY_TARIFF           6
+#define MBUS_CBOR_KEY_DEVICE           7
+#define MBUS_CBOR_KEY_TIMESTAMP        8
+#define MBUS_CBOR_KEY_VALUE_TYPE       9
+#define MBUS_CBOR_KEY_FIRST_BYTE       10
+#define MBUS_CBOR_KEY_LAST_BYTE        11
+#define MBUS_CBOR_KEY_FIRST_BYTE_MONO  12
+#define MBUS_CBOR_KEY_LAST_BYTE_MONO   13
+
+/**
+ * Decoded readout. Records are stored in a caller supplied array, string
+ * and binary values point into the CBOR input.
+ */
+typedef struct _mbus_cbor_readout {
+
+    int type;                             // MBUS_DATA_TYPE_*
+    int error;                            // general application error
+
+    mbus_data_fixed fixed;                // fixed data
+    mbus_data_variable_header header;     // variable data header
+
+    mbus_record_value *records;           // caller supplied
+    size_t max_records;
+    size_t record_count;                  // records in the readout, can exceed max_records
+
+} mbus_cbor_readout;
+
+/**
+ * Encode parsed frame data as CBOR.
+ *
+ * @param data   parsed frame data
+ * @param buff   destination buffer (may be NULL when size is 0)
+ * @param size   size of the destination buffer
+ *
+ * @return length of the complete encoding (can exceed size), -1 on error
+ */
+int mbus_frame_data_cbor(mbus_frame_data *data, unsigned char *buff, size_t size);
+
+/**
+ * Decode a CBOR readout.
+ *
+ * @param buff     CBOR input
+ * @param len      length of the input
+ * @param readout  decoded readout, records and max_records set by caller
+ *
+ * @return number of bytes consumed, -1 on error
+ */
+int mbus_cbor_decode(const unsigned char *buff, size_t len, mbus_cbor_readout *readout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_CBOR_H */
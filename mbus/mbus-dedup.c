@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbus-dedup.h"
+
+//------------------------------------------------------------------------------
+/// Allocate a duplicate filter
+//------------------------------------------------------------------------------
+mbus_dedup *
+mbus_dedup_new(size_t size, time_t window)
+{
+    mbus_dedup *dedup;
+
+    if (size == 0 || window < 0)
+    {
+        mbus_error_str_set("Invalid duplicate filter size or window.");
+        return NULL;
+    }
+
+    if ((dedup = (mbus_dedup *) calloc(1, sizeof(mbus_dedup))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate duplicate filter.");
+        return NULL;
+    }
+
+    if ((dedup->entry = (mbus_dedup_entry *) calloc(size, sizeof(mbus_dedup_entry))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate duplicate filter.");
+        free(dedup);
+        return NULL;
+    }
+
+    dedup->size = size;
+    dedup->window = window;
+
+    return dedup;
+}
+
+//------------------------------------------------------------------------------
+/// Free a duplicate filter
+//------------------------------------------------------------------------------
+void
+mbus_dedup_free(mbus_dedup *dedup)
+{
+    if (dedup)
+    {
+        free(dedup->entry);
+        free(dedup);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Check whether a frame repeats the last telegram of the same meter
+//------------------------------------------------------------------------------
+int
+mbus_dedup_check(mbus_dedup *dedup, mbus_frame *frame)
+{
+    mbus_dedup_entry *entry;
+    unsigned char address[9], access_no;
+    uint32_t hash;
+    time_t now;
+
+    if (dedup == NULL || frame == NULL)
+    {
+        mbus_error_str_set("Got null pointer to filter or frame.");
+        return -1;
+    }
+
+    memset(address, 0, sizeof(address));
+
+    switch (frame->control_information)
+    {
+        case MBUS_CONTROL_INFO_RESP_VARIABLE:
+        case MBUS_CONTROL_INFO_RESP_VARIABLE_MSB:
+            if (frame->data_size < MBUS_DATA_VARIABLE_HEADER_LENGTH)
+            {
+                return 0;
+            }
+
+            // id, manufacturer, version and medium
+            address[0] = MBUS_DATA_TYPE_VARIABLE;
+            memcpy(&address[1], frame->data, 8);
+            access_no = frame->data[8];
+            break;
+
+        case MBUS_CONTROL_INFO_RESP_FIXED:
+        case MBUS_CONTROL_INFO_RESP_FIXED_MSB:
+            if (frame->data_size < MBUS_DATA_FIXED_LENGTH)
+            {
+                return 0;
+            }
+
+            // id, transmission counter
+            address[0] = MBUS_DATA_TYPE_FIXED;
+            memcpy(&address[1], frame->data, 4);
+            access_no = frame->data[4];
+            break;
+
+        default:
+            return 0;
+    }
+
+    if (frame->data_size > sizeof(dedup->entry->data))
+    {
+        return 0;
+    }
+
+    dedup->frames++;
+
+    now = frame->timestamp ? frame->timestamp : time(NULL);
+    hash = mbus_data_hash(frame->data, frame->data_size, MBUS_DATA_HASH_INIT);
+    hash = mbus_data_hash(&(frame->control_information), 1, hash);
+
+    entry = &(dedup->entry[mbus_data_hash(address, sizeof(address), MBUS_DATA_HASH_INIT) % dedup->size]);
+
+    if (memcmp(entry->address, address, sizeof(address)) == 0 &&
+        entry->access_no == access_no &&
+        entry->data_size == frame->data_size &&
+        entry->hash == hash &&
+        entry->control_information == frame->control_information &&
+        memcmp(entry->data, frame->data, frame->data_size) == 0 &&
+        (dedup->window == 0 || (now >= entry->timestamp && now - entry->timestamp <= dedup->window)))
+    {
+        dedup->duplicates++;
+        dedup->bytes += frame->data_size;
+        return 1;
+    }
+
+    memcpy(entry->address, address, sizeof(address));
+    entry->access_no = access_no;
+    entry->data_size = frame->data_size;
+    entry->hash = hash;
+    entry->control_information = frame->control_information;
+    memcpy(entry->data, frame->data, frame->data_size);
+    entry->timestamp = now;
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-dedup.h
+ *
+ * @brief  Suppression of repeated telegrams.
+ *
+ * Retries, repeated reads and several collectors on one gateway deliver the
+ * same telegram more than once. The filter remembers the last telegram of
+ * every meter by secondary address, access number and user data. A telegram
+ * that repeats it within the time window is reported as duplicate, so that
+ * parsing and output can be skipped. The user data is compared byte by byte,
+ * the hash only rejects differing telegrams early.
+ *
+ * Variable data (CI 72h/76h) and fixed data (CI 73h/77h, transmission
+ * counter as access number) telegrams are checked, all other frames are
+ * passed.
+ */
+
+#ifndef MBUS_DEDUP_H
+#define MBUS_DEDUP_H
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _mbus_dedup_entry {
+
+    unsigned char address[9];   // data type and secondary address
+    unsigned char access_no;
+    unsigned char control_information;
+    size_t data_size;
+    uint32_t hash;              // hash of the user data
+    unsigned char data[MBUS_FRAME_DATA_LENGTH];
+    time_t timestamp;           // first reception
+
+} mbus_dedup_entry;
+
+/**
+ * Duplicate filter with work counters
+ */
+typedef struct _mbus_dedup {
+
+    mbus_dedup_entry *entry;
+    size_t size;
+    time_t window;              // seconds, 0 = no time limit
+
+    unsigned long frames;       // telegrams checked
+    unsigned long duplicates;   // telegrams reported as duplicate
+    unsigned long bytes;        // user data bytes of the duplicates
+
+} mbus_dedup;
+
+/**
+ * Allocate a duplicate filter.
+ *
+ * @param size    number of remembered meters (hash table size)
+ * @param window  time window for repeats in seconds, 0 for no limit
+ *
+ * @return newly allocated filter, NULL on error. Use #mbus_dedup_free.
+ */
+mbus_dedup *mbus_dedup_new(size_t size, time_t window);
+
+/**
+ * Free a duplicate filter.
+ *
+ * @param dedup  duplicate filter
+ */
+void mbus_dedup_free(mbus_dedup *dedup);
+
+/**
+ * Check whether a frame repeats the last telegram of the same meter. The
+ * time of the frame is its receive timestamp or the current time when not
+ * set.
+ *
+ * @param dedup  duplicate filter
+ * @param frame  received frame
+ *
+ * @return 1 for a duplicate, 0 otherwise, -1 on error
+ */
+int mbus_dedup_check(mbus_dedup *dedup, mbus_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_DEDUP_H */
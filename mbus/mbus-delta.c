@@ -0,0 +1,417 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbus-delta.h"
+
+#define MBUS_DELTA_ADDRESS_SIZE  9
+#define MBUS_DELTA_KEY_SIZE      (5 + MBUS_DATA_INFO_BLOCK_DIFE_SIZE + \
+                                  MBUS_VALUE_INFO_BLOCK_VIFE_SIZE + \
+                                  MBUS_VALUE_INFO_BLOCK_CUSTOM_VIF_SIZE)
+
+//------------------------------------------------------------------------------
+/// Last value of a record, identity and value are kept in one buffer
+//------------------------------------------------------------------------------
+typedef struct _mbus_delta_entry {
+
+    uint32_t hash;              // hash of the identity
+    unsigned char *buff;        // identity followed by the value
+    size_t key_len;
+    size_t value_len;
+
+} mbus_delta_entry;
+
+struct _mbus_delta_meter {
+
+    unsigned char address[MBUS_DELTA_ADDRESS_SIZE];
+    unsigned long readouts;
+
+    mbus_delta_entry *entry;
+    size_t nentries;
+    size_t max_entries;
+
+    mbus_delta_meter *next;
+};
+
+//------------------------------------------------------------------------------
+/// Allocate a state store
+//------------------------------------------------------------------------------
+mbus_delta_store *
+mbus_delta_store_new(size_t nbuckets, unsigned long snapshot_interval)
+{
+    mbus_delta_store *store;
+
+    if (nbuckets == 0)
+    {
+        mbus_error_str_set("Invalid number of buckets.");
+        return NULL;
+    }
+
+    if ((store = (mbus_delta_store *) calloc(1, sizeof(mbus_delta_store))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate delta store.");
+        return NULL;
+    }
+
+    if ((store->bucket = (mbus_delta_meter **) calloc(nbuckets, sizeof(mbus_delta_meter *))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate delta store.");
+        free(store);
+        return NULL;
+    }
+
+    store->nbuckets = nbuckets;
+    store->snapshot_interval = snapshot_interval;
+
+    return store;
+}
+
+//------------------------------------------------------------------------------
+/// Free the state of all meters
+//------------------------------------------------------------------------------
+void
+mbus_delta_store_clear(mbus_delta_store *store)
+{
+    mbus_delta_meter *meter, *next;
+    size_t i, j;
+
+    if (store == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < store->nbuckets; i++)
+    {
+        for (meter = store->bucket[i]; meter; meter = next)
+        {
+            next = meter->next;
+
+            for (j = 0; j < meter->nentries; j++)
+            {
+                free(meter->entry[j].buff);
+            }
+
+            free(meter->entry);
+            free(meter);
+        }
+
+        store->bucket[i] = NULL;
+    }
+
+    store->meters = 0;
+}
+
+//------------------------------------------------------------------------------
+/// Free a state store
+//------------------------------------------------------------------------------
+void
+mbus_delta_store_free(mbus_delta_store *store)
+{
+    if (store)
+    {
+        mbus_delta_store_clear(store);
+        free(store->bucket);
+        free(store);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Find or add the state of a meter, *created is set for new meters
+//------------------------------------------------------------------------------
+static mbus_delta_meter *
+mbus_delta_meter_get(mbus_delta_store *store, const unsigned char *address, int *created)
+{
+    mbus_delta_meter *meter;
+    size_t i;
+
+    i = mbus_data_hash(address, MBUS_DELTA_ADDRESS_SIZE, MBUS_DATA_HASH_INIT) % store->nbuckets;
+
+    for (meter = store->bucket[i]; meter; meter = meter->next)
+    {
+        if (memcmp(meter->address, address, MBUS_DELTA_ADDRESS_SIZE) == 0)
+        {
+            *created = 0;
+            return meter;
+        }
+    }
+
+    if ((meter = (mbus_delta_meter *) calloc(1, sizeof(mbus_delta_meter))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate meter state.");
+        return NULL;
+    }
+
+    memcpy(meter->address, address, MBUS_DELTA_ADDRESS_SIZE);
+    meter->next = store->bucket[i];
+    store->bucket[i] = meter;
+    store->meters++;
+
+    *created = 1;
+    return meter;
+}
+
+//------------------------------------------------------------------------------
+/// Store the value of a record. Returns 1 when the record is new or its value
+/// changed, 0 when unchanged and -1 on error.
+//------------------------------------------------------------------------------
+static int
+mbus_delta_meter_update(mbus_delta_meter *meter, const unsigned char *key, size_t key_len,
+                        const unsigned char *value, size_t value_len)
+{
+    mbus_delta_entry *entry;
+    unsigned char *buff;
+    uint32_t hash;
+    size_t i;
+
+    hash = mbus_data_hash(key, key_len, MBUS_DATA_HASH_INIT);
+
+    for (i = 0; i < meter->nentries; i++)
+    {
+        entry = &(meter->entry[i]);
+
+        if (entry->hash == hash && entry->key_len == key_len &&
+            memcmp(entry->buff, key, key_len) == 0)
+        {
+            if (entry->value_len == value_len &&
+                memcmp(entry->buff + key_len, value, value_len) == 0)
+            {
+                return 0;
+            }
+
+            if (entry->value_len != value_len)
+            {
+                if ((buff = (unsigned char *) realloc(entry->buff, key_len + value_len + 1)) == NULL)
+                {
+                    mbus_error_str_set("Failed to allocate record state.");
+                    return -1;
+                }
+
+                entry->buff = buff;
+                entry->value_len = value_len;
+            }
+
+            memcpy(entry->buff + key_len, value, value_len);
+            return 1;
+        }
+    }
+
+    if (meter->nentries >= meter->max_entries)
+    {
+        i = meter->max_entries ? 2 * meter->max_entries : 16;
+
+        if ((entry = (mbus_delta_entry *) realloc(meter->entry, i * sizeof(mbus_delta_entry))) == NULL)
+        {
+            mbus_error_str_set("Failed to allocate record state.");
+            return -1;
+        }
+
+        meter->entry = entry;
+        meter->max_entries = i;
+    }
+
+    if ((buff = (unsigned char *) malloc(key_len + value_len + 1)) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate record state.");
+        return -1;
+    }
+
+    memcpy(buff, key, key_len);
+    memcpy(buff + key_len, value, value_len);
+
+    entry = &(meter->entry[meter->nentries++]);
+    entry->hash = hash;
+    entry->buff = buff;
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Identity of a variable data record: DIB, VIB and custom VIF
+//------------------------------------------------------------------------------
+static size_t
+mbus_delta_record_key(mbus_data_record *record, unsigned char *key)
+{
+    mbus_data_information_block *dib = &(record->drh.dib);
+    mbus_value_information_block *vib = &(record->drh.vib);
+    size_t len = 0, i;
+
+    key[len++] = dib->dif;
+    key[len++] = dib->ndife;
+    for (i = 0; i < dib->ndife && i < MBUS_DATA_INFO_BLOCK_DIFE_SIZE; i++)
+    {
+        key[len++] = dib->dife[i];
+    }
+
+    key[len++] = vib->vif;
+    key[len++] = vib->nvife;
+    for (i = 0; i < vib->nvife && i < MBUS_VALUE_INFO_BLOCK_VIFE_SIZE; i++)
+    {
+        key[len++] = vib->vife[i];
+    }
+
+    for (i = 0; i < MBUS_VALUE_INFO_BLOCK_CUSTOM_VIF_SIZE && vib->custom_vif[i]; i++)
+    {
+        key[len++] = vib->custom_vif[i];
+    }
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+/// Compare a readout with the previous readout of the same meter
+//------------------------------------------------------------------------------
+int
+mbus_delta_filter(mbus_delta_store *store, mbus_frame_data *data)
+{
+    unsigned char address[MBUS_DELTA_ADDRESS_SIZE];
+    unsigned char key[MBUS_DELTA_KEY_SIZE + 1], other[MBUS_DELTA_KEY_SIZE + 1], value[5];
+    uint32_t base[MBUS_FRAME_DATA_LENGTH], hash;
+    mbus_data_record *seen[MBUS_FRAME_DATA_LENGTH];
+    mbus_data_record *record, *prev, *next, *dropped;
+    mbus_delta_meter *meter;
+    mbus_data_fixed *fixed;
+    size_t key_len, n, i;
+    int created, snapshot, changed, result;
+
+    if (store == NULL || data == NULL)
+    {
+        mbus_error_str_set("Got null pointer to store or data.");
+        return -1;
+    }
+
+    memset(address, 0, sizeof(address));
+    address[0] = data->type;
+
+    if (data->type == MBUS_DATA_TYPE_VARIABLE)
+    {
+        memcpy(&address[1], data->data_var.header.id_bcd, 4);
+        memcpy(&address[5], data->data_var.header.manufacturer, 2);
+        address[7] = data->data_var.header.version;
+        address[8] = data->data_var.header.medium;
+    }
+    else if (data->type == MBUS_DATA_TYPE_FIXED)
+    {
+        memcpy(&address[1], data->data_fix.id_bcd, 4);
+    }
+    else
+    {
+        return MBUS_DELTA_SNAPSHOT;
+    }
+
+    if ((meter = mbus_delta_meter_get(store, address, &created)) == NULL)
+    {
+        return -1;
+    }
+
+    snapshot = created ||
+               (store->snapshot_interval && (meter->readouts % store->snapshot_interval) == 0);
+    meter->readouts++;
+    changed = 0;
+
+    if (data->type == MBUS_DATA_TYPE_FIXED)
+    {
+        // the two counters are the records of fixed data
+        fixed = &(data->data_fix);
+
+        for (i = 0; i < 2; i++)
+        {
+            key[0] = 0xFF;
+            key[1] = i;
+            key[2] = (i == 0) ? fixed->cnt1_type : fixed->cnt2_type;
+
+            value[0] = fixed->status;
+            memcpy(&value[1], (i == 0) ? fixed->cnt1_val : fixed->cnt2_val, 4);
+
+            if ((result = mbus_delta_meter_update(meter, key, 3, value, 5)) < 0)
+            {
+                return -1;
+            }
+
+            changed |= result;
+        }
+
+        store->records_in += 2;
+        store->records_out += (snapshot || changed) ? 2 : 0;
+
+        return snapshot ? MBUS_DELTA_SNAPSHOT :
+               changed  ? MBUS_DELTA_CHANGED  : MBUS_DELTA_UNCHANGED;
+    }
+
+    prev = NULL;
+    dropped = NULL;
+    n = 0;
+
+    for (record = data->data_var.record; record; record = next)
+    {
+        next = record->next;
+
+        key_len = mbus_delta_record_key(record, key);
+        hash = mbus_data_hash(key, key_len, MBUS_DATA_HASH_INIT);
+
+        // records with the same identity are numbered in order of appearance,
+        // the hash only skips the records with a different identity early
+        key[key_len] = 0;
+        for (i = 0; i < n; i++)
+        {
+            if (base[i] == hash &&
+                mbus_delta_record_key(seen[i], other) == key_len &&
+                memcmp(other, key, key_len) == 0)
+            {
+                key[key_len]++;
+            }
+        }
+        key_len++;
+
+        if (n < MBUS_FRAME_DATA_LENGTH)
+        {
+            base[n] = hash;
+            seen[n++] = record;
+        }
+
+        store->records_in++;
+
+        if ((result = mbus_delta_meter_update(meter, key, key_len, record->data, record->data_len)) < 0)
+        {
+            mbus_data_record_free(dropped);
+            return -1;
+        }
+
+        changed |= result;
+
+        if (result || snapshot)
+        {
+            store->records_out++;
+            prev = record;
+            continue;
+        }
+
+        // unchanged, unlink the record, it is freed once the identities of
+        // all records are numbered
+        if (prev)
+        {
+            prev->next = next;
+        }
+        else
+        {
+            data->data_var.record = next;
+        }
+
+        record->next = dropped;
+        dropped = record;
+        data->data_var.nrecords--;
+    }
+
+    mbus_data_record_free(dropped);
+
+    return snapshot ? MBUS_DELTA_SNAPSHOT :
+           changed  ? MBUS_DELTA_CHANGED  : MBUS_DELTA_UNCHANGED;
+}
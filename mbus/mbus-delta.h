@@ -0,0 +1,106 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-delta.h
+ *
+ * @brief  Change detection between consecutive readouts of a meter.
+ *
+ * The store keeps the last value of every record per meter (secondary
+ * address). A record is identified by its DIB and VIB, i.e. DIF, storage
+ * number, tariff, subunit, VIF and VIFE; records with the same identity in
+ * one telegram are told apart by their position. Values are compared byte
+ * by byte.
+ *
+ * #mbus_delta_filter removes the records that did not change from parsed
+ * frame data, so that the usual serializers (XML, JSON, CBOR) only output
+ * the changes. The first readout of a meter and every snapshot_interval-th
+ * readout after it is passed on unchanged as full snapshot.
+ */
+
+#ifndef MBUS_DELTA_H
+#define MBUS_DELTA_H
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Result of mbus_delta_filter
+//
+#define MBUS_DELTA_UNCHANGED   0   /**< no record changed, nothing to emit */
+#define MBUS_DELTA_CHANGED     1   /**< only changed records are left */
+#define MBUS_DELTA_SNAPSHOT    2   /**< full readout, all records are left */
+
+typedef struct _mbus_delta_meter mbus_delta_meter;
+
+/**
+ * Per meter state store
+ */
+typedef struct _mbus_delta_store {
+
+    mbus_delta_meter **bucket;
+    size_t nbuckets;
+
+    unsigned long snapshot_interval;   // readouts between full snapshots, 0 = first only
+
+    size_t meters;                     // meters in the store
+    unsigned long records_in;          // records passed to mbus_delta_filter
+    unsigned long records_out;         // records left after filtering
+
+} mbus_delta_store;
+
+/**
+ * Allocate a state store.
+ *
+ * @param nbuckets           hash table size, about the number of meters
+ * @param snapshot_interval  emit a full snapshot every n-th readout of a
+ *                           meter (0 = only the first readout)
+ *
+ * @return newly allocated store, NULL on error. Use #mbus_delta_store_free.
+ */
+mbus_delta_store *mbus_delta_store_new(size_t nbuckets, unsigned long snapshot_interval);
+
+/**
+ * Free a state store.
+ *
+ * @param store  state store
+ */
+void mbus_delta_store_free(mbus_delta_store *store);
+
+/**
+ * Compare a readout with the previous readout of the same meter and update
+ * the store.
+ *
+ * Unchanged records are removed from the record list of variable data. Fixed
+ * data is left as it is, the result tells whether a counter changed. Error
+ * data is always reported as snapshot.
+ *
+ * @param store  state store
+ * @param data   parsed frame data, modified in place
+ *
+ * @return MBUS_DELTA_UNCHANGED, MBUS_DELTA_CHANGED or MBUS_DELTA_SNAPSHOT,
+ *         -1 on error
+ */
+int mbus_delta_filter(mbus_delta_store *store, mbus_frame_data *data);
+
+/**
+ * Forget the state of all meters, the next readout of every meter is a
+ * full snapshot.
+ *
+ * @param store  state store
+ */
+void mbus_delta_store_clear(mbus_delta_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_DELTA_H */
@@ -0,0 +1,795 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbus-json.h"
+#include "mbus-protocol-aux.h"
+
+#define MBUS_JSON_MAX_DEPTH  8
+
+//------------------------------------------------------------------------------
+/// Output state of the serializer, output goes to an mbus_sink.
+//------------------------------------------------------------------------------
+typedef struct _mbus_json_writer
+{
+    mbus_sink *sink;
+    int flags;
+
+    int depth;
+    char first[MBUS_JSON_MAX_DEPTH];
+} mbus_json_writer;
+
+static const char mbus_json_hex[] = "0123456789ABCDEF";
+
+static void
+mbus_json_put(mbus_json_writer *w, const char *data, size_t len)
+{
+    mbus_sink_write(w->sink, data, len);
+}
+
+static void
+mbus_json_puts(mbus_json_writer *w, const char *str)
+{
+    mbus_sink_write(w->sink, str, strlen(str));
+}
+
+//------------------------------------------------------------------------------
+/// Length of a valid UTF-8 sequence starting at src, 0 if invalid.
+//------------------------------------------------------------------------------
+static size_t
+mbus_json_utf8_len(const unsigned char *src, size_t len)
+{
+    size_t n, i;
+
+    if (src[0] >= 0xC2 && src[0] <= 0xDF)
+        n = 2;
+    else if (src[0] >= 0xE0 && src[0] <= 0xEF)
+        n = 3;
+    else if (src[0] >= 0xF0 && src[0] <= 0xF4)
+        n = 4;
+    else
+        return 0;
+
+    if (n > len)
+    {
+        return 0;
+    }
+
+    for (i = 1; i < n; i++)
+    {
+        if ((src[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+
+    // overlong encodings, surrogates and code points above U+10FFFF
+    if ((src[0] == 0xE0 && src[1] < 0xA0) ||
+        (src[0] == 0xED && src[1] > 0x9F) ||
+        (src[0] == 0xF0 && src[1] < 0x90) ||
+        (src[0] == 0xF4 && src[1] > 0x8F))
+    {
+        return 0;
+    }
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+/// Escape a chunk of string data. Valid UTF-8 is passed through, other bytes
+/// are taken as ISO-8859-1 (the encoding of the XML output).
+//------------------------------------------------------------------------------
+static void
+mbus_json_escape(mbus_json_writer *w, const unsigned char *src, size_t len)
+{
+    char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+    size_t i, n;
+    unsigned char c;
+
+    for (i = 0; i < len; )
+    {
+        c = src[i];
+
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+        {
+            i++;
+            continue;
+        }
+
+        if (c >= 0x80 && (n = mbus_json_utf8_len(&src[i], len - i)) > 0)
+        {
+            i += n;
+            continue;
+        }
+
+        // flush the run of plain characters before the escape
+        mbus_json_put(w, (const char *) src, i);
+
+        switch (c)
+        {
+            case '"':  mbus_json_put(w, "\\\"", 2); break;
+            case '\\': mbus_json_put(w, "\\\\", 2); break;
+            case '\b': mbus_json_put(w, "\\b", 2);  break;
+            case '\f': mbus_json_put(w, "\\f", 2);  break;
+            case '\n': mbus_json_put(w, "\\n", 2);  break;
+            case '\r': mbus_json_put(w, "\\r", 2);  break;
+            case '\t': mbus_json_put(w, "\\t", 2);  break;
+            default:
+                esc[4] = mbus_json_hex[c >> 4];
+                esc[5] = mbus_json_hex[c & 0x0F];
+                mbus_json_put(w, esc, 6);
+                break;
+        }
+
+        src += i + 1;
+        len -= i + 1;
+        i = 0;
+    }
+
+    mbus_json_put(w, (const char *) src, len);
+}
+
+//------------------------------------------------------------------------------
+/// Write a JSON string. With reverse set the source is read from the end,
+/// the byte order of M-Bus strings (see mbus_data_str_decode).
+//------------------------------------------------------------------------------
+static void
+mbus_json_string(mbus_json_writer *w, const unsigned char *src, size_t len, int reverse)
+{
+    unsigned char tmp[256];
+    size_t i, n;
+
+    mbus_json_put(w, "\"", 1);
+
+    if (src && !reverse)
+    {
+        mbus_json_escape(w, src, len);
+    }
+
+    while (src && reverse && len > 0)
+    {
+        n = (len < sizeof(tmp)) ? len : sizeof(tmp);
+
+        for (i = 0; i < n; i++)
+        {
+            tmp[i] = src[len - 1 - i];
+        }
+
+        // do not split a multi-byte sequence at the window boundary
+        while (n < len && n > 1 && (tmp[n-1] & 0x80))
+        {
+            n--;
+        }
+
+        mbus_json_escape(w, tmp, n);
+        len -= n;
+    }
+
+    mbus_json_put(w, "\"", 1);
+}
+
+//------------------------------------------------------------------------------
+/// Line break and indentation for the given nesting level (pretty output).
+//------------------------------------------------------------------------------
+static void
+mbus_json_indent(mbus_json_writer *w, int depth)
+{
+    static const char indent[] = "\n                                ";
+
+    if ((w->flags & MBUS_JSON_LINES) == 0)
+    {
+        mbus_json_put(w, indent, 1 + 4 * depth);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Separator and key before the next member (key != NULL) or array element.
+//------------------------------------------------------------------------------
+static void
+mbus_json_key(mbus_json_writer *w, const char *key)
+{
+    if (w->depth > 0)
+    {
+        if (w->first[w->depth] == 0)
+        {
+            mbus_json_put(w, ",", 1);
+        }
+
+        w->first[w->depth] = 0;
+        mbus_json_indent(w, w->depth);
+    }
+
+    if (key)
+    {
+        mbus_json_put(w, "\"", 1);
+        mbus_json_puts(w, key);
+        mbus_json_puts(w, (w->flags & MBUS_JSON_LINES) ? "\":" : "\": ");
+    }
+}
+
+static void
+mbus_json_open(mbus_json_writer *w, const char *key, char c)
+{
+    mbus_json_key(w, key);
+    mbus_json_put(w, &c, 1);
+
+    w->depth++;
+    w->first[w->depth] = 1;
+}
+
+static void
+mbus_json_close(mbus_json_writer *w, char c)
+{
+    if (w->first[w->depth] == 0)
+    {
+        mbus_json_indent(w, w->depth - 1);
+    }
+
+    w->depth--;
+    mbus_json_put(w, &c, 1);
+}
+
+static void
+mbus_json_str(mbus_json_writer *w, const char *key, const char *str)
+{
+    mbus_json_key(w, key);
+    mbus_json_string(w, (const unsigned char *) str, str ? strlen(str) : 0, 0);
+}
+
+static void
+mbus_json_int(mbus_json_writer *w, const char *key, long long val)
+{
+    mbus_json_key(w, key);
+    mbus_sink_printf(w->sink, "%lld", val);
+}
+
+static void
+mbus_json_real(mbus_json_writer *w, double val, int precision)
+{
+    if (isfinite(val))
+    {
+        mbus_sink_printf(w->sink, "%.*g", precision, val);
+    }
+    else
+    {
+        mbus_json_put(w, "null", 4);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Write binary data as string of hex bytes, most significant byte first
+/// (same format as mbus_data_bin_decode).
+//------------------------------------------------------------------------------
+static void
+mbus_json_hex_string(mbus_json_writer *w, const unsigned char *src, size_t len)
+{
+    char hex[3] = { 0, 0, ' ' };
+    size_t i;
+
+    mbus_json_put(w, "\"", 1);
+
+    for (i = 0; i < len; i++)
+    {
+        hex[0] = mbus_json_hex[src[len - i - 1] >> 4];
+        hex[1] = mbus_json_hex[src[len - i - 1] & 0x0F];
+        mbus_json_put(w, hex, (i + 1 < len) ? 3 : 2);
+    }
+
+    mbus_json_put(w, "\"", 1);
+}
+
+//------------------------------------------------------------------------------
+/// Write the value of a variable-length data record. Numeric values are
+/// scaled with factor and offset in normalized mode.
+//------------------------------------------------------------------------------
+static void
+mbus_json_record_value(mbus_json_writer *w, mbus_data_record *record, double factor, double offset)
+{
+    mbus_record_value value;
+    char date[MBUS_DATA_TIME_ISO_SIZE + 2];
+    int len;
+
+    mbus_json_key(w, "Value");
+
+    if (mbus_data_record_decode_typed(record, &value) != 0)
+    {
+        mbus_json_put(w, "null", 4);
+        return;
+    }
+
+    switch (value.type)
+    {
+        case MBUS_VALUE_TYPE_INTEGER:
+            if (w->flags & MBUS_JSON_NORMALIZED)
+            {
+                mbus_json_real(w, value.value.integer * factor + offset, 15);
+            }
+            else
+            {
+                mbus_sink_printf(w->sink, "%lld", (long long) value.value.integer);
+            }
+            break;
+
+        case MBUS_VALUE_TYPE_REAL:
+            if (w->flags & MBUS_JSON_NORMALIZED)
+            {
+                mbus_json_real(w, value.value.real * factor + offset, 15);
+            }
+            else
+            {
+                mbus_json_real(w, value.value.real, 9);
+            }
+            break;
+
+        case MBUS_VALUE_TYPE_STRING:
+            mbus_json_string(w, value.data, value.data_len, 1);
+            break;
+
+        case MBUS_VALUE_TYPE_BINARY:
+            mbus_json_hex_string(w, value.data, value.data_len);
+            break;
+
+        case MBUS_VALUE_TYPE_DATE:
+        case MBUS_VALUE_TYPE_DATETIME:
+            // normalized date and time is UTC, like mbus_variable_value_decode
+            len = mbus_data_time_iso(record->data, (value.type == MBUS_VALUE_TYPE_DATE) ? 2 : record->data_len,
+                                     (value.type == MBUS_VALUE_TYPE_DATETIME) && (w->flags & MBUS_JSON_NORMALIZED),
+                                     &date[1], sizeof(date) - 2);
+            date[0] = date[len + 1] = '"';
+            mbus_json_put(w, date, len + 2);
+            break;
+
+        default:
+            mbus_json_put(w, "null", 4);
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Write a single variable-length data record (see mbus_data_variable_record_xml)
+//------------------------------------------------------------------------------
+static void
+mbus_json_data_record(mbus_json_writer *w, mbus_data_record *record, int record_cnt, int frame_cnt)
+{
+    const char *unit, *quantity;
+    double factor = 1.0, offset = 0.0;
+    char timestamp[22], iso[MBUS_TIMESTAMP_ISO_SIZE];
+    struct tm t;
+    long tariff;
+
+    mbus_json_open(w, NULL, '{');
+
+    mbus_json_int(w, "id", record_cnt);
+
+    if (frame_cnt >= 0)
+    {
+        mbus_json_int(w, "frame", frame_cnt);
+    }
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC)
+    {
+        mbus_json_str(w, "Function", "Manufacturer specific");
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_json_str(w, "Function", "More records follow");
+    }
+    else
+    {
+        mbus_json_str(w, "Function", mbus_data_record_function(record));
+        mbus_json_int(w, "StorageNumber", mbus_data_record_storage_number(record));
+
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
+        {
+            mbus_json_int(w, "Tariff", tariff);
+            mbus_json_int(w, "Device", mbus_data_record_device(record));
+        }
+
+        if (w->flags & MBUS_JSON_NORMALIZED)
+        {
+            mbus_vib_unit_lookup_normalized(&(record->drh.vib), &unit, &factor, &offset, &quantity);
+            mbus_json_str(w, "Unit", unit);
+            mbus_json_str(w, "Quantity", quantity);
+        }
+        else
+        {
+            mbus_json_str(w, "Unit", mbus_data_record_unit(record));
+        }
+    }
+
+    mbus_json_record_value(w, record, factor, offset);
+
+    if (record->timestamp > 0 && gmtime_r(&(record->timestamp), &t))
+    {
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &t);
+        mbus_json_str(w, "Timestamp", timestamp);
+    }
+
+    if (mbus_timestamp_iso(&(record->first_byte), iso, sizeof(iso)) > 0)
+    {
+        mbus_json_str(w, "FirstByte", iso);
+        mbus_json_int(w, "FirstByteMonotonic", (long long) record->first_byte.monotonic_ns);
+    }
+
+    if (mbus_timestamp_iso(&(record->last_byte), iso, sizeof(iso)) > 0)
+    {
+        mbus_json_str(w, "LastByte", iso);
+        mbus_json_int(w, "LastByteMonotonic", (long long) record->last_byte.monotonic_ns);
+    }
+
+    mbus_json_close(w, '}');
+}
+
+//------------------------------------------------------------------------------
+/// Write the slave information of a variable-length data header
+//------------------------------------------------------------------------------
+static void
+mbus_json_variable_header(mbus_json_writer *w, mbus_data_variable_header *header)
+{
+    char manufacturer[4];
+    int m_id;
+
+    m_id = (header->manufacturer[1] << 8) | header->manufacturer[0];
+    manufacturer[0] = (char)(((m_id>>10) & 0x001F) + 64);
+    manufacturer[1] = (char)(((m_id>>5)  & 0x001F) + 64);
+    manufacturer[2] = (char)(((m_id)     & 0x001F) + 64);
+    manufacturer[3] = 0;
+
+    mbus_json_open(w, "SlaveInformation", '{');
+
+    mbus_json_key(w, "Id");
+    mbus_sink_printf(w->sink, "\"%llX\"", mbus_data_bcd_decode_hex(header->id_bcd, 4));
+    mbus_json_str(w, "Manufacturer", manufacturer);
+    mbus_json_int(w, "Version", header->version);
+    mbus_json_str(w, "ProductName", mbus_data_product_name(header));
+    mbus_json_str(w, "Medium", mbus_data_variable_medium_lookup(header->medium));
+    mbus_json_int(w, "AccessNumber", header->access_no);
+    mbus_json_key(w, "Status");
+    mbus_sink_printf(w->sink, "\"%.2X\"", header->status);
+    mbus_json_key(w, "Signature");
+    mbus_sink_printf(w->sink, "\"%.2X%.2X\"", header->signature[1], header->signature[0]);
+
+    mbus_json_close(w, '}');
+}
+
+//------------------------------------------------------------------------------
+/// Write a fixed-length frame (see mbus_data_fixed_xml)
+//------------------------------------------------------------------------------
+static void
+mbus_json_fixed(mbus_json_writer *w, mbus_data_fixed *data)
+{
+    unsigned char *cnt_val[2];
+    int cnt_type[2], i, val;
+
+    cnt_val[0]  = data->cnt1_val;
+    cnt_val[1]  = data->cnt2_val;
+    cnt_type[0] = data->cnt1_type;
+    cnt_type[1] = data->cnt2_type;
+
+    mbus_json_open(w, "SlaveInformation", '{');
+    mbus_json_key(w, "Id");
+    mbus_sink_printf(w->sink, "\"%llX\"", mbus_data_bcd_decode_hex(data->id_bcd, 4));
+    mbus_json_str(w, "Medium", mbus_data_fixed_medium(data));
+    mbus_json_int(w, "AccessNumber", data->tx_cnt);
+    mbus_json_key(w, "Status");
+    mbus_sink_printf(w->sink, "\"%.2X\"", data->status);
+    mbus_json_close(w, '}');
+
+    mbus_json_open(w, "DataRecord", '[');
+
+    for (i = 0; i < 2; i++)
+    {
+        mbus_json_open(w, NULL, '{');
+        mbus_json_int(w, "id", i);
+        mbus_json_str(w, "Function", mbus_data_fixed_function(data->status));
+        mbus_json_str(w, "Unit", mbus_data_fixed_unit(cnt_type[i]));
+
+        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+        {
+            mbus_json_int(w, "Value", mbus_data_bcd_decode(cnt_val[i], 4));
+        }
+        else
+        {
+            mbus_data_int_decode(cnt_val[i], 4, &val);
+            mbus_json_int(w, "Value", val);
+        }
+
+        mbus_json_close(w, '}');
+    }
+
+    mbus_json_close(w, ']');
+}
+
+//------------------------------------------------------------------------------
+/// Write a general application error (see mbus_data_error_xml)
+//------------------------------------------------------------------------------
+static void
+mbus_json_error(mbus_json_writer *w, int error)
+{
+    mbus_json_open(w, "SlaveInformation", '{');
+    mbus_json_str(w, "Error", mbus_data_error_lookup(error));
+    mbus_json_close(w, '}');
+}
+
+static void
+mbus_json_end(mbus_json_writer *w)
+{
+    mbus_json_close(w, '}');
+    mbus_json_put(w, "\n", 1);
+}
+
+//------------------------------------------------------------------------------
+/// Write one JSON document for parsed frame data.
+//------------------------------------------------------------------------------
+static int
+mbus_json_frame_data(mbus_json_writer *w, mbus_frame_data *data)
+{
+    mbus_data_record *record;
+    int i;
+
+    if (data->type != MBUS_DATA_TYPE_ERROR &&
+        data->type != MBUS_DATA_TYPE_FIXED &&
+        data->type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        mbus_error_str_set("Unknown frame data type.");
+        return -1;
+    }
+
+    mbus_json_open(w, NULL, '{');
+
+    if (data->type == MBUS_DATA_TYPE_ERROR)
+    {
+        mbus_json_error(w, data->error);
+    }
+    else if (data->type == MBUS_DATA_TYPE_FIXED)
+    {
+        mbus_json_fixed(w, &(data->data_fix));
+    }
+    else
+    {
+        mbus_json_variable_header(w, &(data->data_var.header));
+
+        mbus_json_open(w, "DataRecord", '[');
+
+        for (record = data->data_var.record, i = 0; record; record = record->next, i++)
+        {
+            mbus_json_data_record(w, record, i, -1);
+        }
+
+        mbus_json_close(w, ']');
+    }
+
+    mbus_json_end(w);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Write a frame chain, records are numbered across all frames.
+//------------------------------------------------------------------------------
+static int
+mbus_json_frame(mbus_json_writer *w, mbus_frame *frame)
+{
+    mbus_frame_data frame_data;
+    mbus_data_record *record;
+    mbus_frame *iter;
+    int record_cnt = 0, frame_cnt;
+    int lines = (w->flags & MBUS_JSON_LINES);
+
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+
+    if (mbus_frame_data_parse(frame, &frame_data) == -1)
+    {
+        mbus_error_str_set("M-bus data parse error.");
+        return -1;
+    }
+
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        return mbus_json_frame_data(w, &frame_data);
+    }
+
+    // include frame counter in output if more than one frame is available
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
+
+    for (iter = frame; iter; iter = iter->next)
+    {
+        if (iter != frame)
+        {
+            memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
+
+            if (mbus_frame_data_parse(iter, &frame_data) == -1)
+            {
+                mbus_error_str_set("M-bus variable data parse error.");
+                return -1;
+            }
+        }
+
+        // the header is written once, or once per line in JSON Lines mode
+        if (iter == frame || lines)
+        {
+            mbus_json_open(w, NULL, '{');
+            mbus_json_variable_header(w, &(frame_data.data_var.header));
+            mbus_json_open(w, "DataRecord", '[');
+        }
+
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            mbus_json_data_record(w, record, record_cnt, frame_cnt);
+        }
+
+        if (frame_data.data_var.record)
+        {
+            mbus_data_record_free(frame_data.data_var.record);
+        }
+
+        if (iter->next == NULL || lines)
+        {
+            mbus_json_close(w, ']');
+            mbus_json_end(w);
+        }
+
+        if (frame_cnt >= 0)
+        {
+            frame_cnt++;
+        }
+    }
+
+    return 0;
+}
+
+static void
+mbus_json_init(mbus_json_writer *w, mbus_sink *sink, int flags)
+{
+    w->sink  = sink;
+    w->flags = flags;
+    w->depth = 0;
+    w->first[0] = 1;
+}
+
+//------------------------------------------------------------------------------
+/// Serialize parsed frame data to an output sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_json_sink(mbus_sink *sink, mbus_frame_data *data, int flags)
+{
+    mbus_json_writer w;
+
+    if (sink == NULL || data == NULL)
+    {
+        return -1;
+    }
+
+    mbus_json_init(&w, sink, flags);
+
+    if (mbus_json_frame_data(&w, data) != 0)
+    {
+        return -1;
+    }
+
+    return mbus_sink_flush(sink);
+}
+
+//------------------------------------------------------------------------------
+/// Serialize a frame chain to an output sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_json_sink(mbus_sink *sink, mbus_frame *frame, int flags)
+{
+    mbus_json_writer w;
+
+    if (sink == NULL || frame == NULL)
+    {
+        return -1;
+    }
+
+    mbus_json_init(&w, sink, flags);
+
+    if (mbus_json_frame(&w, frame) != 0)
+    {
+        return -1;
+    }
+
+    return mbus_sink_flush(sink);
+}
+
+//------------------------------------------------------------------------------
+/// Serialize parsed frame data into a buffer (snprintf semantics).
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_json(mbus_frame_data *data, int flags, char *buff, size_t size)
+{
+    mbus_sink sink;
+
+    if (buff == NULL && size > 0)
+    {
+        return -1;
+    }
+
+    mbus_sink_init_buffer(&sink, buff, size);
+
+    if (mbus_frame_data_json_sink(&sink, data, flags) != 0)
+    {
+        return -1;
+    }
+
+    return (int) sink.total;
+}
+
+//------------------------------------------------------------------------------
+/// Serialize parsed frame data through a write callback.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_json_cb(mbus_frame_data *data, int flags, mbus_json_write_fn write, void *arg)
+{
+    mbus_sink sink;
+
+    if (write == NULL)
+    {
+        return -1;
+    }
+
+    mbus_sink_init_callback(&sink, write, arg);
+
+    if (mbus_frame_data_json_sink(&sink, data, flags) != 0)
+    {
+        return -1;
+    }
+
+    return (int) sink.total;
+}
+
+//------------------------------------------------------------------------------
+/// Serialize a frame chain into a buffer (snprintf semantics).
+//------------------------------------------------------------------------------
+int
+mbus_frame_json(mbus_frame *frame, int flags, char *buff, size_t size)
+{
+    mbus_sink sink;
+
+    if (buff == NULL && size > 0)
+    {
+        return -1;
+    }
+
+    mbus_sink_init_buffer(&sink, buff, size);
+
+    if (mbus_frame_json_sink(&sink, frame, flags) != 0)
+    {
+        return -1;
+    }
+
+    return (int) sink.total;
+}
+
+//------------------------------------------------------------------------------
+/// Serialize a frame chain through a write callback.
+//------------------------------------------------------------------------------
+int
+mbus_frame_json_cb(mbus_frame *frame, int flags, mbus_json_write_fn write, void *arg)
+{
+    mbus_sink sink;
+
+    if (write == NULL)
+    {
+        return -1;
+    }
+
+    mbus_sink_init_callback(&sink, write, arg);
+
+    if (mbus_frame_json_sink(&sink, frame, flags) != 0)
+    {
+        return -1;
+    }
+
+    return (int) sink.total;
+}
@@ -0,0 +1,121 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-json.h
+ *
+ * @brief  JSON and JSON Lines representation of parsed M-Bus frames.
+ *
+ * The serializer writes to an mbus_sink (callback, FILE, fixed or growable
+ * buffer), no intermediate buffers are allocated. Key names follow
+ * the XML representation (SlaveInformation, DataRecord, ...).
+ *
+ */
+
+#ifndef MBUS_JSON_H
+#define MBUS_JSON_H
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Output flags
+//
+#define MBUS_JSON_NORMALIZED   0x01  /**< normalized units, quantity and value */
+#define MBUS_JSON_LINES        0x02  /**< compact, one object per line (JSON Lines) */
+
+/**
+ * Write callback, called with consecutive chunks of the JSON text. Same
+ * signature as the callback of an mbus_sink, non-zero return aborts.
+ */
+typedef mbus_sink_write_fn mbus_json_write_fn;
+
+/**
+ * Serialize parsed frame data to an output sink.
+ *
+ * @param sink   output sink
+ * @param data   parsed frame data
+ * @param flags  combination of MBUS_JSON_* flags
+ *
+ * @return zero when OK, -1 on error
+ */
+int mbus_frame_data_json_sink(mbus_sink *sink, mbus_frame_data *data, int flags);
+
+/**
+ * Serialize a (possibly multi-telegram) frame chain to an output sink.
+ *
+ * @param sink   output sink
+ * @param frame  first frame of the chain
+ * @param flags  combination of MBUS_JSON_* flags
+ *
+ * @return zero when OK, -1 on error
+ */
+int mbus_frame_json_sink(mbus_sink *sink, mbus_frame *frame, int flags);
+
+/**
+ * Serialize parsed frame data into a buffer.
+ *
+ * Output is truncated and null terminated like snprintf.
+ *
+ * @param data   parsed frame data
+ * @param flags  combination of MBUS_JSON_* flags
+ * @param buff   destination buffer (may be NULL when size is 0)
+ * @param size   size of the destination buffer
+ *
+ * @return length of the complete JSON text (excluding null), -1 on error
+ */
+int mbus_frame_data_json(mbus_frame_data *data, int flags, char *buff, size_t size);
+
+/**
+ * Serialize parsed frame data through a write callback.
+ *
+ * @param data   parsed frame data
+ * @param flags  combination of MBUS_JSON_* flags
+ * @param write  write callback
+ * @param arg    argument passed to the write callback
+ *
+ * @return number of bytes written, -1 on error
+ */
+int mbus_frame_data_json_cb(mbus_frame_data *data, int flags, mbus_json_write_fn write, void *arg);
+
+/**
+ * Serialize a (possibly multi-telegram) frame chain into a buffer.
+ *
+ * Records of all frames are numbered consecutively and carry the index of
+ * the frame they came from. In JSON Lines mode one object per frame is
+ * written.
+ *
+ * @param frame  first frame of the chain
+ * @param flags  combination of MBUS_JSON_* flags
+ * @param buff   destination buffer (may be NULL when size is 0)
+ * @param size   size of the destination buffer
+ *
+ * @return length of the complete JSON text (excluding null), -1 on error
+ */
+int mbus_frame_json(mbus_frame *frame, int flags, char *buff, size_t size);
+
+/**
+ * Serialize a (possibly multi-telegram) frame chain through a write callback.
+ *
+ * @param frame  first frame of the chain
+ * @param flags  combination of MBUS_JSON_* flags
+ * @param write  write callback
+ * @param arg    argument passed to the write callback
+ *
+ * @return number of bytes written, -1 on error
+ */
+int mbus_frame_json_cb(mbus_frame *frame, int flags, mbus_json_write_fn write, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_JSON_H */
@@ -0,0 +1,602 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbus-loopback.h"
+#include "mbus-stats-internal.h"
+#include "mbus-capture.h"
+
+//------------------------------------------------------------------------------
+/// Length of the frame at the start of the data, the remaining length when
+/// the bytes can't be framed
+//------------------------------------------------------------------------------
+static size_t
+mbus_loopback_frame_length(const unsigned char *data, size_t len)
+{
+    size_t n = len;
+
+    switch (data[0])
+    {
+        case MBUS_FRAME_ACK_START:
+            n = MBUS_FRAME_BASE_SIZE_ACK;
+            break;
+
+        case MBUS_FRAME_SHORT_START:
+            n = MBUS_FRAME_BASE_SIZE_SHORT;
+            break;
+
+        case MBUS_FRAME_LONG_START:
+            // start, L, L, start, L bytes, checksum, stop
+            if (len >= 2)
+            {
+                n = data[1] + 6;
+            }
+            break;
+    }
+
+    return (n < len) ? n : len;
+}
+
+//------------------------------------------------------------------------------
+/// Open the loopback, pending bytes of an earlier connection are dropped
+//------------------------------------------------------------------------------
+int
+mbus_loopback_connect(mbus_handle *handle)
+{
+    mbus_loopback_data *loopback_data;
+
+    if (handle == NULL || handle->auxdata == NULL)
+    {
+        return -1;
+    }
+
+    loopback_data = (mbus_loopback_data *) handle->auxdata;
+    loopback_data->len = 0;
+    loopback_data->pos = 0;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//
+//------------------------------------------------------------------------------
+int
+mbus_loopback_disconnect(mbus_handle *handle)
+{
+    return mbus_loopback_connect(handle);
+}
+
+//------------------------------------------------------------------------------
+//
+//------------------------------------------------------------------------------
+void
+mbus_loopback_data_free(mbus_handle *handle)
+{
+    if (handle)
+    {
+        free(handle->auxdata);
+        handle->auxdata = NULL;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Hand the sent bytes frame by frame to the responder and queue its replies
+//------------------------------------------------------------------------------
+int
+mbus_loopback_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt)
+{
+    mbus_loopback_data *loopback_data;
+    unsigned char request[MBUS_SEND_QUEUE_LENGTH * MBUS_FRAME_PACKED_MAX_SIZE];
+    size_t len, offset, n;
+    int i, ret;
+
+    if (handle == NULL || handle->auxdata == NULL || iov == NULL || iovcnt <= 0)
+    {
+        return -1;
+    }
+
+    loopback_data = (mbus_loopback_data *) handle->auxdata;
+
+    len = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].iov_len > sizeof(request) - len)
+        {
+            mbus_error_str_set("M-Bus loopback transport layer request too long.");
+            return -1;
+        }
+
+        memcpy(&request[len], iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+
+        mbus_capture_event(handle, MBUS_CAPTURE_SEND, iov[i].iov_base, iov[i].iov_len);
+    }
+
+    // make room for the replies
+    if (loopback_data->pos > 0)
+    {
+        memmove(loopback_data->buff, &loopback_data->buff[loopback_data->pos],
+                loopback_data->len - loopback_data->pos);
+        loopback_data->len -= loopback_data->pos;
+        loopback_data->pos = 0;
+    }
+
+    for (offset = 0; offset < len; offset += n)
+    {
+        n = mbus_loopback_frame_length(&request[offset], len - offset);
+
+        loopback_data->requests++;
+
+        ret = loopback_data->responder(loopback_data->arg, &request[offset], n,
+                                       &loopback_data->buff[loopback_data->len],
+                                       sizeof(loopback_data->buff) - loopback_data->len);
+
+        if (ret < 0)
+        {
+            mbus_error_str_set("M-Bus loopback transport layer responder failed.");
+            return -1;
+        }
+
+        if (ret > 0)
+        {
+            loopback_data->replies++;
+            loopback_data->len += ret;
+        }
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//
+//------------------------------------------------------------------------------
+int
+mbus_loopback_send_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[MBUS_FRAME_PACKED_MAX_SIZE];
+    struct iovec iov;
+    int len;
+    char error_str[128];
+
+    if (handle == NULL || frame == NULL)
+    {
+        return -1;
+    }
+
+    if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
+    {
+        snprintf(error_str, sizeof(error_str), "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        mbus_error_str_set(error_str);
+        return -1;
+    }
+
+    iov.iov_base = buff;
+    iov.iov_len = len;
+
+    if (mbus_loopback_send_raw(handle, &iov, 1) != 0)
+    {
+        return -1;
+    }
+
+    //
+    // call the send event function, if the callback function is registered
+    //
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_LOOPBACK, (const char *) buff, len);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Receive the next queued frame, a timeout when nothing is queued
+//------------------------------------------------------------------------------
+int
+mbus_loopback_recv_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    mbus_loopback_data *loopback_data;
+    unsigned char *data;
+    size_t len;
+    int remaining;
+
+    if (handle == NULL || handle->auxdata == NULL || frame == NULL)
+    {
+        fprintf(stderr, "%s: Invalid parameter.\n", __PRETTY_FUNCTION__);
+        return MBUS_RECV_RESULT_ERROR;
+    }
+
+    loopback_data = (mbus_loopback_data *) handle->auxdata;
+
+    if (loopback_data->pos >= loopback_data->len)
+    {
+        mbus_error_str_set("M-Bus loopback transport layer response timeout has been reached.");
+        return MBUS_RECV_RESULT_TIMEOUT;
+    }
+
+    mbus_recv_first_byte(handle, frame);
+
+    data = &loopback_data->buff[loopback_data->pos];
+    len = mbus_loopback_frame_length(data, loopback_data->len - loopback_data->pos);
+    loopback_data->pos += len;
+
+    remaining = mbus_parse(frame, data, len);
+
+    //
+    // call the receive event function, if the callback function is registered
+    //
+    if (handle->recv_event)
+        handle->recv_event(MBUS_HANDLE_TYPE_LOOPBACK, (const char *) data, len);
+
+    mbus_capture_event(handle, MBUS_CAPTURE_RECV, (const char *) data, len);
+
+    if (remaining != 0)
+    {
+        mbus_error_str_set("M-Bus layer failed to parse data.");
+        return MBUS_RECV_RESULT_INVALID;
+    }
+
+    return MBUS_RECV_RESULT_OK;
+}
+
+//------------------------------------------------------------------------------
+/// Allocate an empty simulated bus
+//------------------------------------------------------------------------------
+mbus_loopback_bus *
+mbus_loopback_bus_new(void)
+{
+    mbus_loopback_bus *bus;
+
+    if ((bus = (mbus_loopback_bus *) calloc(1, sizeof(mbus_loopback_bus))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate simulated bus.");
+        return NULL;
+    }
+
+    return bus;
+}
+
+//------------------------------------------------------------------------------
+/// Free a simulated bus and its slaves
+//------------------------------------------------------------------------------
+void
+mbus_loopback_bus_free(mbus_loopback_bus *bus)
+{
+    mbus_loopback_slave *slave, *next;
+
+    if (bus)
+    {
+        for (slave = bus->slave; slave; slave = next)
+        {
+            next = slave->next;
+            free(slave);
+        }
+
+        free(bus);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Add a slave, slaves are kept in the order they were added
+//------------------------------------------------------------------------------
+mbus_loopback_slave *
+mbus_loopback_bus_add_slave(mbus_loopback_bus *bus, int primary)
+{
+    mbus_loopback_slave *slave, **last;
+
+    if (bus == NULL || primary < -1 || primary > 250)
+    {
+        mbus_error_str_set("Invalid bus or primary address.");
+        return NULL;
+    }
+
+    if ((slave = (mbus_loopback_slave *) calloc(1, sizeof(mbus_loopback_slave))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate simulated slave.");
+        return NULL;
+    }
+
+    slave->primary = primary;
+    slave->current = -1;
+
+    for (last = &(bus->slave); *last; last = &((*last)->next))
+        ;
+
+    *last = slave;
+    bus->nslaves++;
+
+    return slave;
+}
+
+//------------------------------------------------------------------------------
+/// Add a reply telegram to a slave
+//------------------------------------------------------------------------------
+int
+mbus_loopback_slave_add_telegram(mbus_loopback_slave *slave, mbus_frame *frame)
+{
+    mbus_frame telegram;
+    int len;
+
+    if (slave == NULL || frame == NULL)
+    {
+        mbus_error_str_set("Got null pointer to slave or frame.");
+        return -1;
+    }
+
+    if (slave->ntelegrams >= MBUS_LOOPBACK_MAX_TELEGRAMS)
+    {
+        mbus_error_str_set("Too many telegrams.");
+        return -1;
+    }
+
+    telegram = *frame;
+    telegram.next = NULL;
+
+    if (slave->primary >= 0)
+    {
+        telegram.address = slave->primary;
+    }
+
+    if ((len = mbus_frame_pack(&telegram, slave->telegram[slave->ntelegrams],
+                               MBUS_FRAME_PACKED_MAX_SIZE)) == -1)
+    {
+        return -1;
+    }
+
+    if (slave->ntelegrams == 0 &&
+        telegram.control_information == MBUS_CONTROL_INFO_RESP_VARIABLE &&
+        telegram.data_size >= MBUS_DATA_VARIABLE_HEADER_LENGTH)
+    {
+        // id, manufacturer, version, medium
+        memcpy(slave->secondary, telegram.data, 8);
+    }
+
+    slave->telegram_len[slave->ntelegrams++] = len;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Check a selection mask, F digits of the id and FFh bytes (FFFFh for the
+/// manufacturer) match any value
+//------------------------------------------------------------------------------
+static int
+mbus_loopback_slave_match(mbus_loopback_slave *slave, const unsigned char *mask)
+{
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if ((mask[i] & 0xF0) != 0xF0 && (mask[i] & 0xF0) != (slave->secondary[i] & 0xF0))
+            return 0;
+
+        if ((mask[i] & 0x0F) != 0x0F && (mask[i] & 0x0F) != (slave->secondary[i] & 0x0F))
+            return 0;
+    }
+
+    if ((mask[4] != 0xFF || mask[5] != 0xFF) && memcmp(&mask[4], &slave->secondary[4], 2) != 0)
+        return 0;
+
+    if (mask[6] != 0xFF && mask[6] != slave->secondary[6])
+        return 0;
+
+    if (mask[7] != 0xFF && mask[7] != slave->secondary[7])
+        return 0;
+
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Flip every bit of a reply with the given probability
+//------------------------------------------------------------------------------
+static void
+mbus_loopback_bit_errors(unsigned char *data, size_t len, double rate, unsigned int *seed)
+{
+    size_t i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        for (bit = 0; bit < 8; bit++)
+        {
+            if (rand_r(seed) < rate * ((double) RAND_MAX + 1.0))
+            {
+                data[i] ^= (1 << bit);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Let a slave process a request, returns the number of reply bytes
+//------------------------------------------------------------------------------
+static size_t
+mbus_loopback_slave_respond(mbus_loopback_slave *slave, mbus_frame *frame,
+                            unsigned char *reply, size_t reply_size)
+{
+    size_t len = 0;
+    int fcb;
+
+    if (frame->type == MBUS_FRAME_TYPE_LONG &&
+        frame->address == MBUS_ADDRESS_NETWORK_LAYER &&
+        frame->control_information == MBUS_CONTROL_INFO_SELECT_SLAVE)
+    {
+        // every slave listens to the selection
+        if (slave->drop > 0)
+        {
+            slave->drop--;
+            return 0;
+        }
+
+        slave->selected = (frame->data_size >= 8 && mbus_loopback_slave_match(slave, frame->data));
+
+        if (slave->selected == 0)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        if (frame->address != slave->primary &&
+            frame->address != MBUS_ADDRESS_BROADCAST_REPLY &&
+            frame->address != MBUS_ADDRESS_BROADCAST_NOREPLY &&
+            (frame->address != MBUS_ADDRESS_NETWORK_LAYER || slave->selected == 0))
+        {
+            return 0;
+        }
+
+        if (slave->drop > 0)
+        {
+            slave->drop--;
+            return 0;
+        }
+
+        if (frame->type == MBUS_FRAME_TYPE_SHORT &&
+            frame->control == MBUS_CONTROL_MASK_SND_NKE)
+        {
+            // reset, a SND_NKE to the network layer address deselects
+            slave->current = -1;
+
+            if (frame->address == MBUS_ADDRESS_NETWORK_LAYER)
+            {
+                slave->selected = 0;
+            }
+        }
+        else if (frame->type == MBUS_FRAME_TYPE_SHORT &&
+                 (frame->control & ~MBUS_CONTROL_MASK_FCB) == MBUS_CONTROL_MASK_REQ_UD2)
+        {
+            if (slave->ntelegrams == 0)
+            {
+                return 0;
+            }
+
+            // a toggled FCB asks for the next telegram, starting over after
+            // the last one, a repeated request (same FCB) gets the same one
+            fcb = (frame->control & MBUS_CONTROL_MASK_FCB) != 0;
+
+            if (slave->current < 0)
+            {
+                slave->current = 0;
+            }
+            else if (fcb != slave->fcb)
+            {
+                slave->current++;
+
+                if ((size_t) slave->current >= slave->ntelegrams)
+                {
+                    slave->current = 0;
+                }
+            }
+
+            slave->fcb = fcb;
+            slave->requests++;
+
+            len = slave->telegram_len[slave->current];
+            if (len > reply_size || frame->address == MBUS_ADDRESS_BROADCAST_NOREPLY)
+            {
+                return 0;
+            }
+
+            memcpy(reply, slave->telegram[slave->current], len);
+            return len;
+        }
+        else if (frame->type == MBUS_FRAME_TYPE_LONG &&
+                 (frame->control & ~MBUS_CONTROL_MASK_FCB) == MBUS_CONTROL_MASK_SND_UD)
+        {
+            if (frame->control_information == MBUS_CONTROL_INFO_DATA_SEND &&
+                frame->data_size == 3 && frame->data[0] == 0x01 && frame->data[1] == 0x7A)
+            {
+                // primary address record
+                slave->primary = frame->data[2];
+            }
+            else if (frame->control_information == MBUS_CONTROL_INFO_APPLICATION_RESET)
+            {
+                slave->current = -1;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+
+        if (frame->address == MBUS_ADDRESS_BROADCAST_NOREPLY)
+        {
+            return 0;
+        }
+    }
+
+    slave->requests++;
+
+    if (reply_size < 1)
+    {
+        return 0;
+    }
+
+    reply[0] = MBUS_FRAME_ACK_START;
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+/// Let every slave of the bus process a request
+//------------------------------------------------------------------------------
+int
+mbus_loopback_bus_respond(void *arg, const unsigned char *request, size_t request_len,
+                          unsigned char *reply, size_t reply_size)
+{
+    mbus_loopback_bus *bus = (mbus_loopback_bus *) arg;
+    mbus_loopback_slave *slave;
+    mbus_frame frame;
+    unsigned char buff[MBUS_FRAME_PACKED_MAX_SIZE];
+    size_t len, n;
+
+    if (bus == NULL || request == NULL || reply == NULL)
+    {
+        mbus_error_str_set("Got null pointer to bus, request or reply.");
+        return -1;
+    }
+
+    // slaves ignore anything that isn't a valid frame
+    if (request_len > sizeof(buff))
+    {
+        return 0;
+    }
+
+    bus->latency_ms = 0;
+
+    memcpy(buff, request, request_len);
+    memset(&frame, 0, sizeof(frame));
+
+    if (mbus_parse(&frame, buff, request_len) != 0)
+    {
+        return 0;
+    }
+
+    len = 0;
+    for (slave = bus->slave; slave; slave = slave->next)
+    {
+        if ((n = mbus_loopback_slave_respond(slave, &frame, &reply[len], reply_size - len)) == 0)
+        {
+            continue;
+        }
+
+        if (slave->bit_error_rate > 0.0)
+        {
+            mbus_loopback_bit_errors(&reply[len], n, slave->bit_error_rate, &(bus->seed));
+        }
+
+        if (slave->latency_ms > bus->latency_ms)
+        {
+            bus->latency_ms = slave->latency_ms;
+        }
+
+        len += n;
+    }
+
+    return len;
+}
@@ -0,0 +1,187 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-loopback.h
+ *
+ * @brief  In-memory M-Bus transport with scriptable slaves.
+ *
+ * The loopback transport hands every frame the master sends to a responder
+ * function instead of a serial port or TCP gateway. The bytes the responder
+ * returns are received by the master as if they came from the bus, so the
+ * complete master stack (requests, retries, multi-telegram replies and
+ * secondary address scans) runs at CPU speed without any hardware.
+ *
+ * The built-in bus responder simulates a set of slaves, each with a primary
+ * address, a secondary address and a list of reply telegrams:
+ *
+ * \verbatim
+ * bus = mbus_loopback_bus_new();
+ * slave = mbus_loopback_bus_add_slave(bus, 5);
+ * mbus_loopback_slave_add_telegram(slave, reply_frame);
+ *
+ * handle = mbus_context_loopback(mbus_loopback_bus_respond, bus);
+ * mbus_connect(handle);
+ * mbus_sendrecv_request(handle, 5, &reply, 16);
+ * \endverbatim
+ *
+ * Slaves answering the same request reply one after the other, which the
+ * master detects as collision just like on a real bus. Bit errors and reply
+ * latencies can be configured per slave; the latency is only reported in
+ * the bus, it is up to emulators on real (pseudo) terminals to wait.
+ */
+
+#ifndef MBUS_LOOPBACK_H
+#define MBUS_LOOPBACK_H
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_LOOPBACK_BUFF_SIZE      (4 * MBUS_SEND_QUEUE_LENGTH * MBUS_FRAME_PACKED_MAX_SIZE)
+#define MBUS_LOOPBACK_MAX_TELEGRAMS  8
+
+/**
+ * Responder of the loopback transport, called for every frame (or
+ * unframeable byte sequence) the master sends.
+ *
+ * @param arg          responder argument given to mbus_context_loopback
+ * @param request      bytes sent by the master
+ * @param request_len  number of bytes sent
+ * @param reply        buffer for the bytes of the slave(s)
+ * @param reply_size   size of the reply buffer
+ *
+ * @return number of reply bytes (0 = no answer), -1 on error
+ */
+typedef int (*mbus_loopback_responder)(void *arg, const unsigned char *request, size_t request_len,
+                                       unsigned char *reply, size_t reply_size);
+
+typedef struct _mbus_loopback_data
+{
+    mbus_loopback_responder responder;
+    void *arg;
+
+    unsigned char buff[MBUS_LOOPBACK_BUFF_SIZE];  /**< bytes not yet received by the master */
+    size_t len;
+    size_t pos;
+
+    unsigned long requests;     /**< byte sequences handed to the responder */
+    unsigned long replies;      /**< byte sequences answered by the responder */
+} mbus_loopback_data;
+
+/**
+ * Simulated slave of the bus responder
+ */
+typedef struct _mbus_loopback_slave
+{
+    int primary;                        /**< primary address, -1 for none */
+    unsigned char secondary[8];         /**< id, manufacturer, version, medium */
+    char selected;                      /**< selected by secondary address */
+
+    unsigned char telegram[MBUS_LOOPBACK_MAX_TELEGRAMS][MBUS_FRAME_PACKED_MAX_SIZE];
+    size_t telegram_len[MBUS_LOOPBACK_MAX_TELEGRAMS];
+    size_t ntelegrams;
+    int current;                        /**< telegram sent last, -1 after reset */
+    int fcb;                            /**< frame count bit of the last request */
+
+    unsigned int drop;                  /**< leave the next n requests unanswered */
+    unsigned int latency_ms;            /**< reply delay, applied by bus emulators */
+    double bit_error_rate;              /**< probability of a flipped bit in the reply */
+    unsigned long requests;             /**< requests answered */
+
+    struct _mbus_loopback_slave *next;
+} mbus_loopback_slave;
+
+/**
+ * Simulated bus, argument of mbus_loopback_bus_respond
+ */
+typedef struct _mbus_loopback_bus
+{
+    mbus_loopback_slave *slave;
+    size_t nslaves;
+
+    unsigned int seed;                  /**< random seed of the bit errors */
+    unsigned int latency_ms;            /**< largest latency of the slaves answering the last request */
+} mbus_loopback_bus;
+
+/**
+ * Allocate and initialize a M-Bus context with the loopback transport.
+ *
+ * @param responder Responder called for every request
+ * @param arg       Argument of the responder
+ *
+ * @return Initialized "unified" handler when successful, NULL otherwise;
+ */
+mbus_handle * mbus_context_loopback(mbus_loopback_responder responder, void *arg);
+
+int  mbus_loopback_connect(mbus_handle *handle);
+int  mbus_loopback_disconnect(mbus_handle *handle);
+int  mbus_loopback_send_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_loopback_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt);
+int  mbus_loopback_recv_frame(mbus_handle *handle, mbus_frame *frame);
+void mbus_loopback_data_free(mbus_handle *handle);
+
+/**
+ * Allocate an empty simulated bus.
+ *
+ * @return newly allocated bus, NULL on error. Use #mbus_loopback_bus_free.
+ */
+mbus_loopback_bus *mbus_loopback_bus_new(void);
+
+/**
+ * Free a simulated bus and its slaves.
+ *
+ * @param bus  simulated bus
+ */
+void mbus_loopback_bus_free(mbus_loopback_bus *bus);
+
+/**
+ * Add a slave to the bus. The slave has no telegrams, it only acknowledges
+ * until telegrams are added.
+ *
+ * @param bus      simulated bus
+ * @param primary  primary address (0-250), -1 for a slave only reachable
+ *                 by secondary address
+ *
+ * @return the new slave, NULL on error
+ */
+mbus_loopback_slave *mbus_loopback_bus_add_slave(mbus_loopback_bus *bus, int primary);
+
+/**
+ * Add a reply telegram to a slave. The address field is set to the primary
+ * address of the slave. The first variable data telegram sets the secondary
+ * address of the slave. Telegrams are sent in turn when the master toggles
+ * the frame count bit, a repeated request gets the same telegram again.
+ *
+ * @param slave  simulated slave
+ * @param frame  RSP_UD frame
+ *
+ * @return Zero when successful.
+ */
+int mbus_loopback_slave_add_telegram(mbus_loopback_slave *slave, mbus_frame *frame);
+
+/**
+ * Responder simulating the slaves of a bus. Answers SND_NKE, REQ_UD2,
+ * SND_UD (including the change of the primary address) and the selection
+ * by secondary address with wildcards.
+ *
+ * @param arg  simulated bus (mbus_loopback_bus)
+ *
+ * @return number of reply bytes, -1 on error
+ */
+int mbus_loopback_bus_respond(void *arg, const unsigned char *request, size_t request_len,
+                              unsigned char *reply, size_t reply_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_LOOPBACK_H */
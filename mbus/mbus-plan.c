@@ -0,0 +1,329 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbus-plan.h"
+
+//------------------------------------------------------------------------------
+/// Check the frame for variable data
+//------------------------------------------------------------------------------
+static int
+mbus_decode_plan_frame_check(mbus_frame *frame)
+{
+    if (frame == NULL)
+    {
+        mbus_error_str_set("Got null pointer to frame.");
+        return -1;
+    }
+
+    if (frame->control_information != MBUS_CONTROL_INFO_RESP_VARIABLE &&
+        frame->control_information != MBUS_CONTROL_INFO_RESP_VARIABLE_MSB)
+    {
+        mbus_error_str_set("No variable data frame.");
+        return -1;
+    }
+
+    if (frame->data_size < MBUS_DATA_VARIABLE_HEADER_LENGTH ||
+        frame->data_size > MBUS_FRAME_DATA_LENGTH)
+    {
+        mbus_error_str_set("Invalid variable data length.");
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Build the decode plan of a variable data frame
+//------------------------------------------------------------------------------
+mbus_decode_plan *
+mbus_decode_plan_new(mbus_frame *frame)
+{
+    mbus_decode_plan *plan;
+    mbus_decode_step step[(MBUS_FRAME_DATA_LENGTH - MBUS_DATA_VARIABLE_HEADER_LENGTH) / 2 + 1];
+    mbus_data_record record;
+    size_t i, n;
+
+    if (mbus_decode_plan_frame_check(frame) != 0)
+    {
+        return NULL;
+    }
+
+    i = MBUS_DATA_VARIABLE_HEADER_LENGTH;
+    n = 0;
+
+    while (i < frame->data_size)
+    {
+        // skip filler dif=2F
+        if ((frame->data[i] & 0xFF) == MBUS_DIB_DIF_IDLE_FILLER)
+        {
+            i++;
+            continue;
+        }
+
+        if (n >= sizeof(step) / sizeof(step[0]))
+        {
+            mbus_error_str_set("Too many records.");
+            return NULL;
+        }
+
+        if (mbus_data_variable_record_parse(frame, &i, &record) != 0)
+        {
+            return NULL;
+        }
+
+        // the data of a record ends at the next record
+        step[n].dif      = record.drh.dib.dif;
+        step[n].offset   = i - record.data_len;
+        step[n].data_len = record.data_len;
+        step[n].decode   = (mbus_data_record_decode_typed(&record, &(step[n].value)) == 0);
+
+        step[n].value.type = MBUS_VALUE_TYPE_NONE;
+        step[n].value.value.integer = 0;
+        step[n].value.data = NULL;
+        step[n].value.data_len = 0;
+        n++;
+    }
+
+    if ((plan = (mbus_decode_plan *) calloc(1, sizeof(mbus_decode_plan))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate decode plan.");
+        return NULL;
+    }
+
+    if (n > 0 && (plan->step = (mbus_decode_step *) malloc(n * sizeof(mbus_decode_step))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate decode plan.");
+        free(plan);
+        return NULL;
+    }
+
+    memcpy(plan->data, frame->data, frame->data_size);
+    plan->data_size = frame->data_size;
+    memcpy(plan->step, step, n * sizeof(mbus_decode_step));
+    plan->nsteps = n;
+
+    return plan;
+}
+
+//------------------------------------------------------------------------------
+/// Free a decode plan
+//------------------------------------------------------------------------------
+void
+mbus_decode_plan_free(mbus_decode_plan *plan)
+{
+    if (plan)
+    {
+        free(plan->step);
+        free(plan);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Compare all bytes except the values (header, DIB, VIB, LVAR and filler)
+/// with the telegram the plan was built from
+//------------------------------------------------------------------------------
+int
+mbus_decode_plan_match(mbus_decode_plan *plan, mbus_frame *frame)
+{
+    size_t pos, start, n;
+
+    if (plan == NULL || frame == NULL || frame->data_size != plan->data_size)
+    {
+        return 0;
+    }
+
+    // the variable data header is not part of the layout
+    pos = MBUS_DATA_VARIABLE_HEADER_LENGTH;
+
+    for (n = 0; n < plan->nsteps; n++)
+    {
+        start = plan->step[n].offset;
+
+        // the LVAR byte determines the data length and type
+        if ((plan->step[n].dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x0D &&
+            plan->step[n].data_len > 0)
+        {
+            start++;
+        }
+
+        if (memcmp(&(frame->data[pos]), &(plan->data[pos]), start - pos) != 0)
+        {
+            return 0;
+        }
+
+        pos = plan->step[n].offset + plan->step[n].data_len;
+    }
+
+    return memcmp(&(frame->data[pos]), &(plan->data[pos]), plan->data_size - pos) == 0;
+}
+
+//------------------------------------------------------------------------------
+/// Decode the records of a frame at the offsets of the plan
+//------------------------------------------------------------------------------
+int
+mbus_decode_plan_execute(mbus_decode_plan *plan, mbus_frame *frame,
+                         mbus_record_value *values, size_t max_values)
+{
+    mbus_decode_step *step;
+    size_t n;
+
+    if (plan == NULL || frame == NULL || (values == NULL && max_values > 0))
+    {
+        mbus_error_str_set("Invalid parameter.");
+        return -1;
+    }
+
+    for (n = 0; n < plan->nsteps && n < max_values; n++)
+    {
+        step = &(plan->step[n]);
+
+        values[n] = step->value;
+        values[n].timestamp = frame->timestamp;
+        values[n].first_byte = frame->first_byte;
+        values[n].last_byte = frame->last_byte;
+
+        if (step->decode)
+        {
+            mbus_data_value_decode_typed(step->dif, &(frame->data[step->offset]),
+                                         step->data_len, &values[n]);
+        }
+    }
+
+    return plan->nsteps;
+}
+
+//------------------------------------------------------------------------------
+/// Allocate a plan cache
+//------------------------------------------------------------------------------
+mbus_decode_plan_cache *
+mbus_decode_plan_cache_new(size_t size)
+{
+    mbus_decode_plan_cache *cache;
+
+    if (size == 0)
+    {
+        mbus_error_str_set("Invalid cache size.");
+        return NULL;
+    }
+
+    if ((cache = (mbus_decode_plan_cache *) calloc(1, sizeof(mbus_decode_plan_cache))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate plan cache.");
+        return NULL;
+    }
+
+    if ((cache->slot = (mbus_decode_plan **) calloc(size, sizeof(mbus_decode_plan *))) == NULL)
+    {
+        mbus_error_str_set("Failed to allocate plan cache.");
+        free(cache);
+        return NULL;
+    }
+
+    cache->size = size;
+    return cache;
+}
+
+//------------------------------------------------------------------------------
+/// Free a plan cache and all cached plans
+//------------------------------------------------------------------------------
+void
+mbus_decode_plan_cache_free(mbus_decode_plan_cache *cache)
+{
+    size_t i;
+
+    if (cache)
+    {
+        for (i = 0; i < cache->size; i++)
+        {
+            mbus_decode_plan_free(cache->slot[i]);
+        }
+
+        free(cache->slot);
+        free(cache);
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Decode a variable data frame through the plan cache
+//------------------------------------------------------------------------------
+int
+mbus_decode_plan_cache_decode(mbus_decode_plan_cache *cache, mbus_frame *frame,
+                              mbus_data_variable_header *header,
+                              mbus_record_value *values, size_t max_values)
+{
+    mbus_decode_plan *plan;
+    unsigned char size;
+    uint32_t hash;
+    size_t i, slot, victim;
+
+    if (cache == NULL || mbus_decode_plan_frame_check(frame) != 0)
+    {
+        return -1;
+    }
+
+    if (header && mbus_data_variable_header_parse(frame, header) != 0)
+    {
+        return -1;
+    }
+
+    // key: secondary address (id, manufacturer, version, medium) and length
+    size = frame->data_size;
+    hash = mbus_data_hash(frame->data, 8, MBUS_DATA_HASH_INIT);
+    hash = mbus_data_hash(&size, 1, hash);
+
+    cache->clock++;
+    victim = hash % cache->size;
+
+    for (i = 0; i < MBUS_PLAN_CACHE_PROBE && i < cache->size; i++)
+    {
+        slot = (hash + i) % cache->size;
+        plan = cache->slot[slot];
+
+        if (plan == NULL)
+        {
+            victim = slot;
+            break;
+        }
+
+        if (memcmp(plan->data, frame->data, 8) == 0 &&
+            mbus_decode_plan_match(plan, frame))
+        {
+            cache->hits++;
+            plan->last_used = cache->clock;
+            return mbus_decode_plan_execute(plan, frame, values, max_values);
+        }
+
+        // replace the same meter (layout changed) or the least recently used
+        if (memcmp(plan->data, frame->data, 8) == 0 && plan->data_size == frame->data_size)
+        {
+            victim = slot;
+            break;
+        }
+
+        if (plan->last_used < cache->slot[victim]->last_used)
+        {
+            victim = slot;
+        }
+    }
+
+    cache->misses++;
+
+    if ((plan = mbus_decode_plan_new(frame)) == NULL)
+    {
+        return -1;
+    }
+
+    mbus_decode_plan_free(cache->slot[victim]);
+    cache->slot[victim] = plan;
+    plan->last_used = cache->clock;
+
+    return mbus_decode_plan_execute(plan, frame, values, max_values);
+}
@@ -0,0 +1,160 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-plan.h
+ *
+ * @brief  Decode plans for variable data telegrams with a fixed record layout.
+ *
+ * A meter sends the same DIF/DIFE/VIF/VIFE layout in every telegram, only
+ * the values change. A decode plan holds the result of the VIF lookups
+ * (unit, exponent, function, storage number, tariff, device) and the data
+ * offset of every record, so that further telegrams with the same layout
+ * are decoded by reading the values at the known offsets.
+ *
+ * The plan cache is keyed by the secondary address (identification number,
+ * manufacturer, version and medium) and the data length. A cached plan is
+ * only used when all bytes of the telegram except the values (DIB, VIB,
+ * LVAR and filler bytes) are identical to the telegram the plan was built
+ * from, otherwise the plan is rebuilt.
+ */
+
+#ifndef MBUS_PLAN_H
+#define MBUS_PLAN_H
+
+#include "mbus-protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_PLAN_CACHE_PROBE  4   /**< slots searched per lookup */
+
+/**
+ * Decode step of a single record
+ */
+typedef struct _mbus_decode_step {
+
+    unsigned char dif;          // DIF, selects the value decoder
+    unsigned char decode;       // non-zero when the value is decoded
+    unsigned char offset;       // data offset in the frame data
+    unsigned char data_len;     // data length, including LVAR
+
+    mbus_record_value value;    // unit, exponent, VIF code, function, ...
+
+} mbus_decode_step;
+
+/**
+ * Decode plan of a telegram layout
+ */
+typedef struct _mbus_decode_plan {
+
+    unsigned char data[MBUS_FRAME_DATA_LENGTH]; // telegram the plan was built from
+    size_t data_size;
+
+    mbus_decode_step *step;
+    size_t nsteps;
+
+    unsigned long last_used;    // cache replacement
+
+} mbus_decode_plan;
+
+/**
+ * Cache of decode plans
+ */
+typedef struct _mbus_decode_plan_cache {
+
+    mbus_decode_plan **slot;
+    size_t size;
+
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+
+} mbus_decode_plan_cache;
+
+/**
+ * Build the decode plan of a variable data frame.
+ *
+ * @param frame  variable data frame
+ *
+ * @return newly allocated plan, NULL on error. Use #mbus_decode_plan_free.
+ */
+mbus_decode_plan *mbus_decode_plan_new(mbus_frame *frame);
+
+/**
+ * Free a decode plan.
+ *
+ * @param plan  decode plan
+ */
+void mbus_decode_plan_free(mbus_decode_plan *plan);
+
+/**
+ * Check whether a frame has the record layout of a plan.
+ *
+ * @param plan   decode plan
+ * @param frame  variable data frame
+ *
+ * @return non-zero when the plan applies to the frame
+ */
+int mbus_decode_plan_match(mbus_decode_plan *plan, mbus_frame *frame);
+
+/**
+ * Decode the records of a frame with a plan, the frame has to match the
+ * plan (see #mbus_decode_plan_match).
+ *
+ * Values are the same as from #mbus_data_record_decode_typed, except that
+ * string, binary and date payloads point into the frame data.
+ *
+ * @param plan        decode plan
+ * @param frame       variable data frame
+ * @param values      decoded values, one per record
+ * @param max_values  size of the values array
+ *
+ * @return number of records (can exceed max_values), -1 on error
+ */
+int mbus_decode_plan_execute(mbus_decode_plan *plan, mbus_frame *frame,
+                             mbus_record_value *values, size_t max_values);
+
+/**
+ * Allocate a plan cache.
+ *
+ * @param size  number of cached plans
+ *
+ * @return newly allocated cache, NULL on error. Use #mbus_decode_plan_cache_free.
+ */
+mbus_decode_plan_cache *mbus_decode_plan_cache_new(size_t size);
+
+/**
+ * Free a plan cache and all cached plans.
+ *
+ * @param cache  plan cache
+ */
+void mbus_decode_plan_cache_free(mbus_decode_plan_cache *cache);
+
+/**
+ * Decode a variable data frame through the plan cache. The plan of the
+ * meter is built on the first telegram and when the layout changes.
+ *
+ * @param cache       plan cache
+ * @param frame       variable data frame
+ * @param header      decoded variable data header (may be NULL)
+ * @param values      decoded values, one per record
+ * @param max_values  size of the values array
+ *
+ * @return number of records (can exceed max_values), -1 on error
+ */
+int mbus_decode_plan_cache_decode(mbus_decode_plan_cache *cache, mbus_frame *frame,
+                                  mbus_data_variable_header *header,
+                                  mbus_record_value *values, size_t max_values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_PLAN_H */
@@ -14,6 +14,10 @@
 #include "mbus-protocol-aux.h"
 #include "mbus-serial.h"
 #include "mbus-tcp.h"
+#include "mbus-loopback.h"
+#include "mbus-stats-internal.h"
+#include "mbus-capture.h"
+#include "mbus-trace.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -788,7 +792,8 @@ void mbus_register_abort_scan_check(mbus_handle *handle, bool (*abort_scan_check
     handle->abort_scan_check = abort_scan_check;
 }
 
-int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, double *value_out, char **quantity_out)
+static int
+mbus_fixed_normalize_interned(int medium_unit, long medium_value, const char **unit_out, double *value_out, const char **quantity_out)
 {
     medium_unit = medium_unit & 0x3F;
 
@@ -801,12 +806,12 @@ int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, do
     switch (medium_unit)
     {
         case 0x00:
-            *unit_out = strdup("h,m,s"); /*  todo convert to unix time... */
-            *quantity_out = strdup("Time");
+            *unit_out = "h,m,s"; /*  todo convert to unix time... */
+            *quantity_out = "Time";
             break;
         case 0x01:
-            *unit_out = strdup("D,M,Y"); /*  todo convert to unix time... */
-            *quantity_out = strdup("Time");
+            *unit_out = "D,M,Y"; /*  todo convert to unix time... */
+            *quantity_out = "Time";
             break;
 
     default:
@@ -814,15 +819,15 @@ int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, do
         {
             if (fixed_table[i].vif == medium_unit)
             {
-                *unit_out = strdup(fixed_table[i].unit);
+                *unit_out = fixed_table[i].unit;
                 *value_out = ((double) (medium_value)) * fixed_table[i].exponent;
-                *quantity_out = strdup(fixed_table[i].quantity);
+                *quantity_out = fixed_table[i].quantity;
                 return 0;
             }
         }
 
-        *unit_out = strdup("Unknown");
-        *quantity_out = strdup("Unknown");
+        *unit_out = "Unknown";
+        *quantity_out = "Unknown";
         *value_out = 0.0;
         return -1;
     }
@@ -831,11 +836,32 @@ int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, do
 }
 
 
+int mbus_fixed_normalize(int medium_unit, long medium_value, char **unit_out, double *value_out, char **quantity_out)
+{
+    const char *unit = NULL, *quantity = NULL;
+    int result;
+
+    if (unit_out == NULL || value_out == NULL || quantity_out == NULL)
+    {
+        MBUS_ERROR("%s: Invalid parameter.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    result = mbus_fixed_normalize_interned(medium_unit, medium_value, &unit, value_out, &quantity);
+
+    if (unit)
+        *unit_out = strdup(unit);
+    if (quantity)
+        *quantity_out = strdup(quantity);
+
+    return result;
+}
+
+
 int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real, char **value_out_str, int *value_out_str_size)
 {
     int result = 0;
     unsigned char vif, vife;
-    struct tm time;
     int value_out_int;
     long long value_out_long_long;
     *value_out_real = 0.0;
@@ -872,16 +898,12 @@ int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real,
                 // E110 1100  Time Point (date)
                 if (vif == 0x6C)
                 {
-                    mbus_data_tm_decode(&time, record->data, 2);
                     if ((*value_out_str = (char*) malloc(11)) == NULL)
                     {
                         MBUS_ERROR("Unable to allocate memory");
                         return -1;
                     }
-                    *value_out_str_size = snprintf(*value_out_str, 11, "%04d-%02d-%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday);
+                    *value_out_str_size = mbus_data_time_iso(record->data, 2, 0, *value_out_str, 11);
                     result = 0;
                 }
                 else  // normal integer
@@ -904,19 +926,12 @@ int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real,
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
                 {
-                    mbus_data_tm_decode(&time, record->data, 4);
                     if ((*value_out_str = (char*) malloc(21)) == NULL)
                     {
                         MBUS_ERROR("Unable to allocate memory");
                         return -1;
                     }
-                    *value_out_str_size = snprintf(*value_out_str, 21, "%04d-%02d-%02dT%02d:%02d:%02dZ",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
+                    *value_out_str_size = mbus_data_time_iso(record->data, 4, 1, *value_out_str, 21);
                     result = 0;
                 }
                 else  // normal integer
@@ -939,19 +954,12 @@ int mbus_variable_value_decode(mbus_data_record *record, double *value_out_real,
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
                 {
-                    mbus_data_tm_decode(&time, record->data, 6);
                     if ((*value_out_str = (char*) malloc(21)) == NULL)
                     {
                         MBUS_ERROR("Unable to allocate memory");
                         return -1;
                     }
-                    *value_out_str_size = snprintf(*value_out_str, 21, "%04d-%02d-%02dT%02d:%02d:%02dZ",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
+                    *value_out_str_size = mbus_data_time_iso(record->data, 6, 1, *value_out_str, 21);
                     result = 0;
                 }
                 else  // normal integer
@@ -1175,6 +1183,94 @@ mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Look up the normalized unit and quantity of a VIB without allocating. The
+/// normalized value is value * factor_out + offset_out, the same result as
+/// mbus_vib_unit_normalize. Returned strings are static or point into vib.
+//------------------------------------------------------------------------------
+int
+mbus_vib_unit_lookup_normalized(mbus_value_information_block *vib, const char **unit_out,
+                                double *factor_out, double *offset_out, const char **quantity_out)
+{
+    unsigned code;
+    int i;
+
+    if (vib == NULL || unit_out == NULL || factor_out == NULL || offset_out == NULL || quantity_out == NULL)
+    {
+        return -1;
+    }
+
+    *factor_out = 1.0;
+    *offset_out = 0.0;
+
+    if (vib->vif == 0xFD || vib->vif == 0xFB) /* VIF extention: see table 8.4.4 a and b */
+    {
+        if (vib->nvife == 0)
+        {
+            return -1;
+        }
+
+        code = ((vib->vife[0]) & MBUS_DIB_VIF_WITHOUT_EXTENSION) | ((vib->vif == 0xFD) ? 0x100 : 0x200);
+    }
+    else if ((vib->vif == 0x7C) ||
+             (vib->vif == 0xFC))
+    {
+        // custom VIF
+        *unit_out = "-";
+        *quantity_out = (const char *) vib->custom_vif;
+        code = 0xFFF;
+    }
+    else
+    {
+        code = (vib->vif) & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+    }
+
+    if (code != 0xFFF)
+    {
+        for (i = 0; vif_table[i].vif < 0xfff; ++i)
+        {
+            if (vif_table[i].vif == code)
+            {
+                break;
+            }
+        }
+
+        if (vif_table[i].vif >= 0xfff)
+        {
+            *unit_out = "Unknown";
+            *quantity_out = "Unknown";
+            *factor_out = 0.0;
+            return -1;
+        }
+
+        *unit_out = vif_table[i].unit;
+        *quantity_out = vif_table[i].quantity;
+        *factor_out = vif_table[i].exponent;
+    }
+
+    if ((vib->vif & MBUS_DIB_VIF_EXTENSION_BIT) &&
+        (vib->vif != 0xFD) &&
+        (vib->vif != 0xFB))                       /* codes for VIF extention: see table 8.4.5 */
+    {
+        code = (vib->vife[0]) & 0x7f;
+
+        if (code >= 0x70 && code <= 0x77)         /* Multiplicative correction factor: 10^nnn-6 */
+        {
+            *factor_out *= pow(10.0, (vib->vife[0] & 0x07) - 6);
+        }
+        else if (code >= 0x78 && code <= 0x7B)    /* Additive correction constant: 10^nn-3 unit of VIF (offset) */
+        {
+            *offset_out = pow(10.0, (vib->vife[0] & 0x03) - 3);
+        }
+        else if (code == 0x7D)                    /* Multiplicative correction factor: 10^3 */
+        {
+            *factor_out *= 1000.0;
+        }
+    }
+
+    return 0;
+}
+
 
 mbus_record *
 mbus_record_new()
@@ -1195,6 +1291,9 @@ mbus_record_new()
     record->device = -1;
     record->tariff = -1;
     record->storage_number = 0;
+    record->flags = 0;
+    memset(&(record->first_byte), 0, sizeof(mbus_timestamp));
+    memset(&(record->last_byte), 0, sizeof(mbus_timestamp));
     return record;
 }
 
@@ -1210,19 +1309,19 @@ mbus_record_free(mbus_record * rec)
             (rec->value).str_val.value = NULL;
         }
 
-        if (rec->unit)
+        if (rec->unit && !(rec->flags & MBUS_RECORD_STATIC_UNIT))
         {
             free(rec->unit);
             rec->unit = NULL;
         }
 
-        if (rec->function_medium)
+        if (rec->function_medium && !(rec->flags & MBUS_RECORD_STATIC_FUNCTION))
         {
             free(rec->function_medium);
             rec->function_medium = NULL;
         }
 
-        if (rec->quantity)
+        if (rec->quantity && !(rec->flags & MBUS_RECORD_STATIC_QUANTITY))
         {
             free(rec->quantity);
             rec->quantity = NULL;
@@ -1232,10 +1331,15 @@ mbus_record_free(mbus_record * rec)
 }
 
 
-mbus_record *
-mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
+//------------------------------------------------------------------------------
+/// Create a fixed data record, with interned strings the unit, function and
+/// quantity point into static tables.
+//------------------------------------------------------------------------------
+static mbus_record *
+mbus_parse_fixed_record_strings(char status_byte, char medium_unit, unsigned char *data, int interned)
 {
     long value = 0;
+    int result;
     mbus_record * record = NULL;
 
     if (!(record = mbus_record_new()))
@@ -1244,8 +1348,15 @@ mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
         return NULL;
     }
 
-    /* shared/static memory - get own copy */
-    record->function_medium = strdup(mbus_data_fixed_function((int)status_byte));  /* stored / actual */
+    if (interned)
+    {
+        record->function_medium = (char *) mbus_data_fixed_function((int)status_byte);  /* stored / actual */
+        record->flags |= MBUS_RECORD_STATIC_FUNCTION;
+    }
+    else
+    {
+        record->function_medium = strdup(mbus_data_fixed_function((int)status_byte));
+    }
 
     if (record->function_medium == NULL)
     {
@@ -1265,7 +1376,19 @@ mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
 
     record->unit = NULL;
     record->is_numeric = 1;
-    if (0 != mbus_fixed_normalize(medium_unit, value, &(record->unit), &(record->value.real_val), &(record->quantity)))
+
+    if (interned)
+    {
+        record->flags |= MBUS_RECORD_STATIC_UNIT | MBUS_RECORD_STATIC_QUANTITY;
+        result = mbus_fixed_normalize_interned(medium_unit, value, (const char **) &(record->unit),
+                                               &(record->value.real_val), (const char **) &(record->quantity));
+    }
+    else
+    {
+        result = mbus_fixed_normalize(medium_unit, value, &(record->unit), &(record->value.real_val), &(record->quantity));
+    }
+
+    if (result != 0)
     {
         MBUS_ERROR("Problem with mbus_fixed_normalize.\n");
         mbus_record_free(record);
@@ -1277,13 +1400,34 @@ mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
 
 
 mbus_record *
-mbus_parse_variable_record(mbus_data_record *data)
+mbus_parse_fixed_record(char status_byte, char medium_unit, unsigned char *data)
+{
+    return mbus_parse_fixed_record_strings(status_byte, medium_unit, data, 0);
+}
+
+
+mbus_record *
+mbus_parse_fixed_record_interned(char status_byte, char medium_unit, unsigned char *data)
+{
+    return mbus_parse_fixed_record_strings(status_byte, medium_unit, data, 1);
+}
+
+
+//------------------------------------------------------------------------------
+/// Create a variable data record, with interned strings the unit, function
+/// and quantity point into static tables.
+//------------------------------------------------------------------------------
+static mbus_record *
+mbus_parse_variable_record_strings(mbus_data_record *data, int interned)
 {
     mbus_record * record = NULL;
     double value_out_real    = 0.0;  /**< raw value */
     char * value_out_str     = NULL;
     int    value_out_str_size = 0;
     double real_val         = 0.0;  /**< normalized value */
+    double factor, offset;
+    const char *function_medium, *unit = NULL, *quantity = NULL;
+    int result;
 
     if (data == NULL)
     {
@@ -1300,17 +1444,23 @@ mbus_parse_variable_record(mbus_data_record *data)
     record->storage_number = mbus_data_record_storage_number(data);
     record->tariff = mbus_data_record_tariff(data);
     record->device = mbus_data_record_device(data);
+    record->first_byte = data->first_byte;
+    record->last_byte = data->last_byte;
 
     if ((data->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) ||
         (data->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)) /* MBUS_DIB_DIF_VENDOR_SPECIFIC */
     {
-        if (data->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+        function_medium = (data->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW) ?
+                          "More records follow" : "Manufacturer specific";
+
+        if (interned)
         {
-            record->function_medium = strdup("More records follow");
+            record->function_medium = (char *) function_medium;
+            record->flags |= MBUS_RECORD_STATIC_FUNCTION;
         }
         else
         {
-            record->function_medium = strdup("Manufacturer specific");
+            record->function_medium = strdup(function_medium);
         }
 
         if (record->function_medium == NULL)
@@ -1344,7 +1494,15 @@ mbus_parse_variable_record(mbus_data_record *data)
     }
     else
     {
-        record->function_medium = strdup(mbus_data_record_function(data));
+        if (interned)
+        {
+            record->function_medium = (char *) mbus_data_record_function(data);
+            record->flags |= MBUS_RECORD_STATIC_FUNCTION;
+        }
+        else
+        {
+            record->function_medium = strdup(mbus_data_record_function(data));
+        }
 
         if (record->function_medium == NULL)
         {
@@ -1363,7 +1521,31 @@ mbus_parse_variable_record(mbus_data_record *data)
         }
         MBUS_DEBUG("value_out_real = %lf \n", value_out_real);
 
-        if (mbus_vib_unit_normalize(&(data->drh.vib), value_out_real, &(record->unit), &real_val, &(record->quantity)) != 0)
+        if (interned)
+        {
+            result = mbus_vib_unit_lookup_normalized(&(data->drh.vib), &unit, &factor, &offset, &quantity);
+            real_val = value_out_real * factor + offset;
+
+            record->unit = (char *) unit;
+            record->flags |= MBUS_RECORD_STATIC_UNIT;
+
+            /* custom VIF text is part of the record, not of a static table */
+            if (quantity == (const char *) data->drh.vib.custom_vif)
+            {
+                record->quantity = strdup(quantity);
+            }
+            else
+            {
+                record->quantity = (char *) quantity;
+                record->flags |= MBUS_RECORD_STATIC_QUANTITY;
+            }
+        }
+        else
+        {
+            result = mbus_vib_unit_normalize(&(data->drh.vib), value_out_real, &(record->unit), &real_val, &(record->quantity));
+        }
+
+        if (result != 0)
         {
             MBUS_ERROR("%s: problem with mbus_vib_unit_normalize\n", __PRETTY_FUNCTION__);
             mbus_record_free(record);
@@ -1389,117 +1571,359 @@ mbus_parse_variable_record(mbus_data_record *data)
     return record;
 }
 
-//------------------------------------------------------------------------------
-/// Generate XML for variable-length data
-//------------------------------------------------------------------------------
-char *
-mbus_data_variable_xml_normalized(mbus_data_variable *data)
+
+mbus_record *
+mbus_parse_variable_record(mbus_data_record *data)
 {
-    mbus_data_record *record;
-    mbus_record *norm_record;
-    char *buff = NULL, *new_buff = NULL;
-    char str_encoded[768] = "";
-    size_t len = 0, buff_size = 8192;
+    return mbus_parse_variable_record_strings(data, 0);
+}
+
+
+mbus_record *
+mbus_parse_variable_record_interned(mbus_data_record *data)
+{
+    return mbus_parse_variable_record_strings(data, 1);
+}
+
+
+int
+mbus_record_index_build(mbus_record_index *index, mbus_frame *frame)
+{
+    mbus_data_record data;
     size_t i;
 
-    if (data)
+    if (index == NULL || frame == NULL)
     {
-        buff = (char*) malloc(buff_size);
+        MBUS_ERROR("%s: Invalid parameter.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    index->frame = frame;
+    index->nrecords = 0;
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    if (mbus_data_variable_header_parse(frame, &(index->header)) != 0)
+    {
+        return -1;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    i = MBUS_DATA_VARIABLE_HEADER_LENGTH;
 
-        len += snprintf(&buff[len], buff_size - len, "%s", mbus_data_variable_header_xml(&(data->header)));
+    while (i < frame->data_size)
+    {
+        // Skip filler dif=2F
+        if ((frame->data[i] & 0xFF) == MBUS_DIB_DIF_IDLE_FILLER)
+        {
+            i++;
+            continue;
+        }
 
-        for (record = data->record, i = 0; record; record = record->next, i++)
+        if (index->nrecords >= MBUS_RECORD_INDEX_SIZE)
         {
-            norm_record = mbus_parse_variable_record(record);
+            MBUS_ERROR("%s: too many records.\n", __PRETTY_FUNCTION__);
+            return -1;
+        }
 
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+        index->entry[index->nrecords].offset = i;
+        index->entry[index->nrecords].record = NULL;
 
-                if (new_buff == NULL)
-                {
-                    mbus_record_free(norm_record);
-                    free(buff);
-                    return NULL;
-                }
+        if (mbus_data_variable_record_parse(frame, &i, &data) != 0)
+        {
+            return -1;
+        }
 
-                buff = new_buff;
-            }
+        index->nrecords++;
+    }
 
-            len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"%zu\">\n", i);
+    return index->nrecords;
+}
 
-            if (norm_record != NULL)
-            {
-                mbus_str_xml_encode(str_encoded, norm_record->function_medium, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
 
-                len += snprintf(&buff[len], buff_size - len, "        <StorageNumber>%ld</StorageNumber>\n", norm_record->storage_number);
+int
+mbus_record_index_data_record(mbus_record_index *index, size_t n, mbus_data_record *record)
+{
+    size_t offset;
 
-                if (norm_record->tariff >= 0)
-                {
-                    len += snprintf(&buff[len], buff_size - len, "        <Tariff>%ld</Tariff>\n", norm_record->tariff);
-                    len += snprintf(&buff[len], buff_size - len, "        <Device>%d</Device>\n", norm_record->device);
-                }
+    if (index == NULL || record == NULL || n >= index->nrecords)
+    {
+        MBUS_ERROR("%s: Invalid record.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
 
-                mbus_str_xml_encode(str_encoded, norm_record->unit, sizeof(str_encoded));
+    offset = index->entry[n].offset;
 
-                len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
+    return mbus_data_variable_record_parse(index->frame, &offset, record);
+}
 
-                mbus_str_xml_encode(str_encoded, norm_record->quantity, sizeof(str_encoded));
-                len += snprintf(&buff[len], buff_size - len, "        <Quantity>%s</Quantity>\n", str_encoded);
 
+mbus_record *
+mbus_record_index_get(mbus_record_index *index, size_t n)
+{
+    mbus_data_record data;
 
-                if (norm_record->is_numeric)
-                {
-                    len += snprintf(&buff[len], buff_size - len, "        <Value>%f</Value>\n", norm_record->value.real_val);
-                }
-                else
-                {
-                    mbus_str_xml_encode(str_encoded, norm_record->value.str_val.value, sizeof(str_encoded));
-                    len += snprintf(&buff[len], buff_size - len, "        <Value>%s</Value>\n", str_encoded);
-                }
+    if (index == NULL || n >= index->nrecords)
+    {
+        MBUS_ERROR("%s: Invalid record.\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
 
-                mbus_record_free(norm_record);
+    if (index->entry[n].record == NULL &&
+        mbus_record_index_data_record(index, n, &data) == 0)
+    {
+        index->entry[n].record = mbus_parse_variable_record(&data);
+    }
+
+    return index->entry[n].record;
+}
+
+
+void
+mbus_record_index_free(mbus_record_index *index)
+{
+    size_t n;
+
+    if (index)
+    {
+        for (n = 0; n < index->nrecords; n++)
+        {
+            mbus_record_free(index->entry[n].record);
+            index->entry[n].record = NULL;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for normalized variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_xml_normalized_sink(mbus_sink *sink, mbus_data_variable *data)
+{
+    mbus_data_record *record;
+    mbus_record *norm_record;
+    char iso[MBUS_TIMESTAMP_ISO_SIZE];
+    size_t i;
+
+    if (sink == NULL || data == NULL)
+    {
+        return -1;
+    }
+
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
+
+    mbus_sink_puts(sink, "<MBusData>\n\n");
+
+    mbus_data_variable_header_xml_sink(sink, &(data->header));
+
+    for (record = data->record, i = 0; record; record = record->next, i++)
+    {
+        // the record only lives until its XML is written
+        norm_record = mbus_parse_variable_record_interned(record);
+
+        mbus_sink_printf(sink, "    <DataRecord id=\"%zu\">\n", i);
+
+        if (norm_record != NULL)
+        {
+            mbus_sink_puts(sink, "        <Function>");
+            mbus_sink_xml_encode(sink, norm_record->function_medium, 768);
+            mbus_sink_puts(sink, "</Function>\n");
+
+            mbus_sink_printf(sink, "        <StorageNumber>%ld</StorageNumber>\n", norm_record->storage_number);
+
+            if (norm_record->tariff >= 0)
+            {
+                mbus_sink_printf(sink, "        <Tariff>%ld</Tariff>\n", norm_record->tariff);
+                mbus_sink_printf(sink, "        <Device>%d</Device>\n", norm_record->device);
+            }
+
+            mbus_sink_puts(sink, "        <Unit>");
+            mbus_sink_xml_encode(sink, norm_record->unit, 768);
+            mbus_sink_puts(sink, "</Unit>\n");
+
+            mbus_sink_puts(sink, "        <Quantity>");
+            mbus_sink_xml_encode(sink, norm_record->quantity, 768);
+            mbus_sink_puts(sink, "</Quantity>\n");
+
+            if (norm_record->is_numeric)
+            {
+                mbus_sink_printf(sink, "        <Value>%f</Value>\n", norm_record->value.real_val);
             }
             else
             {
+                mbus_sink_puts(sink, "        <Value>");
+                mbus_sink_xml_encode(sink, norm_record->value.str_val.value, 768);
+                mbus_sink_puts(sink, "</Value>\n");
             }
 
-            len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
-        }
+            if (mbus_timestamp_iso(&(norm_record->first_byte), iso, sizeof(iso)) > 0)
+            {
+                mbus_sink_printf(sink, "        <FirstByte monotonic=\"%llu\">%s</FirstByte>\n",
+                                 (unsigned long long) norm_record->first_byte.monotonic_ns, iso);
+            }
 
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+            if (mbus_timestamp_iso(&(norm_record->last_byte), iso, sizeof(iso)) > 0)
+            {
+                mbus_sink_printf(sink, "        <LastByte monotonic=\"%llu\">%s</LastByte>\n",
+                                 (unsigned long long) norm_record->last_byte.monotonic_ns, iso);
+            }
+
+            mbus_record_free(norm_record);
+        }
 
-        return buff;
+        mbus_sink_puts(sink, "    </DataRecord>\n\n");
     }
 
-    return NULL;
+    mbus_sink_puts(sink, "</MBusData>\n");
+
+    return mbus_sink_flush(sink);
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an XML representation of the M-BUS frame data.
+/// Generate XML for variable-length data
 //------------------------------------------------------------------------------
 char *
-mbus_frame_data_xml_normalized(mbus_frame_data *data)
+mbus_data_variable_xml_normalized(mbus_data_variable *data)
+{
+    mbus_sink sink;
+
+    if (data == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
+
+    if (mbus_data_variable_xml_normalized_sink(&sink, data) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+/// Write an XML representation of the normalized M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_xml_normalized_sink(mbus_sink *sink, mbus_frame_data *data)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_xml(&(data->data_fix));
+            return mbus_data_fixed_xml_sink(sink, &(data->data_fix));
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_xml_normalized(&(data->data_var));
+            return mbus_data_variable_xml_normalized_sink(sink, &(data->data_var));
+        }
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/// Return a string containing an XML representation of the M-BUS frame data.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_data_xml_normalized(mbus_frame_data *data)
+{
+    mbus_sink sink;
+
+    if (data == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
+
+    if (mbus_frame_data_xml_normalized_sink(&sink, data) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+// Transport registry, the built-in transports come first
+//------------------------------------------------------------------------------
+static const mbus_transport mbus_transport_serial = {
+    "serial", MBUS_HANDLE_TYPE_SERIAL,
+    mbus_serial_connect, mbus_serial_disconnect,
+    mbus_serial_send_frame, mbus_serial_send_raw, mbus_serial_recv_frame,
+    mbus_serial_data_free, mbus_serial_set_option
+};
+
+static const mbus_transport mbus_transport_tcp = {
+    "tcp", MBUS_HANDLE_TYPE_TCP,
+    mbus_tcp_connect, mbus_tcp_disconnect,
+    mbus_tcp_send_frame, mbus_tcp_send_raw, mbus_tcp_recv_frame,
+    mbus_tcp_data_free, mbus_tcp_set_option
+};
+
+static const mbus_transport mbus_transport_loopback = {
+    "loopback", MBUS_HANDLE_TYPE_LOOPBACK,
+    mbus_loopback_connect, mbus_loopback_disconnect,
+    mbus_loopback_send_frame, mbus_loopback_send_raw, mbus_loopback_recv_frame,
+    mbus_loopback_data_free, NULL
+};
+
+static const mbus_transport mbus_transport_replay = {
+    "replay", MBUS_HANDLE_TYPE_REPLAY,
+    mbus_replay_connect, mbus_replay_disconnect,
+    mbus_replay_send_frame, mbus_replay_send_raw, mbus_replay_recv_frame,
+    mbus_replay_data_free, NULL
+};
+
+static const mbus_transport *mbus_transports[MBUS_TRANSPORT_MAX] = {
+    &mbus_transport_serial,
+    &mbus_transport_tcp,
+    &mbus_transport_loopback,
+    &mbus_transport_replay
+};
+
+static size_t mbus_transport_count = 4;
+
+int
+mbus_transport_register(const mbus_transport *transport)
+{
+    if (transport == NULL || transport->name == NULL ||
+        transport->open == NULL || transport->close == NULL ||
+        transport->send == NULL || transport->recv == NULL)
+    {
+        mbus_error_str_set("Incomplete transport.");
+        return -1;
+    }
+
+    if (mbus_transport_lookup(transport->name) != NULL)
+    {
+        mbus_error_str_set("Transport already registered.");
+        return -1;
+    }
+
+    if (mbus_transport_count >= MBUS_TRANSPORT_MAX)
+    {
+        mbus_error_str_set("Too many transports.");
+        return -1;
+    }
+
+    mbus_transports[mbus_transport_count++] = transport;
+    return 0;
+}
+
+const mbus_transport *
+mbus_transport_lookup(const char *name)
+{
+    size_t i;
+
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < mbus_transport_count; i++)
+    {
+        if (strcmp(mbus_transports[i]->name, name) == 0)
+        {
+            return mbus_transports[i];
         }
     }
 
@@ -1507,49 +1931,76 @@ mbus_frame_data_xml_normalized(mbus_frame_data *data)
 }
 
 mbus_handle *
-mbus_context_serial(const char *device)
+mbus_context_transport(const mbus_transport *transport, void *auxdata)
 {
     mbus_handle *handle;
-    mbus_serial_data *serial_data;
-    char error_str[128];
 
-    if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
+    if (transport == NULL)
     {
-        MBUS_ERROR("%s: Failed to allocate handle.\n", __PRETTY_FUNCTION__);
+        MBUS_ERROR("%s: Invalid transport.\n", __PRETTY_FUNCTION__);
         return NULL;
     }
 
-    if ((serial_data = (mbus_serial_data *)malloc(sizeof(mbus_serial_data))) == NULL)
+    if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
     {
-        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
-        mbus_error_str_set(error_str);
-        free(handle);
+        MBUS_ERROR("%s: Failed to allocate handle.\n", __PRETTY_FUNCTION__);
         return NULL;
     }
 
+    handle->fd = -1;
     handle->max_data_retry = 3;
     handle->max_search_retry = 1;
-    handle->is_serial = 1;
+    handle->is_serial = (transport->type == MBUS_HANDLE_TYPE_SERIAL);
     handle->purge_first_frame = MBUS_FRAME_PURGE_M2S;
-    handle->auxdata = serial_data;
+    handle->transport = transport;
+    handle->auxdata = auxdata;
     handle->userdata = NULL;
-    handle->open = mbus_serial_connect;
-    handle->close = mbus_serial_disconnect;
-    handle->recv = mbus_serial_recv_frame;
-    handle->send = mbus_serial_send_frame;
-    handle->free_auxdata = mbus_serial_data_free;
+    handle->open = transport->open;
+    handle->close = transport->close;
+    handle->recv = transport->recv;
+    handle->send = transport->send;
+    handle->send_raw = transport->send_raw;
+    handle->free_auxdata = transport->free_auxdata;
     handle->recv_event = NULL;
     handle->send_event = NULL;
     handle->scan_progress = NULL;
     handle->found_event = NULL;
     handle->abort_scan_check = NULL;
+    handle->frame_cache = NULL;
+    handle->stats = NULL;
+    handle->capture = NULL;
+    handle->capture_id = 0;
+
+    return handle;
+}
+
+mbus_handle *
+mbus_context_serial(const char *device)
+{
+    mbus_handle *handle;
+    mbus_serial_data *serial_data;
+    char error_str[128];
+
+    if ((serial_data = (mbus_serial_data *)malloc(sizeof(mbus_serial_data))) == NULL)
+    {
+        snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
+        mbus_error_str_set(error_str);
+        return NULL;
+    }
 
+    serial_data->drain = 1;
     if ((serial_data->device = strdup(device)) == NULL)
     {
         snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for device\n", __PRETTY_FUNCTION__);
         mbus_error_str_set(error_str);
         free(serial_data);
-        free(handle);
+        return NULL;
+    }
+
+    if ((handle = mbus_context_transport(&mbus_transport_serial, serial_data)) == NULL)
+    {
+        free(serial_data->device);
+        free(serial_data);
         return NULL;
     }
 
@@ -1563,44 +2014,100 @@ mbus_context_tcp(const char *host, uint16_t port)
     mbus_tcp_data *tcp_data;
     char error_str[128];
 
-    if ((handle = (mbus_handle *) malloc(sizeof(mbus_handle))) == NULL)
-    {
-        MBUS_ERROR("%s: Failed to allocate handle.\n", __PRETTY_FUNCTION__);
-        return NULL;
-    }
-
     if ((tcp_data = (mbus_tcp_data *)malloc(sizeof(mbus_tcp_data))) == NULL)
     {
         snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for handle\n", __PRETTY_FUNCTION__);
         mbus_error_str_set(error_str);
-        free(handle);
         return NULL;
     }
 
-    handle->max_data_retry = 3;
-    handle->max_search_retry = 1;
-    handle->is_serial = 0;
-    handle->purge_first_frame = MBUS_FRAME_PURGE_M2S;
-    handle->auxdata = tcp_data;
-    handle->userdata = NULL;
-    handle->open = mbus_tcp_connect;
-    handle->close = mbus_tcp_disconnect;
-    handle->recv = mbus_tcp_recv_frame;
-    handle->send = mbus_tcp_send_frame;
-    handle->free_auxdata = mbus_tcp_data_free;
-    handle->recv_event = NULL;
-    handle->send_event = NULL;
-    handle->scan_progress = NULL;
-    handle->found_event = NULL;
-    handle->abort_scan_check = NULL;
-
     tcp_data->port = port;
+    tcp_data->addr = NULL;
+    tcp_data->connect_timeout_ms = MBUS_TCP_CONNECT_TIMEOUT_MS;
+    tcp_data->keepalive_idle = MBUS_TCP_KEEPALIVE_IDLE;
+    tcp_data->nodelay = 1;
+    tcp_data->auto_reconnect = 0;
+    tcp_data->reconnect_delay_ms = 0;
+    tcp_data->reconnect_after.tv_sec = 0;
+    tcp_data->reconnect_after.tv_nsec = 0;
     if ((tcp_data->host = strdup(host)) == NULL)
     {
         snprintf(error_str, sizeof(error_str), "%s: failed to allocate memory for host\n", __PRETTY_FUNCTION__);
         mbus_error_str_set(error_str);
         free(tcp_data);
-        free(handle);
+        return NULL;
+    }
+
+    if ((handle = mbus_context_transport(&mbus_transport_tcp, tcp_data)) == NULL)
+    {
+        free(tcp_data->host);
+        free(tcp_data);
+        return NULL;
+    }
+
+    return handle;
+}
+
+mbus_handle *
+mbus_context_loopback(mbus_loopback_responder responder, void *arg)
+{
+    mbus_handle *handle;
+    mbus_loopback_data *loopback_data;
+
+    if (responder == NULL)
+    {
+        MBUS_ERROR("%s: Invalid responder.\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((loopback_data = (mbus_loopback_data *) calloc(1, sizeof(mbus_loopback_data))) == NULL)
+    {
+        MBUS_ERROR("%s: Failed to allocate loopback data.\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    loopback_data->responder = responder;
+    loopback_data->arg = arg;
+
+    if ((handle = mbus_context_transport(&mbus_transport_loopback, loopback_data)) == NULL)
+    {
+        free(loopback_data);
+        return NULL;
+    }
+
+    // nothing is echoed in memory
+    handle->purge_first_frame = MBUS_FRAME_PURGE_NONE;
+
+    return handle;
+}
+
+mbus_handle *
+mbus_context_replay(const char *path, double speed, long id)
+{
+    mbus_handle *handle;
+    mbus_replay_data *replay_data;
+
+    if (path == NULL || speed < 0)
+    {
+        MBUS_ERROR("%s: Invalid capture file or speed.\n", __PRETTY_FUNCTION__);
+        return NULL;
+    }
+
+    if ((replay_data = (mbus_replay_data *) calloc(1, sizeof(mbus_replay_data))) == NULL ||
+        (replay_data->path = strdup(path)) == NULL)
+    {
+        MBUS_ERROR("%s: Failed to allocate replay data.\n", __PRETTY_FUNCTION__);
+        free(replay_data);
+        return NULL;
+    }
+
+    replay_data->speed = speed;
+    replay_data->id = id;
+
+    if ((handle = mbus_context_transport(&mbus_transport_replay, replay_data)) == NULL)
+    {
+        free(replay_data->path);
+        free(replay_data);
         return NULL;
     }
 
@@ -1612,7 +2119,10 @@ mbus_context_free(mbus_handle * handle)
 {
     if (handle)
     {
-        handle->free_auxdata(handle);
+        if (handle->free_auxdata)
+            handle->free_auxdata(handle);
+        free(handle->frame_cache);
+        free(handle->stats);
         free(handle);
     }
 }
@@ -1675,6 +2185,19 @@ mbus_context_set_option(mbus_handle * handle, mbus_context_option option, long v
                 return 0;
             }
             break;
+        case MBUS_OPTION_STATS:
+            return mbus_stats_enable(handle, value != 0);
+        case MBUS_OPTION_TCP_CONNECT_TIMEOUT:
+        case MBUS_OPTION_TCP_NODELAY:
+        case MBUS_OPTION_TCP_KEEPALIVE:
+        case MBUS_OPTION_TCP_AUTO_RECONNECT:
+        case MBUS_OPTION_SERIAL_DRAIN:
+            // transport specific, rejected by the other transports
+            if (handle->transport && handle->transport->set_option)
+            {
+                return handle->transport->set_option(handle, option, value);
+            }
+            break;
     }
 
     return -1; // unable to set option
@@ -1693,6 +2216,35 @@ mbus_context_set_userdata(mbus_handle * handle, void *userdata)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Called by the transports when the first byte of a frame arrives.
+//------------------------------------------------------------------------------
+void
+mbus_recv_first_byte(mbus_handle *handle, mbus_frame *frame)
+{
+    if (frame && frame->first_byte.monotonic_ns == 0)
+    {
+        mbus_timestamp_now(&(frame->first_byte));
+    }
+
+    mbus_stats_first_byte(handle);
+}
+
+static int
+mbus_recv_timed(mbus_handle *handle, mbus_frame *frame)
+{
+    int result;
+
+    memset(&(frame->first_byte), 0, sizeof(mbus_timestamp));
+
+    result = handle->recv(handle, frame);
+
+    // first_byte stays zero for transports without first byte notification
+    mbus_timestamp_now(&(frame->last_byte));
+
+    return result;
+}
+
 int
 mbus_recv_frame(mbus_handle * handle, mbus_frame *frame)
 {
@@ -1710,25 +2262,30 @@ mbus_recv_frame(mbus_handle * handle, mbus_frame *frame)
         return MBUS_RECV_RESULT_ERROR;
     }
 
-    result = handle->recv(handle, frame);
+    result = mbus_recv_timed(handle, frame);
 
     switch (mbus_frame_direction(frame))
     {
         case MBUS_CONTROL_MASK_DIR_M2S:
             if (handle->purge_first_frame == MBUS_FRAME_PURGE_M2S)
-                result = handle->recv(handle, frame);  // purge echo and retry
+            {
+                mbus_stats_echo(handle);
+                result = mbus_recv_timed(handle, frame);  // purge echo and retry
+            }
             break;
         case MBUS_CONTROL_MASK_DIR_S2M:
             if (handle->purge_first_frame == MBUS_FRAME_PURGE_S2M)
-                result = handle->recv(handle, frame);  // purge echo and retry
+            {
+                mbus_stats_echo(handle);
+                result = mbus_recv_timed(handle, frame);  // purge echo and retry
+            }
             break;
     }
 
-    if (frame != NULL)
-    {
-        /* set timestamp to receive time */
-        time(&(frame->timestamp));
-    }
+    mbus_stats_received(handle, result, frame);
+
+    /* set timestamp to receive time */
+    frame->timestamp = (time_t) (frame->last_byte.realtime_ns / 1000000000ULL);
 
     return result;
 }
@@ -1737,6 +2294,7 @@ int mbus_purge_frames(mbus_handle *handle)
 {
     int err, received;
     mbus_frame reply;
+    uint64_t start = mbus_stats_now();
 
     memset((void *)&reply, 0, sizeof(mbus_frame));
 
@@ -1751,19 +2309,332 @@ int mbus_purge_frames(mbus_handle *handle)
         received = 1;
     }
 
+    mbus_stats_purged(handle, start);
+
     return received;
 }
 
 int
 mbus_send_frame(mbus_handle * handle, mbus_frame *frame)
 {
+    int ret;
+
+    if (handle == NULL)
+    {
+        MBUS_ERROR("%s: Invalid M-Bus handle for send.\n", __PRETTY_FUNCTION__);
+        return 0;
+    }
+
+    if (frame)
+        MBUS_TRACE3(send_frame, frame->address, frame->control, frame->data_size);
+
+    if ((ret = handle->send(handle, frame)) == 0)
+        mbus_stats_sent_frame(handle, frame);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// Send packed frames through the frame based send of a transport without
+// vectored send, every byte sequence has to hold one complete frame.
+//------------------------------------------------------------------------------
+static int
+mbus_send_raw_frames(mbus_handle * handle, const struct iovec *iov, int iovcnt)
+{
+    mbus_frame frame;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        memset((void *)&frame, 0, sizeof(mbus_frame));
+
+        if (mbus_parse(&frame, (unsigned char *) iov[i].iov_base, iov[i].iov_len) != 0)
+        {
+            MBUS_ERROR("%s: byte sequence %d is no complete frame.\n", __PRETTY_FUNCTION__, i);
+            return -1;
+        }
+
+        if (handle->send(handle, &frame) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int
+mbus_send_raw(mbus_handle * handle, const struct iovec *iov, int iovcnt)
+{
+    int ret, i;
+
     if (handle == NULL)
     {
         MBUS_ERROR("%s: Invalid M-Bus handle for send.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if (iov == NULL || iovcnt <= 0)
+    {
+        MBUS_ERROR("%s: Nothing to send.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    MBUS_TRACE_SEND_RAW(iov, iovcnt);
+
+    if (handle->send_raw)
+    {
+        ret = handle->send_raw(handle, iov, iovcnt);
+
+        //
+        // call the send event function, if the callback function is registered,
+        // the frame based send of the fallback calls it itself
+        //
+        if (ret == 0 && handle->send_event)
+        {
+            for (i = 0; i < iovcnt; i++)
+                handle->send_event(handle->transport ? handle->transport->type : 0,
+                                   iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    else
+        ret = mbus_send_raw_frames(handle, iov, iovcnt);
+
+    if (ret == 0)
+        mbus_stats_sent_raw(handle, iov, iovcnt);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// Send queue: several frames (e.g. a selection followed by REQ_UD2) packed
+// back to back and handed to the transport in one writev/sendmsg call.
+//------------------------------------------------------------------------------
+void
+mbus_send_queue_init(mbus_send_queue *queue)
+{
+    if (queue)
+    {
+        queue->count = 0;
+        queue->used = 0;
+    }
+}
+
+int
+mbus_send_queue_add(mbus_send_queue *queue, mbus_frame *frame)
+{
+    int len;
+
+    if (queue == NULL || frame == NULL)
+        return -1;
+
+    if (queue->count >= MBUS_SEND_QUEUE_LENGTH)
+    {
+        MBUS_ERROR("%s: send queue is full.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((len = mbus_frame_pack(frame, &queue->buff[queue->used], sizeof(queue->buff) - queue->used)) < 0)
+    {
+        MBUS_ERROR("%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    queue->iov[queue->count].iov_base = &queue->buff[queue->used];
+    queue->iov[queue->count].iov_len = len;
+    queue->count++;
+    queue->used += len;
+
+    return 0;
+}
+
+int
+mbus_send_queue_add_raw(mbus_send_queue *queue, const unsigned char *data, size_t len)
+{
+    if (queue == NULL || data == NULL || len == 0)
+        return -1;
+
+    if (queue->count >= MBUS_SEND_QUEUE_LENGTH)
+    {
+        MBUS_ERROR("%s: send queue is full.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    queue->iov[queue->count].iov_base = (void *) data;
+    queue->iov[queue->count].iov_len = len;
+    queue->count++;
+
+    return 0;
+}
+
+int
+mbus_send_queue_flush(mbus_handle * handle, mbus_send_queue *queue)
+{
+    int ret;
+
+    if (queue == NULL)
+        return -1;
+
+    if (queue->count == 0)
         return 0;
+
+    ret = mbus_send_raw(handle, queue->iov, queue->count);
+
+    mbus_send_queue_init(queue);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+// Frame cache: wire bytes of the frames a poller sends over and over again.
+// Short frames are tabulated for every address and request type when the
+// cache is created, selection frames are kept in a small direct-mapped table
+// indexed by a hash of the secondary address.
+//------------------------------------------------------------------------------
+#define MBUS_FRAME_CACHE_SND_NKE      0
+#define MBUS_FRAME_CACHE_REQ_UD2      1
+#define MBUS_FRAME_CACHE_REQ_UD2_FCB  2
+#define MBUS_FRAME_CACHE_SHORT_TYPES  3
+
+#define MBUS_FRAME_CACHE_SELECT_SLOTS 32
+#define MBUS_FRAME_CACHE_SELECT_SIZE  (MBUS_FRAME_LONG_BASE_SIZE + 8)
+
+typedef struct _mbus_frame_cache {
+    unsigned char short_frame[MBUS_FRAME_CACHE_SHORT_TYPES][256][MBUS_FRAME_SHORT_BASE_SIZE];
+    struct {
+        char          address[16];  /**< secondary address (mask), empty slot when zero */
+        unsigned char frame[MBUS_FRAME_CACHE_SELECT_SIZE];
+    } select[MBUS_FRAME_CACHE_SELECT_SLOTS];
+} mbus_frame_cache;
+
+static const unsigned char mbus_frame_cache_control[MBUS_FRAME_CACHE_SHORT_TYPES] = {
+    MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S,
+    MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S,
+    MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S | MBUS_CONTROL_MASK_FCV | MBUS_CONTROL_MASK_FCB
+};
+
+static mbus_frame_cache *
+mbus_frame_cache_get(mbus_handle *handle)
+{
+    mbus_frame_cache *cache;
+    unsigned char *bytes;
+    int type, address;
+
+    if (handle->frame_cache)
+        return handle->frame_cache;
+
+    // without a vectored send the transport can't use the cached bytes
+    if (handle->send_raw == NULL)
+        return NULL;
+
+    if ((cache = (mbus_frame_cache *) calloc(1, sizeof(mbus_frame_cache))) == NULL)
+        return NULL;
+
+    for (type = 0; type < MBUS_FRAME_CACHE_SHORT_TYPES; type++)
+    {
+        for (address = 0; address < 256; address++)
+        {
+            bytes = cache->short_frame[type][address];
+            bytes[0] = MBUS_FRAME_SHORT_START;
+            bytes[1] = mbus_frame_cache_control[type];
+            bytes[2] = address;
+            bytes[3] = (bytes[1] + bytes[2]) & 0xFF;
+            bytes[4] = MBUS_FRAME_STOP;
+        }
+    }
+
+    handle->frame_cache = cache;
+    return cache;
+}
+
+//------------------------------------------------------------------------------
+// Send a short frame, from the cache when the handle supports it.
+//------------------------------------------------------------------------------
+static int
+mbus_send_short_frame(mbus_handle *handle, int type, int address)
+{
+    mbus_frame_cache *cache;
+    mbus_frame *frame;
+    struct iovec iov;
+    int retval;
+
+    if (handle && (cache = mbus_frame_cache_get(handle)) != NULL)
+    {
+        iov.iov_base = cache->short_frame[type][address & 0xFF];
+        iov.iov_len = MBUS_FRAME_SHORT_BASE_SIZE;
+
+        MBUS_TRACE3(send_frame, address & 0xFF, mbus_frame_cache_control[type], 0);
+
+        return mbus_send_raw(handle, &iov, 1);
+    }
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+
+    if (frame == NULL)
+    {
+        MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    frame->control = mbus_frame_cache_control[type];
+    frame->address = address;
+
+    retval = mbus_send_frame(handle, frame);
+
+    mbus_frame_free(frame);
+    return retval;
+}
+
+//------------------------------------------------------------------------------
+// Send a cached selection frame. Returns -2 if the frame can't be served from
+// the cache, the caller then falls back to building the frame.
+//------------------------------------------------------------------------------
+static int
+mbus_frame_cache_send_select(mbus_handle *handle, const char *secondary_addr_str)
+{
+    mbus_frame_cache *cache;
+    mbus_frame frame;
+    struct iovec iov;
+    unsigned int hash;
+    int i, slot;
+
+    if ((cache = mbus_frame_cache_get(handle)) == NULL)
+        return -2;
+
+    if (mbus_is_secondary_address(secondary_addr_str) == 0)
+        return -2;
+
+    hash = 2166136261u;
+    for (i = 0; i < 16; i++)
+    {
+        hash = (hash ^ (unsigned char) secondary_addr_str[i]) * 16777619u;
+    }
+    slot = hash % MBUS_FRAME_CACHE_SELECT_SLOTS;
+
+    if (memcmp(cache->select[slot].address, secondary_addr_str, 16) != 0)
+    {
+        memset((void *)&frame, 0, sizeof(mbus_frame));
+        frame.type   = MBUS_FRAME_TYPE_LONG;
+        frame.start1 = MBUS_FRAME_LONG_START;
+        frame.start2 = MBUS_FRAME_LONG_START;
+        frame.stop   = MBUS_FRAME_STOP;
+
+        if (mbus_frame_select_secondary_pack(&frame, (char*) secondary_addr_str) == -1 ||
+            mbus_frame_pack(&frame, cache->select[slot].frame, MBUS_FRAME_CACHE_SELECT_SIZE) != MBUS_FRAME_CACHE_SELECT_SIZE)
+        {
+            memset(cache->select[slot].address, 0, 16);
+            return -2;
+        }
+
+        memcpy(cache->select[slot].address, secondary_addr_str, 16);
     }
 
-    return handle->send(handle, frame);
+    iov.iov_base = cache->select[slot].frame;
+    iov.iov_len = MBUS_FRAME_CACHE_SELECT_SIZE;
+
+    // control and address field of the packed long frame
+    MBUS_TRACE3(send_frame, cache->select[slot].frame[5], cache->select[slot].frame[4],
+                MBUS_FRAME_CACHE_SELECT_SIZE - MBUS_FRAME_LONG_BASE_SIZE);
+
+    return mbus_send_raw(handle, &iov, 1);
 }
 
 //------------------------------------------------------------------------------
@@ -1775,6 +2646,21 @@ int
 mbus_send_select_frame(mbus_handle * handle, const char *secondary_addr_str)
 {
     mbus_frame *frame;
+    int ret;
+
+    if (handle == NULL)
+    {
+        MBUS_ERROR("%s: Invalid M-Bus handle for send.\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    if ((ret = mbus_frame_cache_send_select(handle, secondary_addr_str)) != -2)
+    {
+        if (ret == -1)
+            MBUS_ERROR("%s: Failed to send mbus frame.\n", __PRETTY_FUNCTION__);
+
+        return ret;
+    }
 
     frame = mbus_frame_new(MBUS_FRAME_TYPE_LONG);
 
@@ -1927,34 +2813,19 @@ mbus_send_application_reset_frame(mbus_handle * handle, int address, int subcode
 int
 mbus_send_request_frame(mbus_handle * handle, int address)
 {
-    int retval = 0;
-    mbus_frame *frame;
-
     if (mbus_is_primary_address(address) == 0)
     {
         MBUS_ERROR("%s: invalid address %d\n", __PRETTY_FUNCTION__, address);
         return -1;
     }
 
-    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
-
-    if (frame == NULL)
-    {
-        MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
-        return -1;
-    }
-
-    frame->control = MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S;
-    frame->address = address;
-
-    if (mbus_send_frame(handle, frame) == -1)
+    if (mbus_send_short_frame(handle, MBUS_FRAME_CACHE_REQ_UD2, address) == -1)
     {
         MBUS_ERROR("%s: failed to send mbus frame.\n", __PRETTY_FUNCTION__);
-        retval = -1;
+        return -1;
     }
 
-    mbus_frame_free(frame);
-    return retval;
+    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -2044,8 +2915,8 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
 {
     int retval = 0, more_frames = 1, retry = 0;
     mbus_frame_data reply_data;
-    mbus_frame *frame, *next_frame;
-    int frame_count = 0, result;
+    mbus_frame *next_frame;
+    int frame_count = 0, result, request;
 
     if (handle == NULL)
     {
@@ -2059,20 +2930,8 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         return 1;
     }
 
-    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
-
-    if (frame == NULL)
-    {
-        MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
-        return -1;
-    }
-
-    frame->control = MBUS_CONTROL_MASK_REQ_UD2 |
-                     MBUS_CONTROL_MASK_DIR_M2S |
-                     MBUS_CONTROL_MASK_FCV     |
-                     MBUS_CONTROL_MASK_FCB;
-
-    frame->address = address;
+    // REQ_UD2 with FCV and FCB set, FCB toggles with every further request
+    request = MBUS_FRAME_CACHE_REQ_UD2_FCB;
 
     //
     // continue to read until no more records are available (usually only one
@@ -2087,6 +2946,7 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         if (retry > handle->max_data_retry)
         {
             // Give up
+            MBUS_TRACE2(sendrecv_give_up, address, retry);
             retval = 1;
             break;
         }
@@ -2094,7 +2954,7 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         if (debug)
             printf("%s: debug: sending request frame\n", __PRETTY_FUNCTION__);
 
-        if (mbus_send_frame(handle, frame) == -1)
+        if (mbus_send_short_frame(handle, request, address) == -1)
         {
             MBUS_ERROR("%s: failed to send mbus frame.\n", __PRETTY_FUNCTION__);
             retval = -1;
@@ -2109,18 +2969,25 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         if (result == MBUS_RECV_RESULT_OK)
         {
             retry = 0;
-            mbus_purge_frames(handle);
+
+            // further frames after the reply, another slave answered too
+            if (mbus_purge_frames(handle))
+                mbus_stats_collision(handle);
         }
         else if (result == MBUS_RECV_RESULT_TIMEOUT)
         {
             MBUS_ERROR("%s: No M-Bus response frame received.\n", __PRETTY_FUNCTION__);
             retry++;
+            mbus_stats_retry(handle);
+            MBUS_TRACE3(sendrecv_retry, address, retry, result);
             continue;
         }
         else if (result == MBUS_RECV_RESULT_INVALID)
         {
             MBUS_ERROR("%s: Received invalid M-Bus response frame.\n", __PRETTY_FUNCTION__);
             retry++;
+            mbus_stats_retry(handle);
+            MBUS_TRACE3(sendrecv_retry, address, retry, result);
             mbus_purge_frames(handle);
             continue;
         }
@@ -2180,7 +3047,8 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
                 next_frame = next_frame->next;
 
                 // toogle FCB bit
-                frame->control ^= MBUS_CONTROL_MASK_FCB;
+                request = (request == MBUS_FRAME_CACHE_REQ_UD2_FCB) ?
+                          MBUS_FRAME_CACHE_REQ_UD2 : MBUS_FRAME_CACHE_REQ_UD2_FCB;
             }
             else
             {
@@ -2196,7 +3064,6 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
         }
     }
 
-    mbus_frame_free(frame);
     return retval;
 }
 
@@ -2207,30 +3074,15 @@ mbus_sendrecv_request(mbus_handle *handle, int address, mbus_frame *reply, int m
 int
 mbus_send_ping_frame(mbus_handle *handle, int address, char purge_response)
 {
-    int retval = 0;
-    mbus_frame *frame;
-
     if (mbus_is_primary_address(address) == 0)
     {
         MBUS_ERROR("%s: invalid address %d\n", __PRETTY_FUNCTION__, address);
         return 1;
     }
 
-    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
-
-    if (frame == NULL)
-    {
-        MBUS_ERROR("%s: failed to allocate mbus frame.\n", __PRETTY_FUNCTION__);
-        return -1;
-    }
-
-    frame->control  = MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S;
-    frame->address  = address;
-
-    if (mbus_send_frame(handle, frame) == -1)
+    if (mbus_send_short_frame(handle, MBUS_FRAME_CACHE_SND_NKE, address) == -1)
     {
         MBUS_ERROR("%s: failed to send mbus frame.\n", __PRETTY_FUNCTION__);
-        mbus_frame_free(frame);
         return -1;
     }
 
@@ -2239,8 +3091,7 @@ mbus_send_ping_frame(mbus_handle *handle, int address, char purge_response)
         mbus_purge_frames(handle);
     }
 
-    mbus_frame_free(frame);
-    return retval;
+    return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -2279,6 +3130,7 @@ mbus_select_secondary_address(mbus_handle * handle, const char *mask)
     {
         /* check for more data (collision) */
         mbus_purge_frames(handle);
+        mbus_stats_collision(handle);
         return MBUS_PROBE_COLLISION;
     }
 
@@ -2287,6 +3139,7 @@ mbus_select_secondary_address(mbus_handle * handle, const char *mask)
         /* check for more data (collision) */
         if (mbus_purge_frames(handle))
         {
+            mbus_stats_collision(handle);
             return MBUS_PROBE_COLLISION;
         }
 
@@ -2342,12 +3195,14 @@ mbus_probe_secondary_address(mbus_handle *handle, const char *mask, char *matchi
             {
                 /* check for more data (collision) */
                 mbus_purge_frames(handle);
+                mbus_stats_collision(handle);
                 return MBUS_PROBE_COLLISION;
             }
 
             /* check for more data (collision) */
             if (mbus_purge_frames(handle))
             {
+                mbus_stats_collision(handle);
                 return MBUS_PROBE_COLLISION;
             }
 
@@ -2545,6 +3400,8 @@ mbus_scan_2nd_address_range_internal(mbus_handle * handle, int pos, const char *
 
             probe_ret = mbus_probe_secondary_address(handle, mask, matching_mask);
 
+            MBUS_TRACE2(scan_probe, mask, probe_ret);
+
             if (probe_ret == MBUS_PROBE_SINGLE)
             {
                 if (!handle->found_event)
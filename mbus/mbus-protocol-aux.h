@@ -23,6 +23,8 @@
  * mbus_handle = mbus_context_serial(device);
  *   or
  * mbus_handle = mbus_context_tcp(host, port);
+ *   or
+ * mbus_handle = mbus_context_loopback(responder, arg); // in-memory, for tests
  *
  * mbus_context_set_option(mbus_handle,option,value); // optional
  *
@@ -68,6 +70,7 @@
 #include "mbus-protocol.h"
 
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -82,6 +85,14 @@ extern "C" {
 #define MBUS_FRAME_PURGE_M2S  1
 #define MBUS_FRAME_PURGE_NONE 0
 
+#define MBUS_FRAME_PACKED_MAX_SIZE (MBUS_FRAME_LONG_BASE_SIZE + MBUS_FRAME_DATA_LENGTH)
+#define MBUS_SEND_QUEUE_LENGTH     8
+
+struct _mbus_frame_cache;
+struct _mbus_transport;
+struct _mbus_stats_state;
+struct _mbus_capture;
+
 /**
  * Unified MBus handle type encapsulating either Serial or TCP gateway.
  */
@@ -101,10 +112,30 @@ typedef struct _mbus_handle {
     void (*scan_progress) (struct _mbus_handle *handle, const char *mask);
     void (*found_event) (struct _mbus_handle *handle, mbus_frame *frame);    
     bool (*abort_scan_check) (struct _mbus_handle *handle);
+    const struct _mbus_transport *transport; /**< transport the handle was created for */
     void *auxdata;
     void *userdata; /**< User‑managed pointer for callback context */
+    struct _mbus_frame_cache *frame_cache; /**< pre-packed request frames (allocated on first use) */
+    struct _mbus_stats_state *stats; /**< traffic statistics, NULL unless enabled with MBUS_OPTION_STATS */
+    struct _mbus_capture *capture; /**< capture recording the traffic, see mbus_capture_attach */
+    uint32_t capture_id; /**< id of the handle in the capture */
+    int (*send_raw) (struct _mbus_handle *handle, const struct iovec *iov, int iovcnt); /**< vectored send, NULL if the transport has none */
 } mbus_handle;
 
+/**
+ * Send queue, coalesces several frames into a single vectored write.
+ *
+ * Frames added with mbus_send_queue_add are packed into the queue's own
+ * buffer, raw byte sequences added with mbus_send_queue_add_raw are referenced
+ * and must stay valid until the queue is flushed.
+ */
+typedef struct _mbus_send_queue {
+    struct iovec  iov[MBUS_SEND_QUEUE_LENGTH];
+    int           count;        /**< number of queued byte sequences */
+    size_t        used;         /**< bytes used in buff */
+    unsigned char buff[MBUS_SEND_QUEUE_LENGTH * MBUS_FRAME_PACKED_MAX_SIZE];
+} mbus_send_queue;
+
 /**
  * MBus slave address type (primary/secodary address)
  */
@@ -150,17 +181,75 @@ typedef struct _mbus_record {
     int                 device;         /**< Quantity device */
     long                tariff;         /**< Quantity tariff */
     long                storage_number; /**< Quantity storage number */
+    int                 flags;          /**< MBUS_RECORD_STATIC_* for strings not to be freed */
+    mbus_timestamp      first_byte;     /**< Arrival of the first byte of the frame */
+    mbus_timestamp      last_byte;      /**< Arrival of the last byte of the frame */
 } mbus_record;
 
+/**
+ * Strings of a record pointing into static tables instead of an own copy
+ */
+#define MBUS_RECORD_STATIC_UNIT      0x01
+#define MBUS_RECORD_STATIC_FUNCTION  0x02
+#define MBUS_RECORD_STATIC_QUANTITY  0x04
+
+/**
+ * Maximum number of records in a variable data frame (two bytes per record)
+ */
+#define MBUS_RECORD_INDEX_SIZE ((MBUS_FRAME_DATA_LENGTH - MBUS_DATA_VARIABLE_HEADER_LENGTH) / 2 + 1)
+
+/**
+ * Record boundaries of a variable data frame, values are decoded on demand
+ */
+typedef struct _mbus_record_index_entry {
+    size_t       offset;        /**< Offset of the DIB in the frame data */
+    mbus_record *record;        /**< Normalized record, NULL until requested */
+} mbus_record_index_entry;
+
+typedef struct _mbus_record_index {
+    mbus_frame                *frame;     /**< Indexed frame, must outlive the index */
+    mbus_data_variable_header  header;    /**< Variable data header */
+    size_t                     nrecords;  /**< Number of records */
+    mbus_record_index_entry    entry[MBUS_RECORD_INDEX_SIZE];
+} mbus_record_index;
+
 /**
  * MBus handle option enumeration
  */
 typedef enum _mbus_context_option {
     MBUS_OPTION_MAX_DATA_RETRY,  /**< option defines the maximum attempts of data request retransmission */
     MBUS_OPTION_MAX_SEARCH_RETRY,  /**< option defines the maximum attempts of search request retransmission */
-    MBUS_OPTION_PURGE_FIRST_FRAME  /**< option controls the echo cancelation for mbus_recv_frame */
+    MBUS_OPTION_PURGE_FIRST_FRAME,  /**< option controls the echo cancelation for mbus_recv_frame */
+    MBUS_OPTION_TCP_CONNECT_TIMEOUT,  /**< option defines the TCP connect timeout in milliseconds */
+    MBUS_OPTION_TCP_NODELAY,  /**< option enables (non zero) or disables TCP_NODELAY */
+    MBUS_OPTION_TCP_KEEPALIVE,  /**< option defines the TCP keepalive idle time in seconds (0 = disabled) */
+    MBUS_OPTION_TCP_AUTO_RECONNECT,  /**< option enables (non zero) transparent reconnect with backoff after connection loss */
+    MBUS_OPTION_SERIAL_DRAIN,  /**< option controls (non zero) whether serial sends wait until the UART is empty */
+    MBUS_OPTION_STATS  /**< option enables (non zero) the collection of statistics, see mbus-stats.h */
 } mbus_context_option;
 
+#define MBUS_TRANSPORT_MAX 16
+
+/**
+ * Transport of a M-Bus handle.
+ *
+ * A transport provides the functions a handle dispatches to, its state is
+ * kept in the auxdata of the handle. The built-in transports are "serial",
+ * "tcp", "loopback" and "replay"; further transports can be added with
+ * mbus_transport_register and used with mbus_context_transport.
+ */
+typedef struct _mbus_transport {
+    const char *name;
+    unsigned char type; /**< source type passed to the send and receive events (MBUS_HANDLE_TYPE_...) */
+    int (*open) (struct _mbus_handle *handle);
+    int (*close) (struct _mbus_handle *handle);
+    int (*send) (struct _mbus_handle *handle, mbus_frame *frame);
+    int (*send_raw) (struct _mbus_handle *handle, const struct iovec *iov, int iovcnt); /**< optional, mbus_send_raw falls back to send; only send calls the send event */
+    int (*recv) (struct _mbus_handle *handle, mbus_frame *frame);
+    void (*free_auxdata) (struct _mbus_handle *handle); /**< optional */
+    int (*set_option) (struct _mbus_handle *handle, mbus_context_option option, long value); /**< optional, transport specific options */
+} mbus_transport;
+
 /**
  * Event register functions
  */
@@ -197,6 +286,37 @@ mbus_handle * mbus_context_serial(const char *device);
  */
 mbus_handle * mbus_context_tcp(const char *host, uint16_t port);
 
+/**
+ * Allocate and initialize M-Bus context for a transport.
+ *
+ * @param transport Transport, must stay valid for the lifetime of the handle
+ * @param auxdata   Transport state, owned by the handle and released with
+ *                  the free_auxdata function of the transport
+ *
+ * @return Initialized "unified" handler when successful, NULL otherwise;
+ */
+mbus_handle * mbus_context_transport(const mbus_transport *transport, void *auxdata);
+
+/**
+ * Register a transport. Registration is not thread safe and should be done
+ * before handles are created.
+ *
+ * @param transport Transport, must stay valid while registered
+ *
+ * @return Zero when successful, -1 when the name is taken, the registry is
+ *         full or a mandatory function is missing.
+ */
+int mbus_transport_register(const mbus_transport *transport);
+
+/**
+ * Look up a registered transport by name.
+ *
+ * @param name Name of the transport
+ *
+ * @return Transport when found, NULL otherwise.
+ */
+const mbus_transport * mbus_transport_lookup(const char *name);
+
 /**
  * Deallocate memory used by M-Bus context.
  *
@@ -245,7 +365,9 @@ int mbus_context_set_option(mbus_handle * handle, mbus_context_option option, lo
 int mbus_context_set_userdata(mbus_handle * handle, void *userdata);
 
 /**
- * Receives a frame using "unified" handle
+ * Receives a frame using "unified" handle. The frame is stamped with the
+ * arrival of its first and last byte (first_byte, last_byte) and the receive
+ * time in seconds (timestamp).
  *
  * @param handle Initialized handle
  * @param frame  Received frame
@@ -254,6 +376,15 @@ int mbus_context_set_userdata(mbus_handle * handle, void *userdata);
  */
 int mbus_recv_frame(mbus_handle * handle, mbus_frame *frame);
 
+/**
+ * Stamp the arrival of the first byte of a frame, called by the transports
+ * from their receive function.
+ *
+ * @param handle Initialized handle
+ * @param frame  Frame being received
+ */
+void mbus_recv_first_byte(mbus_handle *handle, mbus_frame *frame);
+
 /**
  * Used for handling collisions. Blocks as long as receiving frames or corrupted data.
  *
@@ -273,6 +404,58 @@ int mbus_purge_frames(mbus_handle * handle);
  */
 int mbus_send_frame(mbus_handle * handle, mbus_frame *frame);
 
+/**
+ * Sends already packed byte sequences in a single vectored write. Transports
+ * without vectored send get every byte sequence as frame, each one has to
+ * hold exactly one complete frame then. The send event is called for every
+ * byte sequence, also for the frames served from the frame cache.
+ *
+ * @param handle Initialized handle
+ * @param iov    Byte sequences to send
+ * @param iovcnt Number of byte sequences
+ *
+ * @return Zero when successful.
+ */
+int mbus_send_raw(mbus_handle * handle, const struct iovec *iov, int iovcnt);
+
+/**
+ * Reset a send queue to the empty state
+ *
+ * @param queue Send queue
+ */
+void mbus_send_queue_init(mbus_send_queue *queue);
+
+/**
+ * Pack a frame and append it to a send queue
+ *
+ * @param queue Send queue
+ * @param frame Frame to append
+ *
+ * @return Zero when successful, -1 when the queue is full or packing failed.
+ */
+int mbus_send_queue_add(mbus_send_queue *queue, mbus_frame *frame);
+
+/**
+ * Append an already packed byte sequence to a send queue (not copied)
+ *
+ * @param queue Send queue
+ * @param data  Packed bytes, must stay valid until the queue is flushed
+ * @param len   Number of bytes
+ *
+ * @return Zero when successful, -1 when the queue is full.
+ */
+int mbus_send_queue_add_raw(mbus_send_queue *queue, const unsigned char *data, size_t len);
+
+/**
+ * Send all queued byte sequences with a single system call and empty the queue
+ *
+ * @param handle Initialized handle
+ * @param queue  Send queue
+ *
+ * @return Zero when successful.
+ */
+int mbus_send_queue_flush(mbus_handle * handle, mbus_send_queue *queue);
+
 /**
  * Sends secondary address selection frame using "unified" handle
  *
@@ -421,6 +604,13 @@ void mbus_record_free(mbus_record *rec);
  */
 mbus_record *mbus_parse_fixed_record(char statusByte, char medium_unit_byte, unsigned char *data);
 
+/**
+ * Like #mbus_parse_fixed_record, but unit, function_medium and quantity
+ * point into static tables (see flags of mbus_record) instead of being
+ * allocated per record. The caller must not free or modify them.
+ */
+mbus_record *mbus_parse_fixed_record_interned(char statusByte, char medium_unit_byte, unsigned char *data);
+
 
 /**
  * Create/parse single counter from the variable data structure record
@@ -431,6 +621,61 @@ mbus_record *mbus_parse_fixed_record(char statusByte, char medium_unit_byte, uns
  */
 mbus_record * mbus_parse_variable_record(mbus_data_record *record);
 
+/**
+ * Like #mbus_parse_variable_record, but unit, function_medium and quantity
+ * point into static tables (see flags of mbus_record) instead of being
+ * allocated per record. The caller must not free or modify them. Plain
+ * text VIFs are still copied.
+ */
+mbus_record * mbus_parse_variable_record_interned(mbus_data_record *record);
+
+/**
+ * Index the records of a variable data frame without decoding them
+ *
+ * The header is parsed and every record is walked with the regular record
+ * parser (DIB, VIB and data into a scratch record) to find the record
+ * boundaries, which keeps them identical to #mbus_data_variable_parse. No
+ * values are decoded or normalized and no memory is allocated. Use
+ * #mbus_record_index_get to decode single records.
+ *
+ * @param index  index to be initialized
+ * @param frame  variable data frame, must stay valid while the index is used
+ *
+ * @return number of records, -1 on error
+ */
+int mbus_record_index_build(mbus_record_index *index, mbus_frame *frame);
+
+/**
+ * Parse a single record of an index
+ *
+ * @param index  record index
+ * @param n      record number
+ * @param record parsed record (DIB, VIB and data)
+ *
+ * @return zero when OK
+ */
+int mbus_record_index_data_record(mbus_record_index *index, size_t n, mbus_data_record *record);
+
+/**
+ * Get the normalized record of an index
+ *
+ * The record is decoded on first use and kept in the index, further calls
+ * return the same record.
+ *
+ * @param index  record index
+ * @param n      record number
+ *
+ * @return record owned by the index, NULL on error
+ */
+mbus_record * mbus_record_index_get(mbus_record_index *index, size_t n);
+
+/**
+ * Free the records decoded through an index
+ *
+ * @param index  record index
+ */
+void mbus_record_index_free(mbus_record_index *index);
+
 
 
 /**
@@ -488,6 +733,19 @@ int mbus_vif_unit_normalize(int vif, double value, char **unit_out, double *valu
  */
 int mbus_vib_unit_normalize(mbus_value_information_block *vib, double value, char **unit_out, double *value_out, char ** quantity_out);
 
+/**
+ * Look up normalized unit and quantity from VIB without allocating memory
+ *
+ * @param vib          mbus value information block of the variable record
+ * @param unit_out     parsed unit (static string, do not free)
+ * @param factor_out   factor to normalize the raw value with
+ * @param offset_out   additive correction added after the factor
+ * @param quantity_out parsed quantity (static string or custom VIF, do not free)
+ *
+ * @return zero when OK
+ */
+int mbus_vib_unit_lookup_normalized(mbus_value_information_block *vib, const char **unit_out, double *factor_out, double *offset_out, const char **quantity_out);
+
 /**
  * Generate XML for normalized variable-length data
  *
@@ -506,6 +764,26 @@ char * mbus_data_variable_xml_normalized(mbus_data_variable *data);
  */
 char * mbus_frame_data_xml_normalized(mbus_frame_data *data);
 
+/**
+ * Write XML for normalized variable-length data to an output sink
+ *
+ * @param sink    output sink
+ * @param data    variable-length data
+ *
+ * @return zero when OK
+ */
+int mbus_data_variable_xml_normalized_sink(mbus_sink *sink, mbus_data_variable *data);
+
+/**
+ * Write an XML representation of the normalized M-BUS frame data to an output sink
+ *
+ * @param sink    output sink
+ * @param data    M-Bus frame data
+ *
+ * @return zero when OK
+ */
+int mbus_frame_data_xml_normalized_sink(mbus_sink *sink, mbus_frame_data *data);
+
 /**
  * Iterate over secondary addresses, send a probe package to all addresses matching
  * the given addresses mask.
@@ -10,13 +10,15 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "mbus-protocol.h"
+#include "mbus-trace.h"
 
 static int parse_debug = 0, debug = 0;
-static char error_str[512];
+static __thread char error_str[512];
 
 #define NITEMS(x) (sizeof(x)/sizeof(x[0]))
 
@@ -94,6 +96,49 @@ mbus_error_reset()
     snprintf(error_str, sizeof(error_str), "no errors");
 }
 
+//------------------------------------------------------------------------------
+/// Read the monotonic and the realtime clock with nanosecond resolution.
+//------------------------------------------------------------------------------
+void
+mbus_timestamp_now(mbus_timestamp *ts)
+{
+    struct timespec mono, real;
+
+    if (ts == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    ts->monotonic_ns = (uint64_t) mono.tv_sec * 1000000000ULL + mono.tv_nsec;
+    ts->realtime_ns  = (uint64_t) real.tv_sec * 1000000000ULL + real.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+/// Format the realtime of a timestamp as ISO 8601 UTC with nanoseconds, e.g.
+/// 2012-01-31T08:15:30.123456789Z. Returns the length, -1 if unknown.
+//------------------------------------------------------------------------------
+int
+mbus_timestamp_iso(const mbus_timestamp *ts, char *buff, size_t size)
+{
+    struct tm t;
+    time_t sec;
+    size_t len;
+
+    if (ts == NULL || buff == NULL || ts->realtime_ns == 0)
+        return -1;
+
+    sec = (time_t) (ts->realtime_ns / 1000000000ULL);
+
+    if (gmtime_r(&sec, &t) == NULL || (len = strftime(buff, size, "%Y-%m-%dT%H:%M:%S", &t)) == 0 ||
+        snprintf(&buff[len], size - len, ".%09uZ", (unsigned int) (ts->realtime_ns % 1000000000ULL)) != 11)
+    {
+        return -1;
+    }
+
+    return (int) len + 11;
+}
+
 //------------------------------------------------------------------------------
 //
 // M-Bus FRAME RELATED FUNCTIONS
@@ -468,6 +513,60 @@ mbus_data_bcd_encode(unsigned char *bcd_data, size_t bcd_data_size, int value)
     return -1;
 }
 
+//------------------------------------------------------------------------------
+///
+/// Load up to 8 bytes of little endian data into a 64 bit word.
+///
+//------------------------------------------------------------------------------
+static inline uint64_t
+mbus_data_le64_load(const unsigned char *data, size_t data_size)
+{
+    uint64_t word = 0;
+    size_t i;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    if (data_size == 8)
+    {
+        memcpy(&word, data, 8);
+        return word;
+    }
+#endif
+
+    for (i = data_size; i > 0; i--)
+    {
+        word = (word << 8) | data[i-1];
+    }
+
+    return word;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Decode up to 16 BCD digits packed in a 64 bit word, all digits in
+/// parallel (SWAR). Same rules as the digit-by-digit decoder: a high nibble
+/// of Ah-Fh counts as zero, the low nibble is taken as is.
+///
+//------------------------------------------------------------------------------
+static inline long long
+mbus_data_bcd_word_decode(uint64_t word)
+{
+    uint64_t lo, hi, over;
+
+    lo = word & 0x0F0F0F0F0F0F0F0FULL;
+    hi = (word >> 4) & 0x0F0F0F0F0F0F0F0FULL;
+
+    // 01h in every byte whose high nibble is above 9
+    over = ((hi + 0x0606060606060606ULL) & 0x1010101010101010ULL) >> 4;
+    hi &= ~(over * 0x0F);
+
+    // byte lanes: 10*hi + lo (at most 105), then merge lanes pairwise
+    word = hi * 10 + lo;
+    word = (word & 0x00FF00FF00FF00FFULL) + ((word >> 8)  & 0x00FF00FF00FF00FFULL) * 100;
+    word = (word & 0x0000FFFF0000FFFFULL) + ((word >> 16) & 0x0000FFFF0000FFFFULL) * 10000;
+
+    return (long long) ((word & 0xFFFFFFFFULL) + (word >> 32) * 100000000ULL);
+}
+
 //------------------------------------------------------------------------------
 ///
 /// Decode BCD data (decimal)
@@ -479,18 +578,25 @@ mbus_data_bcd_decode(unsigned char *bcd_data, size_t bcd_data_size)
     long long val = 0;
     size_t i;
 
-    if (bcd_data)
+    if (bcd_data && bcd_data_size > 0)
     {
-        for (i = bcd_data_size; i > 0; i--)
+        if (bcd_data_size <= 8)
         {
-            val = (val * 10);
-
-            if (bcd_data[i-1]>>4 < 0xA)
+            val = mbus_data_bcd_word_decode(mbus_data_le64_load(bcd_data, bcd_data_size));
+        }
+        else
+        {
+            for (i = bcd_data_size; i > 0; i--)
             {
-                val += ((bcd_data[i-1]>>4) & 0xF);
-            }
+                val = (val * 10);
+
+                if (bcd_data[i-1]>>4 < 0xA)
+                {
+                    val += ((bcd_data[i-1]>>4) & 0xF);
+                }
 
-            val = (val * 10) + ( bcd_data[i-1] & 0xF);
+                val = (val * 10) + ( bcd_data[i-1] & 0xF);
+            }
         }
 
         // hex code Fh in the MSD position signals a negative BCD number
@@ -518,6 +624,11 @@ mbus_data_bcd_decode_hex(unsigned char *bcd_data, size_t bcd_data_size)
 
     if (bcd_data)
     {
+        if (bcd_data_size <= 8)
+        {
+            return (long long) mbus_data_le64_load(bcd_data, bcd_data_size);
+        }
+
         for (i = bcd_data_size; i > 0; i--)
         {
             val = (val << 8) | bcd_data[i-1];
@@ -529,6 +640,122 @@ mbus_data_bcd_decode_hex(unsigned char *bcd_data, size_t bcd_data_size)
     return -1;
 }
 
+//------------------------------------------------------------------------------
+///
+/// Validate BCD data: all digits 0-9, except an Fh sign nibble in the most
+/// significant position. Returns 0 if valid, -1 otherwise.
+///
+//------------------------------------------------------------------------------
+int
+mbus_data_bcd_validate(const unsigned char *bcd_data, size_t bcd_data_size)
+{
+    uint64_t word, sign;
+    size_t offset, len;
+
+    if (bcd_data == NULL || bcd_data_size == 0)
+    {
+        return -1;
+    }
+
+    for (offset = 0; offset < bcd_data_size; offset += 8)
+    {
+        len = bcd_data_size - offset;
+        if (len > 8)
+            len = 8;
+
+        word = mbus_data_le64_load(&bcd_data[offset], len);
+
+        if (offset + len == bcd_data_size && (bcd_data[bcd_data_size-1] >> 4) == 0xF)
+        {
+            // negative number, sign nibble is no digit
+            sign = 0xF0ULL << (8 * (len - 1));
+            word &= ~sign;
+        }
+
+        // a nibble above 9 carries into bit 4 when adding 6
+        if (((( word       & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL) |
+             (((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) + 0x0606060606060606ULL)) & 0x1010101010101010ULL)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Decode a batch of BCD fields (e.g. all BCD records of a telegram or a
+/// list of identification numbers). If valid is not NULL, it receives 1 for
+/// every field that passes mbus_data_bcd_validate and 0 otherwise. Returns
+/// the number of valid fields.
+///
+//------------------------------------------------------------------------------
+size_t
+mbus_data_bcd_decode_batch(unsigned char * const *bcd_data, const size_t *bcd_data_size,
+                           size_t count, long long *values, unsigned char *valid)
+{
+    size_t i, nvalid = 0;
+    int ok;
+
+    if (bcd_data == NULL || bcd_data_size == NULL || values == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        values[i] = mbus_data_bcd_decode(bcd_data[i], bcd_data_size[i]);
+
+        ok = (mbus_data_bcd_validate(bcd_data[i], bcd_data_size[i]) == 0);
+        nvalid += ok;
+
+        if (valid)
+            valid[i] = ok;
+    }
+
+    return nvalid;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Decode the BCD records (DIF data field 9h-Ch, Eh) of a record list.
+/// values[i] receives the value of the i:th record of the list, records
+/// that are not BCD coded are skipped and leave values[i] untouched.
+/// Returns the number of decoded records.
+///
+//------------------------------------------------------------------------------
+size_t
+mbus_data_record_bcd_decode_batch(mbus_data_record *record, long long *values, size_t max_values)
+{
+    size_t i, n = 0;
+
+    if (values == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; record && i < max_values; record = record->next, i++)
+    {
+        switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA)
+        {
+            case 0x09:
+            case 0x0A:
+            case 0x0B:
+            case 0x0C:
+            case 0x0E:
+                values[i] = mbus_data_bcd_decode(record->data, mbus_dif_datalength_lookup(record->drh.dib.dif));
+                n++;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return n;
+}
+
 //------------------------------------------------------------------------------
 ///
 /// Decode INTEGER data
@@ -607,6 +834,7 @@ mbus_data_long_long_decode(unsigned char *int_data, size_t int_data_size, long l
 {
     size_t i;
     int neg;
+    uint64_t word;
     *value = 0;
 
     if (!int_data || (int_data_size < 1))
@@ -616,6 +844,20 @@ mbus_data_long_long_decode(unsigned char *int_data, size_t int_data_size, long l
 
     neg = int_data[int_data_size-1] & 0x80;
 
+    if (int_data_size <= 8)
+    {
+        // two's complement, sign extend to 64 bit
+        word = mbus_data_le64_load(int_data, int_data_size);
+
+        if (neg && int_data_size < 8)
+        {
+            word |= ~0ULL << (8 * int_data_size);
+        }
+
+        *value = (long long) word;
+        return 0;
+    }
+
     for (i = int_data_size; i > 0; i--)
     {
         if (neg)
@@ -769,6 +1011,29 @@ mbus_data_bin_decode(unsigned char *dst, const unsigned char *src, size_t len, s
     }
 }
 
+//------------------------------------------------------------------------------
+///
+/// Hash binary data (32 bit FNV-1a). Start with MBUS_DATA_HASH_INIT, the
+/// result can be passed as hash to continue over further data.
+///
+//------------------------------------------------------------------------------
+uint32_t
+mbus_data_hash(const unsigned char *data, size_t len, uint32_t hash)
+{
+    size_t i;
+
+    if (data)
+    {
+        for (i = 0; i < len; i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+    }
+
+    return hash;
+}
+
 //------------------------------------------------------------------------------
 ///
 /// Decode time data
@@ -848,80 +1113,345 @@ mbus_data_tm_decode(struct tm *t, unsigned char *t_data, size_t t_data_size)
 
 //------------------------------------------------------------------------------
 ///
-/// Generate manufacturer code from 2-byte encoded data
+/// Date and time fields of type G, F and I data, f = { year, month (1-12),
+/// day, hour, minute, second }, the same values as mbus_data_tm_decode. Invalid
+/// times and unsupported sizes give 1900-01-00 00:00:00 and return -1.
+///
+//------------------------------------------------------------------------------
+static int
+mbus_data_time_fields(const unsigned char *t_data, size_t t_data_size, int f[6])
+{
+    int hundred_year;
+
+    f[0] = 1900;
+    f[1] = 1;
+    f[2] = f[3] = f[4] = f[5] = 0;
+
+    if (t_data == NULL)
+        return -1;
+
+    switch (t_data_size)
+    {
+        case 6:                              // Type I = Compound CP48: Date and Time
+            if (t_data[1] & 0x80)            // Time invalid
+                return -1;
+
+            f[0] = 2000 + (((t_data[3] & 0xE0) >> 5) | ((t_data[4] & 0xF0) >> 1));
+            f[1] = t_data[4] & 0x0F;
+            f[2] = t_data[3] & 0x1F;
+            f[3] = t_data[2] & 0x1F;
+            f[4] = t_data[1] & 0x3F;
+            f[5] = t_data[0] & 0x3F;
+            return 0;
+
+        case 4:                              // Type F = Compound CP32: Date and Time
+            if (t_data[0] & 0x80)            // Time invalid
+                return -1;
+
+            f[0] = ((t_data[2] & 0xE0) >> 5) | ((t_data[3] & 0xF0) >> 1);
+            hundred_year = (t_data[1] & 0x60) >> 5;
+            hundred_year += (hundred_year == 0 && f[0] <= 80);  // circular two digit date
+            f[0] += 1900 + 100 * hundred_year;
+            f[1] = t_data[3] & 0x0F;
+            f[2] = t_data[2] & 0x1F;
+            f[3] = t_data[1] & 0x1F;
+            f[4] = t_data[0] & 0x3F;
+            return 0;
+
+        case 2:                              // Type G: Compound CP16: Date
+            f[0] = 2000 + (((t_data[0] & 0xE0) >> 5) | ((t_data[1] & 0xF0) >> 1));
+            f[1] = t_data[1] & 0x0F;
+            f[2] = t_data[0] & 0x1F;
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+static int64_t
+mbus_data_time_fields_epoch(const int f[6])
+{
+    int64_t y, doy, era, yoe;
+
+    // days from 1970-01-01 of the proleptic Gregorian calendar, with the
+    // year starting in March so the leap day is the last day of the year
+    y   = f[0] - (f[1] <= 2);
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * ((f[1] + 9) % 12) + 2) / 5 + f[2] - 1;
+
+    return ((era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468) * 86400 +
+            f[3] * 3600 + f[4] * 60 + f[5]);
+}
+
+//------------------------------------------------------------------------------
+///
+/// Convert type G, F or I date/time data (2, 4 or 6 bytes) to seconds since
+/// 1970-01-01 without any libc time functions. The meter time has no time
+/// zone, it is converted as if it were UTC (like the normalized output);
+/// the daylight saving flag is ignored. Impossible days (Feb 31) are
+/// normalized like timegm does.
+///
+/// Returns 0 on success, -1 for invalid times (*epoch is set to 0).
 ///
 //------------------------------------------------------------------------------
 int
-mbus_data_manufacturer_encode(unsigned char *m_data, unsigned char *m_code)
+mbus_data_time_epoch(const unsigned char *t_data, size_t t_data_size, int64_t *epoch)
 {
-    int m_val;
+    int f[6];
 
-    if (m_data == NULL || m_code == NULL)
+    if (epoch == NULL)
         return -1;
 
-    m_val = ((((int)m_code[0] - 64) & 0x001F) << 10) +
-            ((((int)m_code[1] - 64) & 0x001F) << 5) +
-            ((((int)m_code[2] - 64) & 0x001F));
+    *epoch = 0;
 
-    mbus_data_int_encode(m_data, 2, m_val);
+    if (mbus_data_time_fields(t_data, t_data_size, f) != 0 ||
+        f[1] < 1 || f[1] > 12 || f[2] < 1 || f[3] > 23 || f[4] > 59 || f[5] > 59)
+    {
+        return -1;
+    }
 
+    *epoch = mbus_data_time_fields_epoch(f);
     return 0;
 }
 
+static char *
+mbus_data_time_digits(char *p, int value, int digits)
+{
+    while (digits-- > 0)
+    {
+        p[digits] = '0' + value % 10;
+        value /= 10;
+    }
+
+    return p;
+}
+
 //------------------------------------------------------------------------------
 ///
-/// Generate manufacturer code from 2-byte encoded data
+/// Format type G date data as YYYY-MM-DD and type F/I date/time data as
+/// YYYY-MM-DDThh:mm:ss, followed by Z if utc is set, without snprintf or
+/// struct tm. The output is the same as formatting mbus_data_tm_decode, also
+/// for invalid times (1900-01-00T00:00:00).
+///
+/// Returns the length of the string, -1 if the buffer is too small
+/// (MBUS_DATA_TIME_ISO_SIZE is always enough).
 ///
 //------------------------------------------------------------------------------
-const char *
-mbus_decode_manufacturer(unsigned char byte1, unsigned char byte2)
+int
+mbus_data_time_iso(const unsigned char *t_data, size_t t_data_size, int utc, char *buff, size_t size)
 {
-    static char m_str[4];
+    int f[6];
+    size_t len;
 
-    int m_id;
+    len = (t_data_size == 2) ? 10 : 19;
+    len += (utc != 0);
 
-    m_str[0] = byte1;
-    m_str[1] = byte2;
+    if (buff == NULL || size <= len)
+        return -1;
 
-    mbus_data_int_decode(m_str, 2, &m_id);
+    mbus_data_time_fields(t_data, t_data_size, f);
 
-    m_str[0] = (char)(((m_id>>10) & 0x001F) + 64);
-    m_str[1] = (char)(((m_id>>5)  & 0x001F) + 64);
-    m_str[2] = (char)(((m_id)     & 0x001F) + 64);
-    m_str[3] = 0;
+    mbus_data_time_digits(&buff[0], f[0], 4);
+    buff[4] = '-';
+    mbus_data_time_digits(&buff[5], f[1], 2);
+    buff[7] = '-';
+    mbus_data_time_digits(&buff[8], f[2], 2);
 
-    return m_str;
+    if (t_data_size != 2)
+    {
+        buff[10] = 'T';
+        mbus_data_time_digits(&buff[11], f[3], 2);
+        buff[13] = ':';
+        mbus_data_time_digits(&buff[14], f[4], 2);
+        buff[16] = ':';
+        mbus_data_time_digits(&buff[17], f[5], 2);
+    }
+
+    if (utc)
+        buff[len - 1] = 'Z';
+
+    buff[len] = '\0';
+
+    return (int) len;
 }
 
-const char *
-mbus_data_product_name(mbus_data_variable_header *header)
+//------------------------------------------------------------------------------
+///
+/// Convert count date/time values to seconds since the epoch, see
+/// mbus_data_time_epoch. If valid is not NULL, valid[i] is set to 1 for
+/// valid times and 0 otherwise. Returns the number of valid times.
+///
+//------------------------------------------------------------------------------
+size_t
+mbus_data_time_epoch_batch(unsigned char * const *t_data, const size_t *t_data_size,
+                           size_t count, int64_t *epoch, unsigned char *valid)
 {
-    static char buff[128];
-    unsigned int manufacturer;
+    size_t i, nvalid = 0;
+    int ok;
 
-    memset(buff, 0, sizeof(buff));
+    if (t_data == NULL || t_data_size == NULL || epoch == NULL)
+    {
+        return 0;
+    }
 
-    if (header)
+    for (i = 0; i < count; i++)
     {
-        manufacturer = (header->manufacturer[1] << 8) + header->manufacturer[0];
+        ok = (mbus_data_time_epoch(t_data[i], t_data_size[i], &epoch[i]) == 0);
+        nvalid += ok;
 
-        // please keep this list ordered by manufacturer code
+        if (valid)
+            valid[i] = ok;
+    }
 
-        if (manufacturer == mbus_manufacturer_id("ABB"))
-        {
-            switch (header->version)
-            {
-                case 0x02:
-                    strcpy(buff,"ABB Delta-Meter");
-                    break;
-                case 0x20:
-                    strcpy(buff,"ABB B21 113-100");
-                    break;
-            }
-        }
-        else if (manufacturer == mbus_manufacturer_id("ACW"))
-        {
-            switch (header->version)
+    return nvalid;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Size of the date/time data of a record (2 for type G, 4 or 6 for type F
+/// and I), 0 if the record holds no date/time.
+///
+//------------------------------------------------------------------------------
+static size_t
+mbus_data_record_time_size(mbus_data_record *record)
+{
+    int vif  = record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+    int vife = record->drh.vib.vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+
+    switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA)
+    {
+        case 0x02:
+            // E110 1100  Time Point (date)
+            return (vif == 0x6C) ? 2 : 0;
+
+        case 0x04:
+        case 0x06:
+            // E110 1101  Time Point (date/time)
+            // E011 0000  Start (date/time) of tariff
+            // E111 0000  Date and time of battery change
+            if ((vif == 0x6D) ||
+                ((record->drh.vib.vif == 0xFD) && (vife == 0x30 || vife == 0x70)))
+            {
+                return mbus_dif_datalength_lookup(record->drh.dib.dif);
+            }
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+///
+/// Convert the date/time records of a record list to seconds since the epoch,
+/// e.g. the time points of a historic series (one record per storage number).
+/// epoch[i] receives the time of the i:th record of the list, other records
+/// and invalid times leave epoch[i] untouched. Returns the number of
+/// converted records.
+///
+//------------------------------------------------------------------------------
+size_t
+mbus_data_record_time_epoch_batch(mbus_data_record *record, int64_t *epoch, size_t max_values)
+{
+    size_t i, len, n = 0;
+    int64_t value;
+
+    if (epoch == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; record && i < max_values; record = record->next, i++)
+    {
+        if ((len = mbus_data_record_time_size(record)) > 0 &&
+            mbus_data_time_epoch(record->data, len, &value) == 0)
+        {
+            epoch[i] = value;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Generate manufacturer code from 2-byte encoded data
+///
+//------------------------------------------------------------------------------
+int
+mbus_data_manufacturer_encode(unsigned char *m_data, unsigned char *m_code)
+{
+    int m_val;
+
+    if (m_data == NULL || m_code == NULL)
+        return -1;
+
+    m_val = ((((int)m_code[0] - 64) & 0x001F) << 10) +
+            ((((int)m_code[1] - 64) & 0x001F) << 5) +
+            ((((int)m_code[2] - 64) & 0x001F));
+
+    mbus_data_int_encode(m_data, 2, m_val);
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+///
+/// Generate manufacturer code from 2-byte encoded data
+///
+//------------------------------------------------------------------------------
+const char *
+mbus_decode_manufacturer(unsigned char byte1, unsigned char byte2)
+{
+    static __thread char m_str[4];
+
+    int m_id;
+
+    m_str[0] = byte1;
+    m_str[1] = byte2;
+
+    mbus_data_int_decode(m_str, 2, &m_id);
+
+    m_str[0] = (char)(((m_id>>10) & 0x001F) + 64);
+    m_str[1] = (char)(((m_id>>5)  & 0x001F) + 64);
+    m_str[2] = (char)(((m_id)     & 0x001F) + 64);
+    m_str[3] = 0;
+
+    return m_str;
+}
+
+const char *
+mbus_data_product_name(mbus_data_variable_header *header)
+{
+    static __thread char buff[128];
+    unsigned int manufacturer;
+
+    memset(buff, 0, sizeof(buff));
+
+    if (header)
+    {
+        manufacturer = (header->manufacturer[1] << 8) + header->manufacturer[0];
+
+        // please keep this list ordered by manufacturer code
+
+        if (manufacturer == mbus_manufacturer_id("ABB"))
+        {
+            switch (header->version)
+            {
+                case 0x02:
+                    strcpy(buff,"ABB Delta-Meter");
+                    break;
+                case 0x20:
+                    strcpy(buff,"ABB B21 113-100");
+                    break;
+            }
+        }
+        else if (manufacturer == mbus_manufacturer_id("ACW"))
+        {
+            switch (header->version)
             {
                 case 0x09:
                     strcpy(buff,"Itron CF Echo 2");
@@ -1376,69 +1906,18 @@ mbus_data_product_name(mbus_data_variable_header *header)
 ///
 /// For fixed-length frames, get a string describing the medium.
 ///
+static const char *mbus_data_fixed_medium_names[16] = {
+    "Other", "Oil", "Electricity", "Gas", "Heat", "Steam", "Hot Water", "Water",
+    "H.C.A.", "Reserved", "Gas Mode 2", "Heat Mode 2", "Hot Water Mode 2",
+    "Water Mode 2", "H.C.A. Mode 2", "Reserved"
+};
+
 const char *
 mbus_data_fixed_medium(mbus_data_fixed *data)
 {
-    static char buff[256];
-
     if (data)
     {
-        switch ( (data->cnt1_type&0xC0)>>6 | (data->cnt2_type&0xC0)>>4 )
-        {
-            case 0x00:
-                snprintf(buff, sizeof(buff), "Other");
-                break;
-            case 0x01:
-                snprintf(buff, sizeof(buff), "Oil");
-                break;
-            case 0x02:
-                snprintf(buff, sizeof(buff), "Electricity");
-                break;
-            case 0x03:
-                snprintf(buff, sizeof(buff), "Gas");
-                break;
-            case 0x04:
-                snprintf(buff, sizeof(buff), "Heat");
-                break;
-            case 0x05:
-                snprintf(buff, sizeof(buff), "Steam");
-                break;
-            case 0x06:
-                snprintf(buff, sizeof(buff), "Hot Water");
-                break;
-            case 0x07:
-                snprintf(buff, sizeof(buff), "Water");
-                break;
-            case 0x08:
-                snprintf(buff, sizeof(buff), "H.C.A.");
-                break;
-            case 0x09:
-                snprintf(buff, sizeof(buff), "Reserved");
-                break;
-            case 0x0A:
-                snprintf(buff, sizeof(buff), "Gas Mode 2");
-                break;
-            case 0x0B:
-                snprintf(buff, sizeof(buff), "Heat Mode 2");
-                break;
-            case 0x0C:
-                snprintf(buff, sizeof(buff), "Hot Water Mode 2");
-                break;
-            case 0x0D:
-                snprintf(buff, sizeof(buff), "Water Mode 2");
-                break;
-            case 0x0E:
-                snprintf(buff, sizeof(buff), "H.C.A. Mode 2");
-                break;
-            case 0x0F:
-                snprintf(buff, sizeof(buff), "Reserved");
-                break;
-            default:
-                snprintf(buff, sizeof(buff), "unknown");
-                break;
-        }
-
-        return buff;
+        return mbus_data_fixed_medium_names[(data->cnt1_type&0xC0)>>6 | (data->cnt2_type&0xC0)>>4];
     }
 
     return NULL;
@@ -1484,215 +1963,60 @@ mbus_data_fixed_medium(mbus_data_fixed *data)
 //  kJ/h * 100   011111     1F    without   units    111111     3F
 //
 //------------------------------------------------------------------------------
+/// Fixed data units: name as in the XML output, typed unit and exponent.
+//------------------------------------------------------------------------------
+typedef struct _mbus_data_fixed_unit_entry {
+    const char *name;
+    mbus_unit unit;
+    int exponent;
+} mbus_data_fixed_unit_entry;
+
+static const mbus_data_fixed_unit_entry mbus_data_fixed_units[64] = {
+    { "h,m,s",   MBUS_UNIT_UNKNOWN, 0 },  { "D,M,Y",    MBUS_UNIT_UNKNOWN, 0 },
+    { "Wh",      MBUS_UNIT_WH, 0 },       { "10 Wh",    MBUS_UNIT_WH, 1 },
+    { "100 Wh",  MBUS_UNIT_WH, 2 },       { "kWh",      MBUS_UNIT_WH, 3 },
+    { "10 kWh",  MBUS_UNIT_WH, 4 },       { "100 kWh",  MBUS_UNIT_WH, 5 },
+    { "MWh",     MBUS_UNIT_WH, 6 },       { "10 MWh",   MBUS_UNIT_WH, 7 },
+    { "100 MWh", MBUS_UNIT_WH, 8 },
+    { "kJ",      MBUS_UNIT_J, 3 },        { "10 kJ",    MBUS_UNIT_J, 4 },
+    { "MJ",      MBUS_UNIT_J, 5 },        { "100 kJ",   MBUS_UNIT_J, 6 },    // names of 0D and 0E are swapped
+    { "10 MJ",   MBUS_UNIT_J, 7 },        { "100 MJ",   MBUS_UNIT_J, 8 },
+    { "GJ",      MBUS_UNIT_J, 9 },        { "10 GJ",    MBUS_UNIT_J, 10 },
+    { "100 GJ",  MBUS_UNIT_J, 11 },
+    { "W",       MBUS_UNIT_W, 0 },        { "10 W",     MBUS_UNIT_W, 1 },
+    { "100 W",   MBUS_UNIT_W, 2 },        { "kW",       MBUS_UNIT_W, 3 },
+    { "10 kW",   MBUS_UNIT_W, 4 },        { "100 kW",   MBUS_UNIT_W, 5 },
+    { "MW",      MBUS_UNIT_W, 6 },        { "10 MW",    MBUS_UNIT_W, 7 },
+    { "100 MW",  MBUS_UNIT_W, 8 },
+    { "kJ/h",    MBUS_UNIT_J_H, 3 },      { "10 kJ/h",  MBUS_UNIT_J_H, 4 },
+    { "100 kJ/h",MBUS_UNIT_J_H, 5 },      { "MJ/h",     MBUS_UNIT_J_H, 6 },
+    { "10 MJ/h", MBUS_UNIT_J_H, 7 },      { "100 MJ/h", MBUS_UNIT_J_H, 8 },
+    { "GJ/h",    MBUS_UNIT_J_H, 9 },      { "10 GJ/h",  MBUS_UNIT_J_H, 10 },
+    { "100 GJ/h",MBUS_UNIT_J_H, 11 },
+    { "ml",      MBUS_UNIT_M3, -6 },      { "10 ml",    MBUS_UNIT_M3, -5 },
+    { "100 ml",  MBUS_UNIT_M3, -4 },      { "l",        MBUS_UNIT_M3, -3 },
+    { "10 l",    MBUS_UNIT_M3, -2 },      { "100 l",    MBUS_UNIT_M3, -1 },
+    { "m^3",     MBUS_UNIT_M3, 0 },       { "10 m^3",   MBUS_UNIT_M3, 1 },
+    { "100 m^3", MBUS_UNIT_M3, 2 },
+    { "ml/h",    MBUS_UNIT_M3_H, -6 },    { "10 ml/h",  MBUS_UNIT_M3_H, -5 },
+    { "100 ml/h",MBUS_UNIT_M3_H, -4 },    { "l/h",      MBUS_UNIT_M3_H, -3 },
+    { "10 l/h",  MBUS_UNIT_M3_H, -2 },    { "100 l/h",  MBUS_UNIT_M3_H, -1 },
+    { "m^3/h",   MBUS_UNIT_M3_H, 0 },     { "10 m^3/h", MBUS_UNIT_M3_H, 1 },
+    { "100 m^3/h", MBUS_UNIT_M3_H, 2 },
+    { "1e-3 °C", MBUS_UNIT_CELSIUS, -3 }, { "units for HCA", MBUS_UNIT_HCA, 0 },
+    { "reserved", MBUS_UNIT_UNKNOWN, 0 }, { "reserved", MBUS_UNIT_UNKNOWN, 0 },
+    { "reserved", MBUS_UNIT_UNKNOWN, 0 }, { "reserved", MBUS_UNIT_UNKNOWN, 0 },
+    { "reserved but historic", MBUS_UNIT_UNKNOWN, 0 },
+    { "without units", MBUS_UNIT_NONE, 0 }
+};
+
 ///
 /// For fixed-length frames, get a string describing the unit of the data.
 ///
 const char *
 mbus_data_fixed_unit(int medium_unit_byte)
 {
-    static char buff[256];
-
-    switch (medium_unit_byte & 0x3F)
-    {
-        case 0x00:
-            snprintf(buff, sizeof(buff), "h,m,s");
-            break;
-        case 0x01:
-            snprintf(buff, sizeof(buff), "D,M,Y");
-            break;
-
-        case 0x02:
-            snprintf(buff, sizeof(buff), "Wh");
-            break;
-        case 0x03:
-            snprintf(buff, sizeof(buff), "10 Wh");
-            break;
-        case 0x04:
-            snprintf(buff, sizeof(buff), "100 Wh");
-            break;
-        case 0x05:
-            snprintf(buff, sizeof(buff), "kWh");
-            break;
-        case 0x06:
-            snprintf(buff, sizeof(buff), "10 kWh");
-            break;
-        case 0x07:
-            snprintf(buff, sizeof(buff), "100 kWh");
-            break;
-        case 0x08:
-            snprintf(buff, sizeof(buff), "MWh");
-            break;
-        case 0x09:
-            snprintf(buff, sizeof(buff), "10 MWh");
-            break;
-        case 0x0A:
-            snprintf(buff, sizeof(buff), "100 MWh");
-            break;
-
-        case 0x0B:
-            snprintf(buff, sizeof(buff), "kJ");
-            break;
-        case 0x0C:
-            snprintf(buff, sizeof(buff), "10 kJ");
-            break;
-        case 0x0E:
-            snprintf(buff, sizeof(buff), "100 kJ");
-            break;
-        case 0x0D:
-            snprintf(buff, sizeof(buff), "MJ");
-            break;
-        case 0x0F:
-            snprintf(buff, sizeof(buff), "10 MJ");
-            break;
-        case 0x10:
-            snprintf(buff, sizeof(buff), "100 MJ");
-            break;
-        case 0x11:
-            snprintf(buff, sizeof(buff), "GJ");
-            break;
-        case 0x12:
-            snprintf(buff, sizeof(buff), "10 GJ");
-            break;
-        case 0x13:
-            snprintf(buff, sizeof(buff), "100 GJ");
-            break;
-
-        case 0x14:
-            snprintf(buff, sizeof(buff), "W");
-            break;
-        case 0x15:
-            snprintf(buff, sizeof(buff), "10 W");
-            break;
-        case 0x16:
-            snprintf(buff, sizeof(buff), "100 W");
-            break;
-        case 0x17:
-            snprintf(buff, sizeof(buff), "kW");
-            break;
-        case 0x18:
-            snprintf(buff, sizeof(buff), "10 kW");
-            break;
-        case 0x19:
-            snprintf(buff, sizeof(buff), "100 kW");
-            break;
-        case 0x1A:
-            snprintf(buff, sizeof(buff), "MW");
-            break;
-        case 0x1B:
-            snprintf(buff, sizeof(buff), "10 MW");
-            break;
-        case 0x1C:
-            snprintf(buff, sizeof(buff), "100 MW");
-            break;
-
-        case 0x1D:
-            snprintf(buff, sizeof(buff), "kJ/h");
-            break;
-        case 0x1E:
-            snprintf(buff, sizeof(buff), "10 kJ/h");
-            break;
-        case 0x1F:
-            snprintf(buff, sizeof(buff), "100 kJ/h");
-            break;
-        case 0x20:
-            snprintf(buff, sizeof(buff), "MJ/h");
-            break;
-        case 0x21:
-            snprintf(buff, sizeof(buff), "10 MJ/h");
-            break;
-        case 0x22:
-            snprintf(buff, sizeof(buff), "100 MJ/h");
-            break;
-        case 0x23:
-            snprintf(buff, sizeof(buff), "GJ/h");
-            break;
-        case 0x24:
-            snprintf(buff, sizeof(buff), "10 GJ/h");
-            break;
-        case 0x25:
-            snprintf(buff, sizeof(buff), "100 GJ/h");
-            break;
-
-        case 0x26:
-            snprintf(buff, sizeof(buff), "ml");
-            break;
-        case 0x27:
-            snprintf(buff, sizeof(buff), "10 ml");
-            break;
-        case 0x28:
-            snprintf(buff, sizeof(buff), "100 ml");
-            break;
-        case 0x29:
-            snprintf(buff, sizeof(buff), "l");
-            break;
-        case 0x2A:
-            snprintf(buff, sizeof(buff), "10 l");
-            break;
-        case 0x2B:
-            snprintf(buff, sizeof(buff), "100 l");
-            break;
-        case 0x2C:
-            snprintf(buff, sizeof(buff), "m^3");
-            break;
-        case 0x2D:
-            snprintf(buff, sizeof(buff), "10 m^3");
-            break;
-        case 0x2E:
-            snprintf(buff, sizeof(buff), "100 m^3");
-            break;
-
-        case 0x2F:
-            snprintf(buff, sizeof(buff), "ml/h");
-            break;
-        case 0x30:
-            snprintf(buff, sizeof(buff), "10 ml/h");
-            break;
-        case 0x31:
-            snprintf(buff, sizeof(buff), "100 ml/h");
-            break;
-        case 0x32:
-            snprintf(buff, sizeof(buff), "l/h");
-            break;
-        case 0x33:
-            snprintf(buff, sizeof(buff), "10 l/h");
-            break;
-        case 0x34:
-            snprintf(buff, sizeof(buff), "100 l/h");
-            break;
-        case 0x35:
-            snprintf(buff, sizeof(buff), "m^3/h");
-            break;
-        case 0x36:
-            snprintf(buff, sizeof(buff), "10 m^3/h");
-            break;
-        case 0x37:
-            snprintf(buff, sizeof(buff), "100 m^3/h");
-            break;
-
-        case 0x38:
-            snprintf(buff, sizeof(buff), "1e-3 °C");
-            break;
-        case 0x39:
-            snprintf(buff, sizeof(buff), "units for HCA");
-            break;
-        case 0x3A:
-        case 0x3B:
-        case 0x3C:
-        case 0x3D:
-            snprintf(buff, sizeof(buff), "reserved");
-            break;
-        case 0x3E:
-            snprintf(buff, sizeof(buff), "reserved but historic");
-            break;
-        case 0x3F:
-            snprintf(buff, sizeof(buff), "without units");
-            break;
-        default:
-            snprintf(buff, sizeof(buff), "unknown");
-            break;
-    }
-
-    return buff;
+    return mbus_data_fixed_units[medium_unit_byte & 0x3F].name;
 }
 
 //------------------------------------------------------------------------------
@@ -1762,7 +2086,7 @@ mbus_data_fixed_unit(int medium_unit_byte)
 const char *
 mbus_data_variable_medium_lookup(unsigned char medium)
 {
-    static char buff[256];
+    static __thread char buff[256];
 
     switch (medium)
     {
@@ -1958,7 +2282,7 @@ mbus_data_variable_medium_lookup(unsigned char medium)
 const char *
 mbus_unit_prefix(int exp)
 {
-    static char buff[256];
+    static __thread char buff[256];
 
     switch (exp)
     {
@@ -2068,7 +2392,7 @@ mbus_dif_datalength_lookup(unsigned char dif)
 const char *
 mbus_vif_unit_lookup(unsigned char vif)
 {
-    static char buff[256];
+    static __thread char buff[256];
     int n;
 
     switch (vif & MBUS_DIB_VIF_WITHOUT_EXTENSION) // ignore the extension bit in this selection
@@ -2396,7 +2720,7 @@ mbus_vif_unit_lookup(unsigned char vif)
 const char *
 mbus_data_error_lookup(int error)
 {
-    static char buff[256];
+    static __thread char buff[256];
 
     switch (error)
     {
@@ -2488,7 +2812,7 @@ mbus_unit_duration_pp(int pp)
 static const char *
 mbus_vib_unit_lookup_fb(mbus_value_information_block *vib)
 {
-    static char buff[256];
+    static __thread char buff[256];
     int n;
     const char * prefix = "";
     switch (vib->vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION)
@@ -2739,7 +3063,7 @@ mbus_vib_unit_lookup_fb(mbus_value_information_block *vib)
 static const char *
 mbus_vib_unit_lookup_fd(mbus_value_information_block *vib)
 {
-    static char buff[256];
+    static __thread char buff[256];
     int n;
 
     // ignore the extension bit in this selection
@@ -3058,7 +3382,7 @@ mbus_vib_unit_lookup_fd(mbus_value_information_block *vib)
 const char *
 mbus_vib_unit_lookup(mbus_value_information_block *vib)
 {
-    static char buff[256];
+    static __thread char buff[256];
     int n;
 
     if (vib == NULL)
@@ -3125,7 +3449,7 @@ mbus_vib_unit_lookup(mbus_value_information_block *vib)
 const char *
 mbus_data_record_decode(mbus_data_record *record)
 {
-    static char buff[768];
+    static __thread char buff[768];
     unsigned char vif, vife;
 
     if (record)
@@ -3133,7 +3457,6 @@ mbus_data_record_decode(mbus_data_record *record)
         int int_val;
         float float_val;
         long long long_long_val;
-        struct tm time;
 
         // ignore extension bit
         vif = (record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION);
@@ -3164,11 +3487,7 @@ mbus_data_record_decode(mbus_data_record *record)
                 // E110 1100  Time Point (date)
                 if (vif == 0x6C)
                 {
-                    mbus_data_tm_decode(&time, record->data, 2);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday);
+                    mbus_data_time_iso(record->data, 2, 0, buff, sizeof(buff));
                 }
                 else  // 2 byte integer
                 {
@@ -3201,14 +3520,7 @@ mbus_data_record_decode(mbus_data_record *record)
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
                 {
-                    mbus_data_tm_decode(&time, record->data, 4);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
+                    mbus_data_time_iso(record->data, 4, 0, buff, sizeof(buff));
                 }
                 else  // 4 byte integer
                 {
@@ -3241,14 +3553,7 @@ mbus_data_record_decode(mbus_data_record *record)
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x30)) ||
                     ((record->drh.vib.vif == 0xFD) && (vife == 0x70)))
                 {
-                    mbus_data_tm_decode(&time, record->data, 6);
-                    snprintf(buff, sizeof(buff), "%04d-%02d-%02dT%02d:%02d:%02d",
-                                                 (time.tm_year + 1900),
-                                                 (time.tm_mon + 1),
-                                                  time.tm_mday,
-                                                  time.tm_hour,
-                                                  time.tm_min,
-                                                  time.tm_sec);
+                    mbus_data_time_iso(record->data, 6, 0, buff, sizeof(buff));
                 }
                 else  // 6 byte integer
                 {
@@ -3399,7 +3704,7 @@ mbus_data_record_decode(mbus_data_record *record)
 const char *
 mbus_data_record_unit(mbus_data_record *record)
 {
-    static char buff[128];
+    static __thread char buff[128];
 
     if (record)
     {
@@ -3417,7 +3722,7 @@ mbus_data_record_unit(mbus_data_record *record)
 const char *
 mbus_data_record_value(mbus_data_record *record)
 {
-    static char buff[768];
+    static __thread char buff[768];
 
     if (record)
     {
@@ -3507,52 +3812,473 @@ int mbus_data_record_device(mbus_data_record *record)
 const char *
 mbus_data_record_function(mbus_data_record *record)
 {
-    static char buff[128];
-
     if (record)
     {
         switch (record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_FUNCTION)
         {
             case 0x00:
-                snprintf(buff, sizeof(buff), "Instantaneous value");
-                break;
+                return "Instantaneous value";
 
             case 0x10:
-                snprintf(buff, sizeof(buff), "Maximum value");
-                break;
+                return "Maximum value";
 
             case 0x20:
-                snprintf(buff, sizeof(buff), "Minimum value");
-                break;
+                return "Minimum value";
 
             case 0x30:
-                snprintf(buff, sizeof(buff), "Value during error state");
-                break;
+                return "Value during error state";
 
             default:
-                snprintf(buff, sizeof(buff), "unknown");
+                return "unknown";
         }
-
-        return buff;
     }
 
     return NULL;
 }
 
 
+//------------------------------------------------------------------------------
+/// Unit names for the typed decode, same vocabulary as the normalized output.
+//------------------------------------------------------------------------------
+static const char *mbus_unit_names[] = {
+    "", "Unknown", "-", "Wh", "J", "m^3", "kg",
+    "s", "min", "h", "d", "month", "year",
+    "W", "J/h", "m^3/h", "m^3/min", "m^3/s", "kg/h",
+    "°C", "K", "°F", "bar", "feet^3",
+    "American gallon", "American gallon/min", "American gallon/h",
+    "V", "A", "Units for H.C.A.", "Currency units", "Baud", "Bittimes",
+    "-", "-"
+};
+
+const char *
+mbus_unit_name(mbus_unit unit)
+{
+    if ((unsigned) unit < sizeof(mbus_unit_names) / sizeof(mbus_unit_names[0]))
+    {
+        return mbus_unit_names[unit];
+    }
+
+    return mbus_unit_names[MBUS_UNIT_UNKNOWN];
+}
+
+static const mbus_unit mbus_time_units[] = {
+    MBUS_UNIT_SECOND, MBUS_UNIT_MINUTE, MBUS_UNIT_HOUR,
+    MBUS_UNIT_DAY, MBUS_UNIT_MONTH, MBUS_UNIT_YEAR
+};
+
+//------------------------------------------------------------------------------
+/// Look up unit code and decimal exponent for a VIF code (see section 8.4.3
+/// and 8.4.4 in the M-BUS spec, code space as in mbus_vif_unit_normalize).
+//------------------------------------------------------------------------------
+static void
+mbus_vif_code_unit(int code, unsigned char dif, mbus_record_value *value)
+{
+    int n = code & 0x07;
+
+    value->exponent = 0;
+    value->unit = MBUS_UNIT_NONE;
+
+    if (code < 0x100)
+    {
+        switch (code & 0x78)
+        {
+            case 0x00: value->unit = MBUS_UNIT_WH;    value->exponent = n - 3; return;
+            case 0x08: value->unit = MBUS_UNIT_J;     value->exponent = n;     return;
+            case 0x10: value->unit = MBUS_UNIT_M3;    value->exponent = n - 6; return;
+            case 0x18: value->unit = MBUS_UNIT_KG;    value->exponent = n - 3; return;
+            case 0x20: value->unit = mbus_time_units[code & 0x03];             return;
+            case 0x28: value->unit = MBUS_UNIT_W;     value->exponent = n - 3; return;
+            case 0x30: value->unit = MBUS_UNIT_J_H;   value->exponent = n;     return;
+            case 0x38: value->unit = MBUS_UNIT_M3_H;  value->exponent = n - 6; return;
+            case 0x40: value->unit = MBUS_UNIT_M3_MIN; value->exponent = n - 7; return;
+            case 0x48: value->unit = MBUS_UNIT_M3_S;  value->exponent = n - 9; return;
+            case 0x50: value->unit = MBUS_UNIT_KG_H;  value->exponent = n - 3; return;
+            case 0x58: value->unit = MBUS_UNIT_CELSIUS; value->exponent = (code & 0x03) - 3; return;
+            case 0x70: value->unit = mbus_time_units[code & 0x03];             return;
+        }
+
+        switch (code & 0x7C)
+        {
+            case 0x60: value->unit = MBUS_UNIT_KELVIN;  value->exponent = (code & 0x03) - 3; return;
+            case 0x64: value->unit = MBUS_UNIT_CELSIUS; value->exponent = (code & 0x03) - 3; return;
+            case 0x68: value->unit = MBUS_UNIT_BAR;     value->exponent = (code & 0x03) - 3; return;
+        }
+
+        switch (code)
+        {
+            case 0x6C: value->unit = MBUS_UNIT_DATE;     return;
+            case 0x6D: value->unit = MBUS_UNIT_DATETIME; return;
+            case 0x6E: value->unit = MBUS_UNIT_HCA;      return;
+            case 0x78: // Fabrication No
+            case 0x79: // (Enhanced) Identification
+            case 0x7A: // Bus Address
+            case 0x7E: // Any VIF
+            case 0x7F: // Manufacturer specific
+                return;
+        }
+
+        value->unit = MBUS_UNIT_UNKNOWN;
+        return;
+    }
+
+    if (code < 0x200)
+    {
+        code &= 0x7F;
+
+        if (code <= 0x07)
+        {
+            value->unit = MBUS_UNIT_CURRENCY; // credit / debit
+            value->exponent = (code & 0x03) - 3;
+            return;
+        }
+
+        if ((code >= 0x08 && code <= 0x18) || code == 0x1A || code == 0x1B ||
+            code == 0x1E || (code >= 0x20 && code <= 0x22) || code == 0x3A ||
+            (code >= 0x60 && code <= 0x67))
+        {
+            return; // identification, counters and other dimensionless values
+        }
+
+        if (code >= 0x24 && code <= 0x29) { value->unit = mbus_time_units[code - 0x24]; return; }
+        if (code >= 0x2C && code <= 0x2F) { value->unit = mbus_time_units[code - 0x2C]; return; }
+        if (code >= 0x31 && code <= 0x33) { value->unit = mbus_time_units[code - 0x30]; return; }
+        if (code >= 0x34 && code <= 0x39) { value->unit = mbus_time_units[code - 0x34]; return; }
+        if (code >= 0x68 && code <= 0x6B) { value->unit = mbus_time_units[code - 0x68 + 2]; return; }
+        if (code >= 0x6C && code <= 0x6F) { value->unit = mbus_time_units[code - 0x6C + 2]; return; }
+
+        if (code >= 0x40 && code <= 0x4F)
+        {
+            value->unit = MBUS_UNIT_V;
+            value->exponent = (code & 0x0F) - 9;
+            return;
+        }
+
+        if (code >= 0x50 && code <= 0x5F)
+        {
+            value->unit = MBUS_UNIT_A;
+            value->exponent = (code & 0x0F) - 12;
+            return;
+        }
+
+        switch (code)
+        {
+            case 0x1C: value->unit = MBUS_UNIT_BAUD;     return;
+            case 0x1D: value->unit = MBUS_UNIT_BITTIMES; return;
+            case 0x30: // Start (date/time) of tariff, type G or F from the DIF
+            case 0x70: // Date and time of battery change
+                value->unit = ((dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x02) ?
+                              MBUS_UNIT_DATE : MBUS_UNIT_DATETIME;
+                return;
+        }
+
+        value->unit = MBUS_UNIT_UNKNOWN;
+        return;
+    }
+
+    code &= 0x7F;
+
+    switch (code)
+    {
+        case 0x00: case 0x01: value->unit = MBUS_UNIT_WH;  value->exponent = (code & 0x01) + 5; return;
+        case 0x08: case 0x09: value->unit = MBUS_UNIT_J;   value->exponent = (code & 0x01) + 8; return;
+        case 0x10: case 0x11: value->unit = MBUS_UNIT_M3;  value->exponent = (code & 0x01) + 2; return;
+        case 0x18: case 0x19: value->unit = MBUS_UNIT_KG;  value->exponent = (code & 0x01) + 5; return;
+        case 0x28: case 0x29: value->unit = MBUS_UNIT_W;   value->exponent = (code & 0x01) + 5; return;
+        case 0x30: case 0x31: value->unit = MBUS_UNIT_J_H; value->exponent = (code & 0x01) + 8; return;
+        case 0x21: value->unit = MBUS_UNIT_FEET3;         value->exponent = -1; return;
+        case 0x22: value->unit = MBUS_UNIT_US_GALLON;     value->exponent = -1; return;
+        case 0x23: value->unit = MBUS_UNIT_US_GALLON;     return;
+        case 0x24: value->unit = MBUS_UNIT_US_GALLON_MIN; value->exponent = -3; return;
+        case 0x25: value->unit = MBUS_UNIT_US_GALLON_MIN; return;
+        case 0x26: value->unit = MBUS_UNIT_US_GALLON_H;   return;
+    }
+
+    if ((code >= 0x58 && code <= 0x67) || (code >= 0x70 && code <= 0x73))
+    {
+        value->unit = MBUS_UNIT_FAHRENHEIT;
+        value->exponent = (code & 0x03) - 3;
+        return;
+    }
+
+    if (code >= 0x74 && code <= 0x77)
+    {
+        value->unit = MBUS_UNIT_CELSIUS;
+        value->exponent = (code & 0x03) - 3;
+        return;
+    }
+
+    if (code >= 0x78)
+    {
+        value->unit = MBUS_UNIT_W; // cumulation counter max power
+        value->exponent = n - 3;
+        return;
+    }
+
+    value->unit = MBUS_UNIT_UNKNOWN;
+}
+
+//------------------------------------------------------------------------------
+/// Decode a variable-length data record into a typed value. No memory is
+/// allocated and no strings are formatted, integer and BCD values stay exact.
+/// Returns 0 on success, -1 on invalid arguments and -2 for unknown DIFs.
+//------------------------------------------------------------------------------
+int
+mbus_data_record_decode_typed(mbus_data_record *record, mbus_record_value *value)
+{
+    mbus_value_information_block *vib;
+    unsigned char dif, vif, vife;
+
+    if (record == NULL || value == NULL)
+    {
+        return -1;
+    }
+
+    dif  = record->drh.dib.dif;
+    vib  = &(record->drh.vib);
+    vif  = vib->vif & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+    vife = vib->vife[0] & MBUS_DIB_VIF_WITHOUT_EXTENSION;
+
+    value->type = MBUS_VALUE_TYPE_NONE;
+    value->value.integer = 0;
+    value->data = NULL;
+    value->data_len = 0;
+
+    value->function       = (dif & MBUS_DATA_RECORD_DIF_MASK_FUNCTION) >> 4;
+    value->storage_number = mbus_data_record_storage_number(record);
+    value->tariff         = mbus_data_record_tariff(record);
+    value->device         = mbus_data_record_device(record);
+    value->timestamp      = record->timestamp;
+    value->first_byte     = record->first_byte;
+    value->last_byte      = record->last_byte;
+
+    //
+    // unit and exponent
+    //
+    if (vib->vif == 0xFD || vib->vif == 0xFB)
+    {
+        value->vif_code = vife | ((vib->vif == 0xFD) ? 0x100 : 0x200);
+    }
+    else
+    {
+        value->vif_code = vif;
+    }
+
+    if (vif == 0x7C)
+    {
+        value->unit = MBUS_UNIT_CUSTOM;
+        value->exponent = 0;
+    }
+    else if ((vib->vif == 0xFD || vib->vif == 0xFB) && vib->nvife == 0)
+    {
+        value->unit = MBUS_UNIT_UNKNOWN;
+        value->exponent = 0;
+    }
+    else
+    {
+        mbus_vif_code_unit(value->vif_code, dif, value);
+    }
+
+    if ((vib->vif & MBUS_DIB_VIF_EXTENSION_BIT) &&
+        (vib->vif != 0xFD) &&
+        (vib->vif != 0xFB))                       // codes for VIF extention: see table 8.4.5
+    {
+        if (vife >= 0x70 && vife <= 0x77)         // multiplicative correction factor: 10^(nnn-6)
+        {
+            value->exponent += (vife & 0x07) - 6;
+        }
+        else if (vife == 0x7D)                    // multiplicative correction factor: 10^3
+        {
+            value->exponent += 3;
+        }
+    }
+
+    return mbus_data_value_decode_typed(dif, record->data, record->data_len, value);
+}
+
+//------------------------------------------------------------------------------
+/// Decode the value of a data record with the given DIF. The unit of value has
+/// to be set already, as it tells dates apart from integers. Only type, value,
+/// data and data_len of value are set.
+//------------------------------------------------------------------------------
+int
+mbus_data_value_decode_typed(unsigned char dif, unsigned char *data, size_t data_len, mbus_record_value *value)
+{
+    long long long_long_val;
+    int int_val, len, i;
+
+    if (data == NULL || value == NULL)
+    {
+        return -1;
+    }
+
+    value->type = MBUS_VALUE_TYPE_NONE;
+    value->value.integer = 0;
+    value->data = NULL;
+    value->data_len = 0;
+
+    //
+    // value, BCD is decoded decimal also for values during error state
+    //
+    switch (dif & MBUS_DATA_RECORD_DIF_MASK_DATA)
+    {
+        case 0x00: // no data
+            break;
+
+        case 0x01: // 1 byte integer (8 bit)
+        case 0x03: // 3 byte integer (24 bit)
+            mbus_data_int_decode(data, dif & MBUS_DATA_RECORD_DIF_MASK_DATA, &int_val);
+            value->type = MBUS_VALUE_TYPE_INTEGER;
+            value->value.integer = int_val;
+            break;
+
+        case 0x02: // 2 byte integer (16 bit) or type G date
+        case 0x04: // 4 byte integer (32 bit) or type F date/time
+        case 0x06: // 6 byte integer (48 bit) or type I date/time
+            len = ((dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x02) ? 2 :
+                  ((dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x04) ? 4 : 6;
+
+            if (value->unit == MBUS_UNIT_DATE || value->unit == MBUS_UNIT_DATETIME)
+            {
+                value->type = (len == 2) ? MBUS_VALUE_TYPE_DATE : MBUS_VALUE_TYPE_DATETIME;
+                value->data = data;
+                value->data_len = len;
+                for (i = len; i > 0; i--)
+                {
+                    value->value.integer = (value->value.integer << 8) | data[i-1];
+                }
+                break;
+            }
+
+            mbus_data_long_long_decode(data, len, &long_long_val);
+            value->type = MBUS_VALUE_TYPE_INTEGER;
+            value->value.integer = long_long_val;
+            break;
+
+        case 0x05: // 4 Byte Real (32 bit)
+            value->type = MBUS_VALUE_TYPE_REAL;
+            value->value.real = mbus_data_float_decode(data);
+            break;
+
+        case 0x07: // 8 byte integer (64 bit)
+            mbus_data_long_long_decode(data, 8, &long_long_val);
+            value->type = MBUS_VALUE_TYPE_INTEGER;
+            value->value.integer = long_long_val;
+            break;
+
+        case 0x09: // 2 digit BCD (8 bit)
+        case 0x0A: // 4 digit BCD (16 bit)
+        case 0x0B: // 6 digit BCD (24 bit)
+        case 0x0C: // 8 digit BCD (32 bit)
+        case 0x0E: // 12 digit BCD (48 bit)
+            len = mbus_dif_datalength_lookup(dif);
+            value->type = MBUS_VALUE_TYPE_INTEGER;
+            value->value.integer = mbus_data_bcd_decode(data, len);
+            break;
+
+        case 0x0D: // variable length
+            if (data_len < 1)
+            {
+                value->type = MBUS_VALUE_TYPE_BINARY;
+                break;
+            }
+
+            value->type = (data[0] <= 0xBF) ? MBUS_VALUE_TYPE_STRING : MBUS_VALUE_TYPE_BINARY;
+            value->data = &data[1];
+            value->data_len = data_len - 1;
+            break;
+
+        case 0x0F: // special functions
+            value->type = MBUS_VALUE_TYPE_BINARY;
+            value->data = data;
+            value->data_len = data_len;
+            break;
+
+        default:
+            return -2;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Decode fixed data in one pass: identification, status and both counters
+/// with unit and exponent. No strings are formatted. Returns 0 on success and
+/// -1 on invalid arguments.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_decode_typed(mbus_data_fixed *data, mbus_data_fixed_value *value)
+{
+    const mbus_data_fixed_unit_entry *unit;
+    mbus_record_value *counter;
+    unsigned char *cnt_val, cnt_type;
+    long long_val;
+    int i;
+
+    if (data == NULL || value == NULL)
+    {
+        return -1;
+    }
+
+    value->id        = mbus_data_bcd_decode(data->id_bcd, 4);
+    value->access_no = data->tx_cnt;
+    value->status    = data->status;
+    value->bcd       = (data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD;
+    value->medium    = (data->cnt1_type & 0xC0) >> 6 | (data->cnt2_type & 0xC0) >> 4;
+
+    for (i = 0; i < 2; i++)
+    {
+        counter  = &(value->counter[i]);
+        cnt_val  = (i == 0) ? data->cnt1_val  : data->cnt2_val;
+        cnt_type = ((i == 0) ? data->cnt1_type : data->cnt2_type) & 0x3F;
+
+        counter->type           = MBUS_VALUE_TYPE_INTEGER;
+        counter->data           = NULL;
+        counter->data_len       = 0;
+        counter->vif_code       = cnt_type;
+        counter->function       = MBUS_RECORD_FUNCTION_INSTANTANEOUS;
+        counter->storage_number = (data->status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED;
+        counter->tariff         = -1;
+        counter->device         = -1;
+        counter->timestamp      = 0;
+        memset(&(counter->first_byte), 0, sizeof(mbus_timestamp));
+        memset(&(counter->last_byte), 0, sizeof(mbus_timestamp));
+
+        if (value->bcd)
+        {
+            counter->value.integer = mbus_data_bcd_decode(cnt_val, 4);
+        }
+        else
+        {
+            mbus_data_long_decode(cnt_val, 4, &long_val);
+            counter->value.integer = long_val;
+        }
+
+        // counter 2 in the unit of counter 1, but historic
+        if (i == 1 && cnt_type == 0x3E)
+        {
+            unit = &mbus_data_fixed_units[data->cnt1_type & 0x3F];
+            counter->storage_number = 1;
+        }
+        else
+        {
+            unit = &mbus_data_fixed_units[cnt_type];
+        }
+
+        counter->unit     = unit->unit;
+        counter->exponent = unit->exponent;
+    }
+
+    return 0;
+}
+
 ///
 /// For fixed-length frames, return a string describing the type of value (stored or actual)
 ///
 const char *
 mbus_data_fixed_function(int status)
 {
-    static char buff[128];
-
-    snprintf(buff, sizeof(buff), "%s",
-            (status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED ?
-            "Stored value" : "Actual value" );
-
-    return buff;
+    return (status & MBUS_DATA_FIXED_STATUS_DATE_MASK) == MBUS_DATA_FIXED_STATUS_DATE_STORED ?
+           "Stored value" : "Actual value";
 }
 
 //------------------------------------------------------------------------------
@@ -3564,8 +4290,8 @@ mbus_data_fixed_function(int status)
 //------------------------------------------------------------------------------
 /// PARSE M-BUS frame data structures from binary data.
 //------------------------------------------------------------------------------
-int
-mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size)
+static int
+mbus_parse_internal(mbus_frame *frame, unsigned char *data, size_t data_size)
 {
     size_t i, len;
 
@@ -3724,6 +4450,16 @@ mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size)
     return -1;
 }
 
+int
+mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size)
+{
+    int result = mbus_parse_internal(frame, data, data_size);
+
+    MBUS_TRACE3(parse, data_size, result, frame ? frame->type : 0);
+
+    return result;
+}
+
 
 //------------------------------------------------------------------------------
 /// Parse the fixed-length data of a M-Bus frame
@@ -3765,215 +4501,257 @@ mbus_data_fixed_parse(mbus_frame *frame, mbus_data_fixed *data)
 
 
 //------------------------------------------------------------------------------
-/// Parse the variable-length data of a M-Bus frame
+/// Parse the fixed header of variable-length data
 //------------------------------------------------------------------------------
 int
-mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
+mbus_data_variable_header_parse(mbus_frame *frame, mbus_data_variable_header *header)
 {
-    mbus_data_record *record = NULL;
-    size_t i, j;
+    if (frame == NULL || header == NULL)
+    {
+        snprintf(error_str, sizeof(error_str), "Got null pointer to frame or header.");
+        return -1;
+    }
 
-    if (frame && data)
+    if (frame->data_size < MBUS_DATA_VARIABLE_HEADER_LENGTH)
     {
-        // parse header
-        data->nrecords = 0;
-        data->more_records_follow = 0;
-        i = MBUS_DATA_VARIABLE_HEADER_LENGTH;
+        snprintf(error_str, sizeof(error_str), "Variable header too short.");
+        return -1;
+    }
 
-        if(frame->data_size < i)
-        {
-            snprintf(error_str, sizeof(error_str), "Variable header too short.");
-            return -1;
-        }
+    // copy the variable data fixed header bytewise
+    header->id_bcd[0]       = frame->data[0];
+    header->id_bcd[1]       = frame->data[1];
+    header->id_bcd[2]       = frame->data[2];
+    header->id_bcd[3]       = frame->data[3];
+    header->manufacturer[0] = frame->data[4];
+    header->manufacturer[1] = frame->data[5];
+    header->version         = frame->data[6];
+    header->medium          = frame->data[7];
+    header->access_no       = frame->data[8];
+    header->status          = frame->data[9];
+    header->signature[0]    = frame->data[10];
+    header->signature[1]    = frame->data[11];
 
-        // first copy the variable data fixed header bytewise
-        data->header.id_bcd[0]       = frame->data[0];
-        data->header.id_bcd[1]       = frame->data[1];
-        data->header.id_bcd[2]       = frame->data[2];
-        data->header.id_bcd[3]       = frame->data[3];
-        data->header.manufacturer[0] = frame->data[4];
-        data->header.manufacturer[1] = frame->data[5];
-        data->header.version         = frame->data[6];
-        data->header.medium          = frame->data[7];
-        data->header.access_no       = frame->data[8];
-        data->header.status          = frame->data[9];
-        data->header.signature[0]    = frame->data[10];
-        data->header.signature[1]    = frame->data[11];
+    return 0;
+}
 
-        data->record = NULL;
+//------------------------------------------------------------------------------
+/// Parse one data record (DIB, VIB and data) of variable-length data starting
+/// at *offset and advance the offset past it. Manufacturer specific data and
+/// the 'more records follow' marker take the rest of the frame.
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_record_parse(mbus_frame *frame, size_t *offset, mbus_data_record *record)
+{
+    size_t i, j;
 
-        while (i < frame->data_size)
-        {
-            // Skip filler dif=2F
-            if ((frame->data[i] & 0xFF) == MBUS_DIB_DIF_IDLE_FILLER)
-            {
-              i++;
-              continue;
-            }
+    if (frame == NULL || offset == NULL || record == NULL || *offset >= frame->data_size)
+    {
+        snprintf(error_str, sizeof(error_str), "Invalid record offset.");
+        return -1;
+    }
 
-            if ((record = mbus_data_record_new()) == NULL)
-            {
-                // clean up...
-                return (-2);
-            }
+    i = *offset;
+    memset(record, 0, sizeof(mbus_data_record));
 
-            // copy timestamp
-            memcpy((void *)&(record->timestamp), (void *)&(frame->timestamp), sizeof(time_t));
+    // copy timestamps
+    memcpy((void *)&(record->timestamp), (void *)&(frame->timestamp), sizeof(time_t));
+    record->first_byte = frame->first_byte;
+    record->last_byte  = frame->last_byte;
 
-            // read and parse DIB (= DIF + DIFE)
+    // read and parse DIB (= DIF + DIFE)
 
-            // DIF
-            record->drh.dib.dif = frame->data[i];
+    // DIF
+    record->drh.dib.dif = frame->data[i];
 
-            if ((record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) ||
-                (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW))
-            {
-                if ((record->drh.dib.dif & 0xFF) == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
-                {
-                  data->more_records_follow = 1;
-                }
+    if ((record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) ||
+        (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW))
+    {
+        i++;
+        // just copy the remaining data as it is vendor specific
+        record->data_len = frame->data_size - i;
+        for (j = 0; j < record->data_len; j++)
+        {
+            record->data[j] = frame->data[i++];
+        }
 
-                i++;
-                // just copy the remaining data as it is vendor specific
-                record->data_len = frame->data_size - i;
-                for (j = 0; j < record->data_len; j++)
-                {
-                    record->data[j] = frame->data[i++];
-                }
+        *offset = i;
+        return 0;
+    }
 
-                // append the record and move on to next one
-                mbus_data_record_append(data, record);
-                data->nrecords++;
-                continue;
-            }
+    // calculate length of data record
+    record->data_len = mbus_dif_datalength_lookup(record->drh.dib.dif);
 
-            // calculate length of data record
-            record->data_len = mbus_dif_datalength_lookup(record->drh.dib.dif);
+    // read DIF extensions
+    record->drh.dib.ndife = 0;
+    while ((i < frame->data_size) &&
+           (frame->data[i] & MBUS_DIB_DIF_EXTENSION_BIT))
+    {
+        unsigned char dife;
 
-            // read DIF extensions
-            record->drh.dib.ndife = 0;
-            while ((i < frame->data_size) &&
-                   (frame->data[i] & MBUS_DIB_DIF_EXTENSION_BIT))
-            {
-                unsigned char dife;
+        if (record->drh.dib.ndife >= MBUS_DATA_INFO_BLOCK_DIFE_SIZE)
+        {
+            snprintf(error_str, sizeof(error_str), "Too many DIFE.");
+            return -1;
+        }
 
-                if (record->drh.dib.ndife >= MBUS_DATA_INFO_BLOCK_DIFE_SIZE)
-                {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Too many DIFE.");
-                    return -1;
-                }
+        dife = frame->data[i+1];
+        record->drh.dib.dife[record->drh.dib.ndife] = dife;
+
+        record->drh.dib.ndife++;
+        i++;
+    }
+    i++;
+
+    if (i > frame->data_size)
+    {
+        snprintf(error_str, sizeof(error_str), "Premature end of record at DIF.");
+        return -1;
+    }
 
-                dife = frame->data[i+1];
-                record->drh.dib.dife[record->drh.dib.ndife] = dife;
+    // read and parse VIB (= VIF + VIFE)
 
-                record->drh.dib.ndife++;
-                i++;
-            }
-            i++;
+    // VIF
+    record->drh.vib.vif = frame->data[i++];
+
+    if ((record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION) == 0x7C)
+    {
+        // variable length VIF in ASCII format
+        int var_vif_len;
+        var_vif_len = frame->data[i++];
+        if (var_vif_len > MBUS_VALUE_INFO_BLOCK_CUSTOM_VIF_SIZE)
+        {
+            snprintf(error_str, sizeof(error_str), "Too long variable length VIF.");
+            return -1;
+        }
+
+        if (i + var_vif_len > frame->data_size)
+        {
+            snprintf(error_str, sizeof(error_str), "Premature end of record at variable length VIF.");
+            return -1;
+        }
+        mbus_data_str_decode(record->drh.vib.custom_vif, &(frame->data[i]), var_vif_len);
+        i += var_vif_len;
+    }
+
+    // VIFE
+    record->drh.vib.nvife = 0;
+
+    if (record->drh.vib.vif & MBUS_DIB_VIF_EXTENSION_BIT)
+    {
+        record->drh.vib.vife[0] = frame->data[i];
+        record->drh.vib.nvife++;
 
-            if (i > frame->data_size)
+        while ((i < frame->data_size) &&
+               (frame->data[i] & MBUS_DIB_VIF_EXTENSION_BIT))
+        {
+            unsigned char vife;
+
+            if (record->drh.vib.nvife >= MBUS_VALUE_INFO_BLOCK_VIFE_SIZE)
             {
-                mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at DIF.");
+                snprintf(error_str, sizeof(error_str), "Too many VIFE.");
                 return -1;
             }
 
-            // read and parse VIB (= VIF + VIFE)
+            vife = frame->data[i+1];
+            record->drh.vib.vife[record->drh.vib.nvife] = vife;
 
-            // VIF
-            record->drh.vib.vif = frame->data[i++];
+            record->drh.vib.nvife++;
+            i++;
+        }
+        i++;
+    }
 
-            if ((record->drh.vib.vif & MBUS_DIB_VIF_WITHOUT_EXTENSION) == 0x7C)
-            {
-                // variable length VIF in ASCII format
-                int var_vif_len;
-                var_vif_len = frame->data[i++];
-                if (var_vif_len > MBUS_VALUE_INFO_BLOCK_CUSTOM_VIF_SIZE)
-                {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Too long variable length VIF.");
-                    return -1;
-                }
+    if (i > frame->data_size)
+    {
+        snprintf(error_str, sizeof(error_str), "Premature end of record at VIF.");
+        return -1;
+    }
 
-                if (i + var_vif_len > frame->data_size)
-                {
-                    mbus_data_record_free(record);
-                    snprintf(error_str, sizeof(error_str), "Premature end of record at variable length VIF.");
-                    return -1;
-                }
-                mbus_data_str_decode(record->drh.vib.custom_vif, &(frame->data[i]), var_vif_len);
-                i += var_vif_len;
-            }
+    // re-calculate data length, if of variable length type
+    if ((record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x0D) // flag for variable length data
+    {
+        if(frame->data[i] <= 0xBF)
+            record->data_len = frame->data[i];
+        else if(frame->data[i] >= 0xC0 && frame->data[i] <= 0xC9)
+            record->data_len = (frame->data[i] - 0xC0) * 2;
+        else if(frame->data[i] >= 0xD0 && frame->data[i] <= 0xD9)
+            record->data_len = (frame->data[i] - 0xD0) * 2;
+        else if(frame->data[i] >= 0xE0 && frame->data[i] <= 0xEF)
+            record->data_len = frame->data[i] - 0xE0;
+        else if(frame->data[i] >= 0xF0 && frame->data[i] <= 0xF4)
+            record->data_len = (frame->data[i] - 0xEC) * 4;
+        else if(frame->data[i] == 0xF5)
+            record->data_len = 48;
+        else if(frame->data[i] == 0xF6)
+            record->data_len = 64;
+        // keep the LVAR byte, which is required to determine the data type
+        record->data_len++;
+    }
 
-            // VIFE
-            record->drh.vib.nvife = 0;
+    if (i + record->data_len > frame->data_size)
+    {
+        snprintf(error_str, sizeof(error_str), "Premature end of record at data.");
+        return -1;
+    }
 
-            if (record->drh.vib.vif & MBUS_DIB_VIF_EXTENSION_BIT)
-            {
-                record->drh.vib.vife[0] = frame->data[i];
-                record->drh.vib.nvife++;
+    // copy data
+    for (j = 0; j < record->data_len; j++)
+    {
+        record->data[j] = frame->data[i++];
+    }
 
-                while ((i < frame->data_size) &&
-                       (frame->data[i] & MBUS_DIB_VIF_EXTENSION_BIT))
-                {
-                    unsigned char vife;
+    *offset = i;
+    return 0;
+}
 
-                    if (record->drh.vib.nvife >= MBUS_VALUE_INFO_BLOCK_VIFE_SIZE)
-                    {
-                        mbus_data_record_free(record);
-                        snprintf(error_str, sizeof(error_str), "Too many VIFE.");
-                        return -1;
-                    }
+//------------------------------------------------------------------------------
+/// Parse the variable-length data of a M-Bus frame
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
+{
+    mbus_data_record *record = NULL;
+    size_t i;
 
-                    vife = frame->data[i+1];
-                    record->drh.vib.vife[record->drh.vib.nvife] = vife;
+    if (frame && data)
+    {
+        // parse header
+        data->nrecords = 0;
+        data->more_records_follow = 0;
+        data->record = NULL;
 
-                    record->drh.vib.nvife++;
-                    i++;
-                }
-                i++;
-            }
+        if (mbus_data_variable_header_parse(frame, &(data->header)) != 0)
+        {
+            return -1;
+        }
 
-            if (i > frame->data_size)
+        i = MBUS_DATA_VARIABLE_HEADER_LENGTH;
+
+        while (i < frame->data_size)
+        {
+            // Skip filler dif=2F
+            if ((frame->data[i] & 0xFF) == MBUS_DIB_DIF_IDLE_FILLER)
             {
-                mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at VIF.");
-                return -1;
+              i++;
+              continue;
             }
 
-            // re-calculate data length, if of variable length type
-            if ((record->drh.dib.dif & MBUS_DATA_RECORD_DIF_MASK_DATA) == 0x0D) // flag for variable length data
+            if ((record = mbus_data_record_new()) == NULL)
             {
-                if(frame->data[i] <= 0xBF)
-                    record->data_len = frame->data[i];
-                else if(frame->data[i] >= 0xC0 && frame->data[i] <= 0xC9)
-                    record->data_len = (frame->data[i] - 0xC0) * 2;
-                else if(frame->data[i] >= 0xD0 && frame->data[i] <= 0xD9)
-                    record->data_len = (frame->data[i] - 0xD0) * 2;
-                else if(frame->data[i] >= 0xE0 && frame->data[i] <= 0xEF)
-                    record->data_len = frame->data[i] - 0xE0;
-                else if(frame->data[i] >= 0xF0 && frame->data[i] <= 0xF4)
-                    record->data_len = (frame->data[i] - 0xEC) * 4;
-                else if(frame->data[i] == 0xF5)
-                    record->data_len = 48;
-                else if(frame->data[i] == 0xF6)
-                    record->data_len = 64;
-                // keep the LVAR byte, which is required to determine the data type
-                record->data_len++;
+                // clean up...
+                return (-2);
             }
 
-            if (i + record->data_len > frame->data_size)
+            if (mbus_data_variable_record_parse(frame, &i, record) != 0)
             {
                 mbus_data_record_free(record);
-                snprintf(error_str, sizeof(error_str), "Premature end of record at data.");
                 return -1;
             }
 
-            // copy data
-            for (j = 0; j < record->data_len; j++)
+            if ((record->drh.dib.dif & 0xFF) == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
             {
-                record->data[j] = frame->data[i++];
+                data->more_records_follow = 1;
             }
 
             // append the record and move on to next one
@@ -3987,12 +4765,65 @@ mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data)
     return -1;
 }
 
+//------------------------------------------------------------------------------
+/// Parse the variable-length data of a M-Bus frame and pass each data record
+/// to a visitor as soon as it is decoded, without building the record list.
+/// The record lives on the stack and is only valid during the callback, a
+/// non-zero return value of the visitor stops the parsing.
+///
+/// Returns 0 when all records were visited, 1 when stopped by the visitor and
+/// -1 on error (records before the faulty one have been visited).
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_parse_visit(mbus_frame *frame,
+                               mbus_data_variable_header *header,
+                               mbus_data_record_visitor visit, void *arg)
+{
+    mbus_data_record record;
+    size_t i;
+
+    if (frame == NULL || header == NULL || visit == NULL)
+    {
+        snprintf(error_str, sizeof(error_str), "Got null pointer to frame, header or visitor.");
+        return -1;
+    }
+
+    if (mbus_data_variable_header_parse(frame, header) != 0)
+    {
+        return -1;
+    }
+
+    i = MBUS_DATA_VARIABLE_HEADER_LENGTH;
+
+    while (i < frame->data_size)
+    {
+        // Skip filler dif=2F
+        if ((frame->data[i] & 0xFF) == MBUS_DIB_DIF_IDLE_FILLER)
+        {
+            i++;
+            continue;
+        }
+
+        if (mbus_data_variable_record_parse(frame, &i, &record) != 0)
+        {
+            return -1;
+        }
+
+        if (visit(header, &record, arg) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 /// Check the stype of the frame data (error, fixed or variable) and dispatch to the
 /// corresponding parser function.
 //------------------------------------------------------------------------------
-int
-mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
+static int
+mbus_frame_data_parse_internal(mbus_frame *frame, mbus_frame_data *data)
 {
     char direction;
 
@@ -4064,6 +4895,20 @@ mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
     return -1;
 }
 
+int
+mbus_frame_data_parse(mbus_frame *frame, mbus_frame_data *data)
+{
+    int result;
+
+    MBUS_TRACE2(frame_data_parse_start, frame, frame ? frame->control_information : 0);
+
+    result = mbus_frame_data_parse_internal(frame, data);
+
+    MBUS_TRACE3(frame_data_parse_end, frame, result, data ? data->type : 0);
+
+    return result;
+}
+
 //------------------------------------------------------------------------------
 /// Pack the M-bus frame into a binary string representation that can be sent
 /// on the bus. The binary packet format is different for the different types
@@ -4537,519 +5382,991 @@ mbus_data_error_print(int error)
 
 //------------------------------------------------------------------------------
 ///
-/// Encode string to XML
+/// Output sinks
 ///
 //------------------------------------------------------------------------------
-int
-mbus_str_xml_encode(unsigned char *dst, const unsigned char *src, size_t max_len)
+static void
+mbus_sink_init(mbus_sink *sink, int type)
 {
-    size_t i, len;
+    sink->type  = type;
+    sink->write = NULL;
+    sink->arg   = NULL;
+    sink->fp    = NULL;
+    sink->buff  = NULL;
+    sink->size  = 0;
+    sink->len   = 0;
+    sink->total = 0;
+    sink->error = 0;
+}
 
-    i = 0;
-    len = 0;
+//------------------------------------------------------------------------------
+/// Sink passing the output to a write callback (non-zero return is an error).
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_callback(mbus_sink *sink, mbus_sink_write_fn write, void *arg)
+{
+    mbus_sink_init(sink, MBUS_SINK_CALLBACK);
+    sink->write = write;
+    sink->arg   = arg;
+}
 
-    if (dst == NULL)
-    {
-        return -1;
-    }
+//------------------------------------------------------------------------------
+/// Sink writing to a stdio stream.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_file(mbus_sink *sink, FILE *fp)
+{
+    mbus_sink_init(sink, MBUS_SINK_FILE);
+    sink->fp = fp;
+}
 
-    if (src == NULL)
-    {
-        dst[len] = '\0';
-        return -2;
-    }
+//------------------------------------------------------------------------------
+/// Sink writing into a fixed buffer, output is truncated like snprintf.
+//------------------------------------------------------------------------------
+void
+mbus_sink_init_buffer(mbus_sink *sink, char *buff, size_t size)
+{
+    mbus_sink_init(sink, MBUS_SINK_BUFFER);
+    sink->buff = buff;
+    sink->size = size;
 
-    while((len+6) < max_len)
+    if (buff && size > 0)
     {
-        if (src[i] == '\0')
-        {
-            break;
-        }
-
-        if (iscntrl(src[i]))
-        {
-            // convert all control chars into spaces
-            dst[len++] = ' ';
-        }
-        else
-        {
-            switch (src[i])
-            {
-                case '&':
-                    len += snprintf(&dst[len], max_len - len, "&amp;");
-                    break;
-                case '<':
-                    len += snprintf(&dst[len], max_len - len, "&lt;");
-                    break;
-                case '>':
-                    len += snprintf(&dst[len], max_len - len, "&gt;");
-                    break;
-                case '"':
-                    len += snprintf(&dst[len], max_len - len, "&quot;");
-                    break;
-                default:
-                    dst[len++] = src[i];
-                    break;
-            }
-        }
-
-        i++;
+        buff[0] = '\0';
     }
-
-    dst[len] = '\0';
-    return 0;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for the variable-length data header
+/// Sink writing into a heap buffer that doubles in size when needed. The
+/// buffer is handed over with mbus_sink_release or freed with mbus_sink_free.
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_header_xml(mbus_data_variable_header *header)
+int
+mbus_sink_init_growable(mbus_sink *sink, size_t size)
 {
-    static char buff[8192];
-    char str_encoded[768];
-    size_t len = 0;
+    mbus_sink_init(sink, MBUS_SINK_GROWABLE);
 
-    if (header)
+    if (size < 64)
     {
-        len += snprintf(&buff[len], sizeof(buff) - len, "    <SlaveInformation>\n");
-
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Id>%llX</Id>\n", mbus_data_bcd_decode_hex(header->id_bcd, 4));
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Manufacturer>%s</Manufacturer>\n",
-                mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Version>%d</Version>\n", header->version);
+        size = 64;
+    }
 
-        mbus_str_xml_encode(str_encoded, mbus_data_product_name(header), sizeof(str_encoded));
+    if ((sink->buff = (char *) malloc(size)) == NULL)
+    {
+        sink->error = 1;
+        return -1;
+    }
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <ProductName>%s</ProductName>\n", str_encoded);
+    sink->buff[0] = '\0';
+    sink->size = size;
 
-        mbus_str_xml_encode(str_encoded, mbus_data_variable_medium_lookup(header->medium), sizeof(str_encoded));
+    return 0;
+}
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Medium>%s</Medium>\n", str_encoded);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <AccessNumber>%d</AccessNumber>\n", header->access_no);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Status>%.2X</Status>\n", header->status);
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Signature>%.2X%.2X</Signature>\n", header->signature[1], header->signature[0]);
+static int
+mbus_sink_grow(mbus_sink *sink, size_t len)
+{
+    size_t size = sink->size;
+    char *buff;
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "    </SlaveInformation>\n\n");
+    while (size - sink->len <= len)
+    {
+        size *= 2;
+    }
 
-        return buff;
+    if ((buff = (char *) realloc(sink->buff, size)) == NULL)
+    {
+        sink->error = 1;
+        return -1;
     }
 
-    return "";
+    sink->buff = buff;
+    sink->size = size;
+
+    return 0;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for a single variable-length data record
+/// Hand over staged output to the write callback.
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_record_xml(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header)
+int
+mbus_sink_flush(mbus_sink *sink)
 {
-    static char buff[8192];
-    char str_encoded[768];
-    size_t len = 0;
-    struct tm * timeinfo;
-    char timestamp[22];
-    long tariff;
+    if (sink == NULL)
+    {
+        return -1;
+    }
 
-    if (record)
+    if (sink->type == MBUS_SINK_CALLBACK && sink->len > 0)
     {
-        if (frame_cnt >= 0)
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "    <DataRecord id=\"%d\" frame=\"%d\">\n",
-                            record_cnt, frame_cnt);
-        }
-        else
+        if (sink->error == 0 && sink->write(sink->arg, sink->stage, sink->len) != 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "    <DataRecord id=\"%d\">\n", record_cnt);
+            sink->error = 1;
         }
 
-        if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
-        {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>Manufacturer specific</Function>\n");
-        }
-        else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+        sink->len = 0;
+    }
+    else if (sink->type == MBUS_SINK_FILE && sink->error == 0)
+    {
+        if (fflush(sink->fp) != 0)
         {
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>More records follow</Function>\n");
+            sink->error = 1;
         }
-        else
-        {
-            mbus_str_xml_encode(str_encoded, mbus_data_record_function(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Function>%s</Function>\n", str_encoded);
-
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <StorageNumber>%ld</StorageNumber>\n",
-                            mbus_data_record_storage_number(record));
+    }
 
-            if ((tariff = mbus_data_record_tariff(record)) >= 0)
-            {
-                len += snprintf(&buff[len], sizeof(buff) - len, "        <Tariff>%ld</Tariff>\n",
-                                tariff);
-                len += snprintf(&buff[len], sizeof(buff) - len, "        <Device>%d</Device>\n",
-                                mbus_data_record_device(record));
-            }
+    return sink->error ? -1 : 0;
+}
 
-            mbus_str_xml_encode(str_encoded, mbus_data_record_unit(record), sizeof(str_encoded));
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Unit>%s</Unit>\n", str_encoded);
-        }
+//------------------------------------------------------------------------------
+/// Append data to the sink.
+//------------------------------------------------------------------------------
+int
+mbus_sink_write(mbus_sink *sink, const char *data, size_t len)
+{
+    size_t n;
 
-        mbus_str_xml_encode(str_encoded, mbus_data_record_value(record), sizeof(str_encoded));
-        len += snprintf(&buff[len], sizeof(buff) - len, "        <Value>%s</Value>\n", str_encoded);
+    if (sink->error)
+    {
+        return -1;
+    }
 
-        if (record->timestamp > 0)
-        {
-            timeinfo = gmtime (&(record->timestamp));
-            strftime(timestamp,21,"%Y-%m-%dT%H:%M:%SZ",timeinfo);
-            len += snprintf(&buff[len], sizeof(buff) - len,
-                            "        <Timestamp>%s</Timestamp>\n", timestamp);
-        }
+    sink->total += len;
 
-        len += snprintf(&buff[len], sizeof(buff) - len, "    </DataRecord>\n\n");
+    switch (sink->type)
+    {
+        case MBUS_SINK_CALLBACK:
+            if (sink->len + len > sizeof(sink->stage))
+            {
+                mbus_sink_flush(sink);
 
-        return buff;
+                if (len >= sizeof(sink->stage))
+                {
+                    if (sink->error == 0 && sink->write(sink->arg, data, len) != 0)
+                    {
+                        sink->error = 1;
+                    }
+                    break;
+                }
+            }
+
+            memcpy(&sink->stage[sink->len], data, len);
+            sink->len += len;
+            break;
+
+        case MBUS_SINK_FILE:
+            if (len > 0 && fwrite(data, 1, len, sink->fp) != len)
+            {
+                sink->error = 1;
+            }
+            break;
+
+        case MBUS_SINK_BUFFER:
+            if (sink->len + 1 < sink->size)
+            {
+                n = sink->size - 1 - sink->len;
+                n = (len < n) ? len : n;
+                memcpy(&sink->buff[sink->len], data, n);
+                sink->len += n;
+                sink->buff[sink->len] = '\0';
+            }
+            break;
+
+        case MBUS_SINK_GROWABLE:
+            if (sink->size - sink->len <= len && mbus_sink_grow(sink, len) != 0)
+            {
+                break;
+            }
+
+            memcpy(&sink->buff[sink->len], data, len);
+            sink->len += len;
+            sink->buff[sink->len] = '\0';
+            break;
     }
 
-    return "";
+    return sink->error ? -1 : 0;
+}
+
+int
+mbus_sink_puts(mbus_sink *sink, const char *str)
+{
+    return mbus_sink_write(sink, str, strlen(str));
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML for variable-length data
+/// Formatted output to the sink. Buffer and callback sinks are printed to in
+/// place, only text longer than the staging buffer is formatted on the heap.
 //------------------------------------------------------------------------------
-char *
-mbus_data_variable_xml(mbus_data_variable *data)
+int
+mbus_sink_printf(mbus_sink *sink, const char *format, ...)
 {
-    mbus_data_record *record;
-    char *buff = NULL, *new_buff;
-    size_t len = 0, buff_size = 8192;
-    int i;
+    char buff[1], *tmp;
+    va_list args;
+    size_t room;
+    int len;
 
-    if (data)
+    if (sink->error)
     {
-        buff = (char*) malloc(buff_size);
+        return -1;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    if (sink->type == MBUS_SINK_BUFFER || sink->type == MBUS_SINK_GROWABLE)
+    {
+        room = (sink->size > sink->len) ? sink->size - sink->len : 0;
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+        va_start(args, format);
+        len = vsnprintf(room ? &sink->buff[sink->len] : buff, room ? room : 1, format, args);
+        va_end(args);
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+        if (len < 0)
+        {
+            sink->error = 1;
+            return -1;
+        }
 
-        len += snprintf(&buff[len], buff_size - len, "%s",
-                        mbus_data_variable_header_xml(&(data->header)));
+        sink->total += len;
 
-        for (record = data->record, i = 0; record; record = record->next, i++)
+        if ((size_t) len < room)
         {
-            if ((buff_size - len) < 1024)
-            {
-                buff_size *= 2;
-                new_buff = (char*) realloc(buff,buff_size);
+            sink->len += len;
+            return 0;
+        }
 
-                if (new_buff == NULL)
-                {
-                    free(buff);
-                    return NULL;
-                }
+        if (sink->type == MBUS_SINK_BUFFER)
+        {
+            // truncated, vsnprintf has terminated the buffer
+            sink->len = room ? sink->size - 1 : sink->len;
+            return 0;
+        }
 
-                buff = new_buff;
-            }
+        if (mbus_sink_grow(sink, len) != 0)
+        {
+            return -1;
+        }
+
+        va_start(args, format);
+        vsnprintf(&sink->buff[sink->len], sink->size - sink->len, format, args);
+        va_end(args);
+
+        sink->len += len;
+        return 0;
+    }
+
+    if (sink->type == MBUS_SINK_FILE)
+    {
+        va_start(args, format);
+        len = vfprintf(sink->fp, format, args);
+        va_end(args);
 
-            len += snprintf(&buff[len], buff_size - len, "%s",
-                            mbus_data_variable_record_xml(record, i, -1, &(data->header)));
+        if (len < 0)
+        {
+            sink->error = 1;
+            return -1;
         }
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
 
-        return buff;
+        sink->total += len;
+        return 0;
     }
 
-    return NULL;
+    // callback sinks are printed to the staging buffer, which is flushed
+    // first when the text does not fit behind the pending data
+    room = sizeof(sink->stage) - sink->len;
+
+    va_start(args, format);
+    len = vsnprintf(&sink->stage[sink->len], room, format, args);
+    va_end(args);
+
+    if (len < 0)
+    {
+        sink->error = 1;
+        return -1;
+    }
+
+    if ((size_t) len < room)
+    {
+        sink->len += len;
+        sink->total += len;
+        return 0;
+    }
+
+    if ((size_t) len < sizeof(sink->stage))
+    {
+        mbus_sink_flush(sink);
+
+        va_start(args, format);
+        vsnprintf(sink->stage, sizeof(sink->stage), format, args);
+        va_end(args);
+
+        sink->len = len;
+        sink->total += len;
+        return sink->error ? -1 : 0;
+    }
+
+    if ((tmp = (char *) malloc(len + 1)) == NULL)
+    {
+        sink->error = 1;
+        return -1;
+    }
+
+    va_start(args, format);
+    vsnprintf(tmp, len + 1, format, args);
+    va_end(args);
+
+    mbus_sink_write(sink, tmp, len);
+    free(tmp);
+
+    return sink->error ? -1 : 0;
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML representation of fixed-length frame.
+/// Return the buffer of a growable sink, the caller has to free it.
 //------------------------------------------------------------------------------
 char *
-mbus_data_fixed_xml(mbus_data_fixed *data)
+mbus_sink_release(mbus_sink *sink)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
-    int val;
+    char *buff;
 
-    if (data)
+    if (sink == NULL || sink->type != MBUS_SINK_GROWABLE || sink->error)
     {
-        buff = (char*) malloc(buff_size);
+        mbus_sink_free(sink);
+        return NULL;
+    }
 
-        if (buff == NULL)
-            return NULL;
+    buff = sink->buff;
+    sink->buff = NULL;
+    sink->size = 0;
+    sink->len  = 0;
 
-        len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    return buff;
+}
 
-        len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+//------------------------------------------------------------------------------
+/// Release the memory held by a growable sink.
+//------------------------------------------------------------------------------
+void
+mbus_sink_free(mbus_sink *sink)
+{
+    if (sink && sink->type == MBUS_SINK_GROWABLE)
+    {
+        free(sink->buff);
+        sink->buff = NULL;
+        sink->size = 0;
+        sink->len  = 0;
+    }
+}
 
-        len += snprintf(&buff[len], buff_size - len, "    <SlaveInformation>\n");
-        len += snprintf(&buff[len], buff_size - len, "        <Id>%llX</Id>\n", mbus_data_bcd_decode_hex(data->id_bcd, 4));
+//------------------------------------------------------------------------------
+///
+/// Encode string to XML
+///
+//------------------------------------------------------------------------------
+int
+mbus_str_xml_encode(unsigned char *dst, const unsigned char *src, size_t max_len)
+{
+    size_t i, len;
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_medium(data), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Medium>%s</Medium>\n", str_encoded);
+    i = 0;
+    len = 0;
 
-        len += snprintf(&buff[len], buff_size - len, "        <AccessNumber>%d</AccessNumber>\n", data->tx_cnt);
-        len += snprintf(&buff[len], buff_size - len, "        <Status>%.2X</Status>\n", data->status);
-        len += snprintf(&buff[len], buff_size - len, "    </SlaveInformation>\n\n");
+    if (dst == NULL)
+    {
+        return -1;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"0\">\n");
+    if (src == NULL)
+    {
+        dst[len] = '\0';
+        return -2;
+    }
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
+    while((len+6) < max_len)
+    {
+        if (src[i] == '\0')
+        {
+            break;
+        }
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_unit(data->cnt1_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+        if (iscntrl(src[i]))
         {
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%llX</Value>\n", mbus_data_bcd_decode_hex(data->cnt1_val, 4));
+            // convert all control chars into spaces
+            dst[len++] = ' ';
         }
         else
         {
-            mbus_data_int_decode(data->cnt1_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%d</Value>\n", val);
+            switch (src[i])
+            {
+                case '&':
+                    len += snprintf(&dst[len], max_len - len, "&amp;");
+                    break;
+                case '<':
+                    len += snprintf(&dst[len], max_len - len, "&lt;");
+                    break;
+                case '>':
+                    len += snprintf(&dst[len], max_len - len, "&gt;");
+                    break;
+                case '"':
+                    len += snprintf(&dst[len], max_len - len, "&quot;");
+                    break;
+                default:
+                    dst[len++] = src[i];
+                    break;
+            }
         }
 
-        len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
+        i++;
+    }
 
-        len += snprintf(&buff[len], buff_size - len, "    <DataRecord id=\"1\">\n");
+    dst[len] = '\0';
+    return 0;
+}
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_function(data->status), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Function>%s</Function>\n", str_encoded);
+//------------------------------------------------------------------------------
+/// Encode string to XML and write it to the sink. Same output as
+/// mbus_str_xml_encode with a buffer of max_len bytes.
+//------------------------------------------------------------------------------
+int
+mbus_sink_xml_encode(mbus_sink *sink, const unsigned char *src, size_t max_len)
+{
+    const char *entity;
+    size_t i, run, len;
 
-        mbus_str_xml_encode(str_encoded, mbus_data_fixed_unit(data->cnt2_type), sizeof(str_encoded));
-        len += snprintf(&buff[len], buff_size - len, "        <Unit>%s</Unit>\n", str_encoded);
-        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+    if (src == NULL)
+    {
+        return -2;
+    }
+
+    for (i = 0, run = 0, len = 0; (len+6) < max_len && src[i] != '\0'; i++)
+    {
+        if (iscntrl(src[i]))
+            entity = " ";
+        else if (src[i] == '&')
+            entity = "&amp;";
+        else if (src[i] == '<')
+            entity = "&lt;";
+        else if (src[i] == '>')
+            entity = "&gt;";
+        else if (src[i] == '"')
+            entity = "&quot;";
+        else
         {
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%llX</Value>\n", mbus_data_bcd_decode_hex(data->cnt2_val, 4));
+            len++;
+            continue;
         }
-        else
+
+        // write the run of plain characters before the replacement
+        mbus_sink_write(sink, (const char *) &src[run], i - run);
+        mbus_sink_puts(sink, entity);
+        len += strlen(entity);
+        run = i + 1;
+    }
+
+    mbus_sink_write(sink, (const char *) &src[run], i - run);
+
+    return sink->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for the variable-length data header to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_header_xml_sink(mbus_sink *sink, mbus_data_variable_header *header)
+{
+    if (header == NULL)
+    {
+        return 0;
+    }
+
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
+
+    mbus_sink_printf(sink, "        <Id>%llX</Id>\n", mbus_data_bcd_decode_hex(header->id_bcd, 4));
+    mbus_sink_printf(sink, "        <Manufacturer>%s</Manufacturer>\n",
+            mbus_decode_manufacturer(header->manufacturer[0], header->manufacturer[1]));
+    mbus_sink_printf(sink, "        <Version>%d</Version>\n", header->version);
+
+    mbus_sink_puts(sink, "        <ProductName>");
+    mbus_sink_xml_encode(sink, mbus_data_product_name(header), 768);
+    mbus_sink_puts(sink, "</ProductName>\n");
+
+    mbus_sink_puts(sink, "        <Medium>");
+    mbus_sink_xml_encode(sink, mbus_data_variable_medium_lookup(header->medium), 768);
+    mbus_sink_puts(sink, "</Medium>\n");
+
+    mbus_sink_printf(sink, "        <AccessNumber>%d</AccessNumber>\n", header->access_no);
+    mbus_sink_printf(sink, "        <Status>%.2X</Status>\n", header->status);
+    mbus_sink_printf(sink, "        <Signature>%.2X%.2X</Signature>\n", header->signature[1], header->signature[0]);
+
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
+
+    return sink->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Generate XML for the variable-length data header
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_header_xml(mbus_data_variable_header *header)
+{
+    static __thread char buff[8192];
+    mbus_sink sink;
+
+    if (header)
+    {
+        mbus_sink_init_buffer(&sink, buff, sizeof(buff));
+        mbus_data_variable_header_xml_sink(&sink, header);
+
+        return buff;
+    }
+
+    return "";
+}
+
+//------------------------------------------------------------------------------
+/// Write XML for a single variable-length data record to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_record_xml_sink(mbus_sink *sink, mbus_data_record *record, int record_cnt, int frame_cnt)
+{
+    struct tm * timeinfo;
+    char timestamp[22], iso[MBUS_TIMESTAMP_ISO_SIZE];
+    long tariff;
+
+    if (record == NULL)
+    {
+        return 0;
+    }
+
+    if (frame_cnt >= 0)
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%d\" frame=\"%d\">\n",
+                         record_cnt, frame_cnt);
+    }
+    else
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%d\">\n", record_cnt);
+    }
+
+    if (record->drh.dib.dif == MBUS_DIB_DIF_MANUFACTURER_SPECIFIC) // MBUS_DIB_DIF_VENDOR_SPECIFIC
+    {
+        mbus_sink_puts(sink, "        <Function>Manufacturer specific</Function>\n");
+    }
+    else if (record->drh.dib.dif == MBUS_DIB_DIF_MORE_RECORDS_FOLLOW)
+    {
+        mbus_sink_puts(sink, "        <Function>More records follow</Function>\n");
+    }
+    else
+    {
+        mbus_sink_puts(sink, "        <Function>");
+        mbus_sink_xml_encode(sink, mbus_data_record_function(record), 768);
+        mbus_sink_puts(sink, "</Function>\n");
+
+        mbus_sink_printf(sink, "        <StorageNumber>%ld</StorageNumber>\n",
+                         mbus_data_record_storage_number(record));
+
+        if ((tariff = mbus_data_record_tariff(record)) >= 0)
         {
-            mbus_data_int_decode(data->cnt2_val, 4, &val);
-            len += snprintf(&buff[len], buff_size - len, "        <Value>%d</Value>\n", val);
+            mbus_sink_printf(sink, "        <Tariff>%ld</Tariff>\n", tariff);
+            mbus_sink_printf(sink, "        <Device>%d</Device>\n",
+                             mbus_data_record_device(record));
         }
 
-        len += snprintf(&buff[len], buff_size - len, "    </DataRecord>\n\n");
+        mbus_sink_puts(sink, "        <Unit>");
+        mbus_sink_xml_encode(sink, mbus_data_record_unit(record), 768);
+        mbus_sink_puts(sink, "</Unit>\n");
+    }
+
+    mbus_sink_puts(sink, "        <Value>");
+    mbus_sink_xml_encode(sink, mbus_data_record_value(record), 768);
+    mbus_sink_puts(sink, "</Value>\n");
+
+    if (record->timestamp > 0)
+    {
+        timeinfo = gmtime (&(record->timestamp));
+        strftime(timestamp,21,"%Y-%m-%dT%H:%M:%SZ",timeinfo);
+        mbus_sink_printf(sink, "        <Timestamp>%s</Timestamp>\n", timestamp);
+    }
+
+    if (mbus_timestamp_iso(&(record->first_byte), iso, sizeof(iso)) > 0)
+    {
+        mbus_sink_printf(sink, "        <FirstByte monotonic=\"%llu\">%s</FirstByte>\n",
+                         (unsigned long long) record->first_byte.monotonic_ns, iso);
+    }
+
+    if (mbus_timestamp_iso(&(record->last_byte), iso, sizeof(iso)) > 0)
+    {
+        mbus_sink_printf(sink, "        <LastByte monotonic=\"%llu\">%s</LastByte>\n",
+                         (unsigned long long) record->last_byte.monotonic_ns, iso);
+    }
+
+    mbus_sink_puts(sink, "    </DataRecord>\n\n");
 
-        len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+    return sink->error ? -1 : 0;
+}
+
+//------------------------------------------------------------------------------
+/// Generate XML for a single variable-length data record
+//------------------------------------------------------------------------------
+char *
+mbus_data_variable_record_xml(mbus_data_record *record, int record_cnt, int frame_cnt, mbus_data_variable_header *header)
+{
+    static __thread char buff[8192];
+    mbus_sink sink;
+
+    if (record)
+    {
+        mbus_sink_init_buffer(&sink, buff, sizeof(buff));
+        mbus_data_variable_record_xml_sink(&sink, record, record_cnt, frame_cnt);
 
         return buff;
     }
 
-    return NULL;
+    return "";
 }
 
 //------------------------------------------------------------------------------
-/// Generate XML representation of a general application error.
+/// Write XML for variable-length data to a sink
+//------------------------------------------------------------------------------
+int
+mbus_data_variable_xml_sink(mbus_sink *sink, mbus_data_variable *data)
+{
+    mbus_data_record *record;
+    int i;
+
+    if (data == NULL)
+    {
+        return -1;
+    }
+
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
+
+    mbus_sink_puts(sink, "<MBusData>\n\n");
+
+    mbus_data_variable_header_xml_sink(sink, &(data->header));
+
+    for (record = data->record, i = 0; record; record = record->next, i++)
+    {
+        mbus_data_variable_record_xml_sink(sink, record, i, -1);
+    }
+
+    mbus_sink_puts(sink, "</MBusData>\n");
+
+    return mbus_sink_flush(sink);
+}
+
+//------------------------------------------------------------------------------
+/// Generate XML for variable-length data
 //------------------------------------------------------------------------------
 char *
-mbus_data_error_xml(int error)
+mbus_data_variable_xml(mbus_data_variable *data)
+{
+    mbus_sink sink;
+
+    if (data == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
+
+    if (mbus_data_variable_xml_sink(&sink, data) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+/// Write XML representation of fixed-length frame to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_fixed_xml_sink(mbus_sink *sink, mbus_data_fixed *data)
 {
-    char *buff = NULL;
-    char str_encoded[256];
-    size_t len = 0, buff_size = 8192;
+    unsigned char *cnt_val[2];
+    int cnt_type[2], i, val;
+
+    if (data == NULL)
+    {
+        return -1;
+    }
 
-    buff = (char*) malloc(buff_size);
+    cnt_val[0]  = data->cnt1_val;
+    cnt_val[1]  = data->cnt2_val;
+    cnt_type[0] = data->cnt1_type;
+    cnt_type[1] = data->cnt2_type;
 
-    if (buff == NULL)
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
+
+    mbus_sink_puts(sink, "<MBusData>\n\n");
+
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
+    mbus_sink_printf(sink, "        <Id>%llX</Id>\n", mbus_data_bcd_decode_hex(data->id_bcd, 4));
+
+    mbus_sink_puts(sink, "        <Medium>");
+    mbus_sink_xml_encode(sink, mbus_data_fixed_medium(data), 256);
+    mbus_sink_puts(sink, "</Medium>\n");
+
+    mbus_sink_printf(sink, "        <AccessNumber>%d</AccessNumber>\n", data->tx_cnt);
+    mbus_sink_printf(sink, "        <Status>%.2X</Status>\n", data->status);
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
+
+    for (i = 0; i < 2; i++)
+    {
+        mbus_sink_printf(sink, "    <DataRecord id=\"%d\">\n", i);
+
+        mbus_sink_puts(sink, "        <Function>");
+        mbus_sink_xml_encode(sink, mbus_data_fixed_function(data->status), 256);
+        mbus_sink_puts(sink, "</Function>\n");
+
+        mbus_sink_puts(sink, "        <Unit>");
+        mbus_sink_xml_encode(sink, mbus_data_fixed_unit(cnt_type[i]), 256);
+        mbus_sink_puts(sink, "</Unit>\n");
+
+        if ((data->status & MBUS_DATA_FIXED_STATUS_FORMAT_MASK) == MBUS_DATA_FIXED_STATUS_FORMAT_BCD)
+        {
+            mbus_sink_printf(sink, "        <Value>%llX</Value>\n", mbus_data_bcd_decode_hex(cnt_val[i], 4));
+        }
+        else
+        {
+            mbus_data_int_decode(cnt_val[i], 4, &val);
+            mbus_sink_printf(sink, "        <Value>%d</Value>\n", val);
+        }
+
+        mbus_sink_puts(sink, "    </DataRecord>\n\n");
+    }
+
+    mbus_sink_puts(sink, "</MBusData>\n");
+
+    return mbus_sink_flush(sink);
+}
+
+//------------------------------------------------------------------------------
+/// Generate XML representation of fixed-length frame.
+//------------------------------------------------------------------------------
+char *
+mbus_data_fixed_xml(mbus_data_fixed *data)
+{
+    mbus_sink sink;
+
+    if (data == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
         return NULL;
+    }
 
-    len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
-    len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    if (mbus_data_fixed_xml_sink(&sink, data) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+/// Write XML representation of a general application error to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_data_error_xml_sink(mbus_sink *sink, int error)
+{
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-    len += snprintf(&buff[len], buff_size - len, "    <SlaveInformation>\n");
+    mbus_sink_puts(sink, "    <SlaveInformation>\n");
 
-    mbus_str_xml_encode(str_encoded, mbus_data_error_lookup(error), sizeof(str_encoded));
-    len += snprintf(&buff[len], buff_size - len, "        <Error>%s</Error>\n", str_encoded);
+    mbus_sink_puts(sink, "        <Error>");
+    mbus_sink_xml_encode(sink, mbus_data_error_lookup(error), 256);
+    mbus_sink_puts(sink, "</Error>\n");
 
-    len += snprintf(&buff[len], buff_size - len, "    </SlaveInformation>\n\n");
+    mbus_sink_puts(sink, "    </SlaveInformation>\n\n");
 
-    len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-    return buff;
+    return mbus_sink_flush(sink);
 }
 
 //------------------------------------------------------------------------------
-/// Return a string containing an XML representation of the M-BUS frame data.
+/// Generate XML representation of a general application error.
 //------------------------------------------------------------------------------
 char *
-mbus_frame_data_xml(mbus_frame_data *data)
+mbus_data_error_xml(int error)
+{
+    mbus_sink sink;
+
+    if (mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
+
+    if (mbus_data_error_xml_sink(&sink, error) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+/// Write an XML representation of the M-BUS frame data to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_data_xml_sink(mbus_sink *sink, mbus_frame_data *data)
 {
     if (data)
     {
         if (data->type == MBUS_DATA_TYPE_ERROR)
         {
-            return mbus_data_error_xml(data->error);
+            return mbus_data_error_xml_sink(sink, data->error);
         }
 
         if (data->type == MBUS_DATA_TYPE_FIXED)
         {
-            return mbus_data_fixed_xml(&(data->data_fix));
+            return mbus_data_fixed_xml_sink(sink, &(data->data_fix));
         }
 
         if (data->type == MBUS_DATA_TYPE_VARIABLE)
         {
-            return mbus_data_variable_xml(&(data->data_var));
+            return mbus_data_variable_xml_sink(sink, &(data->data_var));
         }
     }
 
-    return NULL;
+    return -1;
 }
 
-
 //------------------------------------------------------------------------------
-/// Return an XML representation of the M-BUS frame.
+/// Return a string containing an XML representation of the M-BUS frame data.
 //------------------------------------------------------------------------------
 char *
-mbus_frame_xml(mbus_frame *frame)
+mbus_frame_data_xml(mbus_frame_data *data)
+{
+    mbus_sink sink;
+
+    if (data == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
+
+    if (mbus_frame_data_xml_sink(&sink, data) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
+    }
+
+    return mbus_sink_release(&sink);
+}
+
+//------------------------------------------------------------------------------
+/// Write an XML representation of the M-BUS frame (chain) to a sink.
+//------------------------------------------------------------------------------
+int
+mbus_frame_xml_sink(mbus_sink *sink, mbus_frame *frame)
 {
     mbus_frame_data frame_data;
     mbus_frame *iter;
 
     mbus_data_record *record;
-    char *buff = NULL, *new_buff;
-
-    size_t len = 0, buff_size = 8192;
     int record_cnt = 0, frame_cnt;
 
-    if (frame)
+    if (frame == NULL)
     {
-        memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
-
-        if (mbus_frame_data_parse(frame, &frame_data) == -1)
-        {
-            mbus_error_str_set("M-bus data parse error.");
-            return NULL;
-        }
-
-        if (frame_data.type == MBUS_DATA_TYPE_ERROR)
-        {
-            //
-            // generate XML for error
-            //
-            return mbus_data_error_xml(frame_data.error);
-        }
+        return -1;
+    }
 
-        if (frame_data.type == MBUS_DATA_TYPE_FIXED)
-        {
-            //
-            // generate XML for fixed data
-            //
-            return mbus_data_fixed_xml(&(frame_data.data_fix));
-        }
+    memset((void *)&frame_data, 0, sizeof(mbus_frame_data));
 
-        if (frame_data.type == MBUS_DATA_TYPE_VARIABLE)
-        {
-            //
-            // generate XML for a sequence of variable data frames
-            //
+    if (mbus_frame_data_parse(frame, &frame_data) == -1)
+    {
+        mbus_error_str_set("M-bus data parse error.");
+        return -1;
+    }
 
-            buff = (char*) malloc(buff_size);
+    if (frame_data.type == MBUS_DATA_TYPE_ERROR)
+    {
+        //
+        // generate XML for error
+        //
+        return mbus_data_error_xml_sink(sink, frame_data.error);
+    }
 
-            if (buff == NULL)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-                return NULL;
-            }
+    if (frame_data.type == MBUS_DATA_TYPE_FIXED)
+    {
+        //
+        // generate XML for fixed data
+        //
+        return mbus_data_fixed_xml_sink(sink, &(frame_data.data_fix));
+    }
 
-            // include frame counter in XML output if more than one frame
-            // is available (frame_cnt = -1 => not included in output)
-            frame_cnt = (frame->next == NULL) ? -1 : 0;
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        return -1;
+    }
 
-            len += snprintf(&buff[len], buff_size - len, MBUS_XML_PROCESSING_INSTRUCTION);
+    //
+    // generate XML for a sequence of variable data frames
+    //
 
-            len += snprintf(&buff[len], buff_size - len, "<MBusData>\n\n");
+    // include frame counter in XML output if more than one frame
+    // is available (frame_cnt = -1 => not included in output)
+    frame_cnt = (frame->next == NULL) ? -1 : 0;
 
-            // only print the header info for the first frame (should be
-            // the same for each frame in a sequence of a multi-telegram
-            // transfer.
-            len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_header_xml(&(frame_data.data_var.header)));
+    mbus_sink_puts(sink, MBUS_XML_PROCESSING_INSTRUCTION);
 
-            // loop through all records in the current frame, using a global
-            // record count as record ID in the XML output
-            for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-            {
-                if ((buff_size - len) < 1024)
-                {
-                    buff_size *= 2;
-                    new_buff = (char*) realloc(buff,buff_size);
+    mbus_sink_puts(sink, "<MBusData>\n\n");
 
-                    if (new_buff == NULL)
-                    {
-                        free(buff);
-                        mbus_data_record_free(frame_data.data_var.record);
-                        return NULL;
-                    }
+    // only print the header info for the first frame (should be
+    // the same for each frame in a sequence of a multi-telegram
+    // transfer.
+    mbus_data_variable_header_xml_sink(sink, &(frame_data.data_var.header));
 
-                    buff = new_buff;
-                }
+    for (iter = frame; iter; iter = iter->next)
+    {
+        if (iter != frame && mbus_frame_data_parse(iter, &frame_data) == -1)
+        {
+            mbus_error_str_set("M-bus variable data parse error.");
+            return -1;
+        }
 
-                len += snprintf(&buff[len], buff_size - len, "%s",
-                                mbus_data_variable_record_xml(record, record_cnt, frame_cnt, &(frame_data.data_var.header)));
-            }
+        // loop through all records in the current frame, using a global
+        // record count as record ID in the XML output
+        for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
+        {
+            mbus_data_variable_record_xml_sink(sink, record, record_cnt, frame_cnt);
+        }
 
-            // free all records in the list
-            if (frame_data.data_var.record)
-            {
-                mbus_data_record_free(frame_data.data_var.record);
-            }
+        // free all records in the list
+        if (frame_data.data_var.record)
+        {
+            mbus_data_record_free(frame_data.data_var.record);
+            frame_data.data_var.record = NULL;
+        }
 
+        if (frame_cnt >= 0)
+        {
             frame_cnt++;
+        }
+    }
 
-            for (iter = frame->next; iter; iter = iter->next, frame_cnt++)
-            {
-                if (mbus_frame_data_parse(iter, &frame_data) == -1)
-                {
-                    mbus_error_str_set("M-bus variable data parse error.");
-                    return NULL;
-                }
-
-                // loop through all records in the current frame, using a global
-                // record count as record ID in the XML output
-                for (record = frame_data.data_var.record; record; record = record->next, record_cnt++)
-                {
-                    if ((buff_size - len) < 1024)
-                    {
-                        buff_size *= 2;
-                        new_buff = (char*) realloc(buff,buff_size);
-
-                        if (new_buff == NULL)
-                        {
-                            free(buff);
-                            mbus_data_record_free(frame_data.data_var.record);
-                            return NULL;
-                        }
-
-                        buff = new_buff;
-                    }
+    mbus_sink_puts(sink, "</MBusData>\n");
 
-                    len += snprintf(&buff[len], buff_size - len, "%s",
-                                    mbus_data_variable_record_xml(record, record_cnt, frame_cnt, &(frame_data.data_var.header)));
-                }
+    return mbus_sink_flush(sink);
+}
 
-                // free all records in the list
-                if (frame_data.data_var.record)
-                {
-                    mbus_data_record_free(frame_data.data_var.record);
-                }
-            }
+//------------------------------------------------------------------------------
+/// Return an XML representation of the M-BUS frame.
+//------------------------------------------------------------------------------
+char *
+mbus_frame_xml(mbus_frame *frame)
+{
+    mbus_sink sink;
 
-            len += snprintf(&buff[len], buff_size - len, "</MBusData>\n");
+    if (frame == NULL || mbus_sink_init_growable(&sink, 8192) != 0)
+    {
+        return NULL;
+    }
 
-            return buff;
-        }
+    if (mbus_frame_xml_sink(&sink, frame) != 0)
+    {
+        mbus_sink_free(&sink);
+        return NULL;
     }
 
-    return NULL;
+    return mbus_sink_release(&sink);
 }
 
 
@@ -5163,7 +6480,7 @@ mbus_data_record_append(mbus_data_variable *data, mbus_data_record *record)
 char *
 mbus_frame_get_secondary_address(mbus_frame *frame)
 {
-    static char addr[32];
+    static __thread char addr[32];
     return mbus_frame_get_secondary_address_to_buffer(frame, addr, sizeof(addr));
 }
 
@@ -18,6 +18,7 @@
 #ifndef _MBUS_PROTOCOL_H_
 #define _MBUS_PROTOCOL_H_
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
@@ -72,6 +73,17 @@ extern "C" {
 
 #define MBUS_FRAME_DATA_LENGTH 252
 
+//
+// Receive time with nanosecond resolution: monotonic for latencies, realtime
+// (nanoseconds since the epoch) to align with other clocks. Zero if unknown.
+//
+typedef struct _mbus_timestamp {
+
+    uint64_t monotonic_ns;
+    uint64_t realtime_ns;
+
+} mbus_timestamp;
+
 typedef struct _mbus_frame {
 
     unsigned char start1;
@@ -91,6 +103,9 @@ typedef struct _mbus_frame {
     int type;
     time_t timestamp;
 
+    mbus_timestamp first_byte;   // arrival of the first byte of the frame, zero if the transport can't tell
+    mbus_timestamp last_byte;    // arrival of the last byte of the frame
+
     //mbus_frame_data frame_data;
 
     void *next; // pointer to next mbus_frame for multi-telegram replies
@@ -104,6 +119,8 @@ typedef struct _mbus_frame {
 //
 #define MBUS_HANDLE_TYPE_TCP    0
 #define MBUS_HANDLE_TYPE_SERIAL 1
+#define MBUS_HANDLE_TYPE_LOOPBACK 2
+#define MBUS_HANDLE_TYPE_REPLAY 3
 
 //
 // Resultcodes for mbus_recv_frame
@@ -165,6 +182,8 @@ typedef struct _mbus_data_record {
     size_t data_len;
 
     time_t timestamp;
+    mbus_timestamp first_byte;   // copied from the frame
+    mbus_timestamp last_byte;
 
     void *next;
 
@@ -215,6 +234,14 @@ typedef struct _mbus_data_variable {
 
 } mbus_data_variable;
 
+//
+// Visitor for mbus_data_variable_parse_visit, called for each data record as
+// it is decoded. The record is only valid during the call, return non-zero to
+// stop parsing.
+//
+typedef int (*mbus_data_record_visitor)(mbus_data_variable_header *header,
+                                        mbus_data_record *record, void *arg);
+
 //
 // FIXED LENGTH DATA FORMAT
 //
@@ -280,6 +307,140 @@ typedef struct _mbus_data_secondary_address {
 } mbus_data_secondary_address;
 
 
+//
+// TYPED RECORD VALUE
+//
+// Result of mbus_data_record_decode_typed: the record value in binary form
+// together with the unit as a code and a decimal exponent, so that the
+// physical value is value * 10^exponent [unit]. Decoding does neither
+// allocate memory nor format strings.
+//
+#define MBUS_VALUE_TYPE_NONE     0   // no data
+#define MBUS_VALUE_TYPE_INTEGER  1   // integer and BCD types, value.integer
+#define MBUS_VALUE_TYPE_REAL     2   // 32 bit real, value.real
+#define MBUS_VALUE_TYPE_STRING   3   // variable length ASCII, data/data_len (wire order, reversed)
+#define MBUS_VALUE_TYPE_BINARY   4   // variable length binary and special functions, data/data_len
+#define MBUS_VALUE_TYPE_DATE     5   // type G date, value.integer holds the raw encoding
+#define MBUS_VALUE_TYPE_DATETIME 6   // type F/I date & time, value.integer holds the raw encoding
+
+#define MBUS_RECORD_FUNCTION_INSTANTANEOUS 0
+#define MBUS_RECORD_FUNCTION_MAXIMUM       1
+#define MBUS_RECORD_FUNCTION_MINIMUM       2
+#define MBUS_RECORD_FUNCTION_ERROR         3
+
+typedef enum _mbus_unit {
+    MBUS_UNIT_NONE = 0,         // dimensionless, counters, identification
+    MBUS_UNIT_UNKNOWN,          // reserved or unsupported VIF
+    MBUS_UNIT_CUSTOM,           // plain text VIF, see vib.custom_vif
+    MBUS_UNIT_WH,
+    MBUS_UNIT_J,
+    MBUS_UNIT_M3,
+    MBUS_UNIT_KG,
+    MBUS_UNIT_SECOND,
+    MBUS_UNIT_MINUTE,
+    MBUS_UNIT_HOUR,
+    MBUS_UNIT_DAY,
+    MBUS_UNIT_MONTH,
+    MBUS_UNIT_YEAR,
+    MBUS_UNIT_W,
+    MBUS_UNIT_J_H,
+    MBUS_UNIT_M3_H,
+    MBUS_UNIT_M3_MIN,
+    MBUS_UNIT_M3_S,
+    MBUS_UNIT_KG_H,
+    MBUS_UNIT_CELSIUS,
+    MBUS_UNIT_KELVIN,
+    MBUS_UNIT_FAHRENHEIT,
+    MBUS_UNIT_BAR,
+    MBUS_UNIT_FEET3,
+    MBUS_UNIT_US_GALLON,
+    MBUS_UNIT_US_GALLON_MIN,
+    MBUS_UNIT_US_GALLON_H,
+    MBUS_UNIT_V,
+    MBUS_UNIT_A,
+    MBUS_UNIT_HCA,
+    MBUS_UNIT_CURRENCY,
+    MBUS_UNIT_BAUD,
+    MBUS_UNIT_BITTIMES,
+    MBUS_UNIT_DATE,
+    MBUS_UNIT_DATETIME
+} mbus_unit;
+
+typedef struct _mbus_record_value {
+
+    int type;                    // MBUS_VALUE_TYPE_*
+
+    union {
+        int64_t integer;
+        double  real;
+    } value;
+
+    const unsigned char *data;   // string/binary/date payload, points into the record
+    size_t data_len;
+
+    mbus_unit unit;
+    int exponent;                // decimal exponent, including VIFE correction factors
+    int vif_code;                // VIF code: 0x00-0x7F primary, 0x1nn after FDh, 0x2nn after FBh
+
+    int  function;               // MBUS_RECORD_FUNCTION_*
+    long storage_number;
+    long tariff;                 // -1 if not present
+    int  device;                 // subunit, -1 if not present
+    time_t timestamp;            // time the record was received, 0 if unknown
+    mbus_timestamp first_byte;   // arrival of the first and last byte of the frame
+    mbus_timestamp last_byte;
+
+} mbus_record_value;
+
+//
+// Result of mbus_data_fixed_decode_typed: identification, status and both
+// counters of fixed data. The counters are typed like variable data records,
+// vif_code holds the 6 bit unit code of the counter and storage_number is 1
+// for stored (historic) values.
+//
+typedef struct _mbus_data_fixed_value {
+
+    long long id;                // identification number (decimal)
+    int access_no;               // transmission counter
+    int status;                  // status byte
+    int bcd;                     // non-zero when the counters are BCD coded
+    int medium;                  // medium code 0-15, see mbus_data_fixed_medium
+
+    mbus_record_value counter[2];
+
+} mbus_data_fixed_value;
+
+//
+// Output sink for the serializers (XML, JSON). Output is either passed to a
+// write callback (staged in small chunks), written to a FILE, copied into a
+// fixed buffer (truncated like snprintf) or into a growable heap buffer.
+//
+#define MBUS_SINK_CALLBACK    0
+#define MBUS_SINK_FILE        1
+#define MBUS_SINK_BUFFER      2
+#define MBUS_SINK_GROWABLE    3
+
+typedef int (*mbus_sink_write_fn)(void *arg, const char *data, size_t len);
+
+typedef struct _mbus_sink {
+
+    int type;                    // MBUS_SINK_*
+
+    mbus_sink_write_fn write;
+    void *arg;
+    FILE *fp;
+
+    char  *buff;                 // fixed or growable buffer, always null terminated
+    size_t size;
+    size_t len;                  // bytes held in buff or stage
+
+    size_t total;                // bytes written to the sink (including truncated)
+    int error;
+
+    char stage[512];
+
+} mbus_sink;
+
 //
 // for compatibility with non-gcc compilers:
 //
@@ -551,6 +712,10 @@ int mbus_parse(mbus_frame *frame, unsigned char *data, size_t data_size);
 
 int mbus_data_fixed_parse   (mbus_frame *frame, mbus_data_fixed    *data);
 int mbus_data_variable_parse(mbus_frame *frame, mbus_data_variable *data);
+int mbus_data_variable_header_parse(mbus_frame *frame, mbus_data_variable_header *header);
+int mbus_data_variable_record_parse(mbus_frame *frame, size_t *offset, mbus_data_record *record);
+int mbus_data_variable_parse_visit(mbus_frame *frame, mbus_data_variable_header *header,
+                                   mbus_data_record_visitor visit, void *arg);
 
 int mbus_frame_data_parse   (mbus_frame *frame, mbus_frame_data *data);
 
@@ -570,6 +735,10 @@ long        mbus_data_record_tariff(mbus_data_record *record);
 int         mbus_data_record_device(mbus_data_record *record);
 const char *mbus_data_record_unit(mbus_data_record *record);
 const char *mbus_data_record_value(mbus_data_record *record);
+int         mbus_data_record_decode_typed(mbus_data_record *record, mbus_record_value *value);
+int         mbus_data_value_decode_typed(unsigned char dif, unsigned char *data, size_t data_len, mbus_record_value *value);
+int         mbus_data_fixed_decode_typed(mbus_data_fixed *data, mbus_data_fixed_value *value);
+const char *mbus_unit_name(mbus_unit unit);
 
 //
 // M-Bus frame data struct access/write functions
@@ -577,6 +746,21 @@ const char *mbus_data_record_value(mbus_data_record *record);
 int mbus_frame_type(mbus_frame *frame);
 int mbus_frame_direction(mbus_frame *frame);
 
+//
+// Output sinks
+//
+void  mbus_sink_init_callback(mbus_sink *sink, mbus_sink_write_fn write, void *arg);
+void  mbus_sink_init_file(mbus_sink *sink, FILE *fp);
+void  mbus_sink_init_buffer(mbus_sink *sink, char *buff, size_t size);
+int   mbus_sink_init_growable(mbus_sink *sink, size_t size);
+int   mbus_sink_write(mbus_sink *sink, const char *data, size_t len);
+int   mbus_sink_puts(mbus_sink *sink, const char *str);
+int   mbus_sink_printf(mbus_sink *sink, const char *format, ...);
+int   mbus_sink_xml_encode(mbus_sink *sink, const unsigned char *src, size_t max_len);
+int   mbus_sink_flush(mbus_sink *sink);
+char *mbus_sink_release(mbus_sink *sink);
+void  mbus_sink_free(mbus_sink *sink);
+
 //
 // XML generating functions
 //
@@ -591,6 +775,17 @@ char *mbus_data_variable_header_xml(mbus_data_variable_header *header);
 
 char *mbus_frame_xml(mbus_frame *frame);
 
+//
+// XML generating functions writing to an output sink, return 0 on success
+//
+int mbus_data_variable_header_xml_sink(mbus_sink *sink, mbus_data_variable_header *header);
+int mbus_data_variable_record_xml_sink(mbus_sink *sink, mbus_data_record *record, int record_cnt, int frame_cnt);
+int mbus_data_variable_xml_sink(mbus_sink *sink, mbus_data_variable *data);
+int mbus_data_fixed_xml_sink(mbus_sink *sink, mbus_data_fixed *data);
+int mbus_data_error_xml_sink(mbus_sink *sink, int error);
+int mbus_frame_data_xml_sink(mbus_sink *sink, mbus_frame_data *data);
+int mbus_frame_xml_sink(mbus_sink *sink, mbus_frame *frame);
+
 //
 // Debug/dump
 //
@@ -601,10 +796,22 @@ int mbus_data_error_print(int error);
 int mbus_data_variable_header_print(mbus_data_variable_header *header);
 int mbus_data_variable_print(mbus_data_variable *data);
 
+//
+// Error messages and the strings returned by the decode functions are kept
+// per thread, so frames may be parsed and serialized in parallel threads.
+//
 char *mbus_error_str();
 void  mbus_error_str_set(char *message);
 void  mbus_error_reset();
 
+//
+// Receive timestamps, formatted as 2012-01-31T08:15:30.123456789Z
+//
+#define MBUS_TIMESTAMP_ISO_SIZE 31
+
+void  mbus_timestamp_now(mbus_timestamp *ts);
+int   mbus_timestamp_iso(const mbus_timestamp *ts, char *buff, size_t size);
+
 void  mbus_parse_set_debug(int debug);
 void  mbus_hex_dump(const char *label, const char *buff, size_t len);
 
@@ -620,6 +827,10 @@ int mbus_data_int_encode(unsigned char *int_data, size_t int_data_size, int valu
 
 long long mbus_data_bcd_decode(unsigned char *bcd_data, size_t bcd_data_size);
 long long mbus_data_bcd_decode_hex(unsigned char *bcd_data, size_t bcd_data_size);
+int mbus_data_bcd_validate(const unsigned char *bcd_data, size_t bcd_data_size);
+size_t mbus_data_bcd_decode_batch(unsigned char * const *bcd_data, const size_t *bcd_data_size,
+                                  size_t count, long long *values, unsigned char *valid);
+size_t mbus_data_record_bcd_decode_batch(mbus_data_record *record, long long *values, size_t max_values);
 int mbus_data_int_decode(unsigned char *int_data, size_t int_data_size, int *value);
 int mbus_data_long_decode(unsigned char *int_data, size_t int_data_size, long *value);
 int mbus_data_long_long_decode(unsigned char *int_data, size_t int_data_size, long long *value);
@@ -628,10 +839,21 @@ float mbus_data_float_decode(unsigned char *float_data);
 
 void mbus_data_tm_decode(struct tm *t, unsigned char *t_data, size_t t_data_size);
 
+#define MBUS_DATA_TIME_ISO_SIZE 21   // YYYY-MM-DDThh:mm:ssZ
+
+int mbus_data_time_epoch(const unsigned char *t_data, size_t t_data_size, int64_t *epoch);
+int mbus_data_time_iso(const unsigned char *t_data, size_t t_data_size, int utc, char *buff, size_t size);
+size_t mbus_data_time_epoch_batch(unsigned char * const *t_data, const size_t *t_data_size,
+                                  size_t count, int64_t *epoch, unsigned char *valid);
+size_t mbus_data_record_time_epoch_batch(mbus_data_record *record, int64_t *epoch, size_t max_values);
+
 void mbus_data_str_decode(unsigned char *dst, const unsigned char *src, size_t len);
 
 void mbus_data_bin_decode(unsigned char *dst, const unsigned char *src, size_t len, size_t max_len);
 
+#define MBUS_DATA_HASH_INIT 2166136261u
+uint32_t mbus_data_hash(const unsigned char *data, size_t len, uint32_t hash);
+
 const char *mbus_data_fixed_medium(mbus_data_fixed *data);
 const char *mbus_data_fixed_unit(int medium_unit_byte);
 const char *mbus_data_variable_medium_lookup(unsigned char medium);
@@ -13,6 +13,8 @@
 #include <fcntl.h>
 
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <stdio.h>
 #include <strings.h>
@@ -23,6 +25,9 @@
 
 #include "mbus-serial.h"
 #include "mbus-protocol-aux.h"
+#include "mbus-stats-internal.h"
+#include "mbus-capture.h"
+#include "mbus-trace.h"
 #include "mbus-protocol.h"
 
 #define PACKET_BUFF_SIZE 2048
@@ -223,15 +228,18 @@ mbus_serial_data_free(mbus_handle *handle)
 }
 
 //------------------------------------------------------------------------------
-//
+/// Write one or more packed frames with a single writev() call. Unless the
+/// drain option has been disabled, wait until the UART has sent everything.
 //------------------------------------------------------------------------------
 int
-mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
+mbus_serial_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt)
 {
-    unsigned char buff[PACKET_BUFF_SIZE];
-    int len, ret;
+    mbus_serial_data *serial_data;
+    size_t len, offset;
+    ssize_t ret;
+    int i;
 
-    if (handle == NULL || frame == NULL)
+    if (handle == NULL || iov == NULL || iovcnt <= 0)
     {
         return -1;
     }
@@ -242,45 +250,168 @@ mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
         return -1;
     }
 
-    if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
+#ifdef MBUS_SERIAL_DEBUG
+    // if debug, dump in HEX form to stdout what we write to the serial port
+    for (i = 0; i < iovcnt; i++)
     {
-        fprintf(stderr, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        size_t j;
+        printf("%s: Dumping M-Bus frame [%zu bytes]: ", __PRETTY_FUNCTION__, iov[i].iov_len);
+        for (j = 0; j < iov[i].iov_len; j++)
+        {
+           printf("%.2X ", ((const unsigned char *) iov[i].iov_base)[j]);
+        }
+        printf("\n");
+    }
+#endif
+
+    do {
+        ret = writev(handle->fd, iov, iovcnt);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1)
+    {
+        fprintf(stderr, "%s: Failed to write frame to socket (ret = %zd: %s)\n", __PRETTY_FUNCTION__, ret, strerror(errno));
         return -1;
     }
 
-#ifdef MBUS_SERIAL_DEBUG
-    // if debug, dump in HEX form to stdout what we write to the serial port
-    printf("%s: Dumping M-Bus frame [%d bytes]: ", __PRETTY_FUNCTION__, len);
-    int i;
-    for (i = 0; i < len; i++)
+    //
+    // finish a partial write
+    //
+    offset = ret;
+    for (i = 0; i < iovcnt; i++)
     {
-       printf("%.2X ", buff[i]);
+        len = iov[i].iov_len;
+
+        if (offset >= len)
+        {
+            offset -= len;
+            continue;
+        }
+
+        while (offset < len)
+        {
+            ret = write(handle->fd, (const unsigned char *) iov[i].iov_base + offset, len - offset);
+
+            if (ret == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                fprintf(stderr, "%s: Failed to write frame to socket (ret = %zd: %s)\n", __PRETTY_FUNCTION__, ret, strerror(errno));
+                return -1;
+            }
+
+            offset += ret;
+        }
+
+        offset = 0;
     }
-    printf("\n");
-#endif
 
-    if ((ret = write(handle->fd, buff, len)) == len)
+    if (handle->capture)
     {
-        //
-        // call the send event function, if the callback function is registered
-        //
-        if (handle->send_event)
-                handle->send_event(MBUS_HANDLE_TYPE_SERIAL, buff, len);
+        for (i = 0; i < iovcnt; i++)
+            mbus_capture_event(handle, MBUS_CAPTURE_SEND, iov[i].iov_base, iov[i].iov_len);
     }
-    else
+
+    //
+    // wait until complete frame has been transmitted
+    //
+    serial_data = (mbus_serial_data *) handle->auxdata;
+    if (serial_data == NULL || serial_data->drain)
+    {
+        tcdrain(handle->fd);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+//
+//------------------------------------------------------------------------------
+int
+mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    unsigned char buff[PACKET_BUFF_SIZE];
+    struct iovec iov;
+    int len;
+
+    if (handle == NULL || frame == NULL)
+    {
+        return -1;
+    }
+
+    if ((len = mbus_frame_pack(frame, buff, sizeof(buff))) == -1)
+    {
+        fprintf(stderr, "%s: mbus_frame_pack failed\n", __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    iov.iov_base = buff;
+    iov.iov_len = len;
+
+    if (mbus_serial_send_raw(handle, &iov, 1) != 0)
     {
-        fprintf(stderr, "%s: Failed to write frame to socket (ret = %d: %s)\n", __PRETTY_FUNCTION__, ret, strerror(errno));
         return -1;
     }
 
     //
-    // wait until complete frame has been transmitted
+    // call the send event function, if the callback function is registered
     //
-    tcdrain(handle->fd);
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_SERIAL, (const char *) buff, len);
 
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Number of bytes still waiting in the output queue of the serial port,
+/// allows polling for transmit completion when the drain option is disabled.
+//------------------------------------------------------------------------------
+int
+mbus_serial_pending(mbus_handle *handle)
+{
+    int pending;
+
+    if (handle == NULL || handle->fd < 0)
+    {
+        return -1;
+    }
+
+    if (ioctl(handle->fd, TIOCOUTQ, &pending) == -1)
+    {
+        return -1;
+    }
+
+    return pending;
+}
+
+//------------------------------------------------------------------------------
+/// Set a serial specific option of the handle.
+//------------------------------------------------------------------------------
+int
+mbus_serial_set_option(mbus_handle *handle, mbus_context_option option, long value)
+{
+    mbus_serial_data *serial_data;
+
+    if (handle == NULL)
+        return -1;
+
+    serial_data = (mbus_serial_data *) handle->auxdata;
+    if (serial_data == NULL)
+        return -1;
+
+    switch (option)
+    {
+        case MBUS_OPTION_SERIAL_DRAIN:
+            serial_data->drain = (value != 0);
+            return 0;
+        default:
+            break;
+    }
+
+    return -1;
+}
+
 //------------------------------------------------------------------------------
 //
 //------------------------------------------------------------------------------
@@ -329,6 +460,8 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
             return MBUS_RECV_RESULT_ERROR;
         }
 
+        MBUS_TRACE3(serial_read, handle->fd, nread, len);
+
 //   printf("%s: Got %d byte [remaining %d, len %d]\n", __PRETTY_FUNCTION__, nread, remaining, len);
 
         if (nread == 0)
@@ -349,6 +482,9 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
             return MBUS_RECV_RESULT_ERROR;
         }
 
+        if (len == 0 && nread > 0)
+            mbus_recv_first_byte(handle, frame);
+
         len += nread;
 
     } while ((remaining = mbus_parse(frame, buff, len)) > 0);
@@ -365,6 +501,8 @@ mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame)
     if (handle->recv_event)
         handle->recv_event(MBUS_HANDLE_TYPE_SERIAL, buff, len);
 
+    mbus_capture_event(handle, MBUS_CAPTURE_RECV, buff, len);
+
     if (remaining != 0)
     {
         // Would be OK when e.g. scanning the bus, otherwise it is a failure.
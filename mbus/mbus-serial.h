@@ -31,11 +31,15 @@ typedef struct _mbus_serial_data
 {
     char *device;
     struct termios t;
+    char drain;     /**< non zero to wait in send until the frame has been transmitted */
 } mbus_serial_data;
 
 int  mbus_serial_connect(mbus_handle *handle);
 int  mbus_serial_disconnect(mbus_handle *handle);
 int  mbus_serial_send_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_serial_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt);
+int  mbus_serial_pending(mbus_handle *handle);
+int  mbus_serial_set_option(mbus_handle *handle, mbus_context_option option, long value);
 int  mbus_serial_recv_frame(mbus_handle *handle, mbus_frame *frame);
 int  mbus_serial_set_baudrate(mbus_handle *handle, long baudrate);
 void mbus_serial_data_free(mbus_handle *handle);
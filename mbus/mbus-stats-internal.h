@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-stats-internal.h
+ *
+ * @brief  Accounting of the traffic statistics, used by the library and the
+ *         transports only. Not installed.
+ */
+
+#ifndef MBUS_STATS_INTERNAL_H
+#define MBUS_STATS_INTERNAL_H
+
+#include "mbus-stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Statistics of a handle and the state of the outstanding request
+ */
+typedef struct _mbus_stats_state
+{
+    mbus_stats stats;
+
+    struct
+    {
+        int      address;           /**< -1 if no reply is expected */
+        uint64_t request_ns;
+        uint64_t first_byte_ns;     /**< 0 until the first byte arrived */
+    } pending;
+} mbus_stats_state;
+
+//
+// accounting functions, they do nothing unless statistics are enabled on
+// the handle
+//
+int  mbus_stats_enable(mbus_handle *handle, int enable);
+void mbus_stats_sent_frame(mbus_handle *handle, mbus_frame *frame);
+void mbus_stats_sent_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt);
+void mbus_stats_first_byte(mbus_handle *handle);
+void mbus_stats_echo(mbus_handle *handle);
+void mbus_stats_received(mbus_handle *handle, int result, mbus_frame *frame);
+void mbus_stats_purged(mbus_handle *handle, uint64_t start_ns);
+void mbus_stats_collision(mbus_handle *handle);
+void mbus_stats_retry(mbus_handle *handle);
+uint64_t mbus_stats_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_STATS_INTERNAL_H */
@@ -0,0 +1,406 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbus-stats-internal.h"
+
+//------------------------------------------------------------------------------
+/// Monotonic time in nanoseconds
+//------------------------------------------------------------------------------
+uint64_t
+mbus_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+mbus_stats_histogram_add(mbus_stats_histogram *histogram, uint64_t ns)
+{
+    uint32_t us = (ns / 1000 > UINT32_MAX) ? UINT32_MAX : (uint32_t) (ns / 1000);
+    int n = 0;
+
+    while (n < MBUS_STATS_BUCKETS - 1 && (us >> (n + 1)) != 0)
+    {
+        n++;
+    }
+
+    if (histogram->count == 0 || us < histogram->min_us)
+        histogram->min_us = us;
+    if (us > histogram->max_us)
+        histogram->max_us = us;
+
+    histogram->count++;
+    histogram->bucket[n]++;
+    histogram->sum_us += us;
+}
+
+static void
+mbus_stats_clear(mbus_stats_state *state)
+{
+    memset(state, 0, sizeof(mbus_stats_state));
+    state->pending.address = -1;
+}
+
+//------------------------------------------------------------------------------
+/// Enable (allocate) or disable (free) the statistics of a handle
+//------------------------------------------------------------------------------
+int
+mbus_stats_enable(mbus_handle *handle, int enable)
+{
+    if (handle == NULL)
+    {
+        mbus_error_str_set("Invalid M-Bus handle.");
+        return -1;
+    }
+
+    if (enable == 0)
+    {
+        free(handle->stats);
+        handle->stats = NULL;
+        return 0;
+    }
+
+    if (handle->stats == NULL)
+    {
+        if ((handle->stats = (mbus_stats_state *) malloc(sizeof(mbus_stats_state))) == NULL)
+        {
+            mbus_error_str_set("Failed to allocate statistics.");
+            return -1;
+        }
+
+        mbus_stats_clear(handle->stats);
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Copy the statistics of a handle
+//------------------------------------------------------------------------------
+int
+mbus_stats_snapshot(mbus_handle *handle, mbus_stats *stats)
+{
+    if (handle == NULL || stats == NULL || handle->stats == NULL)
+    {
+        mbus_error_str_set("Statistics are not enabled.");
+        return -1;
+    }
+
+    memcpy(stats, &(handle->stats->stats), sizeof(mbus_stats));
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Reset the statistics of a handle
+//------------------------------------------------------------------------------
+int
+mbus_stats_reset(mbus_handle *handle)
+{
+    if (handle == NULL || handle->stats == NULL)
+    {
+        mbus_error_str_set("Statistics are not enabled.");
+        return -1;
+    }
+
+    mbus_stats_clear(handle->stats);
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Percentile of a histogram, upper bound of its bucket in us
+//------------------------------------------------------------------------------
+uint32_t
+mbus_stats_percentile(const mbus_stats_histogram *histogram, double percentile)
+{
+    uint64_t rank, sum = 0;
+    int n;
+
+    if (histogram == NULL || histogram->count == 0)
+        return 0;
+
+    rank = (uint64_t) (histogram->count * percentile / 100.0 + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    for (n = 0; n < MBUS_STATS_BUCKETS - 1; n++)
+    {
+        if ((sum += histogram->bucket[n]) >= rank)
+        {
+            // the bucket bound is never more accurate than the extremes
+            return (2U << n) - 1 < histogram->max_us ? (2U << n) - 1 : histogram->max_us;
+        }
+    }
+
+    return histogram->max_us;
+}
+
+//------------------------------------------------------------------------------
+// Accounting, called by the library (send, receive and purge functions) and
+// the transports (first byte of a reply).
+//------------------------------------------------------------------------------
+static void
+mbus_stats_request(mbus_stats_state *state, int address, size_t frames, size_t bytes)
+{
+    mbus_stats *stats = &(state->stats);
+
+    stats->frames_sent += frames;
+    stats->bytes_sent += bytes;
+
+    // broadcasts without reply don't start a request
+    if (address < 0 || address == MBUS_ADDRESS_BROADCAST_NOREPLY)
+    {
+        state->pending.address = -1;
+        return;
+    }
+
+    stats->address[address & 0xFF].requests++;
+    state->pending.address = address & 0xFF;
+    state->pending.request_ns = mbus_stats_now();
+    state->pending.first_byte_ns = 0;
+}
+
+void
+mbus_stats_sent_frame(mbus_handle *handle, mbus_frame *frame)
+{
+    size_t len;
+
+    if (handle == NULL || handle->stats == NULL || frame == NULL)
+        return;
+
+    switch (frame->type)
+    {
+        case MBUS_FRAME_TYPE_ACK:
+            len = MBUS_FRAME_BASE_SIZE_ACK;
+            break;
+        case MBUS_FRAME_TYPE_SHORT:
+            len = MBUS_FRAME_BASE_SIZE_SHORT;
+            break;
+        case MBUS_FRAME_TYPE_CONTROL:
+            len = MBUS_FRAME_BASE_SIZE_CONTROL;
+            break;
+        default:
+            len = MBUS_FRAME_BASE_SIZE_LONG + frame->data_size;
+            break;
+    }
+
+    mbus_stats_request(handle->stats, (frame->type == MBUS_FRAME_TYPE_ACK) ? -1 : frame->address, 1, len);
+}
+
+void
+mbus_stats_sent_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt)
+{
+    const unsigned char *data;
+    size_t bytes = 0;
+    int i, address = -1;
+
+    if (handle == NULL || handle->stats == NULL || iov == NULL)
+        return;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        bytes += iov[i].iov_len;
+    }
+
+    // the last frame (e.g. REQ_UD2 after a selection) is the one answered
+    if (iovcnt > 0)
+    {
+        data = (const unsigned char *) iov[iovcnt - 1].iov_base;
+
+        if (data[0] == MBUS_FRAME_SHORT_START && iov[iovcnt - 1].iov_len >= MBUS_FRAME_BASE_SIZE_SHORT)
+            address = data[2];
+        else if (data[0] == MBUS_FRAME_LONG_START && iov[iovcnt - 1].iov_len >= MBUS_FRAME_BASE_SIZE_LONG)
+            address = data[5];
+    }
+
+    mbus_stats_request(handle->stats, address, iovcnt, bytes);
+}
+
+void
+mbus_stats_first_byte(mbus_handle *handle)
+{
+    if (handle && handle->stats && handle->stats->pending.first_byte_ns == 0)
+    {
+        handle->stats->pending.first_byte_ns = mbus_stats_now();
+    }
+}
+
+void
+mbus_stats_echo(mbus_handle *handle)
+{
+    // the bytes received so far were the echo of the request
+    if (handle && handle->stats)
+    {
+        handle->stats->pending.first_byte_ns = 0;
+    }
+}
+
+void
+mbus_stats_received(mbus_handle *handle, int result, mbus_frame *frame)
+{
+    mbus_stats_state *state;
+    mbus_stats *stats;
+    mbus_stats_address *address = NULL;
+    uint64_t now;
+
+    if (handle == NULL || (state = handle->stats) == NULL)
+        return;
+
+    stats = &(state->stats);
+
+    if (state->pending.address >= 0)
+    {
+        address = &(stats->address[state->pending.address]);
+    }
+
+    switch (result)
+    {
+        case MBUS_RECV_RESULT_OK:
+            stats->frames_received++;
+
+            switch (frame->type)
+            {
+                case MBUS_FRAME_TYPE_ACK:
+                    stats->bytes_received += MBUS_FRAME_BASE_SIZE_ACK;
+                    break;
+                case MBUS_FRAME_TYPE_SHORT:
+                    stats->bytes_received += MBUS_FRAME_BASE_SIZE_SHORT;
+                    break;
+                default:
+                    stats->bytes_received += MBUS_FRAME_BASE_SIZE_LONG + frame->data_size;
+                    break;
+            }
+
+            if (address)
+            {
+                now = mbus_stats_now();
+
+                if (state->pending.first_byte_ns == 0)
+                    state->pending.first_byte_ns = now;
+
+                address->replies++;
+                mbus_stats_histogram_add(&(address->first_byte), state->pending.first_byte_ns - state->pending.request_ns);
+                mbus_stats_histogram_add(&(address->complete), now - state->pending.request_ns);
+                mbus_stats_histogram_add(&(stats->first_byte), state->pending.first_byte_ns - state->pending.request_ns);
+                mbus_stats_histogram_add(&(stats->complete), now - state->pending.request_ns);
+            }
+            break;
+
+        case MBUS_RECV_RESULT_TIMEOUT:
+            // purging ends with a timeout, only missing replies count
+            if (address)
+            {
+                stats->timeouts++;
+                address->timeouts++;
+            }
+            break;
+
+        case MBUS_RECV_RESULT_INVALID:
+            stats->invalid_frames++;
+            if (address)
+                address->invalid++;
+            break;
+
+        default:
+            stats->errors++;
+            break;
+    }
+
+    // only the first frame after a request is its reply
+    state->pending.address = -1;
+}
+
+void
+mbus_stats_purged(mbus_handle *handle, uint64_t start_ns)
+{
+    if (handle && handle->stats)
+    {
+        handle->stats->stats.purges++;
+        handle->stats->stats.purge_us += (mbus_stats_now() - start_ns) / 1000;
+    }
+}
+
+void
+mbus_stats_collision(mbus_handle *handle)
+{
+    if (handle && handle->stats)
+    {
+        handle->stats->stats.collisions++;
+    }
+}
+
+void
+mbus_stats_retry(mbus_handle *handle)
+{
+    if (handle && handle->stats)
+    {
+        handle->stats->stats.retries++;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Print the statistics
+//------------------------------------------------------------------------------
+static void
+mbus_stats_histogram_print(const char *label, const mbus_stats_histogram *histogram)
+{
+    if (histogram->count == 0)
+    {
+        printf("%-12s -\n", label);
+        return;
+    }
+
+    printf("%-12s n=%u min=%u avg=%llu p50=%u p90=%u p99=%u max=%u us\n", label,
+           histogram->count, histogram->min_us,
+           (unsigned long long) (histogram->sum_us / histogram->count),
+           mbus_stats_percentile(histogram, 50.0),
+           mbus_stats_percentile(histogram, 90.0),
+           mbus_stats_percentile(histogram, 99.0),
+           histogram->max_us);
+}
+
+int
+mbus_stats_print(const mbus_stats *stats)
+{
+    int i;
+
+    if (stats == NULL)
+        return -1;
+
+    printf("sent         %lu frames, %lu bytes\n", stats->frames_sent, stats->bytes_sent);
+    printf("received     %lu frames, %lu bytes\n", stats->frames_received, stats->bytes_received);
+    printf("timeouts     %lu\n", stats->timeouts);
+    printf("invalid      %lu\n", stats->invalid_frames);
+    printf("errors       %lu\n", stats->errors);
+    printf("collisions   %lu\n", stats->collisions);
+    printf("retries      %lu\n", stats->retries);
+    printf("purges       %lu, %llu us\n", stats->purges, (unsigned long long) stats->purge_us);
+    mbus_stats_histogram_print("first byte", &(stats->first_byte));
+    mbus_stats_histogram_print("complete", &(stats->complete));
+
+    for (i = 0; i < MBUS_STATS_ADDRESSES; i++)
+    {
+        const mbus_stats_address *address = &(stats->address[i]);
+
+        if (address->requests == 0)
+            continue;
+
+        printf("\naddress %d: %u requests, %u replies, %u timeouts, %u invalid\n", i,
+               address->requests, address->replies, address->timeouts, address->invalid);
+        mbus_stats_histogram_print("first byte", &(address->first_byte));
+        mbus_stats_histogram_print("complete", &(address->complete));
+    }
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-stats.h
+ *
+ * @brief  Per-handle traffic statistics and latency histograms.
+ *
+ * Statistics are collected once enabled with the MBUS_OPTION_STATS option of
+ * the handle. They count the frames and bytes sent and received, timeouts,
+ * invalid frames, collisions, retries of mbus_sendrecv_request and the time
+ * spent purging the bus, and record the request-to-first-byte and
+ * request-to-complete latency of every primary address:
+ *
+ * \verbatim
+ * mbus_context_set_option(handle, MBUS_OPTION_STATS, 1);
+ * ...
+ * mbus_stats_snapshot(handle, &stats);
+ * mbus_stats_print(&stats);
+ * \endverbatim
+ *
+ * This allows to tell a slow meter (high latencies of one address) from
+ * line noise (invalid frames, collisions) and too short timeouts (timeouts
+ * with latencies close to the timeout).
+ */
+
+#ifndef MBUS_STATS_H
+#define MBUS_STATS_H
+
+#include "mbus-protocol.h"
+#include "mbus-protocol-aux.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBUS_STATS_ADDRESSES  256
+#define MBUS_STATS_BUCKETS    24
+
+/**
+ * Latency histogram with logarithmic buckets: bucket 0 counts latencies
+ * below 2 us, bucket n latencies from 2^n to 2^(n+1) us, the last bucket
+ * all latencies above 2^(MBUS_STATS_BUCKETS-1) us (about 8 s).
+ */
+typedef struct _mbus_stats_histogram
+{
+    uint32_t count;
+    uint32_t bucket[MBUS_STATS_BUCKETS];
+    uint64_t sum_us;            /**< sum of all latencies */
+    uint32_t min_us;
+    uint32_t max_us;
+} mbus_stats_histogram;
+
+/**
+ * Statistics of a primary address
+ */
+typedef struct _mbus_stats_address
+{
+    uint32_t requests;          /**< requests sent to the address */
+    uint32_t replies;           /**< valid replies to these requests */
+    uint32_t timeouts;          /**< requests without reply */
+    uint32_t invalid;           /**< invalid replies */
+
+    mbus_stats_histogram first_byte;  /**< request to first byte of the reply */
+    mbus_stats_histogram complete;    /**< request to complete reply */
+} mbus_stats_address;
+
+typedef struct _mbus_stats
+{
+    unsigned long frames_sent;
+    unsigned long frames_received;
+    unsigned long bytes_sent;
+    unsigned long bytes_received;   /**< bytes of valid frames */
+
+    unsigned long timeouts;         /**< requests without reply */
+    unsigned long invalid_frames;   /**< checksum, length or framing errors */
+    unsigned long errors;           /**< transport errors and connection resets */
+    unsigned long collisions;       /**< more than one slave replied */
+    unsigned long retries;          /**< retries consumed in mbus_sendrecv_request */
+
+    unsigned long purges;           /**< calls of mbus_purge_frames */
+    uint64_t purge_us;              /**< time spent in mbus_purge_frames */
+
+    mbus_stats_histogram first_byte;  /**< request to first byte, all addresses */
+    mbus_stats_histogram complete;    /**< request to complete reply, all addresses */
+
+    mbus_stats_address address[MBUS_STATS_ADDRESSES];
+} mbus_stats;
+
+/**
+ * Copy the statistics of a handle.
+ *
+ * @param handle  handle with statistics enabled (MBUS_OPTION_STATS)
+ * @param stats   copy of the statistics
+ *
+ * @return Zero when successful, -1 if statistics are not enabled.
+ */
+int mbus_stats_snapshot(mbus_handle *handle, mbus_stats *stats);
+
+/**
+ * Reset the statistics of a handle.
+ *
+ * @param handle  handle with statistics enabled (MBUS_OPTION_STATS)
+ *
+ * @return Zero when successful, -1 if statistics are not enabled.
+ */
+int mbus_stats_reset(mbus_handle *handle);
+
+/**
+ * Estimate a percentile of a histogram from its buckets.
+ *
+ * @param histogram  latency histogram
+ * @param percentile percentile (0-100)
+ *
+ * @return upper bound of the bucket of the percentile in us, 0 if empty
+ */
+uint32_t mbus_stats_percentile(const mbus_stats_histogram *histogram, double percentile);
+
+/**
+ * Print the statistics (totals and addresses with traffic) to stdout.
+ *
+ * @param stats  statistics
+ *
+ * @return Zero when successful.
+ */
+int mbus_stats_print(const mbus_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBUS_STATS_H */
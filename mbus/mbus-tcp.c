@@ -14,7 +14,10 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -22,83 +25,322 @@
 #include <errno.h>
 
 #include "mbus-tcp.h"
+#include "mbus-stats-internal.h"
+#include "mbus-capture.h"
+#include "mbus-trace.h"
 
 #define PACKET_BUFF_SIZE 2048
 #define MAX_PORT_SIZE 6 // Size of port number + NULL char
 
+#define MBUS_TCP_KEEPALIVE_INTERVAL 10
+#define MBUS_TCP_KEEPALIVE_COUNT    3
+
+// A gateway closing the connection must not raise SIGPIPE, systems without
+// MSG_NOSIGNAL (e.g. macOS) set SO_NOSIGPIPE on the socket instead
+#ifdef MSG_NOSIGNAL
+#define MBUS_TCP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define MBUS_TCP_SEND_FLAGS 0
+#endif
+
 static int tcp_timeout_sec = 4;
 static int tcp_timeout_usec = 0;
 
 //------------------------------------------------------------------------------
-/// Setup a TCP/IP handle.
+/// Resolve the gateway address. The result is cached in the TCP data so that
+/// reconnects do not have to go through getaddrinfo again.
 //------------------------------------------------------------------------------
-int
-mbus_tcp_connect(mbus_handle *handle)
+static int
+mbus_tcp_resolve(mbus_tcp_data *tcp_data)
 {
-    char error_str[128], *host;
-    struct addrinfo hints, *servinfo, *p;
-    struct timeval time_out;
-    mbus_tcp_data *tcp_data;
+    char error_str[128];
+    struct addrinfo hints;
     char port[MAX_PORT_SIZE];
     int status;
 
-    if (handle == NULL)
-        return -1;
-
-    tcp_data = (mbus_tcp_data *) handle->auxdata;
-    if (tcp_data == NULL || tcp_data->host == NULL)
-        return -1;
+    if (tcp_data->addr != NULL)
+    {
+        freeaddrinfo(tcp_data->addr);
+        tcp_data->addr = NULL;
+    }
 
-    host = tcp_data->host;
     snprintf(port, MAX_PORT_SIZE, "%d", tcp_data->port);
 
     memset(&hints, 0, sizeof hints);
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
 
-    if ((status = getaddrinfo(host, port, &hints, &servinfo)) != 0)
+    if ((status = getaddrinfo(tcp_data->host, port, &hints, &tcp_data->addr)) != 0)
     {
         snprintf(error_str, sizeof(error_str), "%s: getaddrinfo: %s", __PRETTY_FUNCTION__, gai_strerror(status));
         mbus_error_str_set(error_str);
+        tcp_data->addr = NULL;
         return -1;
     }
 
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/// Connect a socket with a timeout. The socket is switched to non-blocking
+/// mode for the connect and back to blocking mode afterwards.
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_connect_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen, int timeout_ms)
+{
+    struct pollfd pfd;
+    socklen_t optlen;
+    int flags, ret, err;
+
+    if ((flags = fcntl(fd, F_GETFL, 0)) == -1 ||
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        return -1;
+    }
+
+    ret = connect(fd, addr, addrlen);
+
+    if (ret == -1 && errno == EINPROGRESS)
+    {
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+
+        do {
+            ret = poll(&pfd, 1, timeout_ms);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        if (ret == -1)
+        {
+            return -1;
+        }
+
+        optlen = sizeof(err);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &optlen) == -1)
+        {
+            return -1;
+        }
+
+        if (err != 0)
+        {
+            errno = err;
+            return -1;
+        }
+
+        ret = 0;
+    }
+
+    if (ret == -1)
+    {
+        return -1;
+    }
+
+    return fcntl(fd, F_SETFL, flags);
+}
+
+//------------------------------------------------------------------------------
+/// Apply timeouts, TCP_NODELAY and keepalive settings to a connected socket.
+//------------------------------------------------------------------------------
+static void
+mbus_tcp_setup_socket(int fd, mbus_tcp_data *tcp_data)
+{
+    struct timeval time_out;
+    int on = 1;
+
+    // Set a timeout
+    time_out.tv_sec  = tcp_timeout_sec;   // seconds
+    time_out.tv_usec = tcp_timeout_usec;  // microseconds
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &time_out, sizeof(time_out));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &time_out, sizeof(time_out));
+
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    // Requests are small and latency bound, don't let them wait for ACKs
+    if (tcp_data->nodelay)
+    {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    // Detect dead gateways on otherwise idle connections
+    if (tcp_data->keepalive_idle > 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &tcp_data->keepalive_idle, sizeof(int));
+#endif
+#ifdef TCP_KEEPINTVL
+        {
+            int interval = MBUS_TCP_KEEPALIVE_INTERVAL;
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        }
+#endif
+#ifdef TCP_KEEPCNT
+        {
+            int count = MBUS_TCP_KEEPALIVE_COUNT;
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+        }
+#endif
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Try to connect to one of the resolved addresses.
+//------------------------------------------------------------------------------
+static int
+mbus_tcp_connect_addr(mbus_handle *handle, mbus_tcp_data *tcp_data)
+{
+    struct addrinfo *p;
+
     // loop through all the results and connect to the first we can
-    for (p = servinfo; p != NULL; p = p->ai_next)
+    for (p = tcp_data->addr; p != NULL; p = p->ai_next)
     {
         if ((handle->fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
         {
             continue;
         }
 
-        if (connect(handle->fd, p->ai_addr, p->ai_addrlen) == -1)
+        if (mbus_tcp_connect_timeout(handle->fd, p->ai_addr, p->ai_addrlen, tcp_data->connect_timeout_ms) == -1)
         {
             close(handle->fd);
+            handle->fd = -1;
             continue;
         }
 
-        break; // if we get here, we must have connected successfully
+        mbus_tcp_setup_socket(handle->fd, tcp_data);
+        return 0; // if we get here, we must have connected successfully
     }
 
-    // Free addr info, we do not need it anymore
-    freeaddrinfo(servinfo);
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+/// Setup a TCP/IP handle.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_connect(mbus_handle *handle)
+{
+    char error_str[128];
+    mbus_tcp_data *tcp_data;
+    int cached;
+
+    if (handle == NULL)
+        return -1;
+
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+    if (tcp_data == NULL || tcp_data->host == NULL)
+        return -1;
+
+    cached = (tcp_data->addr != NULL);
 
-    if (p == NULL)
+    if (!cached && mbus_tcp_resolve(tcp_data) == -1)
     {
-        snprintf(error_str, sizeof(error_str), "%s: Failed to establish connection to %s:%s", __PRETTY_FUNCTION__, host, port);
-        mbus_error_str_set(error_str);
         return -1;
     }
 
-    // Set a timeout
-    time_out.tv_sec  = tcp_timeout_sec;   // seconds
-    time_out.tv_usec = tcp_timeout_usec;  // microseconds
-    setsockopt(handle->fd, SOL_SOCKET, SO_SNDTIMEO, &time_out, sizeof(time_out));
-    setsockopt(handle->fd, SOL_SOCKET, SO_RCVTIMEO, &time_out, sizeof(time_out));
+    if (mbus_tcp_connect_addr(handle, tcp_data) == -1)
+    {
+        // addresses cached by an earlier connect may be stale, resolve once
+        // more; freshly resolved ones are not tried twice
+        if (cached && mbus_tcp_resolve(tcp_data) == -1)
+        {
+            return -1;
+        }
+
+        if (!cached || mbus_tcp_connect_addr(handle, tcp_data) == -1)
+        {
+            snprintf(error_str, sizeof(error_str), "%s: Failed to establish connection to %s:%d",
+                     __PRETTY_FUNCTION__, tcp_data->host, tcp_data->port);
+            mbus_error_str_set(error_str);
+            return -1;
+        }
+    }
 
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Close a dead connection if the handle reconnects automatically, the next
+/// send re-establishes it.
+//------------------------------------------------------------------------------
+static void
+mbus_tcp_drop(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data = (mbus_tcp_data *) handle->auxdata;
+
+    if (tcp_data && tcp_data->auto_reconnect && handle->fd >= 0)
+    {
+        close(handle->fd);
+        handle->fd = -1;
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Re-establish a lost connection. Failed attempts are spaced with an
+/// exponential backoff; inside the backoff window this fails immediately
+/// instead of blocking the caller for another connect timeout.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_reconnect(mbus_handle *handle)
+{
+    mbus_tcp_data *tcp_data;
+    struct timespec now;
+
+    if (handle == NULL)
+        return -1;
+
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+    if (tcp_data == NULL)
+        return -1;
+
+    if (handle->fd >= 0)
+    {
+        close(handle->fd);
+        handle->fd = -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if ((now.tv_sec < tcp_data->reconnect_after.tv_sec) ||
+        (now.tv_sec == tcp_data->reconnect_after.tv_sec && now.tv_nsec < tcp_data->reconnect_after.tv_nsec))
+    {
+        mbus_error_str_set("M-Bus tcp transport layer is waiting to reconnect.");
+        return -1;
+    }
+
+    if (mbus_tcp_connect(handle) == 0)
+    {
+        tcp_data->reconnect_delay_ms = 0;
+        return 0;
+    }
+
+    if (tcp_data->reconnect_delay_ms == 0)
+    {
+        tcp_data->reconnect_delay_ms = MBUS_TCP_RECONNECT_DELAY_MIN_MS;
+    }
+    else if ((tcp_data->reconnect_delay_ms *= 2) > MBUS_TCP_RECONNECT_DELAY_MAX_MS)
+    {
+        tcp_data->reconnect_delay_ms = MBUS_TCP_RECONNECT_DELAY_MAX_MS;
+    }
+
+    tcp_data->reconnect_after.tv_sec  = now.tv_sec + tcp_data->reconnect_delay_ms / 1000;
+    tcp_data->reconnect_after.tv_nsec = now.tv_nsec + (tcp_data->reconnect_delay_ms % 1000) * 1000000L;
+    if (tcp_data->reconnect_after.tv_nsec >= 1000000000L)
+    {
+        tcp_data->reconnect_after.tv_sec++;
+        tcp_data->reconnect_after.tv_nsec -= 1000000000L;
+    }
+
+    return -1;
+}
+
 //------------------------------------------------------------------------------
 //
 //------------------------------------------------------------------------------
@@ -116,6 +358,9 @@ mbus_tcp_data_free(mbus_handle *handle)
             return;
         }
 
+        if (tcp_data->addr)
+            freeaddrinfo(tcp_data->addr);
+
         free(tcp_data->host);
         free(tcp_data);
         handle->auxdata = NULL;
@@ -144,6 +389,106 @@ mbus_tcp_disconnect(mbus_handle *handle)
     return 0;
 }
 
+//------------------------------------------------------------------------------
+/// Send one or more packed frames with a single sendmsg() call.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt)
+{
+    mbus_tcp_data *tcp_data;
+    struct msghdr msg;
+    size_t len, offset;
+    ssize_t ret;
+    int i;
+    char error_str[128];
+
+    if (handle == NULL || iov == NULL || iovcnt <= 0)
+    {
+        return -1;
+    }
+
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+
+    if (handle->fd < 0 && tcp_data && tcp_data->auto_reconnect)
+    {
+        if (mbus_tcp_reconnect(handle) == -1)
+        {
+            return -1;
+        }
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+
+    do {
+        ret = sendmsg(handle->fd, &msg, MBUS_TCP_SEND_FLAGS);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1 && (errno == EPIPE || errno == ECONNRESET) &&
+        tcp_data && tcp_data->auto_reconnect)
+    {
+        // the gateway dropped the connection since the last exchange
+        if (mbus_tcp_reconnect(handle) == -1)
+        {
+            return -1;
+        }
+
+        do {
+            ret = sendmsg(handle->fd, &msg, MBUS_TCP_SEND_FLAGS);
+        } while (ret == -1 && errno == EINTR);
+    }
+
+    if (ret == -1)
+    {
+        snprintf(error_str, sizeof(error_str), "%s: Failed to write frame to socket (%s)\n", __PRETTY_FUNCTION__, strerror(errno));
+        mbus_error_str_set(error_str);
+        return -1;
+    }
+
+    //
+    // finish a partial write (send timeout or signal)
+    //
+    offset = ret;
+    for (i = 0; i < iovcnt; i++)
+    {
+        len = iov[i].iov_len;
+
+        if (offset >= len)
+        {
+            offset -= len;
+            continue;
+        }
+
+        while (offset < len)
+        {
+            ret = send(handle->fd, (const unsigned char *) iov[i].iov_base + offset, len - offset, MBUS_TCP_SEND_FLAGS);
+
+            if (ret == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                snprintf(error_str, sizeof(error_str), "%s: Failed to write frame to socket (%s)\n", __PRETTY_FUNCTION__, strerror(errno));
+                mbus_error_str_set(error_str);
+                return -1;
+            }
+
+            offset += ret;
+        }
+
+        offset = 0;
+    }
+
+    if (handle->capture)
+    {
+        for (i = 0; i < iovcnt; i++)
+            mbus_capture_event(handle, MBUS_CAPTURE_SEND, iov[i].iov_base, iov[i].iov_len);
+    }
+
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 //
 //------------------------------------------------------------------------------
@@ -151,7 +496,8 @@ int
 mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
 {
     unsigned char buff[PACKET_BUFF_SIZE];
-    int len, ret;
+    struct iovec iov;
+    int len;
     char error_str[128];
 
     if (handle == NULL || frame == NULL)
@@ -166,21 +512,20 @@ mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame)
         return -1;
     }
 
-    if ((ret = write(handle->fd, buff, len)) == len)
-    {
-        //
-        // call the send event function, if the callback function is registered
-        //
-        if (handle->send_event)
-            handle->send_event(MBUS_HANDLE_TYPE_TCP, buff, len);
-    }
-    else
+    iov.iov_base = buff;
+    iov.iov_len = len;
+
+    if (mbus_tcp_send_raw(handle, &iov, 1) != 0)
     {
-        snprintf(error_str, sizeof(error_str), "%s: Failed to write frame to socket (ret = %d)\n", __PRETTY_FUNCTION__, ret);
-        mbus_error_str_set(error_str);
         return -1;
     }
 
+    //
+    // call the send event function, if the callback function is registered
+    //
+    if (handle->send_event)
+        handle->send_event(MBUS_HANDLE_TYPE_TCP, (const char *) buff, len);
+
     return 0;
 }
 
@@ -215,6 +560,9 @@ retry:
         }
 
         nread = read(handle->fd, &buff[len], remaining);
+
+        MBUS_TRACE3(tcp_read, handle->fd, nread, len);
+
         switch (nread) {
         case -1:
             if (errno == EINTR)
@@ -226,9 +574,20 @@ retry:
             }
 
             mbus_error_str_set("M-Bus tcp transport layer failed to read data.");
+
+            if (errno == ECONNRESET || errno == ETIMEDOUT || errno == EPIPE || errno == ENOTCONN)
+            {
+                // the connection is dead, reconnect lazily with the next request
+                mbus_tcp_drop(handle);
+            }
+
             return MBUS_RECV_RESULT_ERROR;
         case 0:
             mbus_error_str_set("M-Bus tcp transport layer connection closed by remote host.");
+
+            // reconnect lazily with the next request
+            mbus_tcp_drop(handle);
+
             return MBUS_RECV_RESULT_RESET;
         default:
             if (len > (SSIZE_MAX-nread))
@@ -237,6 +596,9 @@ retry:
                 return MBUS_RECV_RESULT_ERROR;
             }
 
+            if (len == 0)
+                mbus_recv_first_byte(handle, frame);
+
             len += nread;
         }
     } while ((remaining = mbus_parse(frame, buff, len)) > 0);
@@ -247,6 +609,8 @@ retry:
     if (handle->recv_event)
         handle->recv_event(MBUS_HANDLE_TYPE_TCP, buff, len);
 
+    mbus_capture_event(handle, MBUS_CAPTURE_RECV, buff, len);
+
     if (remaining < 0) {
         mbus_error_str_set("M-Bus layer failed to parse data.");
         return MBUS_RECV_RESULT_INVALID;
@@ -274,3 +638,48 @@ mbus_tcp_set_timeout_set(double seconds)
 
     return 0;
 }
+
+//------------------------------------------------------------------------------
+/// Set a TCP specific option of the handle. Socket options take effect with
+/// the next (re)connect.
+//------------------------------------------------------------------------------
+int
+mbus_tcp_set_option(mbus_handle *handle, mbus_context_option option, long value)
+{
+    mbus_tcp_data *tcp_data;
+
+    if (handle == NULL)
+        return -1;
+
+    tcp_data = (mbus_tcp_data *) handle->auxdata;
+    if (tcp_data == NULL)
+        return -1;
+
+    switch (option)
+    {
+        case MBUS_OPTION_TCP_CONNECT_TIMEOUT:
+            if ((value > 0) && (value <= INT_MAX))
+            {
+                tcp_data->connect_timeout_ms = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_TCP_NODELAY:
+            tcp_data->nodelay = (value != 0);
+            return 0;
+        case MBUS_OPTION_TCP_KEEPALIVE:
+            if ((value >= 0) && (value <= INT_MAX))
+            {
+                tcp_data->keepalive_idle = value;
+                return 0;
+            }
+            break;
+        case MBUS_OPTION_TCP_AUTO_RECONNECT:
+            tcp_data->auto_reconnect = (value != 0);
+            return 0;
+        default:
+            break;
+    }
+
+    return -1;
+}
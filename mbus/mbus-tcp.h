@@ -18,6 +18,9 @@
 #ifndef MBUS_TCP_H
 #define MBUS_TCP_H
 
+#include <time.h>
+#include <netdb.h>
+
 #include "mbus-protocol.h"
 #include "mbus-protocol-aux.h"
 
@@ -30,14 +33,32 @@ typedef struct _mbus_tcp_data
 {
     char *host;
     uint16_t port;
+
+    struct addrinfo *addr;      /**< cached result of getaddrinfo (NULL until first connect) */
+
+    int  connect_timeout_ms;    /**< timeout of the non-blocking connect */
+    int  keepalive_idle;        /**< TCP keepalive idle time in seconds (0 = disabled) */
+    char nodelay;               /**< non zero to disable Nagle's algorithm */
+    char auto_reconnect;        /**< non zero to reconnect transparently after a reset */
+
+    int  reconnect_delay_ms;    /**< current reconnect backoff */
+    struct timespec reconnect_after; /**< no reconnect attempt before this (CLOCK_MONOTONIC) */
 } mbus_tcp_data;
 
+#define MBUS_TCP_CONNECT_TIMEOUT_MS     4000
+#define MBUS_TCP_KEEPALIVE_IDLE         60
+#define MBUS_TCP_RECONNECT_DELAY_MIN_MS 100
+#define MBUS_TCP_RECONNECT_DELAY_MAX_MS 30000
+
 int  mbus_tcp_connect(mbus_handle *handle);
+int  mbus_tcp_reconnect(mbus_handle *handle);
 int  mbus_tcp_disconnect(mbus_handle *handle);
 int  mbus_tcp_send_frame(mbus_handle *handle, mbus_frame *frame);
+int  mbus_tcp_send_raw(mbus_handle *handle, const struct iovec *iov, int iovcnt);
 int  mbus_tcp_recv_frame(mbus_handle *handle, mbus_frame *frame);
 void mbus_tcp_data_free(mbus_handle *handle);
 int  mbus_tcp_set_timeout_set(double seconds);
+int  mbus_tcp_set_option(mbus_handle *handle, mbus_context_option option, long value);
 
 #ifdef __cplusplus
 }
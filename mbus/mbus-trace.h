@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+/**
+ * @file   mbus-trace.h
+ *
+ * @brief  Static tracepoints (USDT) of the library, not installed.
+ *
+ * With ./configure --enable-usdt the tracepoints are compiled in as
+ * SystemTap/DTrace compatible probes (provider "libmbus"), which perf,
+ * bpftrace and systemtap can attach to on a running collector:
+ *
+ * \verbatim
+ * bpftrace -e 'usdt:/usr/lib/libmbus.so:libmbus:sendrecv_retry { @[arg0] = count(); }'
+ * \endverbatim
+ *
+ * Without it the macros expand to nothing. Probes and arguments:
+ *
+ * - send_frame(address, control, data_size): also for the short and
+ *   selection frames sent from the frame cache
+ * - send_raw(iovcnt, bytes)
+ * - serial_read(fd, nread, len), tcp_read(fd, nread, len): every completed
+ *   read() of the receive functions, len is the frame length before it
+ * - parse(data_size, result, type): result of mbus_parse
+ * - frame_data_parse_start(frame, control_information),
+ *   frame_data_parse_end(frame, result, type)
+ * - sendrecv_retry(address, retry, result): a request is repeated
+ *   because of result (timeout or invalid reply)
+ * - sendrecv_give_up(address, retry)
+ * - scan_probe(mask, result): every probe of the secondary address scan
+ */
+
+#ifndef MBUS_TRACE_H
+#define MBUS_TRACE_H
+
+#include "../config.h"
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+#include <sys/uio.h>
+
+#define MBUS_TRACE2(name, a, b)       DTRACE_PROBE2(libmbus, name, a, b)
+#define MBUS_TRACE3(name, a, b, c)    DTRACE_PROBE3(libmbus, name, a, b, c)
+
+#define MBUS_TRACE_SEND_RAW(iov, iovcnt)  mbus_trace_send_raw(iov, iovcnt)
+
+// the byte count is only summed up with tracepoints compiled in
+static inline void
+mbus_trace_send_raw(const struct iovec *iov, int iovcnt)
+{
+    size_t bytes = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        bytes += iov[i].iov_len;
+
+    MBUS_TRACE2(send_raw, iovcnt, bytes);
+}
+
+#else
+
+#define MBUS_TRACE2(name, a, b)       do {} while (0)
+#define MBUS_TRACE3(name, a, b, c)    do {} while (0)
+
+#define MBUS_TRACE_SEND_RAW(iov, iovcnt)  do {} while (0)
+
+#endif
+
+#endif /* MBUS_TRACE_H */
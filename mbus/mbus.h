@@ -37,6 +37,14 @@
 #include "mbus-protocol-aux.h"
 #include "mbus-tcp.h"
 #include "mbus-serial.h"
+#include "mbus-loopback.h"
+#include "mbus-json.h"
+#include "mbus-cbor.h"
+#include "mbus-plan.h"
+#include "mbus-delta.h"
+#include "mbus-dedup.h"
+#include "mbus-stats.h"
+#include "mbus-capture.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,678 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+#define MAX_FRAMES 1024
+
+static unsigned char raw[MAX_FRAMES][MBUS_FRAME_PACKED_MAX_SIZE];
+static size_t raw_len[MAX_FRAMES];
+static size_t raw_count;
+
+static mbus_frame parsed[MAX_FRAMES];
+static size_t parsed_count;
+
+static mbus_frame frames[MAX_FRAMES];
+static mbus_frame_data frame_data[MAX_FRAMES];
+static size_t frame_count;
+
+static char json_buff[65536];
+
+static unsigned char cbor_buff[MAX_FRAMES][2048];
+static size_t cbor_len[MAX_FRAMES];
+static mbus_record_value records[256];
+static mbus_cbor_readout readout;
+static mbus_record_index record_index;
+
+static int machine_readable;
+
+//
+// count the allocations of every stage, the library resolves malloc & co.
+// to these wrappers. Only on glibc, which exports the underlying allocator,
+// and not under the sanitizers, which interpose malloc themselves.
+//
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define MBUS_BENCH_SANITIZER
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define MBUS_BENCH_SANITIZER
+#endif
+
+#if defined(__GLIBC__) && !defined(MBUS_BENCH_SANITIZER)
+#define MBUS_BENCH_COUNT_ALLOCATIONS
+#endif
+
+static unsigned long allocations;
+
+#ifdef MBUS_BENCH_COUNT_ALLOCATIONS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// start a stage
+//
+static double
+begin()
+{
+    allocations = 0;
+    return now();
+}
+
+static int
+load_hex_file(const char *file)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096], buff[4096];
+    size_t buff_len;
+    mbus_frame reply;
+
+    if (raw_count >= MAX_FRAMES)
+    {
+        return -1;
+    }
+
+    if ((fp = fopen(file, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    memset(raw_buff, 0, sizeof(raw_buff));
+    fread(raw_buff, 1, sizeof(raw_buff), fp);
+    fclose(fp);
+
+    buff_len = mbus_hex2bin(buff, sizeof(buff), raw_buff, sizeof(raw_buff));
+
+    if (buff_len > 0 && buff_len <= MBUS_FRAME_PACKED_MAX_SIZE)
+    {
+        memcpy(raw[raw_count], buff, buff_len);
+        raw_len[raw_count++] = buff_len;
+    }
+
+    memset(&reply, 0, sizeof(reply));
+
+    if (mbus_parse(&reply, buff, buff_len) != 0)
+    {
+        return -1;
+    }
+
+    memcpy(&parsed[parsed_count++], &reply, sizeof(mbus_frame));
+
+    memcpy(&frames[frame_count], &reply, sizeof(mbus_frame));
+    memset(&frame_data[frame_count], 0, sizeof(mbus_frame_data));
+
+    if (mbus_frame_data_parse(&reply, &frame_data[frame_count]) != 0)
+    {
+        return -1;
+    }
+
+    frame_count++;
+    return 0;
+}
+
+static int
+discard(void *arg, const char *data, size_t len)
+{
+    (void) data;
+
+    *(size_t *) arg += len;
+    return 0;
+}
+
+static int
+is_variable(mbus_frame *frame)
+{
+    return frame->data_size > 0 &&
+           mbus_frame_direction(frame) == MBUS_CONTROL_MASK_DIR_S2M &&
+           (frame->control_information == MBUS_CONTROL_INFO_RESP_VARIABLE ||
+            frame->control_information == MBUS_CONTROL_INFO_RESP_VARIABLE_MSB);
+}
+
+//
+// stop at the first instantaneous energy value, like a consumer interested
+// in a single register only
+//
+static int
+find_energy(mbus_data_variable_header *header, mbus_data_record *record, void *arg)
+{
+    mbus_record_value value;
+
+    (void) header;
+
+    if (mbus_data_record_decode_typed(record, &value) == 0 &&
+        (value.unit == MBUS_UNIT_WH || value.unit == MBUS_UNIT_J) &&
+        value.function == MBUS_RECORD_FUNCTION_INSTANTANEOUS &&
+        value.storage_number == 0)
+    {
+        *(size_t *) arg += 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+report(const char *name, double elapsed, size_t bytes, size_t frames)
+{
+    char allocs[32];
+
+#ifdef MBUS_BENCH_COUNT_ALLOCATIONS
+    snprintf(allocs, sizeof(allocs), "%.2f", (double) allocations / frames);
+#else
+    snprintf(allocs, sizeof(allocs), "n/a");
+#endif
+
+    if (machine_readable)
+    {
+        // stage, frames, ns/frame, allocations/frame, MB/s
+        printf("%s\t%zu\t%.1f\t%s\t%.2f\n", name, frames, elapsed * 1e9 / frames,
+               allocs, bytes / elapsed / 1e6);
+        return;
+    }
+
+    printf("%-16s %10.3f s %10.2f MB/s %12.0f frames/s %10.1f ns/frame %8s allocs/frame\n",
+           name, elapsed, bytes / elapsed / 1e6, frames / elapsed,
+           elapsed * 1e9 / frames, allocs);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, iterations = 1000, flags = 0;
+    mbus_frame_data data;
+    mbus_data_variable_header header;
+    mbus_data_record *data_record;
+    mbus_record *record;
+    mbus_decode_plan_cache *plan_cache;
+    mbus_dedup *dedup;
+    mbus_loopback_bus *bus;
+    mbus_loopback_slave *slave;
+    mbus_handle *handle;
+    mbus_frame reply;
+    mbus_data_fixed_value fixed_value;
+    mbus_data_fixed *fixed;
+    size_t n, bytes, found = 0;
+    double start;
+    char *xml;
+    int len;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+        {
+            flags |= MBUS_JSON_NORMALIZED;
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-m") == 0)
+        {
+            machine_readable = 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i >= argc || iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [-n] [-m] [-i iterations] hex-file ...\n", argv[0]);
+        fprintf(stderr, "    optional flag -n for normalized values\n");
+        fprintf(stderr, "    optional flag -m for tab separated output (stage, frames, ns/frame,\n"
+                        "                     allocations/frame, MB/s)\n");
+        fprintf(stderr, "    allocations are counted on glibc without sanitizers only (n/a otherwise)\n");
+        return 1;
+    }
+
+    for (; i < argc; i++)
+    {
+        if (load_hex_file(argv[i]) != 0)
+        {
+            fprintf(stderr, "%s: skipping '%s'\n", argv[0], argv[i]);
+        }
+    }
+
+    if (frame_count == 0)
+    {
+        fprintf(stderr, "%s: no frames loaded\n", argv[0]);
+        return 1;
+    }
+
+    if (machine_readable == 0)
+    {
+        printf("%zu frames, %d iterations\n", frame_count, iterations);
+    }
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < raw_count; n++)
+        {
+            if (mbus_parse(&reply, raw[n], raw_len[n]) == 0)
+            {
+                bytes += raw_len[n];
+            }
+        }
+    }
+    report("frame parse", now() - start, bytes, raw_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < parsed_count; n++)
+        {
+            memset(&data, 0, sizeof(data));
+            if (mbus_frame_data_parse(&parsed[n], &data) == 0)
+            {
+                bytes += parsed[n].data_size;
+            }
+
+            if (data.type == MBUS_DATA_TYPE_VARIABLE)
+            {
+                mbus_data_record_free(data.data_var.record);
+            }
+        }
+    }
+    report("data parse", now() - start, bytes, parsed_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (!is_variable(&frames[n]))
+            {
+                continue;
+            }
+
+            memset(&data, 0, sizeof(data));
+            if (mbus_data_variable_parse(&frames[n], &data.data_var) == 0)
+            {
+                bytes += frames[n].data_size;
+            }
+            mbus_data_record_free(data.data_var.record);
+        }
+    }
+    report("parse", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (!is_variable(&frames[n]))
+            {
+                continue;
+            }
+
+            if (mbus_data_variable_parse_visit(&frames[n], &header, find_energy, &found) >= 0)
+            {
+                bytes += frames[n].data_size;
+            }
+        }
+    }
+    report("parse visit", now() - start, bytes, frame_count * iterations);
+    if (machine_readable == 0)
+    {
+        printf("%-16s %10zu\n", "energy values", found / iterations);
+    }
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (!is_variable(&frames[n]))
+            {
+                continue;
+            }
+
+            for (data_record = frame_data[n].data_var.record; data_record; data_record = data_record->next)
+            {
+                record = mbus_parse_variable_record(data_record);
+                mbus_record_free(record);
+            }
+            bytes += frames[n].data_size;
+        }
+    }
+    report("normalized", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            for (data_record = frame_data[n].data_var.record; data_record; data_record = data_record->next)
+            {
+                record = mbus_parse_variable_record_interned(data_record);
+                mbus_record_free(record);
+            }
+            bytes += frames[n].data_size;
+        }
+    }
+    report("interned", now() - start, bytes, frame_count * iterations);
+
+    // the first three records only, decoded on demand
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (!is_variable(&frames[n]) || mbus_record_index_build(&record_index, &frames[n]) < 0)
+            {
+                continue;
+            }
+
+            for (len = 0; len < 3 && len < (int) record_index.nrecords; len++)
+            {
+                mbus_record_index_get(&record_index, len);
+            }
+            mbus_record_index_free(&record_index);
+            bytes += frames[n].data_size;
+        }
+    }
+    report("normalized lazy", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            for (data_record = frame_data[n].data_var.record; data_record; data_record = data_record->next)
+            {
+                mbus_data_record_decode_typed(data_record, &records[0]);
+            }
+            bytes += frames[n].data_size;
+        }
+    }
+    report("typed", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (frame_data[n].type != MBUS_DATA_TYPE_FIXED)
+            {
+                continue;
+            }
+
+            fixed = &frame_data[n].data_fix;
+            record = mbus_parse_fixed_record(fixed->status, fixed->cnt1_type, fixed->cnt1_val);
+            mbus_record_free(record);
+            record = mbus_parse_fixed_record(fixed->status, fixed->cnt2_type, fixed->cnt2_val);
+            mbus_record_free(record);
+            bytes += frames[n].data_size;
+        }
+    }
+    report("fixed normalized", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (frame_data[n].type == MBUS_DATA_TYPE_FIXED &&
+                mbus_data_fixed_decode_typed(&frame_data[n].data_fix, &fixed_value) == 0)
+            {
+                bytes += frames[n].data_size;
+            }
+        }
+    }
+    report("fixed typed", now() - start, bytes, frame_count * iterations);
+
+    if ((plan_cache = mbus_decode_plan_cache_new(2 * frame_count)) == NULL)
+    {
+        fprintf(stderr, "%s: failed to allocate plan cache\n", argv[0]);
+        return 1;
+    }
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (is_variable(&frames[n]) &&
+                mbus_decode_plan_cache_decode(plan_cache, &frames[n], &header, records,
+                                              sizeof(records) / sizeof(records[0])) >= 0)
+            {
+                bytes += frames[n].data_size;
+            }
+        }
+    }
+    report("typed plan", now() - start, bytes, frame_count * iterations);
+    if (machine_readable == 0)
+    {
+        printf("%-16s %10lu hits %10lu misses\n", "plan cache", plan_cache->hits, plan_cache->misses);
+    }
+    mbus_decode_plan_cache_free(plan_cache);
+
+    // every telegram arrives twice, e.g. from two collectors
+    if ((dedup = mbus_dedup_new(2 * frame_count, 0)) == NULL)
+    {
+        fprintf(stderr, "%s: failed to allocate duplicate filter\n", argv[0]);
+        return 1;
+    }
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < 2 * frame_count; n++)
+        {
+            if (mbus_dedup_check(dedup, &frames[n / 2]) == 0)
+            {
+                bytes += frames[n / 2].data_size;
+            }
+        }
+    }
+    report("dedup", now() - start, bytes, 2 * frame_count * iterations);
+    if (machine_readable == 0)
+    {
+        printf("%-16s %10lu frames %10lu duplicates\n", "dedup", dedup->frames, dedup->duplicates);
+    }
+    mbus_dedup_free(dedup);
+
+    // the full request/response path against one simulated slave per frame
+    if ((bus = mbus_loopback_bus_new()) == NULL ||
+        (handle = mbus_context_loopback(mbus_loopback_bus_respond, bus)) == NULL ||
+        mbus_connect(handle) != 0)
+    {
+        fprintf(stderr, "%s: failed to set up loopback bus\n", argv[0]);
+        return 1;
+    }
+
+    for (n = 0; n < frame_count && n < 250; n++)
+    {
+        if ((slave = mbus_loopback_bus_add_slave(bus, n)) == NULL ||
+            mbus_loopback_slave_add_telegram(slave, &frames[n]) != 0)
+        {
+            fprintf(stderr, "%s: failed to add slave\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < bus->nslaves; n++)
+        {
+            if (mbus_sendrecv_request(handle, n, &reply, 1) == 0)
+            {
+                bytes += reply.data_size;
+            }
+        }
+    }
+    report("loopback", now() - start, bytes, bus->nslaves * iterations);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    mbus_loopback_bus_free(bus);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((xml = mbus_frame_data_xml(&frame_data[n])) != NULL)
+            {
+                bytes += strlen(xml);
+                free(xml);
+            }
+        }
+    }
+    report("xml", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((xml = mbus_frame_data_xml_normalized(&frame_data[n])) != NULL)
+            {
+                bytes += strlen(xml);
+                free(xml);
+            }
+        }
+    }
+    report("xml normalized", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((len = mbus_frame_data_json(&frame_data[n], flags, json_buff, sizeof(json_buff))) > 0)
+            {
+                bytes += len;
+            }
+        }
+    }
+    report("json", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((len = mbus_frame_data_json(&frame_data[n], flags | MBUS_JSON_LINES,
+                                            json_buff, sizeof(json_buff))) > 0)
+            {
+                bytes += len;
+            }
+        }
+    }
+    report("json lines", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            mbus_frame_data_json_cb(&frame_data[n], flags, discard, &bytes);
+        }
+    }
+    report("json callback", now() - start, bytes, frame_count * iterations);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((len = mbus_frame_data_cbor(&frame_data[n], cbor_buff[n], sizeof(cbor_buff[n]))) > 0)
+            {
+                bytes += len;
+                cbor_len[n] = len;
+            }
+        }
+    }
+    report("cbor", now() - start, bytes, frame_count * iterations);
+
+    readout.records = records;
+    readout.max_records = sizeof(records) / sizeof(records[0]);
+
+    bytes = 0;
+    start = begin();
+    for (i = 0; i < iterations; i++)
+    {
+        for (n = 0; n < frame_count; n++)
+        {
+            if (mbus_cbor_decode(cbor_buff[n], cbor_len[n], &readout) > 0)
+            {
+                bytes += cbor_len[n];
+            }
+        }
+    }
+    report("cbor decode", now() - start, bytes, frame_count * iterations);
+
+    for (n = 0; n < frame_count; n++)
+    {
+        mbus_data_record_free(frame_data[n].data_var.record);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1085 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+//
+// Checks of library functions the frame corpus (mbus_conformance) does not
+// reach: transports, send queues and the other parts that need a sequence
+// of requests or hand made input. Every failed check is printed, the exit
+// code is 1 if any check failed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+static int checks, failures;
+
+#define CHECK(cond) check((cond) != 0, #cond, __func__, __LINE__)
+
+static void
+check(int ok, const char *cond, const char *func, int line)
+{
+    checks++;
+
+    if (!ok)
+    {
+        failures++;
+        printf("== %s:%d: check failed: %s\n", func, line, cond);
+    }
+}
+
+//------------------------------------------------------------------------------
+// transport without vectored send: mbus_send_raw hands every byte sequence
+// to the frame based send
+//------------------------------------------------------------------------------
+static int frames_sent;
+static unsigned char frames_control[4];
+
+static int
+frame_only_open(mbus_handle *handle)
+{
+    (void) handle;
+    return 0;
+}
+
+static int
+frame_only_send(mbus_handle *handle, mbus_frame *frame)
+{
+    (void) handle;
+
+    if (frames_sent < (int) sizeof(frames_control))
+        frames_control[frames_sent] = frame->control;
+
+    frames_sent++;
+    return 0;
+}
+
+static int
+frame_only_recv(mbus_handle *handle, mbus_frame *frame)
+{
+    (void) handle;
+    (void) frame;
+    return MBUS_RECV_RESULT_TIMEOUT;
+}
+
+static const mbus_transport frame_only_transport = {
+    "frame-only", MBUS_HANDLE_TYPE_TCP,
+    frame_only_open, frame_only_open, frame_only_send, NULL, frame_only_recv, NULL, NULL
+};
+
+static void
+check_send_raw_fallback(void)
+{
+    mbus_handle *handle;
+    mbus_send_queue queue;
+    mbus_frame *frame;
+    unsigned char garbage[3] = { 0x10, 0x5B, 0x01 };
+
+    handle = mbus_context_transport(&frame_only_transport, NULL);
+    CHECK(handle != NULL);
+
+    if (handle == NULL || mbus_connect(handle) != 0)
+        return;
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+    frame->control = MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S;
+    frame->address = 5;
+
+    mbus_send_queue_init(&queue);
+    CHECK(mbus_send_queue_add(&queue, frame) == 0);
+
+    frame->control = MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S;
+    CHECK(mbus_send_queue_add(&queue, frame) == 0);
+
+    CHECK(mbus_send_queue_flush(handle, &queue) == 0);
+    CHECK(frames_sent == 2);
+    CHECK(frames_control[0] == (MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S));
+    CHECK(frames_control[1] == (MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S));
+
+    // the cached request frames go through the same path
+    CHECK(mbus_send_request_frame(handle, 5) == 0);
+    CHECK(frames_sent == 3);
+
+    // a truncated frame can't be sent frame by frame
+    mbus_send_queue_add_raw(&queue, garbage, sizeof(garbage));
+    CHECK(mbus_send_queue_flush(handle, &queue) == -1);
+    CHECK(frames_sent == 3);
+
+    // the transport doesn't report the first byte of a reply
+    memset(frame, 0, sizeof(mbus_frame));
+    CHECK(mbus_recv_frame(handle, frame) == MBUS_RECV_RESULT_TIMEOUT);
+    CHECK(frame->first_byte.monotonic_ns == 0 && frame->first_byte.realtime_ns == 0);
+    CHECK(frame->last_byte.monotonic_ns != 0);
+
+    mbus_frame_free(frame);
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+}
+
+//------------------------------------------------------------------------------
+// send queue: the queued frames reach the bus back to back in one send
+//------------------------------------------------------------------------------
+static unsigned char bus_bytes[1024];
+static size_t bus_len;
+static int bus_requests;
+
+static int
+record_requests(void *arg, const unsigned char *request, size_t request_len,
+                unsigned char *reply, size_t reply_size)
+{
+    (void) arg;
+    (void) reply;
+    (void) reply_size;
+
+    if (request_len <= sizeof(bus_bytes) - bus_len)
+    {
+        memcpy(&bus_bytes[bus_len], request, request_len);
+        bus_len += request_len;
+    }
+
+    bus_requests++;
+    return 0;
+}
+
+static void
+check_send_queue(void)
+{
+    mbus_handle *handle;
+    mbus_send_queue queue;
+    mbus_frame *frame;
+    unsigned char raw[5] = { 0x10, 0x7B, 0x01, 0x7C, 0x16 };
+    const unsigned char expected[] = {
+        0x10, 0x40, 0x05, 0x45, 0x16,   // SND_NKE
+        0x10, 0x5B, 0x05, 0x60, 0x16,   // REQ_UD2
+        0x10, 0x7B, 0x01, 0x7C, 0x16    // REQ_UD2 with FCB, added raw
+    };
+    int i;
+
+    handle = mbus_context_loopback(record_requests, NULL);
+    CHECK(handle != NULL);
+
+    if (handle == NULL || mbus_connect(handle) != 0)
+        return;
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+    frame->address = 5;
+
+    mbus_send_queue_init(&queue);
+
+    frame->control = MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S;
+    CHECK(mbus_send_queue_add(&queue, frame) == 0);
+
+    frame->control = MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S;
+    CHECK(mbus_send_queue_add(&queue, frame) == 0);
+
+    CHECK(mbus_send_queue_add_raw(&queue, raw, sizeof(raw)) == 0);
+    CHECK(queue.count == 3);
+
+    bus_len = 0;
+    bus_requests = 0;
+
+    CHECK(mbus_send_queue_flush(handle, &queue) == 0);
+    CHECK(queue.count == 0 && queue.used == 0);
+    CHECK(bus_requests == 3);
+    CHECK(bus_len == sizeof(expected) && memcmp(bus_bytes, expected, sizeof(expected)) == 0);
+
+    // an empty queue sends nothing
+    CHECK(mbus_send_queue_flush(handle, &queue) == 0);
+    CHECK(bus_requests == 3);
+
+    // a full queue rejects further frames and keeps the queued ones
+    for (i = 0; i < MBUS_SEND_QUEUE_LENGTH; i++)
+    {
+        CHECK(mbus_send_queue_add(&queue, frame) == 0);
+    }
+
+    CHECK(mbus_send_queue_add(&queue, frame) == -1);
+    CHECK(mbus_send_queue_add_raw(&queue, raw, sizeof(raw)) == -1);
+    CHECK(mbus_send_queue_flush(handle, &queue) == 0);
+    CHECK(bus_requests == 3 + MBUS_SEND_QUEUE_LENGTH);
+    CHECK(bus_len == sizeof(expected) + MBUS_SEND_QUEUE_LENGTH * 5);
+
+    mbus_frame_free(frame);
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+}
+
+//------------------------------------------------------------------------------
+// loopback slave: only a toggled FCB moves on to the next telegram, a
+// repeated request gets the same telegram again, also the last one
+//------------------------------------------------------------------------------
+static int
+request_telegram(mbus_handle *handle, int fcb)
+{
+    mbus_frame *request, reply;
+    int result = -1;
+
+    request = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+    request->control = MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S;
+    request->address = 5;
+
+    if (fcb)
+        request->control |= MBUS_CONTROL_MASK_FCB;
+
+    memset(&reply, 0, sizeof(reply));
+
+    if (mbus_send_frame(handle, request) == 0 &&
+        mbus_recv_frame(handle, &reply) == MBUS_RECV_RESULT_OK &&
+        reply.data_size == 1)
+    {
+        result = reply.data[0];
+    }
+
+    mbus_frame_free(request);
+    return result;
+}
+
+static void
+check_loopback_fcb(void)
+{
+    mbus_loopback_bus *bus;
+    mbus_loopback_slave *slave;
+    mbus_handle *handle;
+    mbus_frame *telegram;
+    int i;
+
+    bus = mbus_loopback_bus_new();
+    CHECK(bus != NULL);
+
+    if (bus == NULL)
+        return;
+
+    slave = mbus_loopback_bus_add_slave(bus, 5);
+    CHECK(slave != NULL);
+
+    telegram = mbus_frame_new(MBUS_FRAME_TYPE_LONG);
+    telegram->control = MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_DIR_S2M;
+    telegram->control_information = MBUS_CONTROL_INFO_RESP_FIXED;
+    telegram->data_size = 1;
+
+    for (i = 0; i < 3; i++)
+    {
+        telegram->data[0] = i;
+        CHECK(mbus_loopback_slave_add_telegram(slave, telegram) == 0);
+    }
+
+    mbus_frame_free(telegram);
+
+    handle = mbus_context_loopback(mbus_loopback_bus_respond, bus);
+    CHECK(handle != NULL);
+
+    if (handle != NULL && mbus_connect(handle) == 0)
+    {
+        CHECK(request_telegram(handle, 1) == 0);
+        CHECK(request_telegram(handle, 1) == 0);
+        CHECK(request_telegram(handle, 0) == 1);
+        CHECK(request_telegram(handle, 1) == 2);
+        CHECK(request_telegram(handle, 1) == 2);    // repeated last telegram
+        CHECK(request_telegram(handle, 0) == 0);    // starts over
+        CHECK(request_telegram(handle, 0) == 0);
+
+        mbus_disconnect(handle);
+    }
+
+    mbus_context_free(handle);
+    mbus_loopback_bus_free(bus);
+}
+
+//------------------------------------------------------------------------------
+// delta filter: records are told apart by their identity (DIB and VIB) and
+// their position among records of the same identity
+//------------------------------------------------------------------------------
+static mbus_frame_data *
+parse_readout(const unsigned char *records, size_t records_len)
+{
+    const unsigned char header[] = {
+        0x78, 0x56, 0x34, 0x12, 0x24, 0x40, 0x01, 0x07, 0x01, 0x00, 0x00, 0x00
+    };
+    mbus_frame *frame;
+    mbus_frame_data *data;
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_LONG);
+    frame->control = MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_DIR_S2M;
+    frame->address = 5;
+    frame->control_information = MBUS_CONTROL_INFO_RESP_VARIABLE;
+
+    memcpy(frame->data, header, sizeof(header));
+    memcpy(&frame->data[sizeof(header)], records, records_len);
+    frame->data_size = sizeof(header) + records_len;
+
+    data = mbus_frame_data_new();
+
+    if (mbus_frame_data_parse(frame, data) != 0)
+    {
+        mbus_frame_data_free(data);
+        data = NULL;
+    }
+
+    mbus_frame_free(frame);
+    return data;
+}
+
+static int
+delta_filter(mbus_delta_store *store, const unsigned char *records, size_t records_len,
+             unsigned char *kept, size_t *nkept)
+{
+    mbus_frame_data *data;
+    mbus_data_record *record;
+    int result;
+
+    if ((data = parse_readout(records, records_len)) == NULL)
+        return -1;
+
+    result = mbus_delta_filter(store, data);
+
+    // first data byte of the records left
+    *nkept = 0;
+    for (record = data->data_var.record; record; record = record->next)
+    {
+        kept[(*nkept)++] = record->data[0];
+    }
+
+    if (*nkept != data->data_var.nrecords)
+        result = -1;
+
+    mbus_frame_data_free(data);
+    return result;
+}
+
+static void
+check_delta_filter(void)
+{
+    mbus_delta_store *store;
+    unsigned char kept[8];
+    size_t nkept;
+
+    // volume twice, the second one changes
+    const unsigned char volume1[] = {
+        0x04, 0x13, 0x01, 0x00, 0x00, 0x00,
+        0x04, 0x13, 0x02, 0x00, 0x00, 0x00
+    };
+    const unsigned char volume2[] = {
+        0x04, 0x13, 0x01, 0x00, 0x00, 0x00,
+        0x04, 0x13, 0x03, 0x00, 0x00, 0x00
+    };
+
+    // plain text units "GAVUX" and "QQITB", their identities have the same
+    // hash; the second readout lacks the first record
+    const unsigned char text1[] = {
+        0x01, 0x7C, 0x05, 'X', 'U', 'V', 'A', 'G', 0x11,
+        0x01, 0x7C, 0x05, 'B', 'T', 'I', 'Q', 'Q', 0x12,
+        0x01, 0x13, 0x21
+    };
+    const unsigned char text2[] = {
+        0x01, 0x7C, 0x05, 'B', 'T', 'I', 'Q', 'Q', 0x12,
+        0x01, 0x13, 0x22
+    };
+
+    store = mbus_delta_store_new(16, 0);
+    CHECK(store != NULL);
+
+    if (store == NULL)
+        return;
+
+    CHECK(delta_filter(store, volume1, sizeof(volume1), kept, &nkept) == MBUS_DELTA_SNAPSHOT);
+    CHECK(nkept == 2 && kept[0] == 0x01 && kept[1] == 0x02);
+
+    CHECK(delta_filter(store, volume2, sizeof(volume2), kept, &nkept) == MBUS_DELTA_CHANGED);
+    CHECK(nkept == 1 && kept[0] == 0x03);
+
+    CHECK(delta_filter(store, volume2, sizeof(volume2), kept, &nkept) == MBUS_DELTA_UNCHANGED);
+    CHECK(nkept == 0);
+
+    mbus_delta_store_clear(store);
+
+    CHECK(delta_filter(store, text1, sizeof(text1), kept, &nkept) == MBUS_DELTA_SNAPSHOT);
+    CHECK(nkept == 3);
+
+    CHECK(delta_filter(store, text2, sizeof(text2), kept, &nkept) == MBUS_DELTA_CHANGED);
+    CHECK(nkept == 1 && kept[0] == 0x22);
+
+    CHECK(store->records_in == 2 + 2 + 2 + 3 + 2);
+    CHECK(store->records_out == 2 + 1 + 0 + 3 + 1);
+
+    mbus_delta_store_free(store);
+}
+
+//------------------------------------------------------------------------------
+// statistics: counters and latency histograms of a loopback bus, the reply
+// is read 5 ms after the request
+//------------------------------------------------------------------------------
+static int
+stats_request(mbus_handle *handle, int address)
+{
+    struct timespec ts = { 0, 5000000 };
+    mbus_frame *request, reply;
+    int result;
+
+    request = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+    request->control = MBUS_CONTROL_MASK_REQ_UD2 | MBUS_CONTROL_MASK_DIR_M2S;
+    request->address = address;
+
+    if (mbus_send_frame(handle, request) != 0)
+    {
+        mbus_frame_free(request);
+        return -1;
+    }
+
+    nanosleep(&ts, NULL);
+
+    memset(&reply, 0, sizeof(reply));
+    result = mbus_recv_frame(handle, &reply);
+
+    mbus_frame_free(request);
+    return result;
+}
+
+static uint32_t
+bucket_sum(const mbus_stats_histogram *histogram, int first, int last)
+{
+    uint32_t sum = 0;
+    int n;
+
+    for (n = first; n <= last; n++)
+    {
+        sum += histogram->bucket[n];
+    }
+
+    return sum;
+}
+
+static void
+check_stats(void)
+{
+    mbus_loopback_bus *bus;
+    mbus_loopback_slave *slave;
+    mbus_handle *handle;
+    mbus_frame *telegram;
+    mbus_stats stats;
+    mbus_stats_histogram histogram;
+
+    bus = mbus_loopback_bus_new();
+    slave = mbus_loopback_bus_add_slave(bus, 5);
+
+    telegram = mbus_frame_new(MBUS_FRAME_TYPE_LONG);
+    telegram->control = MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_DIR_S2M;
+    telegram->control_information = MBUS_CONTROL_INFO_RESP_FIXED;
+    telegram->data_size = 1;
+    CHECK(mbus_loopback_slave_add_telegram(slave, telegram) == 0);
+    mbus_frame_free(telegram);
+
+    handle = mbus_context_loopback(mbus_loopback_bus_respond, bus);
+    CHECK(handle != NULL);
+
+    if (handle == NULL || mbus_connect(handle) != 0)
+    {
+        mbus_context_free(handle);
+        mbus_loopback_bus_free(bus);
+        return;
+    }
+
+    CHECK(mbus_stats_snapshot(handle, &stats) == -1);
+    CHECK(mbus_context_set_option(handle, MBUS_OPTION_STATS, 1) == 0);
+
+    CHECK(stats_request(handle, 5) == MBUS_RECV_RESULT_OK);
+    CHECK(stats_request(handle, 5) == MBUS_RECV_RESULT_OK);
+    CHECK(stats_request(handle, 7) == MBUS_RECV_RESULT_TIMEOUT);
+
+    CHECK(mbus_stats_snapshot(handle, &stats) == 0);
+    CHECK(stats.frames_sent == 3);
+    CHECK(stats.bytes_sent == 3 * MBUS_FRAME_BASE_SIZE_SHORT);
+    CHECK(stats.frames_received == 2);
+    CHECK(stats.bytes_received == 2 * (MBUS_FRAME_BASE_SIZE_LONG + 1));
+    CHECK(stats.timeouts == 1);
+    CHECK(stats.invalid_frames == 0 && stats.collisions == 0);
+
+    CHECK(stats.address[5].requests == 2 && stats.address[5].replies == 2);
+    CHECK(stats.address[7].requests == 1 && stats.address[7].timeouts == 1);
+
+    // both replies took 5 ms or more, i.e. fall into bucket 12 (4096 us) or up
+    CHECK(stats.complete.count == 2 && stats.first_byte.count == 2);
+    CHECK(stats.address[5].complete.count == 2);
+    CHECK(bucket_sum(&stats.complete, 0, MBUS_STATS_BUCKETS - 1) == 2);
+    CHECK(bucket_sum(&stats.complete, 0, 11) == 0);
+    CHECK(bucket_sum(&stats.first_byte, 0, 11) == 0);
+    CHECK(stats.complete.min_us >= 5000 && stats.complete.min_us <= stats.complete.max_us);
+    CHECK(stats.complete.sum_us >= stats.complete.min_us + stats.complete.max_us);
+    CHECK(stats.address[7].complete.count == 0);
+
+    CHECK(mbus_stats_reset(handle) == 0);
+    CHECK(mbus_stats_snapshot(handle, &stats) == 0);
+    CHECK(stats.frames_sent == 0 && stats.address[5].requests == 0 && stats.complete.count == 0);
+
+    CHECK(mbus_context_set_option(handle, MBUS_OPTION_STATS, 0) == 0);
+    CHECK(mbus_stats_snapshot(handle, &stats) == -1);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    mbus_loopback_bus_free(bus);
+
+    // percentiles are the upper bound of the bucket, limited by the maximum
+    memset(&histogram, 0, sizeof(histogram));
+    histogram.count = 10;
+    histogram.bucket[3] = 9;        // 8 - 15 us
+    histogram.bucket[10] = 1;       // 1024 - 2047 us
+    histogram.min_us = 8;
+    histogram.max_us = 1500;
+
+    CHECK(mbus_stats_percentile(&histogram, 50.0) == 15);
+    CHECK(mbus_stats_percentile(&histogram, 90.0) == 15);
+    CHECK(mbus_stats_percentile(&histogram, 99.0) == 1500);
+}
+
+//------------------------------------------------------------------------------
+// date/time to epoch: type G (CP16), F (CP32) and I (CP48) data against
+// epochs computed with timegm
+//------------------------------------------------------------------------------
+static void
+cp16(unsigned char *t, int year, int month, int day)
+{
+    // year since 2000
+    t[0] = day | ((year & 0x07) << 5);
+    t[1] = month | ((year & 0x78) << 1);
+}
+
+static void
+cp32(unsigned char *t, int hundred_year, int year, int month, int day, int hour, int minute)
+{
+    // two digit year and the hundred year field (0 = 1900, or 2000 up to 80)
+    t[0] = minute;
+    t[1] = hour | (hundred_year << 5);
+    t[2] = day | ((year & 0x07) << 5);
+    t[3] = month | ((year & 0x78) << 1);
+}
+
+static void
+cp48(unsigned char *t, int year, int month, int day, int hour, int minute, int second)
+{
+    // year since 2000
+    t[0] = second;
+    t[1] = minute;
+    t[2] = hour;
+    t[3] = day | ((year & 0x07) << 5);
+    t[4] = month | ((year & 0x78) << 1);
+    t[5] = 0;
+}
+
+static int64_t
+time_epoch(const unsigned char *t, size_t len)
+{
+    int64_t epoch = -1;
+
+    if (mbus_data_time_epoch(t, len, &epoch) != 0)
+        return (epoch == 0) ? -1 : -2;
+
+    return epoch;
+}
+
+static void
+check_time_epoch(void)
+{
+    unsigned char t[8][6], *t_data[8];
+    size_t t_size[8];
+    int64_t epoch[8];
+    unsigned char valid[8];
+    unsigned char records[] = {
+        0x02, 0x6C, 0, 0,                           // date
+        0x04, 0x13, 0x01, 0x00, 0x00, 0x00,         // volume
+        0x04, 0x6D, 0, 0, 0, 0,                     // invalid date/time
+        0x04, 0x6D, 0, 0, 0, 0,                     // date/time
+        0x06, 0x6D, 0, 0, 0, 0, 0, 0,               // date/time
+        0x04, 0x6D, 0, 0, 0, 0                      // month 13
+    };
+    mbus_frame_data *data;
+    int i;
+
+    // CP16, 2100 is no leap year, its Feb 29 is normalized to Mar 1
+    cp16(t[0], 0, 1, 1);
+    CHECK(time_epoch(t[0], 2) == 946684800);
+    cp16(t[0], 24, 2, 29);
+    CHECK(time_epoch(t[0], 2) == 1709164800);
+    cp16(t[0], 100, 3, 1);
+    CHECK(time_epoch(t[0], 2) == 4107542400LL);
+    cp16(t[0], 100, 2, 29);
+    CHECK(time_epoch(t[0], 2) == 4107542400LL);
+    cp16(t[0], 24, 13, 1);
+    CHECK(time_epoch(t[0], 2) == -1);
+    cp16(t[0], 24, 0, 1);
+    CHECK(time_epoch(t[0], 2) == -1);
+
+    // CP32, a hundred year field of 0 means 2000 up to year 80, 1900 after
+    cp32(t[0], 0, 24, 2, 29, 23, 59);
+    CHECK(time_epoch(t[0], 4) == 1709251140);
+    cp32(t[0], 0, 0, 1, 1, 0, 0);
+    CHECK(time_epoch(t[0], 4) == 946684800);
+    cp32(t[0], 1, 0, 1, 1, 0, 0);
+    CHECK(time_epoch(t[0], 4) == 946684800);
+    cp32(t[0], 0, 80, 6, 15, 8, 0);
+    CHECK(time_epoch(t[0], 4) == 3485664000LL);
+    cp32(t[0], 0, 81, 6, 15, 8, 0);
+    CHECK(time_epoch(t[0], 4) == 361440000);
+    cp32(t[0], 1, 5, 1, 2, 3, 4);
+    CHECK(time_epoch(t[0], 4) == 1104635040);
+    cp32(t[0], 2, 0, 2, 28, 6, 7);
+    CHECK(time_epoch(t[0], 4) == 4107478020LL);
+    cp32(t[0], 2, 0, 3, 1, 0, 0);
+    CHECK(time_epoch(t[0], 4) == 4107542400LL);
+    cp32(t[0], 1, 24, 13, 1, 0, 0);
+    CHECK(time_epoch(t[0], 4) == -1);
+    cp32(t[0], 1, 24, 2, 29, 23, 59);
+    t[0][0] |= 0x80;                        // time invalid
+    CHECK(time_epoch(t[0], 4) == -1);
+    t[0][0] &= 0x7F;
+    t[0][1] |= 0x80;                        // summer time is ignored
+    CHECK(time_epoch(t[0], 4) == 1709251140);
+
+    // CP48
+    cp48(t[0], 0, 2, 29, 12, 30, 45);
+    CHECK(time_epoch(t[0], 6) == 951827445);
+    cp48(t[0], 23, 12, 31, 23, 59, 59);
+    CHECK(time_epoch(t[0], 6) == 1704067199);
+    cp48(t[0], 100, 3, 1, 0, 0, 0);
+    CHECK(time_epoch(t[0], 6) == 4107542400LL);
+    cp48(t[0], 23, 13, 31, 23, 59, 59);
+    CHECK(time_epoch(t[0], 6) == -1);
+    cp48(t[0], 23, 12, 31, 23, 59, 59);
+    t[0][1] |= 0x80;                        // time invalid
+    CHECK(time_epoch(t[0], 6) == -1);
+
+    // unsupported size
+    CHECK(time_epoch(t[0], 3) == -1);
+
+    // batch, the invalid times are flagged and set to 0
+    cp16(t[0], 24, 2, 29);
+    cp32(t[1], 1, 24, 13, 1, 0, 0);
+    cp32(t[2], 0, 81, 6, 15, 8, 0);
+    cp48(t[3], 23, 12, 31, 23, 59, 59);
+    cp48(t[4], 23, 12, 31, 23, 59, 59);
+    t[4][1] |= 0x80;
+    cp32(t[5], 0, 24, 2, 29, 23, 59);
+    t[5][0] |= 0x80;
+
+    for (i = 0; i < 6; i++)
+    {
+        t_data[i] = t[i];
+        t_size[i] = (i == 0) ? 2 : (i == 3 || i == 4) ? 6 : 4;
+        epoch[i] = -1;
+    }
+
+    CHECK(mbus_data_time_epoch_batch(t_data, t_size, 6, epoch, valid) == 3);
+    CHECK(valid[0] == 1 && epoch[0] == 1709164800);
+    CHECK(valid[1] == 0 && epoch[1] == 0);
+    CHECK(valid[2] == 1 && epoch[2] == 361440000);
+    CHECK(valid[3] == 1 && epoch[3] == 1704067199);
+    CHECK(valid[4] == 0 && epoch[4] == 0);
+    CHECK(valid[5] == 0 && epoch[5] == 0);
+    CHECK(mbus_data_time_epoch_batch(t_data, t_size, 6, epoch, NULL) == 3);
+
+    // records, only valid date/time records are converted, the others keep
+    // their value
+    cp16(&records[2], 24, 2, 29);
+    cp32(&records[12], 1, 5, 1, 2, 3, 4);
+    records[12] |= 0x80;
+    cp32(&records[18], 1, 5, 1, 2, 3, 4);
+    cp48(&records[24], 23, 12, 31, 23, 59, 59);
+    cp32(&records[32], 1, 5, 13, 2, 3, 4);
+
+    data = parse_readout(records, sizeof(records));
+    CHECK(data != NULL);
+
+    if (data)
+    {
+        for (i = 0; i < 8; i++)
+            epoch[i] = -1;
+
+        CHECK(mbus_data_record_time_epoch_batch(data->data_var.record, epoch, 8) == 3);
+        CHECK(epoch[0] == 1709164800);
+        CHECK(epoch[1] == -1 && epoch[2] == -1);
+        CHECK(epoch[3] == 1104635040);
+        CHECK(epoch[4] == 1704067199);
+        CHECK(epoch[5] == -1 && epoch[6] == -1);
+
+        // the list is cut after max_values records
+        epoch[3] = -1;
+        CHECK(mbus_data_record_time_epoch_batch(data->data_var.record, epoch, 3) == 1);
+        CHECK(epoch[3] == -1);
+
+        mbus_frame_data_free(data);
+    }
+}
+
+//------------------------------------------------------------------------------
+// BCD: the word decoder and the batch decoders against a digit by digit
+// decoder, for all widths and with nibbles Ah-Fh and the sign nibble
+//------------------------------------------------------------------------------
+static long long
+bcd_reference(const unsigned char *bcd_data, size_t bcd_data_size)
+{
+    long long val = 0;
+    size_t i;
+
+    // a high nibble above 9 counts as zero, the low nibble is taken as is
+    for (i = bcd_data_size; i > 0; i--)
+    {
+        val = val * 10 + ((bcd_data[i-1] >> 4) < 0xA ? (bcd_data[i-1] >> 4) : 0);
+        val = val * 10 + (bcd_data[i-1] & 0xF);
+    }
+
+    if ((bcd_data[bcd_data_size-1] >> 4) == 0xF)
+        val = -val;
+
+    return val;
+}
+
+static int
+bcd_reference_valid(const unsigned char *bcd_data, size_t bcd_data_size)
+{
+    size_t i;
+
+    for (i = 0; i < bcd_data_size; i++)
+    {
+        if ((bcd_data[i] & 0xF) > 9)
+            return 0;
+
+        if ((bcd_data[i] >> 4) > 9 && !(i == bcd_data_size - 1 && (bcd_data[i] >> 4) == 0xF))
+            return 0;
+    }
+
+    return 1;
+}
+
+#define BCD_PATTERNS  512
+#define BCD_WIDTH_MAX 10
+
+static void
+check_bcd_decode(void)
+{
+    static unsigned char bcd[BCD_PATTERNS][BCD_WIDTH_MAX];
+    unsigned char *bcd_data[BCD_PATTERNS];
+    size_t bcd_size[BCD_PATTERNS];
+    long long values[BCD_PATTERNS];
+    unsigned char valid[BCD_PATTERNS];
+    unsigned char byte[2];
+    unsigned int seed = 1, mismatch, nvalid;
+    size_t width, i, j, n;
+    mbus_frame_data *data;
+    mbus_data_record *record;
+    unsigned char records[] = {
+        0x09, 0x13, 0x99,                                       // 2 digits
+        0x0A, 0x13, 0x34, 0xF2,                                 // -234
+        0x04, 0x13, 0x01, 0x00, 0x00, 0x00,                     // integer
+        0x0B, 0x13, 0x56, 0x34, 0x12,                           // 6 digits
+        0x0C, 0x13, 0x7A, 0xB5, 0x00, 0xF1,                     // Ah, Bh, sign
+        0x0E, 0x13, 0x12, 0x90, 0x78, 0x56, 0x34, 0x12          // 12 digits
+    };
+
+    // every 1 and 2 byte value
+    mismatch = 0;
+    for (i = 0; i < 0x10000; i++)
+    {
+        byte[0] = i & 0xFF;
+        byte[1] = i >> 8;
+
+        if (i < 0x100)
+        {
+            mismatch += mbus_data_bcd_decode(byte, 1) != bcd_reference(byte, 1);
+            mismatch += (mbus_data_bcd_validate(byte, 1) == 0) != bcd_reference_valid(byte, 1);
+        }
+
+        mismatch += mbus_data_bcd_decode(byte, 2) != bcd_reference(byte, 2);
+        mismatch += (mbus_data_bcd_validate(byte, 2) == 0) != bcd_reference_valid(byte, 2);
+    }
+    CHECK(mismatch == 0);
+
+    // pseudo random patterns, a quarter of them plain BCD, half negative
+    for (width = 1; width <= BCD_WIDTH_MAX; width++)
+    {
+        mismatch = 0;
+        nvalid = 0;
+
+        for (i = 0; i < BCD_PATTERNS; i++)
+        {
+            for (j = 0; j < width; j++)
+            {
+                seed = seed * 1103515245 + 12345;
+                bcd[i][j] = (seed >> 16) & 0xFF;
+
+                if (i % 4 == 0)
+                    bcd[i][j] = ((bcd[i][j] >> 4) % 10) << 4 | (bcd[i][j] & 0xF) % 10;
+            }
+
+            if (i % 2)
+                bcd[i][width-1] |= 0xF0;
+
+            bcd_data[i] = bcd[i];
+            bcd_size[i] = width;
+            nvalid += bcd_reference_valid(bcd[i], width);
+
+            mismatch += mbus_data_bcd_decode(bcd[i], width) != bcd_reference(bcd[i], width);
+        }
+
+        CHECK(mismatch == 0);
+        CHECK(nvalid > 0);
+
+        memset(values, 0, sizeof(values));
+        CHECK(mbus_data_bcd_decode_batch(bcd_data, bcd_size, BCD_PATTERNS, values, valid) == nvalid);
+
+        mismatch = 0;
+        for (i = 0; i < BCD_PATTERNS; i++)
+        {
+            mismatch += values[i] != mbus_data_bcd_decode(bcd[i], width);
+            mismatch += valid[i] != bcd_reference_valid(bcd[i], width);
+        }
+        CHECK(mismatch == 0);
+
+        CHECK(mbus_data_bcd_decode_batch(bcd_data, bcd_size, BCD_PATTERNS, values, NULL) == nvalid);
+    }
+
+    // mixed widths in one batch
+    nvalid = 0;
+    for (i = 0; i < BCD_PATTERNS; i++)
+    {
+        bcd_size[i] = 1 + i % BCD_WIDTH_MAX;
+        nvalid += bcd_reference_valid(bcd[i], bcd_size[i]);
+    }
+
+    CHECK(mbus_data_bcd_decode_batch(bcd_data, bcd_size, BCD_PATTERNS, values, valid) == nvalid);
+
+    mismatch = 0;
+    for (i = 0; i < BCD_PATTERNS; i++)
+    {
+        mismatch += values[i] != mbus_data_bcd_decode(bcd[i], bcd_size[i]);
+        mismatch += valid[i] != bcd_reference_valid(bcd[i], bcd_size[i]);
+    }
+    CHECK(mismatch == 0);
+
+    // records, only the BCD records are decoded, the others keep their value
+    data = parse_readout(records, sizeof(records));
+    CHECK(data != NULL);
+
+    if (data == NULL)
+        return;
+
+    for (i = 0; i < 8; i++)
+        values[i] = -1;
+
+    CHECK(mbus_data_record_bcd_decode_batch(data->data_var.record, values, 8) == 5);
+    CHECK(values[0] == 99);
+    CHECK(values[1] == -234);
+    CHECK(values[2] == -1);
+    CHECK(values[3] == 123456);
+    CHECK(values[4] == -1000580);
+    CHECK(values[5] == 123456789012LL);
+    CHECK(values[6] == -1);
+
+    for (record = data->data_var.record, n = 0; record; record = record->next, n++)
+    {
+        if (n != 2)
+            CHECK(values[n] == mbus_data_bcd_decode(record->data, record->data_len));
+    }
+
+    mbus_frame_data_free(data);
+}
+
+//------------------------------------------------------------------------------
+// send event: called once for every frame put on the bus, also for the
+// frames sent from the frame cache
+//------------------------------------------------------------------------------
+static unsigned char event_bytes[256];
+static size_t event_len;
+static int event_calls;
+static unsigned char event_type;
+
+static void
+record_send_event(unsigned char src_type, const char *buff, size_t len)
+{
+    if (len <= sizeof(event_bytes) - event_len)
+    {
+        memcpy(&event_bytes[event_len], buff, len);
+        event_len += len;
+    }
+
+    event_type = src_type;
+    event_calls++;
+}
+
+static void
+check_send_event(void)
+{
+    mbus_handle *handle;
+    mbus_frame *frame;
+    mbus_send_queue queue;
+    const unsigned char user_data[] = { 0x01, 0x7A, 0x07 };
+    const unsigned char expected[] = {
+        0x10, 0x40, 0x05, 0x45, 0x16,                       // SND_NKE
+        0x10, 0x5B, 0x05, 0x60, 0x16,                       // REQ_UD2
+        0x68, 0x0B, 0x0B, 0x68, 0x73, 0xFD, 0x52,           // selection
+        0x78, 0x56, 0x34, 0x12, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xD2, 0x16,
+        0x68, 0x06, 0x06, 0x68, 0x53, 0x05, 0x51,           // SND_UD, not cached
+        0x01, 0x7A, 0x07, 0x2B, 0x16,
+        0x10, 0x40, 0x07, 0x47, 0x16                        // queued SND_NKE
+    };
+
+    handle = mbus_context_loopback(record_requests, NULL);
+    CHECK(handle != NULL);
+
+    if (handle == NULL || mbus_connect(handle) != 0)
+        return;
+
+    mbus_register_send_event(handle, record_send_event);
+
+    event_len = 0;
+    event_calls = 0;
+    bus_len = 0;
+
+    CHECK(mbus_send_ping_frame(handle, 5, 0) == 0);
+    CHECK(mbus_send_request_frame(handle, 5) == 0);
+    CHECK(mbus_send_select_frame(handle, "12345678FFFFFFFF") == 0);
+    CHECK(mbus_send_user_data_frame(handle, 5, user_data, sizeof(user_data)) == 0);
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_SHORT);
+    frame->control = MBUS_CONTROL_MASK_SND_NKE | MBUS_CONTROL_MASK_DIR_M2S;
+    frame->address = 7;
+
+    mbus_send_queue_init(&queue);
+    CHECK(mbus_send_queue_add(&queue, frame) == 0);
+    CHECK(mbus_send_queue_flush(handle, &queue) == 0);
+    mbus_frame_free(frame);
+
+    CHECK(event_calls == 5);
+    CHECK(event_type == MBUS_HANDLE_TYPE_LOOPBACK);
+    CHECK(event_len == sizeof(expected) && memcmp(event_bytes, expected, sizeof(expected)) == 0);
+
+    // the events show what went on the bus
+    CHECK(bus_len == event_len && memcmp(bus_bytes, event_bytes, event_len) == 0);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+}
+
+//------------------------------------------------------------------------------
+// duplicate filter: a telegram is a duplicate if it repeats the last one of
+// the same meter byte by byte within the time window
+//------------------------------------------------------------------------------
+static int
+dedup_check(mbus_dedup *dedup, int control_information, const unsigned char *data,
+            size_t data_size, time_t timestamp)
+{
+    mbus_frame *frame;
+    int result;
+
+    frame = mbus_frame_new(MBUS_FRAME_TYPE_LONG);
+    frame->control = MBUS_CONTROL_MASK_RSP_UD | MBUS_CONTROL_MASK_DIR_S2M;
+    frame->control_information = control_information;
+    frame->timestamp = timestamp;
+
+    memcpy(frame->data, data, data_size);
+    frame->data_size = data_size;
+
+    result = mbus_dedup_check(dedup, frame);
+
+    mbus_frame_free(frame);
+    return result;
+}
+
+static void
+check_dedup(void)
+{
+    mbus_dedup *dedup;
+    unsigned char other[17], next[17];
+
+    // id 12345678, access number 01, the user data of a and b differ but
+    // have the same hash
+    const unsigned char a[17] = {
+        0x78, 0x56, 0x34, 0x12, 0x24, 0x40, 0x01, 0x07, 0x01, 0x00, 0x00, 0x00,
+        'I', 'D', 'E', 'Q', 'I'
+    };
+    const unsigned char b[17] = {
+        0x78, 0x56, 0x34, 0x12, 0x24, 0x40, 0x01, 0x07, 0x01, 0x00, 0x00, 0x00,
+        'Q', 'B', 'C', 'A', 'A'
+    };
+
+    // fixed data: id 12345678, transmission counter 05
+    const unsigned char fixed[16] = {
+        0x78, 0x56, 0x34, 0x12, 0x05, 0x00, 0x00, 0x00,
+        0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00
+    };
+
+    dedup = mbus_dedup_new(64, 60);
+    CHECK(dedup != NULL);
+
+    if (dedup == NULL)
+        return;
+
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, sizeof(a), 1000) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, sizeof(a), 1030) == 1);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, sizeof(a), 1060) == 1);
+
+    // the window starts at the first reception
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, sizeof(a), 1061) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, sizeof(a), 1062) == 1);
+
+    // same hash, different data
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, b, sizeof(b), 1063) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, b, sizeof(b), 1064) == 1);
+
+    // new access number, same readings
+    memcpy(next, b, sizeof(b));
+    next[8] = 0x02;
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, next, sizeof(next), 1065) == 0);
+
+    // same data with the other CI field (MSB first)
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE_MSB, next, sizeof(next), 1066) == 0);
+
+    // another meter doesn't replace the last telegram of the first one
+    memcpy(other, next, sizeof(next));
+    other[0] = 0x79;
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, other, sizeof(other), 1067) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE_MSB, next, sizeof(next), 1068) == 1);
+
+    // fixed data, keyed by the transmission counter
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_FIXED, fixed, sizeof(fixed), 1070) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_FIXED, fixed, sizeof(fixed), 1071) == 1);
+
+    // other frames and short user data are never duplicates and not counted
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_DATA_SEND, a, sizeof(a), 1072) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_DATA_SEND, a, sizeof(a), 1073) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, 8, 1074) == 0);
+    CHECK(dedup_check(dedup, MBUS_CONTROL_INFO_RESP_VARIABLE, a, 8, 1075) == 0);
+
+    CHECK(dedup->frames == 13);
+    CHECK(dedup->duplicates == 6);
+    CHECK(dedup->bytes == 5 * sizeof(a) + sizeof(fixed));
+
+    mbus_dedup_free(dedup);
+}
+
+int
+main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+
+    check_send_raw_fallback();
+    check_send_queue();
+    check_send_event();
+    check_loopback_fcb();
+    check_delta_filter();
+    check_dedup();
+    check_stats();
+    check_time_epoch();
+    check_bcd_decode();
+
+    printf("** %d checks, %d failed\n", checks, failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,891 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+//
+// In-process replacement of generate-xml.sh: all hex files of a directory
+// are parsed and serialized (plain and normalized XML and JSON) by a pool of
+// threads and compared in memory with the XML and JSON files next to them.
+//
+// Variable data frames are also decoded through CBOR (encode and decode) and
+// through the decode plan cache, both have to give the same values as
+// mbus_data_record_decode_typed. The visitor parser and the record index have
+// to give the same records as mbus_data_variable_parse.
+//
+// Failures, new tests and parse errors are reported like generate-xml.sh
+// does (failing_tests.txt, new_tests.txt, same messages and exit codes),
+// diff is only run for the files that differ. With -i every frame is
+// processed repeatedly, all results have to be identical, which exercises
+// the thread safety of the library.
+//
+
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mbus/mbus.h>
+
+#define FAILING_TESTS "failing_tests.txt"
+#define NEW_TESTS     "new_tests.txt"
+
+#define CONFORMANCE_XML       0
+#define CONFORMANCE_XML_NORM  1
+#define CONFORMANCE_JSON      2
+#define CONFORMANCE_JSON_NORM 3
+#define CONFORMANCE_CHECK     4   /* decoders checked against each other */
+#define CONFORMANCE_KINDS     5
+
+static const char *suffix[] = { ".xml", ".norm.xml", ".json", ".norm.json", NULL };
+
+typedef struct _conformance_file
+{
+    char *hexfile;
+    unsigned char raw_buff[4096];
+    size_t raw_len;
+} conformance_file;
+
+typedef struct _conformance_job
+{
+    conformance_file *file;
+    int kind;                   /* CONFORMANCE_* */
+
+    char outfile[PATH_MAX + sizeof(".norm.json")];
+    char *expected;             /* NULL if there is no output file yet */
+    size_t expected_len;
+
+    char *result;               /* output of the first run, NULL on error */
+    char error[1024];           /* what mbus_parse_hex prints on stderr */
+    int unstable;               /* runs gave different results */
+    int failed;                 /* decoder check failed */
+} conformance_job;
+
+static conformance_job *jobs;
+static size_t job_count;
+static size_t next_job;
+static int iterations = 1;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+read_file(const char *path, size_t *len)
+{
+    FILE *fp;
+    struct stat st;
+    char *data;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        return NULL;
+    }
+
+    if (fstat(fileno(fp), &st) != 0 || (data = (char *) malloc(st.st_size + 1)) == NULL)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    *len = fread(data, 1, st.st_size, fp);
+    data[*len] = '\0';
+    fclose(fp);
+
+    return data;
+}
+
+static int
+write_file(const char *path, const char *data)
+{
+    FILE *fp;
+    int ret;
+
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        return -1;
+    }
+
+    ret = (fwrite(data, 1, strlen(data), fp) == strlen(data)) ? 0 : -1;
+    fclose(fp);
+
+    return ret;
+}
+
+static void
+append_line(const char *path, const char *line)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "a")) != NULL)
+    {
+        fprintf(fp, "%s\n", line);
+        fclose(fp);
+    }
+}
+
+//
+// print a file and delete it if it is empty, returns its size
+//
+static long
+report_file(const char *path, const char *title)
+{
+    char *data;
+    size_t len = 0;
+
+    if ((data = read_file(path, &len)) == NULL)
+    {
+        return 0;
+    }
+
+    if (len > 0)
+    {
+        printf("%s\n%s", title, data);
+    }
+    else
+    {
+        unlink(path);
+    }
+
+    free(data);
+    return len;
+}
+
+static void
+run_diff(const char *old_file, const char *new_file)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+
+    if ((pid = fork()) == 0)
+    {
+        execlp("diff", "diff", "-u", old_file, new_file, (char *) NULL);
+        _exit(2);
+    }
+
+    if (pid > 0)
+    {
+        waitpid(pid, &status, 0);
+    }
+}
+
+//
+// parse a frame the way mbus_parse_hex does
+//
+static int
+conformance_parse(conformance_file *file, mbus_frame *reply, mbus_frame_data *frame_data,
+                  char *error, size_t error_size)
+{
+    unsigned char buff[4096];
+    size_t buff_len;
+    int result;
+
+    // every run starts with a clean error like a new mbus_parse_hex process
+    mbus_error_str_set("");
+
+    buff_len = mbus_hex2bin(buff, sizeof(buff), file->raw_buff, sizeof(file->raw_buff));
+
+    memset(reply, 0, sizeof(mbus_frame));
+    memset(frame_data, 0, sizeof(mbus_frame_data));
+
+    result = mbus_parse(reply, buff, buff_len);
+
+    if (result < 0)
+    {
+        snprintf(error, error_size, "mbus_parse: %s\n", mbus_error_str());
+        return -1;
+    }
+    else if (result > 0)
+    {
+        snprintf(error, error_size, "mbus_parse: need %d more bytes\n", result);
+        return -1;
+    }
+
+    if (mbus_frame_data_parse(reply, frame_data) != 0)
+    {
+        snprintf(error, error_size, "mbus_frame_data_parse: %s\n", mbus_error_str());
+        mbus_data_record_free(frame_data->data_var.record);
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// parse and serialize a frame (XML like mbus_parse_hex, or JSON)
+//
+static char *
+conformance_output(conformance_file *file, int kind, char *error, size_t error_size)
+{
+    mbus_frame reply;
+    mbus_frame_data frame_data;
+    mbus_sink sink;
+    char *result = NULL;
+    int flags;
+
+    if (conformance_parse(file, &reply, &frame_data, error, error_size) != 0)
+    {
+        return NULL;
+    }
+
+    switch (kind)
+    {
+        case CONFORMANCE_XML:
+            result = mbus_frame_data_xml(&frame_data);
+            break;
+
+        case CONFORMANCE_XML_NORM:
+            result = mbus_frame_data_xml_normalized(&frame_data);
+            break;
+
+        default:
+            flags = (kind == CONFORMANCE_JSON_NORM) ? MBUS_JSON_NORMALIZED : 0;
+
+            if (mbus_sink_init_growable(&sink, 1024) == 0)
+            {
+                mbus_frame_data_json_sink(&sink, &frame_data, flags);
+                result = mbus_sink_release(&sink);
+            }
+            break;
+    }
+
+    if (result == NULL)
+    {
+        snprintf(error, error_size, "Failed to generate %s representation of MBUS frame: %s\n",
+                 (kind == CONFORMANCE_XML || kind == CONFORMANCE_XML_NORM) ? "XML" : "JSON",
+                 mbus_error_str());
+    }
+
+    mbus_data_record_free(frame_data.data_var.record);
+
+    return result;
+}
+
+//
+// compare a value with the one of mbus_data_record_decode_typed, strings of
+// a CBOR readout are in reading order (reversed)
+//
+static int
+conformance_value_cmp(const mbus_record_value *value, const mbus_record_value *expected, int reversed)
+{
+    size_t i;
+
+    if (value->type != expected->type ||
+        value->unit != expected->unit ||
+        value->exponent != expected->exponent ||
+        value->vif_code != expected->vif_code ||
+        value->function != expected->function ||
+        value->storage_number != expected->storage_number ||
+        value->tariff != expected->tariff ||
+        value->device != expected->device ||
+        value->timestamp != expected->timestamp)
+    {
+        return -1;
+    }
+
+    switch (expected->type)
+    {
+        case MBUS_VALUE_TYPE_INTEGER:
+            return (value->value.integer == expected->value.integer) ? 0 : -1;
+
+        case MBUS_VALUE_TYPE_REAL:
+            if (isnan(expected->value.real))
+                return isnan(value->value.real) ? 0 : -1;
+            return (value->value.real == expected->value.real) ? 0 : -1;
+
+        case MBUS_VALUE_TYPE_DATE:
+        case MBUS_VALUE_TYPE_DATETIME:
+            if (value->value.integer != expected->value.integer)
+                return -1;
+            // fall through
+
+        case MBUS_VALUE_TYPE_STRING:
+        case MBUS_VALUE_TYPE_BINARY:
+            if (value->data_len != expected->data_len)
+                return -1;
+
+            for (i = 0; i < expected->data_len; i++)
+            {
+                if (value->data[i] != expected->data[(reversed && expected->type == MBUS_VALUE_TYPE_STRING) ?
+                                                     expected->data_len - 1 - i : i])
+                    return -1;
+            }
+            return 0;
+    }
+
+    return 0;
+}
+
+//
+// Compare the DIB, VIB and data of two parsed records
+//
+static int
+conformance_record_cmp(const mbus_data_record *record, const mbus_data_record *expected)
+{
+    const mbus_data_information_block *dib = &(record->drh.dib), *dib_exp = &(expected->drh.dib);
+    const mbus_value_information_block *vib = &(record->drh.vib), *vib_exp = &(expected->drh.vib);
+
+    if (dib->dif != dib_exp->dif || dib->ndife != dib_exp->ndife ||
+        memcmp(dib->dife, dib_exp->dife, sizeof(dib->dife)) != 0 ||
+        vib->vif != vib_exp->vif || vib->nvife != vib_exp->nvife ||
+        memcmp(vib->vife, vib_exp->vife, sizeof(vib->vife)) != 0 ||
+        strcmp((const char *) vib->custom_vif, (const char *) vib_exp->custom_vif) != 0 ||
+        record->data_len != expected->data_len ||
+        memcmp(record->data, expected->data, expected->data_len) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// Compare two normalized records, strings may be missing in both
+//
+static int
+conformance_string_cmp(const char *s, const char *expected)
+{
+    if (s == NULL || expected == NULL)
+        return (s == expected) ? 0 : -1;
+
+    return strcmp(s, expected);
+}
+
+static int
+conformance_normalized_cmp(const mbus_record *record, const mbus_record *expected)
+{
+    if (record == NULL || expected == NULL)
+        return (record == expected) ? 0 : -1;
+
+    if (record->is_numeric != expected->is_numeric ||
+        conformance_string_cmp(record->unit, expected->unit) != 0 ||
+        conformance_string_cmp(record->function_medium, expected->function_medium) != 0 ||
+        conformance_string_cmp(record->quantity, expected->quantity) != 0 ||
+        record->device != expected->device ||
+        record->tariff != expected->tariff ||
+        record->storage_number != expected->storage_number)
+    {
+        return -1;
+    }
+
+    if (expected->is_numeric)
+    {
+        if (isnan(expected->value.real_val))
+            return isnan(record->value.real_val) ? 0 : -1;
+
+        return (record->value.real_val == expected->value.real_val) ? 0 : -1;
+    }
+
+    return conformance_string_cmp(record->value.str_val.value, expected->value.str_val.value);
+}
+
+typedef struct _conformance_visit
+{
+    mbus_data_record *expected;     /* next record of mbus_data_variable_parse */
+    size_t count;
+    int failed;
+} conformance_visit;
+
+static int
+conformance_visitor(mbus_data_variable_header *header, mbus_data_record *record, void *arg)
+{
+    conformance_visit *visit = (conformance_visit *) arg;
+
+    (void) header;
+
+    if (visit->expected == NULL || conformance_record_cmp(record, visit->expected) != 0)
+    {
+        visit->failed = 1;
+        return 1;
+    }
+
+    visit->expected = visit->expected->next;
+    visit->count++;
+
+    return 0;
+}
+
+//
+// decode a variable data frame in the other ways the library offers and
+// compare the values with mbus_data_record_decode_typed, the records with
+// mbus_data_variable_parse
+//
+static int
+conformance_check(conformance_file *file, char *error, size_t error_size)
+{
+    mbus_frame reply;
+    mbus_frame_data frame_data;
+    mbus_data_record *record;
+    mbus_record_value expected[MBUS_FRAME_DATA_LENGTH], values[MBUS_FRAME_DATA_LENGTH];
+    mbus_cbor_readout readout;
+    mbus_decode_plan_cache *cache;
+    mbus_data_variable_header header;
+    conformance_visit visit;
+    mbus_record_index index;
+    mbus_data_record indexed;
+    mbus_record *normalized;
+    unsigned char cbor[8192];
+    size_t i, count = 0;
+    int len, run, ret = 0;
+
+    if (conformance_parse(file, &reply, &frame_data, error, error_size) != 0)
+    {
+        // reported by the XML jobs
+        error[0] = '\0';
+        return 0;
+    }
+
+    if (frame_data.type != MBUS_DATA_TYPE_VARIABLE)
+    {
+        return 0;
+    }
+
+    for (record = frame_data.data_var.record; record && count < MBUS_FRAME_DATA_LENGTH; record = record->next)
+    {
+        if (mbus_data_record_decode_typed(record, &expected[count]) != 0)
+        {
+            expected[count].type = MBUS_VALUE_TYPE_NONE;
+        }
+        count++;
+    }
+
+    //
+    // CBOR encode and decode
+    //
+    memset(&readout, 0, sizeof(readout));
+    readout.records = values;
+    readout.max_records = MBUS_FRAME_DATA_LENGTH;
+
+    len = mbus_frame_data_cbor(&frame_data, cbor, sizeof(cbor));
+
+    if (len < 0 || (size_t) len > sizeof(cbor) || mbus_cbor_decode(cbor, len, &readout) != len)
+    {
+        snprintf(error, error_size, "CBOR round trip failed: %s\n", mbus_error_str());
+        ret = -1;
+    }
+    else if (readout.record_count != count)
+    {
+        snprintf(error, error_size, "CBOR round trip gave %zu records, expected %zu\n",
+                 readout.record_count, count);
+        ret = -1;
+    }
+
+    for (i = 0; ret == 0 && i < count; i++)
+    {
+        // records without value only keep the type
+        if ((expected[i].type == MBUS_VALUE_TYPE_NONE) ? values[i].type != MBUS_VALUE_TYPE_NONE :
+            conformance_value_cmp(&values[i], &expected[i], 1) != 0)
+        {
+            snprintf(error, error_size, "CBOR round trip differs in record %zu\n", i);
+            ret = -1;
+        }
+    }
+
+    //
+    // decode plan: the first run builds the plan, the second one uses it
+    //
+    if ((cache = mbus_decode_plan_cache_new(1)) == NULL)
+    {
+        snprintf(error, error_size, "mbus_decode_plan_cache_new: %s\n", mbus_error_str());
+        ret = -1;
+    }
+
+    for (run = 0; ret == 0 && run < 2; run++)
+    {
+        len = mbus_decode_plan_cache_decode(cache, &reply, NULL, values, MBUS_FRAME_DATA_LENGTH);
+
+        if (len < 0 || (size_t) len != count)
+        {
+            snprintf(error, error_size, "decode plan gave %d records, expected %zu: %s\n",
+                     len, count, mbus_error_str());
+            ret = -1;
+        }
+
+        for (i = 0; ret == 0 && i < count; i++)
+        {
+            if ((expected[i].type == MBUS_VALUE_TYPE_NONE) ? values[i].type != MBUS_VALUE_TYPE_NONE :
+                conformance_value_cmp(&values[i], &expected[i], 0) != 0)
+            {
+                snprintf(error, error_size, "decode plan differs in record %zu (%s plan)\n",
+                         i, run ? "cached" : "new");
+                ret = -1;
+            }
+        }
+    }
+
+    mbus_decode_plan_cache_free(cache);
+
+    //
+    // visitor parser, same header and records in the same order
+    //
+    memset(&visit, 0, sizeof(visit));
+    visit.expected = frame_data.data_var.record;
+
+    if (ret == 0 &&
+        (mbus_data_variable_parse_visit(&reply, &header, conformance_visitor, &visit) != 0 ||
+         visit.failed || visit.expected != NULL ||
+         memcmp(&header, &(frame_data.data_var.header), sizeof(header)) != 0))
+    {
+        snprintf(error, error_size, "visitor parser differs in record %zu\n", visit.count);
+        ret = -1;
+    }
+
+    //
+    // record index, every record parsed and normalized on its own
+    //
+    if (ret == 0 && (len = mbus_record_index_build(&index, &reply)) >= 0)
+    {
+        if ((size_t) len != count)
+        {
+            snprintf(error, error_size, "record index has %d records, expected %zu\n", len, count);
+            ret = -1;
+        }
+
+        for (record = frame_data.data_var.record, i = 0; ret == 0 && record; record = record->next, i++)
+        {
+            normalized = mbus_parse_variable_record(record);
+
+            if (mbus_record_index_data_record(&index, i, &indexed) != 0 ||
+                conformance_record_cmp(&indexed, record) != 0 ||
+                conformance_normalized_cmp(mbus_record_index_get(&index, i), normalized) != 0 ||
+                mbus_record_index_get(&index, i) != mbus_record_index_get(&index, i))
+            {
+                snprintf(error, error_size, "record index differs in record %zu\n", i);
+                ret = -1;
+            }
+
+            mbus_record_free(normalized);
+        }
+
+        mbus_record_index_free(&index);
+    }
+    else if (ret == 0)
+    {
+        snprintf(error, error_size, "mbus_record_index_build failed\n");
+        ret = -1;
+    }
+
+    mbus_data_record_free(frame_data.data_var.record);
+
+    return ret;
+}
+
+static void *
+conformance_worker(void *arg)
+{
+    conformance_job *job;
+    char error[sizeof(job->error)];
+    char *xml;
+    int i;
+
+    (void) arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job_lock);
+        job = (next_job < job_count) ? &jobs[next_job++] : NULL;
+        pthread_mutex_unlock(&job_lock);
+
+        if (job == NULL)
+        {
+            return NULL;
+        }
+
+        if (job->kind == CONFORMANCE_CHECK)
+        {
+            job->failed = (conformance_check(job->file, job->error, sizeof(job->error)) != 0);
+            continue;
+        }
+
+        job->result = conformance_output(job->file, job->kind, job->error, sizeof(job->error));
+
+        for (i = 1; i < iterations; i++)
+        {
+            error[0] = '\0';
+            xml = conformance_output(job->file, job->kind, error, sizeof(error));
+
+            if ((xml == NULL) != (job->result == NULL) ||
+                (xml && strcmp(xml, job->result) != 0) ||
+                (xml == NULL && strcmp(error, job->error) != 0))
+            {
+                job->unstable = 1;
+            }
+
+            free(xml);
+        }
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    conformance_file *files;
+    conformance_job *job;
+    pthread_t *threads;
+    glob_t hexfiles;
+    FILE *fp;
+    char pattern[PATH_MAX], name[PATH_MAX], *dot;
+    char base[sizeof(jobs->outfile)], newfile[sizeof(jobs->outfile) + sizeof(".new")];
+    size_t i, file_count;
+    long threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int arg, kind, parsing_errors = 0, unstable = 0, check_errors = 0, ret = 0;
+    double start, elapsed;
+    const char *directory;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            threads_count = atol(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc)
+        {
+            iterations = atoi(argv[++arg]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (arg != argc - 1 || threads_count < 1 || iterations < 1)
+    {
+        fprintf(stderr, "usage: %s [-j threads] [-i iterations] path_to_directory_with_xml_files\n", argv[0]);
+        fprintf(stderr, "    -j  number of threads (default: number of processors)\n");
+        fprintf(stderr, "    -i  parse every frame n times and check that the results are identical\n");
+        return 3;
+    }
+
+    directory = argv[arg];
+
+    if (access(directory, F_OK) != 0)
+    {
+        printf("%s not found\n", directory);
+        return 3;
+    }
+
+    // same as touch in generate-xml.sh, results of earlier runs are kept
+    if ((fp = fopen(FAILING_TESTS, "a")) != NULL)
+        fclose(fp);
+    if ((fp = fopen(NEW_TESTS, "a")) != NULL)
+        fclose(fp);
+
+    if (snprintf(pattern, sizeof(pattern), "%s/*.hex", directory) >= (int) sizeof(pattern))
+    {
+        fprintf(stderr, "%s: path too long: %s\n", argv[0], directory);
+        return 3;
+    }
+
+    if (glob(pattern, 0, NULL, &hexfiles) != 0)
+    {
+        hexfiles.gl_pathc = 0;
+    }
+
+    file_count = hexfiles.gl_pathc;
+    files = (conformance_file *) calloc(file_count ? file_count : 1, sizeof(conformance_file));
+    jobs = (conformance_job *) calloc(file_count ? CONFORMANCE_KINDS * file_count : 1, sizeof(conformance_job));
+    threads = (pthread_t *) calloc(threads_count, sizeof(pthread_t));
+
+    if (files == NULL || jobs == NULL || threads == NULL)
+    {
+        fprintf(stderr, "%s: failed to allocate memory\n", argv[0]);
+        return 3;
+    }
+
+    //
+    // load hex files and expected XML
+    //
+    for (i = 0; i < file_count; i++)
+    {
+        files[i].hexfile = hexfiles.gl_pathv[i];
+
+        if ((fp = fopen(files[i].hexfile, "r")) == NULL)
+        {
+            continue;
+        }
+
+        files[i].raw_len = fread(files[i].raw_buff, 1, sizeof(files[i].raw_buff), fp);
+        fclose(fp);
+
+        // a truncated path would compare the wrong file
+        if (snprintf(name, sizeof(name), "%s", files[i].hexfile) >= (int) sizeof(name))
+        {
+            fprintf(stderr, "%s: path too long: %s\n", argv[0], files[i].hexfile);
+            return 3;
+        }
+
+        if ((dot = strrchr(name, '.')) != NULL)
+            *dot = '\0';
+
+        // one job per output format and the checks, in the order of kind
+        for (kind = CONFORMANCE_XML; kind < CONFORMANCE_KINDS; kind++)
+        {
+            job = &jobs[job_count++];
+            job->file = &files[i];
+            job->kind = kind;
+
+            if (suffix[kind])
+            {
+                snprintf(job->outfile, sizeof(job->outfile), "%s%s", name, suffix[kind]);
+                job->expected = read_file(job->outfile, &job->expected_len);
+            }
+        }
+    }
+
+    //
+    // parse and serialize all frames in parallel
+    //
+    start = now();
+
+    for (i = 0; i < (size_t) threads_count; i++)
+    {
+        if (pthread_create(&threads[i], NULL, conformance_worker, NULL) != 0)
+        {
+            break;
+        }
+    }
+
+    if (i == 0)
+    {
+        conformance_worker(NULL);
+    }
+
+    while (i > 0)
+    {
+        pthread_join(threads[--i], NULL);
+    }
+
+    elapsed = now() - start;
+
+    //
+    // report in the order of the files
+    //
+    for (i = 0; i < job_count; i++)
+    {
+        job = &jobs[i];
+
+        if (job->kind == CONFORMANCE_CHECK)
+        {
+            if (job->failed)
+            {
+                check_errors++;
+                printf("== %s: %s", job->file->hexfile, job->error);
+            }
+            continue;
+        }
+
+        // XML files are reported without extension like generate-xml.sh does
+        snprintf(base, sizeof(base), "%s", job->outfile);
+        if (job->kind == CONFORMANCE_XML || job->kind == CONFORMANCE_XML_NORM)
+            base[strlen(base) - 4] = '\0';
+        snprintf(newfile, sizeof(newfile), "%s.new", job->outfile);
+
+        if (job->unstable)
+        {
+            unstable++;
+            printf("== %s gave different results in %d runs\n", base, iterations);
+        }
+
+        if (job->result == NULL)
+        {
+            // a frame that does not parse is counted once, by its XML job
+            // (first job of the file)
+            if (job->kind != CONFORMANCE_XML && job->kind != CONFORMANCE_XML_NORM &&
+                jobs[i - job->kind].result == NULL)
+            {
+                continue;
+            }
+
+            parsing_errors++;
+            fputs(job->error, stderr);
+            printf("Unable to generate %s for %s\n",
+                   (job->kind == CONFORMANCE_XML || job->kind == CONFORMANCE_XML_NORM) ? "XML" : "JSON",
+                   job->file->hexfile);
+            continue;
+        }
+
+        if (job->expected == NULL)
+        {
+            printf("Create %s\n", basename(job->outfile));
+            write_file(job->outfile, job->result);
+            append_line(NEW_TESTS, basename(base));
+        }
+        else if (strcmp(job->expected, job->result) != 0)
+        {
+            printf("== %s failed\n", base);
+            write_file(newfile, job->result);
+            run_diff(job->outfile, newfile);
+            printf("\n");
+            append_line(FAILING_TESTS, basename(base));
+        }
+        else
+        {
+            unlink(newfile);
+        }
+    }
+
+    printf("** %zu frames in %.3f ms with %ld threads: %.0f frames/s\n",
+           job_count * iterations, elapsed * 1000.0, threads_count,
+           elapsed > 0 ? job_count * iterations / elapsed : 0.0);
+
+    if (report_file(FAILING_TESTS, "** There were errors in the following file(s):") > 0)
+    {
+        ret = 1;
+    }
+    else
+    {
+        report_file(NEW_TESTS, "** There were new test in the following file(s):");
+
+        if (parsing_errors != 0)
+        {
+            printf("** There were %d files that did not parse, expected 0 files.\n\n", parsing_errors);
+            ret = parsing_errors;
+        }
+        else if (unstable != 0)
+        {
+            printf("** There were %d files with different results in repeated runs.\n\n", unstable);
+            ret = 1;
+        }
+        else if (check_errors != 0)
+        {
+            printf("** There were %d files that failed the decoder checks.\n\n", check_errors);
+            ret = 1;
+        }
+        else
+        {
+            printf("** Tests executed successfully in \"%s\".\n\n", basename((char *) directory));
+        }
+    }
+
+    for (i = 0; i < job_count; i++)
+    {
+        free(jobs[i].expected);
+        free(jobs[i].result);
+    }
+
+    free(jobs);
+    free(files);
+    free(threads);
+    globfree(&hexfiles);
+
+    return ret;
+}
@@ -14,30 +14,48 @@
 
 #include <mbus/mbus.h>
 
+static int
+write_stdout(void *arg, const char *data, size_t len)
+{
+    return (fwrite(data, 1, len, stdout) == len) ? 0 : -1;
+}
+
 int
 main(int argc, char *argv[])
 {
     FILE *fp = NULL;
     size_t buff_len;
-    int result, normalized = 0;
+    int i, result, normalized = 0, json = 0;
     unsigned char raw_buff[4096], buff[4096];
     mbus_frame reply;
     mbus_frame_data frame_data;
     char *xml_result = NULL, *file = NULL;
 
-    if (argc == 3 && strcmp(argv[1], "-n") == 0)
+    for (i = 1; i < argc - 1; i++)
     {
-        file = argv[2];
-        normalized = 1;
+        if (strcmp(argv[i], "-n") == 0)
+        {
+            normalized = 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0)
+        {
+            json = 1;
+        }
+        else
+        {
+            break;
+        }
     }
-    else if (argc == 2)
+
+    if (argc >= 2 && i == argc - 1)
     {
-        file = argv[1];
+        file = argv[i];
     }
     else
     {
-        fprintf(stderr, "usage: %s [-n] hex-file\n", argv[0]);
+        fprintf(stderr, "usage: %s [-n] [-j] hex-file\n", argv[0]);
         fprintf(stderr, "    optional flag -n for normalized values\n");
+        fprintf(stderr, "    optional flag -j for JSON output\n");
         return 1;
     }
 
@@ -91,6 +109,21 @@ main(int argc, char *argv[])
     //mbus_frame_print(&reply);
     //mbus_frame_data_print(&frame_data);
 
+    if (json)
+    {
+        result = mbus_frame_data_json_cb(&frame_data, normalized ? MBUS_JSON_NORMALIZED : 0,
+                                         write_stdout, NULL);
+        mbus_data_record_free(frame_data.data_var.record);
+
+        if (result < 0)
+        {
+            fprintf(stderr, "Failed to generate JSON representation of MBUS frame: %s\n", mbus_error_str());
+            return 1;
+        }
+
+        return 0;
+    }
+
     xml_result = normalized ? mbus_frame_data_xml_normalized(&frame_data) : mbus_frame_data_xml(&frame_data);
 
     if (xml_result == NULL)
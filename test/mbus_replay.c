@@ -0,0 +1,178 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+//
+// Dump a capture (-d) or replay the conversation of the master: every
+// recorded request is sent again through the replay transport and the
+// replies are received with mbus_recv_frame, with the original timing
+// (-s 1), faster (-s 10) or as fast as possible (-s 0, the default).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mbus/mbus.h>
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+dump(FILE *fp, long id)
+{
+    mbus_capture_header header;
+    mbus_capture_record record;
+    time_t start;
+    size_t i;
+    int ret;
+
+    if (mbus_capture_read_header(fp, &header) != 0)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    start = (time_t) (header.realtime_ns / 1000000000ULL);
+    printf("capture started %s", ctime(&start));
+
+    while ((ret = mbus_capture_read(fp, &record)) == 0)
+    {
+        if (id >= 0 && record.id != (uint32_t) id)
+            continue;
+
+        printf("%12.6f %u %s", (record.timestamp_ns - header.monotonic_ns) / 1e9, record.id,
+               (record.direction == MBUS_CAPTURE_SEND) ? "SEND" : "RECV");
+
+        for (i = 0; i < record.len; i++)
+        {
+            printf(" %02X", record.data[i]);
+        }
+
+        printf("\n");
+    }
+
+    if (ret < 0)
+    {
+        fprintf(stderr, "%s\n", mbus_error_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    mbus_handle *handle;
+    mbus_capture_header header;
+    mbus_capture_record record;
+    mbus_frame reply;
+    struct iovec iov;
+    FILE *fp;
+    double speed = 0.0, start;
+    unsigned long requests = 0, replies = 0, invalid = 0;
+    long id = -1;
+    int i, result, dump_only = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            speed = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            id = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-d") == 0)
+        {
+            dump_only = 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i != argc - 1 || speed < 0)
+    {
+        fprintf(stderr, "usage: %s [-s speed] [-i id] [-d] capture-file\n", argv[0]);
+        fprintf(stderr, "    -s  replay speed, 1 = original timing, 0 = no delays (default)\n");
+        fprintf(stderr, "    -i  replay only the handle with this id\n");
+        fprintf(stderr, "    -d  dump the records\n");
+        return 1;
+    }
+
+    if ((fp = fopen(argv[i], "rb")) == NULL)
+    {
+        fprintf(stderr, "%s: failed to open '%s'\n", argv[0], argv[i]);
+        return 1;
+    }
+
+    if (dump_only)
+    {
+        result = dump(fp, id);
+        fclose(fp);
+        return result;
+    }
+
+    if (mbus_capture_read_header(fp, &header) != 0 ||
+        (handle = mbus_context_replay(argv[i], speed, id)) == NULL ||
+        mbus_connect(handle) != 0)
+    {
+        fprintf(stderr, "%s: failed to replay '%s': %s\n", argv[0], argv[i], mbus_error_str());
+        return 1;
+    }
+
+    start = now();
+
+    while ((result = mbus_capture_read(fp, &record)) == 0)
+    {
+        if (record.direction != MBUS_CAPTURE_SEND || (id >= 0 && record.id != (uint32_t) id))
+            continue;
+
+        iov.iov_base = record.data;
+        iov.iov_len = record.len;
+
+        if (mbus_send_raw(handle, &iov, 1) != 0)
+        {
+            fprintf(stderr, "%s: failed to send request: %s\n", argv[0], mbus_error_str());
+            break;
+        }
+
+        requests++;
+
+        for (;;)
+        {
+            memset(&reply, 0, sizeof(reply));
+            result = mbus_recv_frame(handle, &reply);
+
+            if (result == MBUS_RECV_RESULT_OK)
+                replies++;
+            else if (result == MBUS_RECV_RESULT_INVALID)
+                invalid++;
+            else
+                break;
+        }
+    }
+
+    printf("%lu requests, %lu replies, %lu invalid in %.3f s\n", requests, replies, invalid, now() - start);
+
+    mbus_disconnect(handle);
+    mbus_context_free(handle);
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+//
+// Emulate a M-Bus with simulated slaves on a pseudo-terminal, so that the
+// mbus-serial-* tools can be pointed at it instead of a real bus:
+//
+//   mbus_serial_emulator -L /tmp/mbus0 test/test-frames/*.hex &
+//   mbus-serial-request-data /tmp/mbus0 1
+//
+// Every hex file becomes a slave replying with that telegram. Slaves get the
+// primary addresses 1, 2, ... in order, "address=file" or
+// "address/latency=file" assigns an address (and reply latency in ms).
+// Slaves sharing an address collide.
+//
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mbus/mbus.h>
+
+static volatile sig_atomic_t running = 1;
+
+static void
+stop(int sig)
+{
+    (void) sig;
+
+    running = 0;
+}
+
+static void
+sleep_ms(double ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) ((ms - ts.tv_sec * 1000.0) * 1e6);
+    nanosleep(&ts, NULL);
+}
+
+static int
+load_slave(mbus_loopback_bus *bus, const char *arg, int primary, unsigned int latency_ms)
+{
+    FILE *fp;
+    const char *file = arg, *eq;
+    unsigned char raw_buff[4096], buff[4096];
+    size_t raw_len, buff_len;
+    mbus_loopback_slave *slave;
+    mbus_frame frame;
+    unsigned int latency;
+    int address;
+
+    if ((eq = strchr(arg, '=')) != NULL)
+    {
+        latency = latency_ms;
+        if (sscanf(arg, "%d/%u=", &address, &latency) < 1)
+        {
+            return -1;
+        }
+
+        primary = address;
+        latency_ms = latency;
+        file = eq + 1;
+    }
+
+    if ((fp = fopen(file, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    memset(raw_buff, 0, sizeof(raw_buff));
+    raw_len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+
+    if (ferror(fp) || raw_len == 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+
+    buff_len = mbus_hex2bin(buff, sizeof(buff), raw_buff, raw_len);
+
+    memset(&frame, 0, sizeof(frame));
+
+    if (mbus_parse(&frame, buff, buff_len) != 0 ||
+        (slave = mbus_loopback_bus_add_slave(bus, primary)) == NULL ||
+        mbus_loopback_slave_add_telegram(slave, &frame) != 0)
+    {
+        return -1;
+    }
+
+    slave->latency_ms = latency_ms;
+    return 0;
+}
+
+//
+// length of the frame at the start of the buffer, 0 while incomplete
+//
+static size_t
+frame_length(const unsigned char *data, size_t len)
+{
+    switch (data[0])
+    {
+        case MBUS_FRAME_ACK_START:
+            return 1;
+        case MBUS_FRAME_SHORT_START:
+            return (len >= MBUS_FRAME_BASE_SIZE_SHORT) ? MBUS_FRAME_BASE_SIZE_SHORT : 0;
+        case MBUS_FRAME_LONG_START:
+            return (len >= 2 && len >= (size_t) data[1] + 6) ? (size_t) data[1] + 6 : 0;
+        default:
+            // noise, skip the byte
+            return 1;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    mbus_loopback_bus *bus;
+    mbus_loopback_slave *slave;
+    struct termios term;
+    struct pollfd pfd;
+    unsigned char request[4096], reply[MBUS_LOOPBACK_BUFF_SIZE];
+    size_t request_len = 0, len;
+    unsigned int latency_ms = 0;
+    unsigned long requests = 0, replies = 0;
+    double bit_error_rate = 0.0;
+    long baudrate = 0;
+    const char *link_name = NULL;
+    int i, master, tty, ret, primary = 1;
+
+    if ((bus = mbus_loopback_bus_new()) == NULL)
+    {
+        fprintf(stderr, "%s: failed to allocate bus\n", argv[0]);
+        return 1;
+    }
+
+    bus->seed = (unsigned int) time(NULL);
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            latency_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+        {
+            bit_error_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            baudrate = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            bus->seed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+        {
+            link_name = argv[++i];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (i >= argc)
+    {
+        fprintf(stderr, "usage: %s [-l latency-ms] [-e bit-error-rate] [-b baudrate] [-s seed] [-L link]\n"
+                        "       [address[/latency-ms]=]hex-file ...\n", argv[0]);
+        fprintf(stderr, "    -l  reply latency of all slaves in ms\n");
+        fprintf(stderr, "    -e  probability of a flipped bit in the replies\n");
+        fprintf(stderr, "    -b  emulate the transmission time at this baudrate\n");
+        fprintf(stderr, "    -s  random seed of the bit errors\n");
+        fprintf(stderr, "    -L  create a symbolic link to the pseudo-terminal\n");
+        return 1;
+    }
+
+    for (; i < argc; i++)
+    {
+        if (load_slave(bus, argv[i], primary, latency_ms) != 0)
+        {
+            fprintf(stderr, "%s: failed to load slave '%s'\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        primary = bus->nslaves + 1;
+    }
+
+    for (slave = bus->slave; slave; slave = slave->next)
+    {
+        slave->bit_error_rate = bit_error_rate;
+    }
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) == -1 ||
+        grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        fprintf(stderr, "%s: failed to open pseudo-terminal: %s\n", argv[0], strerror(errno));
+        return 1;
+    }
+
+    // keep the slave side open (and raw), so that the master side stays
+    // usable while no client is connected
+    if ((tty = open(ptsname(master), O_RDWR | O_NOCTTY)) == -1 ||
+        tcgetattr(tty, &term) != 0)
+    {
+        fprintf(stderr, "%s: failed to open '%s': %s\n", argv[0], ptsname(master), strerror(errno));
+        return 1;
+    }
+
+    cfmakeraw(&term);
+    tcsetattr(tty, TCSANOW, &term);
+
+    if (link_name)
+    {
+        unlink(link_name);
+        if (symlink(ptsname(master), link_name) != 0)
+        {
+            fprintf(stderr, "%s: failed to create link '%s': %s\n", argv[0], link_name, strerror(errno));
+            return 1;
+        }
+    }
+
+    printf("%s: %zu slaves on %s\n", argv[0], bus->nslaves, link_name ? link_name : ptsname(master));
+    fflush(stdout);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    pfd.fd = master;
+    pfd.events = POLLIN;
+
+    while (running)
+    {
+        if ((ret = poll(&pfd, 1, 100)) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (ret == 0)
+        {
+            // an incomplete frame is dropped after a pause on the line
+            request_len = 0;
+            continue;
+        }
+
+        if ((ret = read(master, &request[request_len], sizeof(request) - request_len)) <= 0)
+        {
+            if (ret == -1 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            break;
+        }
+
+        request_len += ret;
+
+        while (request_len > 0 && (len = frame_length(request, request_len)) > 0)
+        {
+            requests++;
+
+            if (baudrate > 0)
+            {
+                // 11 bits per byte (start, 8 data, parity, stop)
+                sleep_ms(len * 11 * 1000.0 / baudrate);
+            }
+
+            ret = mbus_loopback_bus_respond(bus, request, len, reply, sizeof(reply));
+
+            request_len -= len;
+            memmove(request, &request[len], request_len);
+
+            if (ret <= 0)
+            {
+                continue;
+            }
+
+            replies++;
+
+            if (bus->latency_ms > 0)
+            {
+                sleep_ms(bus->latency_ms);
+            }
+
+            if (baudrate > 0)
+            {
+                sleep_ms(ret * 11 * 1000.0 / baudrate);
+            }
+
+            if (write(master, reply, ret) != ret)
+            {
+                fprintf(stderr, "%s: failed to write reply: %s\n", argv[0], strerror(errno));
+            }
+        }
+
+        if (request_len >= sizeof(request))
+        {
+            request_len = 0;
+        }
+    }
+
+    printf("%s: %lu requests, %lu replies\n", argv[0], requests, replies);
+
+    if (link_name)
+    {
+        unlink(link_name);
+    }
+
+    close(tty);
+    close(master);
+    mbus_loopback_bus_free(bus);
+
+    return 0;
+}
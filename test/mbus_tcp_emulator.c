@@ -0,0 +1,507 @@
+//------------------------------------------------------------------------------
+// Copyright (C) 2026, libmbus contributors
+// All rights reserved.
+//
+// Distributed under the terms of the BSD license, see the file LICENSE.
+//
+//------------------------------------------------------------------------------
+
+//
+// Emulate many M-Bus TCP gateways on one machine, for load tests of
+// collectors using the mbus_tcp_* transport:
+//
+//   mbus_tcp_emulator -p 20000 -n 500 -d 20 test/test-frames/*.hex &
+//   mbus-tcp-request-data 127.0.0.1 20123 1
+//
+// Gateway n listens on port base+n and has its own bus with one simulated
+// slave per hex file (primary addresses 1, 2, ...). Replies can be delayed,
+// split into partial writes, dropped (timeout) or replaced by closing the
+// connection (reset). Everything runs in one poll loop.
+//
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <mbus/mbus.h>
+
+#define MAX_FILES       250
+#define MAX_CONNECTIONS 4096
+
+typedef struct _connection {
+    int fd;
+    int gateway;
+    unsigned char request[1024];
+    size_t request_len;
+    unsigned char reply[MBUS_LOOPBACK_BUFF_SIZE];
+    size_t reply_len;
+    size_t reply_pos;
+    double due;                 // time of the next write
+} connection;
+
+static volatile sig_atomic_t running = 1;
+
+static mbus_frame frames[MAX_FILES];
+static size_t frame_count;
+
+static mbus_loopback_bus **bus;
+static int *listener;
+static int gateways = 1;
+
+static connection conn[MAX_CONNECTIONS];
+static size_t nconn;
+
+static struct pollfd pfd[MAX_CONNECTIONS + 1024];
+
+// behaviour of the gateways
+static double delay_ms, chunk_interval_ms, timeout_rate, reset_rate;
+static size_t chunk_size;
+static unsigned int seed;
+
+// counters
+static unsigned long accepted, requests, replies, timeouts, resets;
+
+static void
+stop(int sig)
+{
+    (void) sig;
+
+    running = 0;
+}
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+chance(double rate)
+{
+    return rate > 0.0 && rand_r(&seed) < rate * ((double) RAND_MAX + 1.0);
+}
+
+static int
+load_hex_file(const char *file)
+{
+    FILE *fp;
+    unsigned char raw_buff[4096], buff[4096];
+    size_t raw_len, buff_len;
+
+    if (frame_count >= MAX_FILES || (fp = fopen(file, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    memset(raw_buff, 0, sizeof(raw_buff));
+    raw_len = fread(raw_buff, 1, sizeof(raw_buff), fp);
+
+    if (ferror(fp) || raw_len == 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+
+    buff_len = mbus_hex2bin(buff, sizeof(buff), raw_buff, raw_len);
+
+    memset(&frames[frame_count], 0, sizeof(mbus_frame));
+
+    if (mbus_parse(&frames[frame_count], buff, buff_len) != 0)
+    {
+        return -1;
+    }
+
+    frame_count++;
+    return 0;
+}
+
+static int
+listen_port(int port)
+{
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1)
+    {
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        listen(fd, 64) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void
+close_connection(size_t i)
+{
+    close(conn[i].fd);
+    conn[i] = conn[--nconn];
+}
+
+//
+// length of the frame at the start of the buffer, 0 while incomplete
+//
+static size_t
+frame_length(const unsigned char *data, size_t len)
+{
+    switch (data[0])
+    {
+        case MBUS_FRAME_ACK_START:
+            return 1;
+        case MBUS_FRAME_SHORT_START:
+            return (len >= MBUS_FRAME_BASE_SIZE_SHORT) ? MBUS_FRAME_BASE_SIZE_SHORT : 0;
+        case MBUS_FRAME_LONG_START:
+            return (len >= 2 && len >= (size_t) data[1] + 6) ? (size_t) data[1] + 6 : 0;
+        default:
+            // noise, skip the byte
+            return 1;
+    }
+}
+
+//
+// read and answer requests, returns -1 when the connection is to be closed
+//
+static int
+handle_request(connection *c)
+{
+    size_t len;
+    ssize_t nread;
+    int ret;
+
+    nread = read(c->fd, &c->request[c->request_len], sizeof(c->request) - c->request_len);
+
+    if (nread == -1 && (errno == EINTR || errno == EAGAIN))
+    {
+        return 0;
+    }
+
+    if (nread <= 0)
+    {
+        return -1;
+    }
+
+    c->request_len += nread;
+
+    while (c->request_len > 0 && (len = frame_length(c->request, c->request_len)) > 0)
+    {
+        requests++;
+
+        if (chance(reset_rate))
+        {
+            resets++;
+            return -1;
+        }
+
+        ret = mbus_loopback_bus_respond(bus[c->gateway], c->request, len,
+                                        &c->reply[c->reply_len], sizeof(c->reply) - c->reply_len);
+
+        c->request_len -= len;
+        memmove(c->request, &c->request[len], c->request_len);
+
+        if (ret <= 0)
+        {
+            continue;
+        }
+
+        if (chance(timeout_rate))
+        {
+            timeouts++;
+            continue;
+        }
+
+        if (c->reply_len == c->reply_pos)
+        {
+            c->due = now() + delay_ms / 1000.0;
+        }
+
+        c->reply_len += ret;
+        replies++;
+    }
+
+    if (c->request_len >= sizeof(c->request))
+    {
+        c->request_len = 0;
+    }
+
+    return 0;
+}
+
+//
+// write the due part of the pending reply
+//
+static int
+handle_reply(connection *c, double t)
+{
+    size_t len;
+    ssize_t nwritten;
+
+    if (c->reply_pos >= c->reply_len || t < c->due)
+    {
+        return 0;
+    }
+
+    len = c->reply_len - c->reply_pos;
+    if (chunk_size > 0 && len > chunk_size)
+    {
+        len = chunk_size;
+    }
+
+    if ((nwritten = write(c->fd, &c->reply[c->reply_pos], len)) == -1)
+    {
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    }
+
+    c->reply_pos += nwritten;
+    c->due = t + chunk_interval_ms / 1000.0;
+
+    if (c->reply_pos >= c->reply_len)
+    {
+        c->reply_pos = c->reply_len = 0;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    mbus_loopback_slave *slave;
+    size_t i, n, nfds;
+    double t, next;
+    int base_port = 10001, fd, timeout, on = 1, k;
+
+    seed = (unsigned int) time(NULL);
+
+    for (k = 1; k < argc && argv[k][0] == '-'; k++)
+    {
+        if (strcmp(argv[k], "-p") == 0 && k + 1 < argc)
+        {
+            base_port = atoi(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-n") == 0 && k + 1 < argc)
+        {
+            gateways = atoi(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-d") == 0 && k + 1 < argc)
+        {
+            delay_ms = atof(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-c") == 0 && k + 1 < argc)
+        {
+            chunk_size = atoi(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-i") == 0 && k + 1 < argc)
+        {
+            chunk_interval_ms = atof(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-t") == 0 && k + 1 < argc)
+        {
+            timeout_rate = atof(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-r") == 0 && k + 1 < argc)
+        {
+            reset_rate = atof(argv[++k]);
+        }
+        else if (strcmp(argv[k], "-s") == 0 && k + 1 < argc)
+        {
+            seed = atoi(argv[++k]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (k >= argc || gateways < 1 || gateways > 1024)
+    {
+        fprintf(stderr, "usage: %s [-p base-port] [-n gateways] [-d delay-ms] [-c chunk-size]\n"
+                        "       [-i chunk-interval-ms] [-t timeout-rate] [-r reset-rate] [-s seed] hex-file ...\n", argv[0]);
+        fprintf(stderr, "    -p  port of the first gateway, gateway n listens on base-port+n\n");
+        fprintf(stderr, "    -n  number of gateways (1-1024)\n");
+        fprintf(stderr, "    -d  delay of the replies in ms\n");
+        fprintf(stderr, "    -c  write replies in chunks of this size (partial writes)\n");
+        fprintf(stderr, "    -i  pause between the chunks in ms\n");
+        fprintf(stderr, "    -t  probability of an unanswered request (timeout)\n");
+        fprintf(stderr, "    -r  probability of closing the connection instead of replying (reset)\n");
+        fprintf(stderr, "    -s  random seed\n");
+        return 1;
+    }
+
+    for (; k < argc; k++)
+    {
+        if (load_hex_file(argv[k]) != 0)
+        {
+            fprintf(stderr, "%s: failed to load '%s'\n", argv[0], argv[k]);
+            return 1;
+        }
+    }
+
+    if ((bus = (mbus_loopback_bus **) calloc(gateways, sizeof(mbus_loopback_bus *))) == NULL ||
+        (listener = (int *) calloc(gateways, sizeof(int))) == NULL)
+    {
+        fprintf(stderr, "%s: failed to allocate gateways\n", argv[0]);
+        return 1;
+    }
+
+    // every gateway has its own bus, selection and FCB state are per bus
+    for (k = 0; k < gateways; k++)
+    {
+        if ((bus[k] = mbus_loopback_bus_new()) == NULL)
+        {
+            fprintf(stderr, "%s: failed to allocate bus\n", argv[0]);
+            return 1;
+        }
+
+        for (n = 0; n < frame_count; n++)
+        {
+            if ((slave = mbus_loopback_bus_add_slave(bus[k], n + 1)) == NULL ||
+                mbus_loopback_slave_add_telegram(slave, &frames[n]) != 0)
+            {
+                fprintf(stderr, "%s: failed to add slave\n", argv[0]);
+                return 1;
+            }
+        }
+
+        if ((listener[k] = listen_port(base_port + k)) == -1)
+        {
+            fprintf(stderr, "%s: failed to listen on port %d: %s\n", argv[0], base_port + k, strerror(errno));
+            return 1;
+        }
+    }
+
+    printf("%s: %d gateways with %zu slaves on ports %d-%d\n", argv[0],
+           gateways, frame_count, base_port, base_port + gateways - 1);
+    fflush(stdout);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (running)
+    {
+        //
+        // listeners first, then the connections
+        //
+        for (k = 0; k < gateways; k++)
+        {
+            pfd[k].fd = (nconn < MAX_CONNECTIONS) ? listener[k] : -1;
+            pfd[k].events = POLLIN;
+        }
+
+        t = now();
+        next = -1.0;
+
+        for (i = 0; i < nconn; i++)
+        {
+            pfd[gateways + i].fd = conn[i].fd;
+            pfd[gateways + i].events = POLLIN;
+
+            if (conn[i].reply_pos < conn[i].reply_len)
+            {
+                if (conn[i].due <= t)
+                {
+                    pfd[gateways + i].events |= POLLOUT;
+                }
+                else if (next < 0.0 || conn[i].due < next)
+                {
+                    next = conn[i].due;
+                }
+            }
+        }
+
+        nfds = gateways + nconn;
+        timeout = (next < 0.0) ? 100 : (int) ((next - t) * 1000.0) + 1;
+
+        if (poll(pfd, nfds, timeout) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        t = now();
+
+        // serve the connections from the back, closing moves the last one
+        for (i = nfds - gateways; i-- > 0; )
+        {
+            if (pfd[gateways + i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                if (handle_request(&conn[i]) != 0)
+                {
+                    close_connection(i);
+                    continue;
+                }
+            }
+
+            if (handle_reply(&conn[i], t) != 0)
+            {
+                close_connection(i);
+            }
+        }
+
+        for (k = 0; k < gateways; k++)
+        {
+            if ((pfd[k].revents & POLLIN) == 0 || nconn >= MAX_CONNECTIONS)
+                continue;
+
+            if ((fd = accept4(listener[k], NULL, NULL, SOCK_NONBLOCK)) == -1)
+                continue;
+
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            memset(&conn[nconn], 0, sizeof(connection));
+            conn[nconn].fd = fd;
+            conn[nconn].gateway = k;
+            nconn++;
+            accepted++;
+        }
+    }
+
+    printf("%s: %lu connections, %lu requests, %lu replies, %lu timeouts, %lu resets\n",
+           argv[0], accepted, requests, replies, timeouts, resets);
+
+    while (nconn > 0)
+    {
+        close_connection(nconn - 1);
+    }
+
+    for (k = 0; k < gateways; k++)
+    {
+        close(listener[k]);
+        mbus_loopback_bus_free(bus[k]);
+    }
+
+    free(listener);
+    free(bus);
+
+    return 0;
+}